@@ -57,6 +57,16 @@ typedef NS_ENUM(NSInteger, CDTAttachmentError) {
                  inTransaction:(FMDatabase *)db
                          error:(NSError *__autoreleasing *)error;
 
+/**
+ Returns the attachments for several revisions with one query.
+
+ @return NSDictionary mapping each sequence (NSNumber) that has attachments
+         to an NSArray of CDTAttachment
+ */
+- (NSDictionary *)attachmentsForSequences:(NSArray *)sequences
+                            inTransaction:(FMDatabase *)db
+                                    error:(NSError *__autoreleasing *)error;
+
 /*
  Streams attachment data into a blob in the blob store.
  Returns nil if there was a problem, otherwise a dictionary
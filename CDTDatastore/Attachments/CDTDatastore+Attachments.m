@@ -45,6 +45,11 @@ const NSString *SQL_ATTACHMENTS_SELECT_ALL =
     @"SELECT sequence, filename, key, type, encoding, length, encoded_length revpos "
     @"FROM attachments WHERE sequence = :sequence";
 
+// Format string, takes the placeholder list for the sequences
+const NSString *SQL_ATTACHMENTS_SELECT_SEQUENCES =
+    @"SELECT sequence, filename, key, type, encoding, length, encoded_length revpos "
+    @"FROM attachments WHERE sequence IN (%@)";
+
 const NSString *SQL_DELETE_ATTACHMENT_ROW =
     @"DELETE FROM attachments WHERE filename = :filename AND sequence = :sequence";
 
@@ -68,13 +73,11 @@ static NSString *const CDTAttachmentsErrorDomain = @"CDTAttachmentsErrorDomain";
 
 - (NSArray *)attachmentsForSeq:(SequenceNumber)seq error:(NSError *__autoreleasing *)error
 {
-    FMDatabaseQueue *db_queue = self.database.fmdbQueue;
-    
     __block NSArray *attachments;
     
     __weak CDTDatastore *weakSelf = self;
     
-    [db_queue inDatabase:^(FMDatabase *db) {
+    [self.database inReadTransaction:^(FMDatabase *db) {
         
         CDTDatastore *strongSelf = weakSelf;
         attachments = [strongSelf attachmentsForSeq:seq inTransaction:db error:error];
@@ -115,6 +118,48 @@ static NSString *const CDTAttachmentsErrorDomain = @"CDTAttachmentsErrorDomain";
     return attachments;
 }
 
+- (NSDictionary *)attachmentsForSequences:(NSArray *)sequences
+                            inTransaction:(FMDatabase *)db
+                                    error:(NSError *__autoreleasing *)error
+{
+    NSMutableDictionary *attachments = [NSMutableDictionary dictionary];
+    if (sequences.count == 0) {
+        return attachments;
+    }
+
+    NSMutableArray *placeholders = [NSMutableArray arrayWithCapacity:sequences.count];
+    for (NSUInteger i = 0; i < sequences.count; i++) {
+        [placeholders addObject:@"?"];
+    }
+    NSString *sql = [NSString stringWithFormat:(NSString *)SQL_ATTACHMENTS_SELECT_SEQUENCES,
+                                               [placeholders componentsJoinedByString:@", "]];
+    FMResultSet *r = [db executeQuery:sql withArgumentsInArray:sequences];
+
+    @try {
+        while ([r next]) {
+            CDTSavedAttachment *attachment = [self attachmentFromDbRow:r inDatabase:db];
+
+            if (attachment != nil) {
+                NSNumber *sequence = @(attachment.sequence);
+                NSMutableArray *forSequence = attachments[sequence];
+                if (!forSequence) {
+                    forSequence = [NSMutableArray array];
+                    attachments[sequence] = forSequence;
+                }
+                [forSequence addObject:attachment];
+            } else {
+                CDTLogInfo(CDTDATASTORE_LOG_CONTEXT,
+                        @"Error reading an attachment row for attachments on %lu revisions\n"
+                        @"Closed connection during read?",
+                        (unsigned long)sequences.count);
+            }
+        }
+    }
+    @finally { [r close]; }
+
+    return attachments;
+}
+
 - (CDTSavedAttachment *)attachmentFromDbRow:(FMResultSet *)r inDatabase:(FMDatabase *)db
 {
     // SELECT sequence, filename, key, type, encoding, length, encoded_length revpos ...
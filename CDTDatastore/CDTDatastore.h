@@ -136,6 +136,36 @@ extern NSString * __nonnull const CDTDatastoreChangeNotification;
  */
 - (nonnull NSArray<NSString*> *)getAllDocumentIds;
 
+/**
+ * Enumerates the current winning revision of every document, in document ID order.
+ *
+ * Documents are read a page at a time, so memory use stays flat however many documents
+ * the datastore holds. Each page is a consistent snapshot, but documents written between
+ * pages may or may not be seen. The block isn't called from inside a database transaction,
+ * so it may write to the datastore.
+ *
+ * @param block called with each document revision; set `stop` to YES to end the enumeration
+ * @param error will point to an NSError object in the case of an error
+ *
+ * @return NO if the enumeration was ended by an error
+ */
+- (BOOL)enumerateAllDocumentsUsingBlock:(void (^ __nonnull)(CDTDocumentRevision * __nonnull revision,
+                                                            BOOL * __nonnull stop))block
+                                  error:(NSError *__autoreleasing __nullable * __nullable)error;
+
+/**
+ * Enumerates the document identifiers of every document with a non-deleted winning revision,
+ * in order. Works like -enumerateAllDocumentsUsingBlock:error: without loading bodies.
+ *
+ * @param block called with each document ID; set `stop` to YES to end the enumeration
+ * @param error will point to an NSError object in the case of an error
+ *
+ * @return NO if the enumeration was ended by an error
+ */
+- (BOOL)enumerateAllDocumentIdsUsingBlock:(void (^ __nonnull)(NSString * __nonnull docId,
+                                                              BOOL * __nonnull stop))block
+                                    error:(NSError *__autoreleasing __nullable * __nullable)error;
+
 /**
  * Enumerate the current winning revisions for all documents in the
  * datastore.
@@ -209,6 +239,36 @@ extern NSString * __nonnull const CDTDatastoreChangeNotification;
  */
 - (nullable CDTDocumentRevision *)updateDocumentFromRevision:(nonnull CDTDocumentRevision *)revision
                                               error:(NSError *__autoreleasing __nullable  * __nullable )error;
+
+/**
+ * Creates documents from several revisions in a single transaction.
+ *
+ * All bodies and attachments are validated before anything is written. A document that
+ * can't be created doesn't stop the others from being created.
+ *
+ * @param revisions document revisions to create documents from
+ * @param error will point to an NSError object if the batch as a whole couldn't be written
+ *
+ * @return an array with one entry per revision, in the same order: the created
+ *         CDTDocumentRevision, or the NSError explaining why that document wasn't created.
+ *         nil if the batch as a whole couldn't be written.
+ */
+- (nullable NSArray *)createDocumentsFromRevisions:(nonnull NSArray<CDTDocumentRevision *> *)revisions
+                                             error:(NSError *__autoreleasing __nullable * __nullable)error;
+
+/**
+ * Updates documents with new revisions in a single transaction.
+ *
+ * Works like -createDocumentsFromRevisions:error:. Each entry in the returned array is the
+ * updated CDTDocumentRevision or the NSError for that document, for example a conflict.
+ *
+ * @param revisions updated document revisions
+ * @param error will point to an NSError object if the batch as a whole couldn't be written
+ *
+ * @return an array with one entry per revision, in the same order, or nil.
+ */
+- (nullable NSArray *)updateDocumentsFromRevisions:(nonnull NSArray<CDTDocumentRevision *> *)revisions
+                                             error:(NSError *__autoreleasing __nullable * __nullable)error;
 /**
  * Deletes a document from the datastore.
  *
@@ -39,6 +39,11 @@
 
 NSString *const CDTDatastoreChangeNotification = @"CDTDatastoreChangeNotification";
 
+static NSString *const kCDTBulkSaveSavePoint = @"bulkSave";
+
+/** Number of documents read per query when enumerating all documents. */
+static const unsigned kCDTAllDocumentsPageSize = 500;
+
 @interface CDTDatastore ()
 
 @property (nonatomic, strong, readonly) id<CDTEncryptionKeyProvider> keyProvider;
@@ -225,61 +230,15 @@ NSString *const CDTDatastoreChangeNotification = @"CDTDatastoreChangeNotificatio
 
 - (NSArray *)getAllDocuments
 {
-    NSError *error;
     if (![self ensureDatabaseOpen]) {
         return nil;
     }
 
-    NSArray *result = [NSArray array];
-    TDContentOptions contentOptions = kTDIncludeLocalSeq;
-    struct TDQueryOptions query = {.limit = UINT_MAX,
-                                   .inclusiveEnd = YES,
-                                   .skip = 0,
-                                   .descending = NO,
-                                   .includeDocs = YES,
-                                   .content = contentOptions};
-
-    // This method must loop to get around the fact that conflicted documents
-    // contribute more than one row in the query -getDocsWithIDs:options: uses,
-    // so in the face of conflicted documents, the initial query above will
-    // only return the winning revisions of a subset of the documents.
-    BOOL done = NO;
-    do {
-        NSMutableArray *batch = [NSMutableArray array];
-
-        NSDictionary *dictResults = [self.database getDocsWithIDs:nil options:&query];
-
-        for (NSDictionary *row in dictResults[@"rows"]) {
-            NSString *docId = row[@"id"];
-            NSString *revId = row[@"value"][@"rev"];
-
-            TD_Revision *revision =
-                [[TD_Revision alloc] initWithDocID:docId revID:revId deleted:NO];
-            revision.body = [[TD_Body alloc] initWithProperties:row[@"doc"]];
-            revision.sequence = [row[@"doc"][@"_local_seq"] longLongValue];
-
-            NSArray *attachments = [self attachmentsForSeq:revision.sequence error:&error];
-            NSMutableDictionary *dict = [NSMutableDictionary dictionary];
-            for (CDTAttachment *attachment in attachments) {
-                [dict setObject:attachment forKey:attachment.name];
-            }
-            [batch addObject:[[CDTDocumentRevision alloc] initWithDocId:revision.docID
-                                                             revisionId:revision.revID
-                                                                   body:revision.body.properties
-                                                                deleted:revision.deleted
-                                                            attachments:dict
-                                                               sequence:revision.sequence]];
-        }
-
-        result = [result arrayByAddingObjectsFromArray:batch];
-
-        done = ((NSArray *)dictResults[@"rows"]).count == 0;
-
-        query.skip = query.skip + query.limit;
-
-    } while (!done);
-
-    return result;
+    NSMutableArray *result = [NSMutableArray array];
+    [self enumerateAllDocumentsUsingBlock:^(CDTDocumentRevision *revision, BOOL *stop) {
+        [result addObject:revision];
+    } error:nil];
+    return [NSArray arrayWithArray:result];
 }
 
 - (NSArray *)getAllDocumentIds
@@ -289,24 +248,107 @@ NSString *const CDTDatastoreChangeNotification = @"CDTDatastoreChangeNotificatio
     }
 
     NSMutableArray *result = [NSMutableArray array];
-    struct TDQueryOptions query = {.limit = UINT_MAX,
-                                   .inclusiveEnd = YES,
-                                   .skip = 0,
-                                   .descending = NO,
-                                   .includeDocs = NO};
+    [self enumerateAllDocumentIdsUsingBlock:^(NSString *docId, BOOL *stop) {
+        [result addObject:docId];
+    } error:nil];
+    return [NSArray arrayWithArray:result];
+}
 
-    NSDictionary *dictResults;
-    do {
-        dictResults = [self.database getDocsWithIDs:nil options:&query];
-        for (NSDictionary *row in dictResults[@"rows"]) {
-            [result addObject:row[@"id"]];
+- (BOOL)enumerateAllDocumentsUsingBlock:(void (^)(CDTDocumentRevision *revision, BOOL *stop))block
+                                  error:(NSError *__autoreleasing *)error
+{
+    return [self enumerateWinningRevisionsWithOptions:0
+                                           usingBlock:^(TD_Revision *revision,
+                                                        NSArray *attachments, BOOL *stop) {
+        NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+        for (CDTAttachment *attachment in attachments) {
+            [dict setObject:attachment forKey:attachment.name];
         }
+        block([[CDTDocumentRevision alloc] initWithDocId:revision.docID
+                                              revisionId:revision.revID
+                                                    body:revision.body.properties
+                                                 deleted:revision.deleted
+                                             attachments:dict
+                                                sequence:revision.sequence],
+              stop);
+    } error:error];
+}
 
-        query.skip = query.skip + query.limit;
-    } while (((NSArray *)dictResults[@"rows"]).count > 0);
+- (BOOL)enumerateAllDocumentIdsUsingBlock:(void (^)(NSString *docId, BOOL *stop))block
+                                    error:(NSError *__autoreleasing *)error
+{
+    return [self enumerateWinningRevisionsWithOptions:kTDNoBody
+                                           usingBlock:^(TD_Revision *revision,
+                                                        NSArray *attachments, BOOL *stop) {
+        block(revision.docID, stop);
+    } error:error];
+}
 
-    return [NSArray arrayWithArray:result];
+/**
+ * Pages through the winning revisions in document ID order, continuing each page from the
+ * last document ID seen. Attachments are read for a whole page at once, and only when bodies
+ * are loaded.
+ */
+- (BOOL)enumerateWinningRevisionsWithOptions:(TDContentOptions)options
+                                  usingBlock:(void (^)(TD_Revision *revision, NSArray *attachments,
+                                                       BOOL *stop))block
+                                       error:(NSError *__autoreleasing *)error
+{
+    if (![self ensureDatabaseOpen]) {
+        if (error) {
+            *error = TDStatusToNSError(kTDStatusException, nil);
+        }
+        return NO;
+    }
+
+    BOOL includeAttachments = !(options & kTDNoBody);
+    NSString *lastDocId = nil;
+    BOOL stop = NO;
+    while (!stop) {
+        @autoreleasepool {
+            __block NSArray *page = nil;
+            __block NSDictionary *attachments = nil;
+            __block NSError *pageError = nil;
+            __weak CDTDatastore *weakSelf = self;
+            [self.database inReadTransaction:^(FMDatabase *db) {
+                CDTDatastore *strongSelf = weakSelf;
+                page = [strongSelf.database winningRevisionsAfterDocID:lastDocId
+                                                                 limit:kCDTAllDocumentsPageSize
+                                                               options:options
+                                                              database:db];
+                if (page.count > 0 && includeAttachments) {
+                    NSMutableArray *sequences = [NSMutableArray arrayWithCapacity:page.count];
+                    for (TD_Revision *revision in page) {
+                        [sequences addObject:@(revision.sequence)];
+                    }
+                    attachments = [strongSelf attachmentsForSequences:sequences
+                                                        inTransaction:db
+                                                                error:&pageError];
+                }
+            }];
+
+            if (!page || pageError) {
+                if (error) {
+                    *error = pageError ?: TDStatusToNSError(kTDStatusDBError, nil);
+                }
+                return NO;
+            }
 
+            for (TD_Revision *revision in page) {
+                block(revision, attachments[@(revision.sequence)], &stop);
+                if (stop) {
+                    break;
+                }
+            }
+
+            if (page.count < kCDTAllDocumentsPageSize) {
+                break;
+            }
+            lastDocId = ((TD_Revision *)page.lastObject).docID;
+        }
+    }
+
+    return YES;
 }
 
 - (NSArray *)getAllDocumentsOffset:(NSUInteger)offset
@@ -332,14 +374,17 @@ NSString *const CDTDatastoreChangeNotification = @"CDTDatastoreChangeNotificatio
 /* docIds can be null for getting all documents */
 - (NSArray *)allDocsQuery:(NSArray *)docIds options:(TDQueryOptions *)queryOptions
 {
-    NSError *error;
     if (![self ensureDatabaseOpen]) {
         return nil;
     }
 
     NSMutableArray *result = [NSMutableArray array];
 
-    NSDictionary *dictResults = [self.database getDocsWithIDs:docIds options:queryOptions];
+    // Attachments are read below as CDTAttachments, so don't also build '_attachments'
+    struct TDQueryOptions options = *queryOptions;
+    options.content |= kTDNoAttachments;
+    NSDictionary *dictResults = [self.database getDocsWithIDs:docIds options:&options];
+    NSDictionary *attachmentsBySequence = [self attachmentsForRows:dictResults[@"rows"]];
 
     for (NSDictionary *row in dictResults[@"rows"]) {
         NSString *docId = row[@"id"];
@@ -365,7 +410,7 @@ NSString *const CDTDatastoreChangeNotification = @"CDTDatastoreChangeNotificatio
             revision.body = [[TD_Body alloc] initWithProperties:row[@"doc"]];
         }
 
-        NSArray *attachments = [self attachmentsForSeq:revision.sequence error:&error];
+        NSArray *attachments = attachmentsBySequence[@(revision.sequence)];
         NSMutableDictionary *dict = [NSMutableDictionary dictionary];
         for (CDTAttachment *attachment in attachments) {
             [dict setObject:attachment forKey:attachment.name];
@@ -381,6 +426,41 @@ NSString *const CDTDatastoreChangeNotification = @"CDTDatastoreChangeNotificatio
     return result;
 }
 
+/**
+ * Returns the attachments of the documents in rows from -getDocsWithIDs:options:, keyed by
+ * sequence, reading them a page of documents at a time.
+ */
+- (NSDictionary *)attachmentsForRows:(NSArray *)rows
+{
+    NSMutableArray *sequences = [NSMutableArray arrayWithCapacity:rows.count];
+    for (NSDictionary *row in rows) {
+        NSNumber *sequence = row[@"doc"][@"_local_seq"];
+        if (sequence) {
+            [sequences addObject:sequence];
+        }
+    }
+
+    NSMutableDictionary *attachments = [NSMutableDictionary dictionary];
+    if (sequences.count == 0) {
+        return attachments;
+    }
+
+    __weak CDTDatastore *weakSelf = self;
+    [self.database inReadTransaction:^(FMDatabase *db) {
+        CDTDatastore *strongSelf = weakSelf;
+        for (NSUInteger start = 0; start < sequences.count; start += kCDTAllDocumentsPageSize) {
+            NSRange range = NSMakeRange(
+                start, MIN((NSUInteger)kCDTAllDocumentsPageSize, sequences.count - start));
+            NSDictionary *page =
+                [strongSelf attachmentsForSequences:[sequences subarrayWithRange:range]
+                                      inTransaction:db
+                                              error:nil];
+            [attachments addEntriesFromDictionary:page];
+        }
+    }];
+    return attachments;
+}
+
 - (NSArray *)getRevisionHistory:(CDTDocumentRevision *)revision
 {
     if (![self ensureDatabaseOpen]) {
@@ -483,23 +563,56 @@ NSString *const CDTDatastoreChangeNotification = @"CDTDatastoreChangeNotificatio
                                               error:(NSError *__autoreleasing *)error
 {
     // first lets check to see if we can save the document
-    if (!revision.body) {
-        TDStatus status = kTDStatusBadRequest;
+    if (![self validateRevision:revision forUpdate:NO error:error]) {
+        return nil;
+    }
+
+    if (![self ensureDatabaseOpen]) {
         if (error) {
-            *error = TDStatusToNSError(status, nil);
+            *error = TDStatusToNSError(kTDStatusException, nil);
         }
         return nil;
     }
 
-    if (![self validateBodyDictionary:revision.body error:error]) {
+    // dowload attachments to the blob store
+    NSMutableArray *downloadedAttachments = [NSMutableArray array];
+    NSMutableArray *attachmentsToCopy = [NSMutableArray array];
+    if (![self streamAttachmentsOfRevision:revision
+                     downloadedAttachments:downloadedAttachments
+                         attachmentsToCopy:attachmentsToCopy
+                                     error:error]) {
         return nil;
     }
 
-    if (![self validateAttachments:revision.attachments]) {
-        CDTLogWarn(
-            CDTDATASTORE_LOG_CONTEXT,
-            @"Attachments dictionary is not keyed by attachment name. "
-             "When accessing attachments on saved revisions they will be keyed by attachment name");
+    // create the document revision with the attachments
+
+    __block CDTDocumentRevision *saved;
+    __weak CDTDatastore *datastore = self;
+
+    [self.database.fmdbQueue inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        saved = [datastore saveRevision:revision
+                         prevRevisionID:nil
+                  downloadedAttachments:downloadedAttachments
+                      attachmentsToCopy:attachmentsToCopy
+                             inDatabase:db
+                                  error:error];
+        if (!saved) {
+            *rollback = YES;
+        }
+    }];
+
+    if (saved) {
+        saved = [self revisionWithAttachmentsFromBlobStore:saved error:error];
+        [self postChangeNotificationForRevision:saved];
+    }
+    return saved;
+}
+
+- (CDTDocumentRevision *)updateDocumentFromRevision:(CDTDocumentRevision *)revision
+                                              error:(NSError *__autoreleasing *)error
+{
+    if (![self validateRevision:revision forUpdate:YES error:error]) {
+        return nil;
     }
 
     if (![self ensureDatabaseOpen]) {
@@ -509,126 +622,166 @@ NSString *const CDTDatastoreChangeNotification = @"CDTDatastoreChangeNotificatio
         return nil;
     }
 
-    // convert CDTMutableDocument to TD_Revision
+    NSMutableArray *downloadedAttachments = [[NSMutableArray alloc] init];
+    NSMutableArray *attachmentToCopy = [[NSMutableArray alloc] init];
+    if (![self streamAttachmentsOfRevision:revision
+                     downloadedAttachments:downloadedAttachments
+                         attachmentsToCopy:attachmentToCopy
+                                     error:error]) {
+        return nil;
+    }
 
-    // we know it shouldn't have a TD_revision behind it, since its a create
+    __block CDTDocumentRevision *result;
+    __weak CDTDatastore *datastore = self;
 
-    TD_Revision *converted =
-        [[TD_Revision alloc] initWithDocID:revision.docId revID:nil deleted:false];
-    converted.body = [[TD_Body alloc] initWithProperties:revision.body];
+    [self.database.fmdbQueue inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        result = [datastore saveRevision:revision
+                          prevRevisionID:revision.revId
+                   downloadedAttachments:downloadedAttachments
+                       attachmentsToCopy:attachmentToCopy
+                              inDatabase:db
+                                   error:error];
+        if (!result) {
+            *rollback = YES;
+        }
+    }];
 
-    // dowload attachments to the blob store
-    NSMutableArray *downloadedAttachments = [NSMutableArray array];
-    NSMutableArray *attachmentsToCopy = [NSMutableArray array];
-    if (revision.attachments) {
-        for (NSString *key in revision.attachments) {
-            CDTAttachment *attachment = [revision.attachments objectForKey:key];
-            // check if thae attachment has been saved to blobstore, if not save it
-            if (![attachment isKindOfClass:[CDTSavedAttachment class]]) {
-                NSDictionary *attachmentData =
-                    [self streamAttachmentToBlobStore:attachment error:error];
-                if (attachmentData != nil) {
-                    [downloadedAttachments addObject:attachmentData];
-                } else {  // Error downloading the attachment, bail
-                    // error out variable set by -stream...
-                    CDTLogWarn(CDTDATASTORE_LOG_CONTEXT,
-                            @"Error reading %@ from stream for doc <%@, %@>, rolling back",
-                            attachment.name, converted.docID, converted.revID);
-                    return nil;
-                }
-            } else {
-                [attachmentsToCopy addObject:attachment];
-            }
+    if (result) {
+        // populate the attachment array with attachments
+        result = [self revisionWithAttachmentsFromBlobStore:result error:error];
+        [self postChangeNotificationForRevision:result];
+    }
+
+    return result;
+}
+
+- (NSArray *)createDocumentsFromRevisions:(NSArray<CDTDocumentRevision *> *)revisions
+                                    error:(NSError *__autoreleasing *)error
+{
+    return [self saveDocumentsFromRevisions:revisions forUpdate:NO error:error];
+}
+
+- (NSArray *)updateDocumentsFromRevisions:(NSArray<CDTDocumentRevision *> *)revisions
+                                    error:(NSError *__autoreleasing *)error
+{
+    return [self saveDocumentsFromRevisions:revisions forUpdate:YES error:error];
+}
+
+/**
+ * Shared implementation of -createDocumentsFromRevisions:error: and
+ * -updateDocumentsFromRevisions:error:.
+ *
+ * Every revision is validated and has its attachments streamed to the blob store before the
+ * transaction starts. Each document is then written under its own savepoint, so a conflict only
+ * rolls back that document's changes.
+ */
+- (NSArray *)saveDocumentsFromRevisions:(NSArray<CDTDocumentRevision *> *)revisions
+                              forUpdate:(BOOL)update
+                                  error:(NSError *__autoreleasing *)error
+{
+    if (![self ensureDatabaseOpen]) {
+        if (error) {
+            *error = TDStatusToNSError(kTDStatusException, nil);
         }
+        return nil;
     }
 
-    // create the document revision with the attachments
+    // Entries are NSNull until the revision is saved, or the NSError that stopped it.
+    NSMutableArray *results = [NSMutableArray arrayWithCapacity:revisions.count];
+    NSMutableArray *downloadedAttachments = [NSMutableArray arrayWithCapacity:revisions.count];
+    NSMutableArray *attachmentsToCopy = [NSMutableArray arrayWithCapacity:revisions.count];
+    for (CDTDocumentRevision *revision in revisions) {
+        NSError *revisionError = nil;
+        NSMutableArray *downloaded = [NSMutableArray array];
+        NSMutableArray *toCopy = [NSMutableArray array];
+        if ([self validateRevision:revision forUpdate:update error:&revisionError] &&
+            [self streamAttachmentsOfRevision:revision
+                        downloadedAttachments:downloaded
+                            attachmentsToCopy:toCopy
+                                        error:&revisionError]) {
+            [results addObject:[NSNull null]];
+        } else {
+            [results addObject:revisionError ?: TDStatusToNSError(kTDStatusBadRequest, nil)];
+        }
+        [downloadedAttachments addObject:downloaded];
+        [attachmentsToCopy addObject:toCopy];
+    }
 
-    __block CDTDocumentRevision *saved;
+    __block NSError *transactionError = nil;
     __weak CDTDatastore *datastore = self;
 
     [self.database.fmdbQueue inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        for (NSUInteger i = 0; i < revisions.count; i++) {
+            if (results[i] != [NSNull null]) {
+                continue;
+            }
 
-        TDStatus status;
-        TD_Revision *new = [datastore.database putRevision : converted prevRevisionID
-                            : nil allowConflict : NO status : &status database : db];
+            @autoreleasepool {
+                NSError *savePointError = nil;
+                if (![db startSavePointWithName:kCDTBulkSaveSavePoint error:&savePointError]) {
+                    CDTLogWarn(CDTDATASTORE_LOG_CONTEXT, @"Failed to start savepoint: %@",
+                               savePointError);
+                    transactionError = TDStatusToNSError(kTDStatusDBError, nil);
+                    *rollback = YES;
+                    return;
+                }
 
-        if (TDStatusIsError(status)) {
-            *error = TDStatusToNSError(status, nil);
-            *rollback = YES;
-            saved = nil;
-            return;
-        } else {
-            saved = [[CDTDocumentRevision alloc] initWithDocId:new.docID
-                                                    revisionId:new.revID
-                                                          body:new.body.properties
-                                                       deleted:new.deleted
-                                                   attachments:@{}
-                                                      sequence:new.sequence];
-            for (NSDictionary *attachment in downloadedAttachments) {
-                // insert each attchment into the database, if this fails rollback
-                if (![datastore addAttachment:attachment toRev:saved inDatabase:db error:error]) {
-                    // failed need to rollback
-                    saved = nil;
+                CDTDocumentRevision *revision = revisions[i];
+                NSError *revisionError = nil;
+                CDTDocumentRevision *saved =
+                    [datastore saveRevision:revision
+                             prevRevisionID:(update ? revision.revId : nil)
+                      downloadedAttachments:downloadedAttachments[i]
+                          attachmentsToCopy:attachmentsToCopy[i]
+                                 inDatabase:db
+                                      error:&revisionError];
+                if (!saved &&
+                    ![db rollbackToSavePointWithName:kCDTBulkSaveSavePoint error:&savePointError]) {
+                    CDTLogWarn(CDTDATASTORE_LOG_CONTEXT, @"Failed to roll back savepoint: %@",
+                               savePointError);
+                    transactionError = TDStatusToNSError(kTDStatusDBError, nil);
                     *rollback = YES;
-                    if ((*error).code == SQLITE_FULL) {
-                        *error = TDStatusToNSError(kTDStatusInsufficientStorage, nil);
-                    } else {
-                        *error = TDStatusToNSError(kTDStatusDBError, nil);
-                    }
                     return;
                 }
-            }
-            // copy saved attachments
-            for (CDTSavedAttachment *attachment in attachmentsToCopy) {
-                TDStatus status = [self.database copyAttachmentNamed:attachment.name
-                                                        fromSequence:attachment.sequence
-                                                          toSequence:new.sequence
-                                                          inDatabase:db];
-                if (TDStatusIsError(status)) {
-                    *error = TDStatusToNSError(status, nil);
+                if (![db releaseSavePointWithName:kCDTBulkSaveSavePoint error:&savePointError]) {
+                    CDTLogWarn(CDTDATASTORE_LOG_CONTEXT, @"Failed to release savepoint: %@",
+                               savePointError);
+                    transactionError = TDStatusToNSError(kTDStatusDBError, nil);
                     *rollback = YES;
-                    saved = nil;
                     return;
                 }
+                results[i] = saved ?: (revisionError ?: TDStatusToNSError(kTDStatusDBError, nil));
             }
-
-            saved = [[CDTDocumentRevision alloc] initWithDocId:new.docID
-                                                    revisionId:new.revID
-                                                          body:new.body.properties
-                                                       deleted:new.deleted
-                                                   attachments:@{}
-                                                      sequence:new.sequence];
         }
     }];
 
-    if (saved) {
-        NSArray *attachmentsFromBlobStore = [self attachmentsForRev:saved error:error];
-        NSMutableDictionary *attachmentDict = [NSMutableDictionary dictionary];
-
-        for (CDTAttachment *attachment in attachmentsFromBlobStore) {
-            [attachmentDict setObject:attachment forKey:attachment.name];
+    if (transactionError) {
+        if (error) {
+            *error = transactionError;
         }
+        return nil;
+    }
 
-        saved = [[CDTDocumentRevision alloc] initWithDocId:saved.docId
-                                                revisionId:saved.revId
-                                                      body:saved.body
-                                                   deleted:saved.deleted
-                                               attachments:attachmentDict
-                                                  sequence:saved.sequence];
-
-        NSDictionary *userInfo = @{ @"rev" : saved, @"winner" : saved };
-        [[NSNotificationCenter defaultCenter] postNotificationName:CDTDatastoreChangeNotification
-                                                            object:self
-                                                          userInfo:userInfo];
+    for (NSUInteger i = 0; i < results.count; i++) {
+        if ([results[i] isKindOfClass:[CDTDocumentRevision class]]) {
+            NSError *attachmentsError = nil;
+            results[i] = [self revisionWithAttachmentsFromBlobStore:results[i]
+                                                              error:&attachmentsError];
+            [self postChangeNotificationForRevision:results[i]];
+        }
     }
-    return saved;
+
+    return [results copy];
 }
 
-- (CDTDocumentRevision *)updateDocumentFromRevision:(CDTDocumentRevision *)revision
-                                              error:(NSError *__autoreleasing *)error
+/**
+ * Checks a revision can be written before any work is done for it.
+ */
+- (BOOL)validateRevision:(CDTDocumentRevision *)revision
+               forUpdate:(BOOL)update
+                   error:(NSError *__autoreleasing *)error
 {
-    if (!revision.isFullRevision) {
+    if (update && !revision.isFullRevision) {
         if (error) {
             NSString *reason = @"Trying to save revision where isFullVersion is NO";
             NSString *msg = @"Possibly trying to save projected query result.";
@@ -641,7 +794,7 @@ NSString *const CDTDatastoreChangeNotification = @"CDTDatastoreChangeNotificatio
             *error =
                 [NSError errorWithDomain:TDHTTPErrorDomain code:kTDStatusBadRequest userInfo:info];
         }
-        return nil;
+        return NO;
     }
 
     if (!revision.body) {
@@ -649,11 +802,11 @@ NSString *const CDTDatastoreChangeNotification = @"CDTDatastoreChangeNotificatio
         if (error) {
             *error = TDStatusToNSError(status, nil);
         }
-        return nil;
+        return NO;
     }
 
     if (![self validateBodyDictionary:revision.body error:error]) {
-        return nil;
+        return NO;
     }
 
     if (![self validateAttachments:revision.attachments]) {
@@ -663,142 +816,137 @@ NSString *const CDTDatastoreChangeNotification = @"CDTDatastoreChangeNotificatio
              "When accessing attachments on saved revisions they will be keyed by attachment name");
     }
 
-    if (![self ensureDatabaseOpen]) {
-        if (error) {
-            *error = TDStatusToNSError(kTDStatusException, nil);
+    return YES;
+}
+
+/**
+ * Streams the revision's new attachments into the blob store, adding their data to
+ * downloadedAttachments. Attachments that are already saved are added to attachmentsToCopy.
+ */
+- (BOOL)streamAttachmentsOfRevision:(CDTDocumentRevision *)revision
+              downloadedAttachments:(NSMutableArray *)downloadedAttachments
+                  attachmentsToCopy:(NSMutableArray *)attachmentsToCopy
+                              error:(NSError *__autoreleasing *)error
+{
+    for (NSString *key in revision.attachments) {
+        CDTAttachment *attachment = [revision.attachments objectForKey:key];
+        // if the attachment is not saved, save it to the blob store
+        // otherwise add it to the array to copy it to the new revision
+        if (![attachment isKindOfClass:[CDTSavedAttachment class]]) {
+            NSDictionary *attachmentData =
+                [self streamAttachmentToBlobStore:attachment error:error];
+            if (attachmentData != nil) {
+                [downloadedAttachments addObject:attachmentData];
+            } else {  // Error downloading the attachment, bail
+                // error out variable set by -stream...
+                CDTLogWarn(CDTDATASTORE_LOG_CONTEXT,
+                        @"Error reading %@ from stream for doc <%@, %@>, rolling back",
+                        attachment.name, revision.docId, revision.revId);
+                return NO;
+            }
+        } else {
+            [attachmentsToCopy addObject:attachment];
         }
-        return nil;
     }
+    return YES;
+}
 
-    TD_Revision *converted = [[TD_Revision alloc] initWithDocID:revision.docId
-                                                          revID:revision.revId
-                                                        deleted:revision.deleted];
+/**
+ * Writes a new revision of the document and its attachments. The caller must roll back
+ * if this returns nil.
+ *
+ * Only call from within a queued transaction.
+ */
+- (CDTDocumentRevision *)saveRevision:(CDTDocumentRevision *)revision
+                       prevRevisionID:(NSString *)prevRevisionID
+                downloadedAttachments:(NSArray *)downloadedAttachments
+                    attachmentsToCopy:(NSArray *)attachmentsToCopy
+                           inDatabase:(FMDatabase *)db
+                                error:(NSError *__autoreleasing *)error
+{
+    TD_Revision *converted =
+        [[TD_Revision alloc] initWithDocID:revision.docId revID:nil deleted:NO];
     converted.body = [[TD_Body alloc] initWithProperties:revision.body];
 
-    NSMutableArray *downloadedAttachments = [[NSMutableArray alloc] init];
-    NSMutableArray *attachmentToCopy = [[NSMutableArray alloc] init];
-    if (revision.attachments) {
-        for (NSString *key in revision.attachments) {
-            CDTAttachment *attachment = [revision.attachments objectForKey:key];
-            // if the attachment is not saved, save it to the blob store
-            // otherwise add it to the array to copy it to the new revision
-            if (![attachment isKindOfClass:[CDTSavedAttachment class]]) {
-                NSDictionary *attachmentData =
-                    [self streamAttachmentToBlobStore:attachment error:error];
-                if (attachmentData != nil) {
-                    [downloadedAttachments addObject:attachmentData];
-                } else {  // Error downloading the attachment, bail
-                    // error out variable set by -stream...
-                    CDTLogWarn(CDTDATASTORE_LOG_CONTEXT,
-                            @"Error reading %@ from stream for doc <%@, %@>, rolling back",
-                            attachment.name, converted.docID, converted.revID);
-                    return nil;
-                }
-            } else {
-                [attachmentToCopy addObject:attachment];
-            }
+    TDStatus status;
+    TD_Revision *new = [self.database putRevision:converted
+                                   prevRevisionID:prevRevisionID
+                                    allowConflict:NO
+                                           status:&status
+                                         database:db];
+    if (TDStatusIsError(status)) {
+        if (error) {
+            *error = TDStatusToNSError(status, nil);
         }
+        return nil;
     }
 
-    __block CDTDocumentRevision *result;
-    __weak CDTDatastore *datastore = self;
-
-    [self.database.fmdbQueue inTransaction:^(FMDatabase *db, BOOL *rollback) {
-        result = [datastore updateDocumentFromTDRevision:converted
-                                                   docId:revision.docId
-                                                 prevRev:revision.revId
-                                           inTransaction:db
-                                                rollback:rollback
-                                                   error:error];
-
-        if (result) {
-            for (NSDictionary *attachment in downloadedAttachments) {
-                // insert each attchment into the database, if this fails rollback
-                if (![datastore addAttachment:attachment toRev:result inDatabase:db error:error]) {
-                    // failed need to rollback
-                    result = nil;
-                    *rollback = YES;
-                    if ((*error).code == SQLITE_FULL) {
-                        *error = TDStatusToNSError(kTDStatusInsufficientStorage, nil);
-                    } else {
-                        *error = TDStatusToNSError(kTDStatusDBError, nil);
-                    }
-                }
-            }
-            for (CDTSavedAttachment *attachment in attachmentToCopy) {
-                TDStatus status = [self.database copyAttachmentNamed:attachment.name
-                                                        fromSequence:attachment.sequence
-                                                          toSequence:result.sequence
-                                                          inDatabase:db];
-                if (TDStatusIsError(status)) {
-                    *error = TDStatusToNSError(status, nil);
-                    *rollback = YES;
-                    result = nil;
+    CDTDocumentRevision *saved = [[CDTDocumentRevision alloc] initWithDocId:new.docID
+                                                                 revisionId:new.revID
+                                                                       body:new.body.properties
+                                                                    deleted:new.deleted
+                                                                attachments:@{}
+                                                                   sequence:new.sequence];
+
+    for (NSDictionary *attachment in downloadedAttachments) {
+        // insert each attchment into the database, if this fails rollback
+        NSError *attachmentError = nil;
+        if (![self addAttachment:attachment toRev:saved inDatabase:db error:&attachmentError]) {
+            if (error) {
+                if (attachmentError.code == SQLITE_FULL) {
+                    *error = TDStatusToNSError(kTDStatusInsufficientStorage, nil);
+                } else {
+                    *error = TDStatusToNSError(kTDStatusDBError, nil);
                 }
             }
+            return nil;
         }
-    }];
-
-    if (result) {
-        // populate the attachment array with attachments
-        NSArray *attachmentsFromBlobStore = [self attachmentsForRev:result error:error];
-        NSMutableDictionary *attachmentDict = [NSMutableDictionary dictionary];
+    }
 
-        for (CDTAttachment *attachment in attachmentsFromBlobStore) {
-            [attachmentDict setObject:attachment forKey:attachment.name];
+    // copy saved attachments
+    for (CDTSavedAttachment *attachment in attachmentsToCopy) {
+        status = [self.database copyAttachmentNamed:attachment.name
+                                       fromSequence:attachment.sequence
+                                         toSequence:new.sequence
+                                         inDatabase:db];
+        if (TDStatusIsError(status)) {
+            if (error) {
+                *error = TDStatusToNSError(status, nil);
+            }
+            return nil;
         }
-
-        result = [[CDTDocumentRevision alloc] initWithDocId:result.docId
-                                                 revisionId:result.revId
-                                                       body:result.body
-                                                    deleted:result.deleted
-                                                attachments:attachmentDict
-                                                   sequence:result.sequence];
-
-        NSDictionary *userInfo = $dict({ @"rev", result }, { @"winner", result });
-        [[NSNotificationCenter defaultCenter] postNotificationName:CDTDatastoreChangeNotification
-                                                            object:self
-                                                          userInfo:userInfo];
     }
 
-    return result;
+    return saved;
 }
 
-- (CDTDocumentRevision *)updateDocumentFromTDRevision:(TD_Revision *)td_rev
-                                                docId:(NSString *)docId
-                                              prevRev:(NSString *)prevRev
-                                        inTransaction:(FMDatabase *)db
-                                             rollback:(BOOL *)rollback
-                                                error:(NSError *__autoreleasing *)error
+/**
+ * Returns a copy of a just-saved revision with its attachments filled in.
+ */
+- (CDTDocumentRevision *)revisionWithAttachmentsFromBlobStore:(CDTDocumentRevision *)saved
+                                                        error:(NSError *__autoreleasing *)error
 {
-    if (![self ensureDatabaseOpen]) {
-        if  (error) {
-            *error = TDStatusToNSError(kTDStatusException, nil);
-        }
+    NSArray *attachmentsFromBlobStore = [self attachmentsForRev:saved error:error];
+    NSMutableDictionary *attachmentDict = [NSMutableDictionary dictionary];
 
-        return nil;
+    for (CDTAttachment *attachment in attachmentsFromBlobStore) {
+        [attachmentDict setObject:attachment forKey:attachment.name];
     }
 
-    TD_Revision *revision = [[TD_Revision alloc] initWithDocID:docId revID:nil deleted:NO];
-    revision.body = td_rev.body;
-
-    TDStatus status;
-    TD_Revision *new = [self.database putRevision : revision prevRevisionID : prevRev allowConflict
-                        : NO status : &status database : db];
-    if (TDStatusIsError(status)) {
-        if (error) {
-            *error = TDStatusToNSError(status, nil);
-        }
-        *rollback = YES;
-        return nil;
-    }
+    return [[CDTDocumentRevision alloc] initWithDocId:saved.docId
+                                           revisionId:saved.revId
+                                                 body:saved.body
+                                              deleted:saved.deleted
+                                          attachments:attachmentDict
+                                             sequence:saved.sequence];
+}
 
-    return [[CDTDocumentRevision alloc] initWithDocId:new.docID
-                                           revisionId:new.revID
-                                                 body:new.body.properties
-                                              deleted:new.deleted
-                                          attachments:@{}
-                                             sequence:new.sequence];
+- (void)postChangeNotificationForRevision:(CDTDocumentRevision *)revision
+{
+    NSDictionary *userInfo = $dict({ @"rev", revision }, { @"winner", revision });
+    [[NSNotificationCenter defaultCenter] postNotificationName:CDTDatastoreChangeNotification
+                                                        object:self
+                                                      userInfo:userInfo];
 }
 
 - (CDTDocumentRevision *)deleteDocumentFromRevision:(CDTDocumentRevision *)revision
@@ -843,13 +991,18 @@ NSString *const CDTDatastoreChangeNotification = @"CDTDatastoreChangeNotificatio
 
     [self.database.fmdbQueue inTransaction:^(FMDatabase *db, BOOL *rollback) {
 
-        FMResultSet *result = [db executeQueryWithFormat:@"SELECT revs.revid FROM docs,revs WHERE \
-        revs.doc_id = docs.doc_id AND docs.docid = %@ AND deleted = 0 AND revs.sequence \
-        NOT IN (SELECT DISTINCT parent FROM revs WHERE parent NOT NULL)",
-                                                         docId];
-
+        // Non-deleted leaves are found through the revs_current index.
+        FMResultSet *result = [db executeQuery:@"SELECT revs.revid FROM docs, revs "
+                                               "WHERE docs.docid = ? AND revs.doc_id = docs.doc_id "
+                                               "AND revs.current = 1 AND revs.deleted = 0",
+                                              docId];
+        NSMutableArray *leafRevIds = [NSMutableArray array];
         while ([result next]) {
-            NSString *revId = [result stringForColumn:@"revid"];
+            [leafRevIds addObject:[result stringForColumn:@"revid"]];
+        }
+        [result close];
+
+        for (NSString *revId in leafRevIds) {
             CDTDocumentRevision *deleted;
 
             TD_Revision *td_revision =
@@ -18,6 +18,20 @@
 
 extern NSString *__nonnull const CDTDatastoreErrorDomain;
 
+/**
+ Option for -initWithDirectory:options:error:. An NSNumber; when YES, datastores store new
+ revision bodies in a compact binary format rather than as JSON. Opening a datastore with this
+ set upgrades it to a version older releases of the library can't read. Defaults to NO.
+ */
+extern NSString *__nonnull const CDTDatastoreManagerOptionBinaryBodies;
+
+/**
+ Option for -initWithDirectory:options:error:. An NSNumber giving the size in bytes of stored
+ JSON to keep decoded in memory for each datastore, so that documents read often aren't parsed
+ every time. Only the winning revision of each document is cached. Defaults to 0, no cache.
+ */
+extern NSString *__nonnull const CDTDatastoreManagerOptionDocumentCacheSize;
+
 @class CDTDatastore;
 @class TD_DatabaseManager;
 
@@ -41,6 +55,19 @@ extern NSString *__nonnull const CDTDatastoreErrorDomain;
  */
 - (nullable instancetype)initWithDirectory:(nonnull NSString *)directoryPath error:(NSError * __autoreleasing __nullable * __nullable)outError;
 
+/**
+ Initialises the datastore manager with a directory where the files
+ for datastores are persisted to disk, and options for the datastores
+ it opens.
+
+ @param directoryPath  directory for files. This must exist.
+ @param options dictionary of CDTDatastoreManagerOption... keys, or nil for the defaults.
+ @param outError will point to an NSError object in case of error.
+ */
+- (nullable instancetype)initWithDirectory:(nonnull NSString *)directoryPath
+                                   options:(nullable NSDictionary<NSString *, id> *)options
+                                     error:(NSError *__autoreleasing __nullable *__nullable)outError;
+
 /**
  Returns a datastore for the given name.
 
@@ -24,6 +24,8 @@
 
 NSString *const CDTDatastoreErrorDomain = @"CDTDatastoreErrorDomain";
 NSString *const CDTExtensionsDirName = @"_extensions";
+NSString *const CDTDatastoreManagerOptionBinaryBodies = @"binaryBodies";
+NSString *const CDTDatastoreManagerOptionDocumentCacheSize = @"documentCacheSize";
 
 @interface CDTDatastoreManager ()
 
@@ -34,12 +36,25 @@ NSString *const CDTExtensionsDirName = @"_extensions";
 @implementation CDTDatastoreManager
 
 - (id)initWithDirectory:(NSString *)directoryPath error:(NSError **)outError
+{
+    return [self initWithDirectory:directoryPath options:nil error:outError];
+}
+
+- (id)initWithDirectory:(NSString *)directoryPath
+                options:(NSDictionary *)options
+                  error:(NSError **)outError
 {
     self = [super init];
     if (self) {
         _openDatastores = [NSMutableDictionary dictionary];
-        _manager =
-            [[TD_DatabaseManager alloc] initWithDirectory:directoryPath options:nil error:outError];
+
+        TD_DatabaseManagerOptions managerOptions = kTD_DatabaseManagerDefaultOptions;
+        managerOptions.binaryBodies = [options[CDTDatastoreManagerOptionBinaryBodies] boolValue];
+        managerOptions.documentCacheSize =
+            [options[CDTDatastoreManagerOptionDocumentCacheSize] unsignedIntegerValue];
+        _manager = [[TD_DatabaseManager alloc] initWithDirectory:directoryPath
+                                                         options:&managerOptions
+                                                           error:outError];
         if (!_manager) {
             self = nil;
         }
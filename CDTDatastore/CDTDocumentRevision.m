@@ -92,15 +92,21 @@
         _attachments = [CDTChangedDictionary dictionaryCopyingContents:attachments];
         _sequence = sequence;
         if (!deleted && body) {
-            NSMutableDictionary *mutableCopy = [body mutableCopy];
-
             NSPredicate *_prefixPredicate =
                 [NSPredicate predicateWithFormat:@" self BEGINSWITH '_'"];
 
             NSArray *keysToRemove = [[body allKeys] filteredArrayUsingPredicate:_prefixPredicate];
 
-            [mutableCopy removeObjectsForKeys:keysToRemove];
-            _body = [CDTChangedDictionary dictionaryCopyingContents:mutableCopy];
+            if ([body isKindOfClass:[TDLazyJSONDictionary class]]) {
+                // Leave the values unparsed until they're read
+                NSDictionary *filtered =
+                    [(TDLazyJSONDictionary *)body dictionaryByRemovingKeys:keysToRemove];
+                _body = [CDTChangedDictionary dictionaryCopyingContents:filtered];
+            } else {
+                NSMutableDictionary *mutableCopy = [body mutableCopy];
+                [mutableCopy removeObjectsForKeys:keysToRemove];
+                _body = [CDTChangedDictionary dictionaryCopyingContents:mutableCopy];
+            }
         } else {
             _body = [CDTChangedDictionary dictionaryCopyingContents:@{}];
         }
@@ -17,11 +17,17 @@
 #import "CDTChangedDictionary.h"
 
 #import "CDTChangedArray.h"
+#import "TDJSON.h"
 
 @interface CDTChangedDictionary ()
 
 @property (nonatomic, strong, readonly) NSMutableDictionary *wrappedDictionary;
 
+/**
+ Contents not yet copied into wrappedDictionary, see -initCopyingContentsOnDemand:.
+ */
+@property (nonatomic, strong) NSDictionary *uncopiedDictionary;
+
 @end
 
 @implementation CDTChangedDictionary
@@ -49,18 +55,41 @@
     }
 }
 
+/**
+ Init with an immutable dictionary whose contents are copied a value at a time as they're read,
+ and all at once before the first change.
+ */
+- (instancetype)initCopyingContentsOnDemand:(NSDictionary *)dictionary
+{
+    self = [self initWithDictionary:[NSMutableDictionary dictionaryWithCapacity:dictionary.count]];
+    if (self) {
+        _uncopiedDictionary = dictionary;
+    }
+    return self;
+}
+
+- (void)copyRemainingContents
+{
+    for (NSString *key in self.uncopiedDictionary) {
+        [self objectForKey:key];
+    }
+    self.uncopiedDictionary = nil;
+}
+
 - (void)contentOfObjectDidChange:(NSObject *)object { self.changed = YES; }
 
 #pragma mark NSMutableDictionary primitive methods
 
 - (void)setObject:(id)anObject forKey:(id<NSCopying>)aKey
 {
+    [self copyRemainingContents];
     self.changed = YES;
     [self.wrappedDictionary setObject:anObject forKey:aKey];
 }
 
 - (void)removeObjectForKey:(id)aKey
 {
+    [self copyRemainingContents];
     self.changed = YES;
     [self.wrappedDictionary removeObjectForKey:aKey];
 }
@@ -79,14 +108,49 @@
     return self;
 }
 
-- (NSUInteger)count { return self.wrappedDictionary.count; }
+- (NSUInteger)count
+{
+    NSDictionary *uncopied = self.uncopiedDictionary;
+    return uncopied ? uncopied.count : self.wrappedDictionary.count;
+}
 
-- (id)objectForKey:(id)aKey { return [self.wrappedDictionary objectForKey:aKey]; }
+- (id)objectForKey:(id)aKey
+{
+    id object = [self.wrappedDictionary objectForKey:aKey];
+    NSObject *uncopied = object ? nil : self.uncopiedDictionary[aKey];
+    if (uncopied) {
+        if ([uncopied isKindOfClass:[NSDictionary class]]) {
+            CDTChangedDictionary *tmp =
+                [CDTChangedDictionary dictionaryCopyingContents:(NSDictionary *)uncopied];
+            tmp.delegate = self;
+            object = tmp;
+        } else if ([uncopied isKindOfClass:[NSArray class]]) {
+            CDTChangedArray *tmp = [CDTChangedDictionary arrayCopyingContents:(NSArray *)uncopied];
+            tmp.delegate = self;
+            object = tmp;
+        } else {
+            object = uncopied;
+        }
+        // Not through -setObject:forKey:, as copying isn't a change
+        [self.wrappedDictionary setObject:object forKey:aKey];
+    }
+    return object;
+}
 
-- (NSEnumerator *)keyEnumerator { return [self.wrappedDictionary keyEnumerator]; }
+- (NSEnumerator *)keyEnumerator
+{
+    NSDictionary *uncopied = self.uncopiedDictionary;
+    return uncopied ? [uncopied keyEnumerator] : [self.wrappedDictionary keyEnumerator];
+}
 
 + (CDTChangedDictionary *)dictionaryCopyingContents:(NSDictionary *)dictionary
 {
+    // A lazily parsed document body is copied lazily too, so values that are never read are
+    // never parsed.
+    if ([dictionary isKindOfClass:[TDLazyJSONDictionary class]]) {
+        return [[CDTChangedDictionary alloc] initCopyingContentsOnDemand:dictionary];
+    }
+
     // We need to create the changed dictionary at the end to avoid setting
     // isChanged prematurely.
     CDTChangedDictionary *changedDict = [CDTChangedDictionary emptyDictionary];
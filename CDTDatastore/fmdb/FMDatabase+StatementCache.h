@@ -0,0 +1,48 @@
+//
+//  FMDatabase+StatementCache.h
+//  CloudantSync
+//
+//  Copyright (c) 2016 IBM Cloudant. All rights reserved.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//  except in compliance with the License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  Unless required by applicable law or agreed to in writing, software distributed under the
+//  License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//  either express or implied. See the License for the specific language governing permissions
+//  and limitations under the License.
+//
+
+#import <Foundation/Foundation.h>
+#import <FMDB/FMDatabase.h>
+
+/**
+ Per-connection reuse of compiled statements for fixed-shape SQL.
+
+ These methods run the statement through FMDB's statement cache, which is keyed by the SQL text,
+ and count whether a compiled statement could be reused. The cache is only used by these methods,
+ so the connection should leave `shouldCacheStatements` off; it holds the statements of the 64
+ most recently used SQL texts.
+
+ Only use these methods for SQL whose text doesn't depend on the arguments; statements with
+ inlined values would never be reused.
+ */
+@interface FMDatabase (StatementCache)
+
+/** Number of statements that were found compiled in this connection's cache. */
+@property (readonly) NSUInteger statementCacheHits;
+
+/** Number of statements that had to be compiled by this connection. */
+@property (readonly) NSUInteger statementCacheMisses;
+
+- (FMResultSet *)executeCachedQuery:(NSString *)sql, ...;
+- (FMResultSet *)executeCachedQuery:(NSString *)sql withArgumentsInArray:(NSArray *)arguments;
+
+- (BOOL)executeCachedUpdate:(NSString *)sql, ...;
+- (BOOL)executeCachedUpdate:(NSString *)sql withArgumentsInArray:(NSArray *)arguments;
+- (BOOL)executeCachedUpdate:(NSString *)sql withErrorAndBindings:(NSError **)outErr, ...;
+
+/** Like -longLongForQuery:, for a single-value query run through the statement cache. */
+- (long long)longLongForCachedQuery:(NSString *)sql, ...;
+
+@end
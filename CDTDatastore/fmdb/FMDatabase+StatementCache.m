@@ -0,0 +1,209 @@
+//
+//  FMDatabase+StatementCache.m
+//  CloudantSync
+//
+//  Copyright (c) 2016 IBM Cloudant. All rights reserved.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//  except in compliance with the License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//  Unless required by applicable law or agreed to in writing, software distributed under the
+//  License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//  either express or implied. See the License for the specific language governing permissions
+//  and limitations under the License.
+//
+
+#import "FMDatabase+StatementCache.h"
+
+#import <objc/runtime.h>
+
+/**
+ FMDB's statement cache is only turned on for the duration of the methods below, so statements
+ with inlined values run through the ordinary methods never enter it. The statements of this many
+ distinct SQL texts are kept, and the least recently used are closed to make room for more.
+ */
+static const NSUInteger kMaxCachedStatements = 64;
+
+static char kStatementCacheHitsKey;
+static char kStatementCacheMissesKey;
+static char kStatementCacheRecencyKey;
+
+@implementation FMDatabase (StatementCache)
+
+- (NSUInteger)statementCacheHits
+{
+    return [objc_getAssociatedObject(self, &kStatementCacheHitsKey) unsignedIntegerValue];
+}
+
+- (NSUInteger)statementCacheMisses
+{
+    return [objc_getAssociatedObject(self, &kStatementCacheMissesKey) unsignedIntegerValue];
+}
+
+- (FMResultSet *)executeCachedQuery:(NSString *)sql, ...
+{
+    va_list args;
+    va_start(args, sql);
+    BOOL wasCaching = [self beginCachedStatementForQuery:sql];
+    FMResultSet *result = [self executeQuery:sql withVAList:args];
+    [self endCachedStatement:wasCaching];
+    va_end(args);
+    return result;
+}
+
+- (FMResultSet *)executeCachedQuery:(NSString *)sql withArgumentsInArray:(NSArray *)arguments
+{
+    BOOL wasCaching = [self beginCachedStatementForQuery:sql];
+    FMResultSet *result = [self executeQuery:sql withArgumentsInArray:arguments];
+    [self endCachedStatement:wasCaching];
+    return result;
+}
+
+- (BOOL)executeCachedUpdate:(NSString *)sql, ...
+{
+    va_list args;
+    va_start(args, sql);
+    BOOL wasCaching = [self beginCachedStatementForQuery:sql];
+    BOOL result = [self executeUpdate:sql withVAList:args];
+    [self endCachedStatement:wasCaching];
+    va_end(args);
+    return result;
+}
+
+- (BOOL)executeCachedUpdate:(NSString *)sql withArgumentsInArray:(NSArray *)arguments
+{
+    BOOL wasCaching = [self beginCachedStatementForQuery:sql];
+    BOOL result = [self executeUpdate:sql withArgumentsInArray:arguments];
+    [self endCachedStatement:wasCaching];
+    return result;
+}
+
+- (BOOL)executeCachedUpdate:(NSString *)sql withErrorAndBindings:(NSError **)outErr, ...
+{
+    va_list args;
+    va_start(args, sql);
+    BOOL wasCaching = [self beginCachedStatementForQuery:sql];
+    BOOL result = [self executeUpdate:sql
+                                error:outErr
+                 withArgumentsInArray:nil
+                         orDictionary:nil
+                             orVAList:args];
+    [self endCachedStatement:wasCaching];
+    va_end(args);
+    return result;
+}
+
+- (long long)longLongForCachedQuery:(NSString *)sql, ...
+{
+    va_list args;
+    va_start(args, sql);
+    BOOL wasCaching = [self beginCachedStatementForQuery:sql];
+    FMResultSet *resultSet = [self executeQuery:sql withVAList:args];
+    [self endCachedStatement:wasCaching];
+    va_end(args);
+
+    long long result = 0;
+    if ([resultSet next]) {
+        result = [resultSet longLongIntForColumnIndex:0];
+    }
+    [resultSet close];
+    return result;
+}
+
+#pragma mark Bookkeeping
+
+/** A cache entry is either a single statement or, in later FMDB versions, a set of them. */
+static BOOL hasIdleStatement(id cached)
+{
+    if ([cached isKindOfClass:[NSSet class]]) {
+        for (FMStatement *statement in cached) {
+            if (!statement.inUse) return YES;
+        }
+        return NO;
+    }
+    return cached != nil && ![(FMStatement *)cached inUse];
+}
+
+static BOOL isInUse(id cached)
+{
+    if ([cached isKindOfClass:[NSSet class]]) {
+        for (FMStatement *statement in cached) {
+            if (statement.inUse) return YES;
+        }
+        return NO;
+    }
+    return [(FMStatement *)cached inUse];
+}
+
+static void closeStatements(id cached)
+{
+    if ([cached isKindOfClass:[NSSet class]]) {
+        [cached makeObjectsPerformSelector:@selector(close)];
+    } else {
+        [(FMStatement *)cached close];
+    }
+}
+
+/**
+ Counts the lookup, marks the SQL as the most recently used and turns the statement cache on for
+ the statement about to run. Returns whether it was on before, for -endCachedStatement:.
+ */
+- (BOOL)beginCachedStatementForQuery:(NSString *)sql
+{
+    NSMutableDictionary *cache = self.cachedStatements;
+    if (!cache) {
+        cache = [NSMutableDictionary dictionary];
+        self.cachedStatements = cache;
+    }
+
+    void *key = hasIdleStatement(cache[sql]) ? &kStatementCacheHitsKey : &kStatementCacheMissesKey;
+    NSUInteger count = [objc_getAssociatedObject(self, key) unsignedIntegerValue];
+    objc_setAssociatedObject(self, key, @(count + 1), OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+
+    // Least recently used first
+    NSMutableArray *recency = objc_getAssociatedObject(self, &kStatementCacheRecencyKey);
+    if (!recency) {
+        recency = [NSMutableArray array];
+        objc_setAssociatedObject(self, &kStatementCacheRecencyKey, recency,
+                                 OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+    }
+    [recency removeObject:sql];
+    [recency addObject:[sql copy]];
+
+    // Statements that are in use belong to open result sets, so only idle ones can be evicted.
+    // Entries closed by FMDB, e.g. when the connection was closed, are forgotten here too.
+    for (NSUInteger i = 0; recency.count > kMaxCachedStatements && i < recency.count - 1;) {
+        NSString *oldest = recency[i];
+        id cached = cache[oldest];
+        if (cached && isInUse(cached)) {
+            i++;
+            continue;
+        }
+        closeStatements(cached);
+        [cache removeObjectForKey:oldest];
+        [recency removeObjectAtIndex:i];
+    }
+
+    BOOL wasCaching = self.shouldCacheStatements;
+    self.shouldCacheStatements = YES;
+    return wasCaching;
+}
+
+/**
+ Turns the statement cache back off if it was off before -beginCachedStatementForQuery:.
+
+ -setShouldCacheStatements:NO also drops the cached statements, so they're put back; FMDB only
+ looks statements up while caching is on, but still closes those in the dictionary with the
+ connection.
+ */
+- (void)endCachedStatement:(BOOL)wasCaching
+{
+    if (wasCaching) {
+        return;
+    }
+    NSMutableDictionary *cache = self.cachedStatements;
+    self.shouldCacheStatements = NO;
+    self.cachedStatements = cache;
+}
+
+@end
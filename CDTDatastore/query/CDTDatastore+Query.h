@@ -16,6 +16,7 @@
 #import <Foundation/Foundation.h>
 #import "CDTDatastore.h"
 #import "CDTQIndexManager.h"
+#import "CDTQPreparedQuery.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -35,6 +36,25 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (nonatomic, readonly, getter = isTextSearchEnabled) BOOL textSearchEnabled;
 
+/**
+ Keep indexes up to date in the background as documents are written.
+
+ By default indexes are updated lazily by the next query, so the first query
+ after many writes, or after a pull replication, does all the indexing work.
+ Setting this to YES moves that work to a background queue that runs shortly
+ after each change, keeping query latency predictable.
+ */
+@property (nonatomic) BOOL updatesIndexesInBackground;
+
+/**
+ Build projected results from index columns when every projected field is in
+ one JSON index, rather than loading each document.
+
+ Projected revisions built this way have no attachments. Fields which have held
+ arrays, booleans or sub-documents are still projected from the documents.
+ */
+@property (nonatomic) BOOL coveringProjectionsEnabled;
+
 /**
  Return a list of the indexes defined.
  
@@ -195,6 +215,21 @@ NS_ASSUME_NONNULL_BEGIN
                           fields:(nullable NSArray *)fields
                             sort:(nullable NSArray *)sortDocument;
 
+/**
+ Prepare a query to be run many times with different values.
+
+ Use CDTQPlaceholder objects in place of values in the selector, then run the
+ returned query with -[CDTQPreparedQuery findWithValues:]. Other parameters
+ are as for -find:skip:limit:fields:sort:.
+
+ @return Prepared query, or `nil` if the selector is invalid.
+ */
+- (nullable CDTQPreparedQuery *)prepareQuery:(NSDictionary *)query
+                                        skip:(NSUInteger)skip
+                                       limit:(NSUInteger)limit
+                                      fields:(nullable NSArray *)fields
+                                        sort:(nullable NSArray *)sortDocument;
+
 @end
 
 NS_ASSUME_NONNULL_END
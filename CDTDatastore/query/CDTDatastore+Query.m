@@ -38,6 +38,26 @@
     return [self.CDTQManager isTextSearchEnabled];
 }
 
+- (BOOL)updatesIndexesInBackground
+{
+    return [self.CDTQManager updatesIndexesInBackground];
+}
+
+- (void)setUpdatesIndexesInBackground:(BOOL)updatesIndexesInBackground
+{
+    [self.CDTQManager setUpdatesIndexesInBackground:updatesIndexesInBackground];
+}
+
+- (BOOL)coveringProjectionsEnabled
+{
+    return [self.CDTQManager coveringProjectionsEnabled];
+}
+
+- (void)setCoveringProjectionsEnabled:(BOOL)coveringProjectionsEnabled
+{
+    [self.CDTQManager setCoveringProjectionsEnabled:coveringProjectionsEnabled];
+}
+
 - (NSDictionary *)listIndexes
 {
     return [self.CDTQManager listIndexes];
@@ -102,6 +122,19 @@
     return [self.CDTQManager find:query skip:skip limit:limit fields:fields sort:sortDocument];
 }
 
+- (CDTQPreparedQuery *)prepareQuery:(NSDictionary *)query
+                               skip:(NSUInteger)skip
+                              limit:(NSUInteger)limit
+                             fields:(NSArray *)fields
+                               sort:(NSArray *)sortDocument
+{
+    return [self.CDTQManager prepareQuery:query
+                                     skip:skip
+                                    limit:limit
+                                   fields:fields
+                                     sort:sortDocument];
+}
+
 - (BOOL)deleteIndexNamed:(NSString *)indexName
 {
     return [self.CDTQManager deleteIndexNamed:indexName];
@@ -26,6 +26,7 @@ extern NSString *const kCDTQIndexMetadataTableName;
 
 @class CDTDatastore;
 @class CDTQResultSet;
+@class CDTQPreparedQuery;
 @class CDTDocumentRevision;
 @class FMDatabaseQueue;
 @class FMDatabase;
@@ -93,6 +94,25 @@ typedef NS_ENUM(NSInteger, CDTQQueryError) {
 @property (nonatomic, strong) FMDatabaseQueue *database;
 @property (nonatomic, readonly, getter = isTextSearchEnabled) BOOL textSearchEnabled;
 
+/**
+ When YES, the manager observes CDTDatastoreChangeNotification and brings
+ indexes up to date on a background queue shortly after each write, so that
+ queries don't pay the indexing cost of a burst of writes or a replication.
+
+ Queries still check indexes are current before running; they wait for any
+ in-progress background update rather than starting a second one.
+
+ Defaults to NO.
+ */
+@property (nonatomic) BOOL updatesIndexesInBackground;
+
+/**
+ When YES, projections whose fields are all in one JSON index are built from the
+ index rather than by loading documents. See -[CDTQQueryExecutor
+ coveringProjectionsEnabled] for the limitations. Defaults to NO.
+ */
+@property (nonatomic) BOOL coveringProjectionsEnabled;
+
 /**
  Constructs a new CDTQIndexManager which indexes documents in `datastore`
  */
@@ -103,6 +123,12 @@ managerUsingDatastore:(CDTDatastore *)datastore
 - (nullable instancetype)initUsingDatastore:(CDTDatastore *)datastore
                                       error:(NSError *__autoreleasing __nullable *__nullable)error;
 
+/**
+ Returns the definitions of the datastore's indexes.
+
+ The definitions are cached until this manager creates or deletes an index, so
+ changes made through another manager for the same datastore aren't seen.
+ */
 - (NSDictionary<NSString *, NSArray<NSString *> *> *)listIndexes;
 
 /** Internal */
@@ -146,6 +172,18 @@ managerUsingDatastore:(CDTDatastore *)datastore
                           fields:(nullable NSArray *)fields
                             sort:(nullable NSArray *)sortDocument;
 
+/**
+ Validate and translate a selector containing CDTQPlaceholder values, returning
+ a query which can be run many times with different values for them.
+
+ @return the prepared query, or `nil` if the selector is invalid.
+ */
+- (nullable CDTQPreparedQuery *)prepareQuery:(NSDictionary *)query
+                                        skip:(NSUInteger)skip
+                                       limit:(NSUInteger)limit
+                                      fields:(nullable NSArray *)fields
+                                        sort:(nullable NSArray *)sortDocument;
+
 /** Internal */
 + (NSString *)tableNameForIndex:(NSString *)indexName;
 + (CDTQIndexType)indexTypeForString:(NSString *)string;
@@ -20,13 +20,16 @@
 //
 // The metadata for an index is represented in the database table as follows:
 //
-//   index_name  |  index_type  |  field_name  |  last_sequence
-//   -----------------------------------------------------------
-//     name      |  json        |   _id        |     0
-//     name      |  json        |   _rev       |     0
-//     name      |  json        |   firstName  |     0
-//     name      |  json        |   lastName   |     0
-//     age       |  json        |   age        |     0
+//   index_name  |  index_type  |  field_name  |  last_sequence  |  projectable
+//   ---------------------------------------------------------------------------
+//     name      |  json        |   _id        |     0           |     1
+//     name      |  json        |   _rev       |     0           |     1
+//     name      |  json        |   firstName  |     0           |     1
+//     name      |  json        |   lastName   |     0           |     1
+//     age       |  json        |   age        |     0           |     1
+//
+// A field stops being projectable once a value which its index column can't
+// reproduce is indexed for it, see CDTQIndexUpdater.
 //
 // The index itself is a single table, with a colum for docId and each of the indexed fields:
 //
@@ -48,6 +51,8 @@
 #import "CDTQResultSet.h"
 #import "CDTQIndexUpdater.h"
 #import "CDTQQueryExecutor.h"
+#import "CDTQQueryPlanCache.h"
+#import "CDTQPreparedQuery.h"
 #import "CDTQIndexCreator.h"
 #import "CDTLogging.h"
 
@@ -58,6 +63,7 @@
 #import "TD_Body.h"
 
 #import "FMDatabase+EncryptionKey.h"
+#import "FMDatabase+StatementCache.h"
 
 #import <CloudantSync.h>
 #import <FMDB/FMDB.h>
@@ -72,13 +78,44 @@ NSString *const kCDTQIndexMetadataTableName = @"_t_cloudant_sync_query_metadata"
 static NSString *const kCDTQExtensionName = @"com.cloudant.sync.query";
 static NSString *const kCDTQIndexFieldNamePattern = @"^[a-zA-Z][a-zA-Z0-9_]*$";
 
-static const int VERSION = 2;
+static const int VERSION = 3;
+
+// Re-run ANALYZE once this many changes have been indexed since it last ran
+static const SInt64 kCDTQAnalyzeSequenceInterval = 1000;
+
+// Number of distinct queries whose plans are kept
+static const NSUInteger kCDTQPlanCacheCapacity = 64;
 
 @interface CDTQIndexManager ()
 
 @property (nonatomic, strong) NSRegularExpression *validFieldName;
 @property (readwrite) BOOL textSearchEnabled;
 
+// All index updates run on this serial queue, so a background update and the
+// update done before a query never process the same changes concurrently.
+@property (nonatomic, strong) dispatch_queue_t indexingQueue;
+@property (nonatomic) BOOL backgroundUpdatePending;
+
+// Planner statistics from sqlite_stat1, refreshed on the indexing queue
+@property (strong) NSDictionary *indexRowCounts;  // index name -> NSNumber
+@property (nonatomic, strong) NSSet *analyzedIndexNames;
+@property (nonatomic) SInt64 analyzedSequence;
+
+// Index definitions as returned by -listIndexes, loaded on first use and dropped
+// when this manager creates or deletes an index. The generation changes on each
+// drop, so a load which raced with one isn't cached. They're reloaded if the schema
+// version has changed since, as when another manager changed the indexes.
+@property (nonatomic, strong) NSDictionary *indexCatalog;
+@property (nonatomic) NSUInteger indexCatalogGeneration;
+@property (nonatomic) long long indexCatalogSchemaVersion;
+
+// Last result of -listIndexesWithStatistics and the inputs it was built from
+@property (nonatomic, strong) NSDictionary *plannerIndexes;
+@property (nonatomic, strong) NSDictionary *plannerIndexesCatalog;
+@property (nonatomic, strong) NSDictionary *plannerIndexesRowCounts;
+
+@property (nonatomic, strong) CDTQQueryPlanCache *planCache;
+
 @end
 
 @implementation CDTQSqlParts
@@ -119,6 +156,9 @@ static const int VERSION = 2;
                                                      options:0
                                                        error:error];
             _textSearchEnabled = [CDTQIndexManager ftsAvailableInDatabase:_database];
+            _indexingQueue = dispatch_queue_create("com.cloudant.sync.query.indexing",
+                                                   DISPATCH_QUEUE_SERIAL);
+            _planCache = [[CDTQQueryPlanCache alloc] initWithCapacity:kCDTQPlanCacheCapacity];
         } else {
             self = nil;
         }
@@ -131,6 +171,7 @@ static const int VERSION = 2;
 {
     // close the database.
     CDTLogDebug(CDTQ_LOGGING_CONTEXT, @"-dealloc CDTQIndexManager %@", self);
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
     [self.database close];
 }
 
@@ -146,7 +187,53 @@ static const int VERSION = 2;
  */
 - (NSDictionary * /* NSString -> NSArray[NSString]*/)listIndexes
 {
-    return [CDTQIndexManager listIndexesInDatabaseQueue:_database];
+    NSDictionary *cached;
+    long long cachedSchemaVersion;
+    NSUInteger generation;
+    @synchronized(self)
+    {
+        cached = _indexCatalog;
+        cachedSchemaVersion = _indexCatalogSchemaVersion;
+        generation = _indexCatalogGeneration;
+    }
+
+    // Creating or deleting an index changes the schema, so the cached definitions
+    // hold as long as the schema version does, whichever manager made the change.
+    __block NSDictionary *indexes;
+    __block long long schemaVersion;
+    [_database inDatabase:^(FMDatabase *db) {
+        schemaVersion = [db longLongForCachedQuery:@"PRAGMA schema_version;"];
+        if (cached && schemaVersion == cachedSchemaVersion) {
+            indexes = cached;
+        } else {
+            indexes = [CDTQIndexManager listIndexesInDatabase:db];
+        }
+    }];
+
+    if (indexes && indexes != cached) {
+        @synchronized(self)
+        {
+            if (generation == _indexCatalogGeneration) {
+                _indexCatalog = indexes;
+                _indexCatalogSchemaVersion = schemaVersion;
+            }
+        }
+    }
+    return indexes;
+}
+
+/**
+ Drop the cached index definitions and the plans made with them. Call after
+ changing the index metadata.
+ */
+- (void)invalidateIndexCatalog
+{
+    @synchronized(self)
+    {
+        _indexCatalog = nil;
+        _indexCatalogGeneration++;
+    }
+    [_planCache removeAllPlans];
 }
 
 + (NSDictionary /* NSString -> NSArray[NSString]*/ *)listIndexesInDatabaseQueue:
@@ -243,9 +330,7 @@ static const int VERSION = 2;
  */
 - (NSString *)ensureIndexed:(NSArray * /* NSString */)fieldNames withName:(NSString *)indexName
 {
-    return [CDTQIndexCreator ensureIndexed:[CDTQIndex index:indexName withFields:fieldNames]
-                                inDatabase:_database
-                             fromDatastore:_datastore];
+    return [self ensureIndexed:fieldNames withName:indexName ofType:CDTQIndexTypeJSON];
 }
 
 #pragma mark Deprecated methods
@@ -298,12 +383,16 @@ static const int VERSION = 2;
                      ofType:(CDTQIndexType)type
                    settings:(NSDictionary *)indexSettings
 {
-    return [CDTQIndexCreator ensureIndexed:[CDTQIndex index:indexName
-                                                 withFields:fieldNames
-                                                       type:type
-                                               withSettings:indexSettings]
-                                inDatabase:_database
-                             fromDatastore:_datastore];
+    CDTQIndex *index =
+        [CDTQIndex index:indexName withFields:fieldNames type:type withSettings:indexSettings];
+
+    // Creating an index indexes existing documents, so it must not overlap a background update.
+    __block NSString *name;
+    dispatch_sync(_indexingQueue, ^{
+        name = [CDTQIndexCreator ensureIndexed:index inDatabase:_database fromDatastore:_datastore];
+    });
+    [self invalidateIndexCatalog];
+    return name;
 }
 
 + (CDTQIndexType)indexTypeForString:(NSString *)string
@@ -346,40 +435,228 @@ static const int VERSION = 2;
 {
     __block BOOL success = YES;
 
-    [_database inTransaction:^(FMDatabase *db, BOOL *rollback) {
+    // The index table must not be dropped while a background update is writing to it.
+    dispatch_sync(_indexingQueue, ^{
+        [_database inTransaction:^(FMDatabase *db, BOOL *rollback) {
 
-        NSString *tableName = [CDTQIndexManager tableNameForIndex:indexName];
-        NSString *sql;
+            NSString *tableName = [CDTQIndexManager tableNameForIndex:indexName];
+            NSString *sql;
 
-        // Drop the index table
-        sql = [NSString stringWithFormat:@"DROP TABLE \"%@\";", tableName];
-        success = success && [db executeUpdate:sql withArgumentsInArray:@[]];
+            // Drop the index table
+            sql = [NSString stringWithFormat:@"DROP TABLE \"%@\";", tableName];
+            success = success && [db executeUpdate:sql withArgumentsInArray:@[]];
 
-        // Delete the metadata entries
-        sql = [NSString
-            stringWithFormat:@"DELETE FROM %@ WHERE index_name = ?", kCDTQIndexMetadataTableName];
-        success = success && [db executeUpdate:sql withArgumentsInArray:@[ indexName ]];
+            // Delete the metadata entries
+            sql = [NSString stringWithFormat:@"DELETE FROM %@ WHERE index_name = ?",
+                                             kCDTQIndexMetadataTableName];
+            success = success && [db executeUpdate:sql withArgumentsInArray:@[ indexName ]];
 
-        if (!success) {
-            CDTLogError(CDTQ_LOG_CONTEXT, @"Failed to delete index: %@", indexName);
-            *rollback = YES;
-        }
-    }];
+            if (!success) {
+                CDTLogError(CDTQ_LOG_CONTEXT, @"Failed to delete index: %@", indexName);
+                *rollback = YES;
+            }
+        }];
+    });
 
+    [self invalidateIndexCatalog];
     return success;
 }
 
 #pragma mark Update indexes
 
 - (BOOL)updateAllIndexes
+{
+    __block BOOL success;
+    dispatch_sync(_indexingQueue, ^{ success = [self updateAllIndexesOnIndexingQueue]; });
+    return success;
+}
+
+/** Only call from the indexing queue **/
+- (BOOL)updateAllIndexesOnIndexingQueue
 {
     // TODO
 
     // To start with, assume top-level fields only
 
     NSDictionary *indexes = [self listIndexes];
-    return
+    BOOL success =
         [CDTQIndexUpdater updateAllIndexes:indexes inDatabase:_database fromDatastore:_datastore];
+    if (success) {
+        [self refreshStatisticsForIndexes:indexes];
+    }
+    return success;
+}
+
+#pragma mark Planner statistics
+
+/**
+ Keep SQLite's statistics for the index tables reasonably fresh, so the query
+ planner can prefer cheaper indexes. ANALYZE runs when an index has never been
+ analysed or enough changes have been indexed since it last ran.
+
+ Only call from the indexing queue.
+ */
+- (void)refreshStatisticsForIndexes:(NSDictionary *)indexes
+{
+    SInt64 lastSequence = _datastore.database.lastSequence;
+
+    if (!self.indexRowCounts) {
+        // Statistics persist in the database, so reuse those from a previous run
+        self.indexRowCounts = [self loadIndexRowCounts];
+        _analyzedIndexNames = [NSSet setWithArray:[self.indexRowCounts allKeys]];
+        _analyzedSequence = lastSequence;
+    }
+
+    NSSet *indexNames = [NSSet setWithArray:[indexes allKeys]];
+    BOOL unanalyzedIndex = ![indexNames isSubsetOfSet:_analyzedIndexNames];
+    if (!unanalyzedIndex && lastSequence - _analyzedSequence < kCDTQAnalyzeSequenceInterval) {
+        return;
+    }
+
+    [_database inDatabase:^(FMDatabase *db) {
+        // Bound the work ANALYZE does on large indexes (ignored by older SQLite versions).
+        // Setting it returns the new limit as a row, so run it as a query.
+        [[db executeQuery:@"PRAGMA analysis_limit = 1000;"] close];
+        if (![db executeUpdate:@"ANALYZE;"]) {
+            CDTLogWarn(CDTQ_LOG_CONTEXT, @"Failed to analyze query indexes: %@", [db lastError]);
+        }
+    }];
+
+    self.indexRowCounts = [self loadIndexRowCounts];
+    _analyzedIndexNames = indexNames;
+    _analyzedSequence = lastSequence;
+}
+
+/**
+ Returns the estimated number of rows in each analysed index's table.
+ */
+- (NSDictionary *)loadIndexRowCounts
+{
+    NSMutableDictionary *rowCounts = [NSMutableDictionary dictionary];
+
+    [_database inDatabase:^(FMDatabase *db) {
+        if (![db tableExists:@"sqlite_stat1"]) {
+            return;
+        }
+
+        // stat is "rows rowsPerKeyPrefix..." for the index on each table
+        FMResultSet *rs =
+            [db executeQuery:@"SELECT tbl, stat FROM sqlite_stat1 WHERE idx IS NOT NULL;"];
+        while ([rs next]) {
+            NSString *table = [rs stringForColumnIndex:0];
+            NSString *stat = [rs stringForColumnIndex:1];
+            if (![table hasPrefix:kCDTQIndexTablePrefix] || stat.length == 0) {
+                continue;
+            }
+            NSString *indexName = [table substringFromIndex:kCDTQIndexTablePrefix.length];
+            NSString *rows = [stat componentsSeparatedByString:@" "][0];
+            rowCounts[indexName] = @([rows longLongValue]);
+        }
+        [rs close];
+    }];
+
+    return [NSDictionary dictionaryWithDictionary:rowCounts];
+}
+
+/**
+ Returns -listIndexes with each analysed index's estimated row count under `rows`,
+ for use by the query planner.
+ */
+- (NSDictionary *)listIndexesWithStatistics
+{
+    NSDictionary *indexes = [self listIndexes];
+    NSDictionary *rowCounts = self.indexRowCounts;
+    if (rowCounts.count == 0) {
+        return indexes;
+    }
+
+    @synchronized(self)
+    {
+        if (_plannerIndexes && _plannerIndexesCatalog == indexes &&
+            _plannerIndexesRowCounts == rowCounts) {
+            return _plannerIndexes;
+        }
+    }
+
+    NSMutableDictionary *withStatistics = [NSMutableDictionary dictionary];
+    for (NSString *indexName in indexes) {
+        NSNumber *rows = rowCounts[indexName];
+        if (rows) {
+            NSMutableDictionary *details = [indexes[indexName] mutableCopy];
+            details[@"rows"] = rows;
+            withStatistics[indexName] = [NSDictionary dictionaryWithDictionary:details];
+        } else {
+            withStatistics[indexName] = indexes[indexName];
+        }
+    }
+
+    NSDictionary *plannerIndexes = [NSDictionary dictionaryWithDictionary:withStatistics];
+    @synchronized(self)
+    {
+        _plannerIndexes = plannerIndexes;
+        _plannerIndexesCatalog = indexes;
+        _plannerIndexesRowCounts = rowCounts;
+    }
+    return plannerIndexes;
+}
+
+- (void)setUpdatesIndexesInBackground:(BOOL)updatesIndexesInBackground
+{
+    @synchronized(self)
+    {
+        if (_updatesIndexesInBackground == updatesIndexesInBackground) {
+            return;
+        }
+        _updatesIndexesInBackground = updatesIndexesInBackground;
+
+        NSNotificationCenter *center = [NSNotificationCenter defaultCenter];
+        if (updatesIndexesInBackground) {
+            [center addObserver:self
+                       selector:@selector(datastoreChanged:)
+                           name:CDTDatastoreChangeNotification
+                         object:_datastore];
+        } else {
+            [center removeObserver:self name:CDTDatastoreChangeNotification object:nil];
+        }
+    }
+
+    if (updatesIndexesInBackground) {
+        // Catch up with anything written before we started observing.
+        [self scheduleBackgroundUpdate];
+    }
+}
+
+- (void)datastoreChanged:(NSNotification *)n { [self scheduleBackgroundUpdate]; }
+
+/**
+ Queue an index update unless one is already waiting to run. A pull or bulk
+ save posts a notification per document; the pending flag collapses them into
+ a single update which picks up every change made before it starts.
+ */
+- (void)scheduleBackgroundUpdate
+{
+    @synchronized(self)
+    {
+        if (_backgroundUpdatePending) {
+            return;
+        }
+        _backgroundUpdatePending = YES;
+    }
+
+    __weak CDTQIndexManager *weakSelf = self;
+    dispatch_async(_indexingQueue, ^{
+        CDTQIndexManager *strongSelf = weakSelf;
+        if (!strongSelf) {
+            return;
+        }
+
+        // Clear before updating so writes made during this update schedule another.
+        @synchronized(strongSelf) { strongSelf.backgroundUpdatePending = NO; }
+
+        if (![strongSelf updateAllIndexesOnIndexingQueue]) {
+            CDTLogWarn(CDTQ_LOG_CONTEXT, @"Background index update failed for %@", strongSelf);
+        }
+    });
 }
 
 #pragma mark Query indexes
@@ -404,16 +681,43 @@ static const int VERSION = 2;
         return nil;
     }
 
-    CDTQQueryExecutor *queryExecutor =
-        [[CDTQQueryExecutor alloc] initWithDatabase:_database datastore:_datastore];
+    CDTQQueryExecutor *queryExecutor = [self queryExecutor];
+    queryExecutor.planCache = _planCache;
     return [queryExecutor find:query
-                  usingIndexes:[self listIndexes]
+                  usingIndexes:[self listIndexesWithStatistics]
                           skip:skip
                          limit:limit
                         fields:fields
                           sort:sortDocument];
 }
 
+- (CDTQPreparedQuery *)prepareQuery:(NSDictionary *)query
+                               skip:(NSUInteger)skip
+                              limit:(NSUInteger)limit
+                             fields:(NSArray *)fields
+                               sort:(NSArray *)sortDocument
+{
+    if (!query) {
+        CDTLogError(CDTQ_LOG_CONTEXT, @"-prepareQuery called with nil selector; bailing.");
+        return nil;
+    }
+
+    return [CDTQPreparedQuery preparedQueryWithSelector:query
+                                                   skip:skip
+                                                  limit:limit
+                                                 fields:fields
+                                                   sort:sortDocument
+                                           indexManager:self];
+}
+
+- (CDTQQueryExecutor *)queryExecutor
+{
+    CDTQQueryExecutor *queryExecutor =
+        [[CDTQQueryExecutor alloc] initWithDatabase:_database datastore:_datastore];
+    queryExecutor.coveringProjectionsEnabled = self.coveringProjectionsEnabled;
+    return queryExecutor;
+}
+
 #pragma mark Utilities
 
 + (NSString *)tableNameForIndex:(NSString *)indexName
@@ -570,6 +874,10 @@ static const int VERSION = 2;
             success = success && [CDTQIndexManager migrate_1_2:db];
         }
 
+        if (version < 3) {
+            success = success && [CDTQIndexManager migrate_2_3:db];
+        }
+
         // Set user_version unconditionally
         NSString *sql = [NSString stringWithFormat:@"pragma user_version = %d", currentVersion];
         success = success && [db executeUpdate:sql];
@@ -598,4 +906,14 @@ static const int VERSION = 2;
     return [db executeUpdate:SCHEMA_INDEX];
 }
 
++ (BOOL)migrate_2_3:(FMDatabase *)db
+{
+    // New indexes start out projectable until the updater indexes a value which isn't.
+    // Existing indexes were built without checking their values, so none are.
+    NSString *SCHEMA_INDEX = @"ALTER TABLE _t_cloudant_sync_query_metadata "
+                             @"        ADD COLUMN projectable INTEGER NOT NULL DEFAULT 1;";
+    return [db executeUpdate:SCHEMA_INDEX] &&
+           [db executeUpdate:@"UPDATE _t_cloudant_sync_query_metadata SET projectable = 0;"];
+}
+
 @end
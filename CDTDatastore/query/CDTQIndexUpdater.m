@@ -81,23 +81,19 @@
 
 - (BOOL)updateAllIndexes:(NSDictionary /*NSString -> NSArray[NSString]*/ *)indexes
 {
-    BOOL success = YES;
-
+    NSMutableDictionary *fieldNamesByIndex = [NSMutableDictionary dictionary];
     for (NSString *indexName in [indexes allKeys]) {
-        NSArray *fields = indexes[indexName][@"fields"];
-        success = [self updateIndex:indexName withFields:fields error:nil];
+        fieldNamesByIndex[indexName] = indexes[indexName][@"fields"];
     }
 
-    return success;
+    return [self updateIndexes:fieldNamesByIndex];
 }
 
 - (BOOL)updateIndex:(NSString *)indexName
          withFields:(NSArray /* NSString */ *)fieldNames
               error:(NSError *__autoreleasing *)error
 {
-    BOOL success = [self updateIndex:indexName
-                          fieldNames:fieldNames
-                    startingSequence:[self sequenceNumberForIndex:indexName]];
+    BOOL success = [self updateIndexes:@{indexName : fieldNames}];
 
     // raise error
     if (!success) {
@@ -115,13 +111,31 @@
     return success;
 }
 
-- (BOOL)updateIndex:(NSString *)indexName
-          fieldNames:(NSArray /* NSString */ *)fieldNames
-    startingSequence:(SequenceNumber)lastSequence
+/**
+ Brings a set of indexes up to date with a single pass over the changes feed.
+
+ The pass starts from the sequence of the index that is furthest behind. Each changed
+ document is loaded once and written to every index in the same transaction. Re-indexing
+ a document in an index that had already seen it writes the same rows again, so indexes
+ that are further ahead stay correct.
+ */
+- (BOOL)updateIndexes:(NSDictionary /* NSString -> NSArray[NSString] */ *)fieldNamesByIndex
 {
+    if (fieldNamesByIndex.count == 0) {
+        return YES;
+    }
+
     __block bool success = YES;
 
-    NSString *lastSeqString = [[NSNumber numberWithLongLong:lastSequence] stringValue];
+    NSMutableDictionary *lastSequences = [NSMutableDictionary dictionary];
+    SequenceNumber startSequence = LLONG_MAX;
+    for (NSString *indexName in fieldNamesByIndex) {
+        SequenceNumber lastSequence = [self sequenceNumberForIndex:indexName];
+        lastSequences[indexName] = @(lastSequence);
+        startSequence = MIN(startSequence, lastSequence);
+    }
+
+    NSString *lastSeqString = [[NSNumber numberWithLongLong:startSequence] stringValue];
     CDTFetchChanges *fetcher =
         [[CDTFetchChanges alloc] initWithDatastore:_datastore startSequenceValue:lastSeqString];
 
@@ -132,16 +146,15 @@
 
     fetcher.documentChangedBlock = ^(CDTDocumentRevision *revision) {
 
-      CDTLogVerbose(CDTQ_LOG_CONTEXT, @"documentChangedBlock: <%@,%@>", indexName, revision.docId);
+      CDTLogVerbose(CDTQ_LOG_CONTEXT, @"documentChangedBlock: <%@>", revision.docId);
 
       [updateBatch addObject:revision];
 
       if (updateBatch.count > 500) {
           CDTQIndexUpdater *self = weakSelf;
           if (self) {
-              success =
-                  success &&
-                  [self processUpdateBatch:updateBatch forIndex:indexName fieldNames:fieldNames];
+              success = success && [self processUpdateBatch:updateBatch
+                                                 forIndexes:fieldNamesByIndex];
               [updateBatch removeAllObjects];
           }
       }
@@ -150,14 +163,15 @@
 
     fetcher.documentWithIDWasDeletedBlock = ^(NSString *docId) {
 
-      CDTLogVerbose(CDTQ_LOG_CONTEXT, @"documentWithIDWasDeletedBlock: <%@,%@>", indexName, docId);
+      CDTLogVerbose(CDTQ_LOG_CONTEXT, @"documentWithIDWasDeletedBlock: <%@>", docId);
 
       [deleteBatch addObject:docId];
 
       if (deleteBatch.count > 500) {
           CDTQIndexUpdater *self = weakSelf;
           if (self) {
-              success = success && [self processDeleteBatch:deleteBatch forIndex:indexName];
+              success = success && [self processDeleteBatch:deleteBatch
+                                                 forIndexes:fieldNamesByIndex];
               [deleteBatch removeAllObjects];
           }
       }
@@ -167,20 +181,23 @@
     fetcher.fetchRecordChangesCompletionBlock = ^(NSString *newSeqVal, NSString *prevSeqVal,
                                                   NSError *error) {
 
-      CDTLogVerbose(CDTQ_LOG_CONTEXT, @"fetchRecordChangesCompletionBlock: <%@,%@>", indexName,
-                    newSeqVal);
+      CDTLogVerbose(CDTQ_LOG_CONTEXT, @"fetchRecordChangesCompletionBlock: <%@>", newSeqVal);
 
       CDTQIndexUpdater *self = weakSelf;
       if (self) {
           // Process any remaining updates and deletes
-          success = success &&
-                    [self processUpdateBatch:updateBatch forIndex:indexName fieldNames:fieldNames];
+          success = success && [self processUpdateBatch:updateBatch forIndexes:fieldNamesByIndex];
           [updateBatch removeAllObjects];
-          success = success && [self processDeleteBatch:deleteBatch forIndex:indexName];
+          success = success && [self processDeleteBatch:deleteBatch forIndexes:fieldNamesByIndex];
           [deleteBatch removeAllObjects];
 
           if (success) {
-              [self updateMetadataForIndex:indexName lastSequence:[newSeqVal longLongValue]];
+              for (NSString *indexName in fieldNamesByIndex) {
+                  // An index that was ahead of the pass keeps its own sequence.
+                  SequenceNumber lastSequence =
+                      MAX([newSeqVal longLongValue], [lastSequences[indexName] longLongValue]);
+                  [self updateMetadataForIndex:indexName lastSequence:lastSequence];
+              }
           }
       }
 
@@ -192,39 +209,60 @@
 }
 
 - (BOOL)processUpdateBatch:(NSArray *)updateBatch
-                  forIndex:(NSString *)indexName
-                fieldNames:(NSArray /* NSString */ *)fieldNames
+                forIndexes:(NSDictionary /* NSString -> NSArray[NSString] */ *)fieldNamesByIndex
 {
     __block BOOL success = YES;
 
     [_database inTransaction:^(FMDatabase *db, BOOL *rollback) {
 
+        // Index name -> fields given a value the index can't reproduce
+        NSMutableDictionary *unprojectableFields = [NSMutableDictionary dictionary];
+
         for (CDTDocumentRevision *revision in updateBatch) {
-            // Delete existing values
-            CDTQSqlParts *parts = [CDTQIndexUpdater partsToDeleteIndexEntriesForDocId:revision.docId
-                                                                            fromIndex:indexName];
-            [db executeUpdate:parts.sqlWithPlaceholders
-                withArgumentsInArray:parts.placeholderValues];
-
-            // Insert new values as the rev isn't deleted
-
-            // If we are indexing a document where one field is an array, we
-            // have multiple rows to insert into the index.
-            NSArray *insertStatements = [CDTQIndexUpdater partsToIndexRevision:revision
-                                                                       inIndex:indexName
-                                                                withFieldNames:fieldNames];
-
-            for (CDTQSqlParts *insert in insertStatements) {
-                // partsToIndexRevision:... returns nil if there are no applicable fields to
-                // index
-                if (insert) {
-                    success = success && [db executeUpdate:insert.sqlWithPlaceholders
-                                             withArgumentsInArray:insert.placeholderValues];
+            for (NSString *indexName in fieldNamesByIndex) {
+                for (NSString *fieldName in fieldNamesByIndex[indexName]) {
+                    NSObject *value = [CDTQValueExtractor extractValueForFieldName:fieldName
+                                                                    fromDictionary:revision.body];
+                    if (![CDTQIndexUpdater isProjectableValue:value]) {
+                        if (!unprojectableFields[indexName]) {
+                            unprojectableFields[indexName] = [NSMutableSet set];
+                        }
+                        [unprojectableFields[indexName] addObject:fieldName];
+                    }
+                }
+
+                // Delete existing values
+                CDTQSqlParts *parts =
+                    [CDTQIndexUpdater partsToDeleteIndexEntriesForDocId:revision.docId
+                                                              fromIndex:indexName];
+                [db executeUpdate:parts.sqlWithPlaceholders
+                    withArgumentsInArray:parts.placeholderValues];
+
+                // Insert new values as the rev isn't deleted
+
+                // If we are indexing a document where one field is an array, we
+                // have multiple rows to insert into the index.
+                NSArray *insertStatements =
+                    [CDTQIndexUpdater partsToIndexRevision:revision
+                                                   inIndex:indexName
+                                            withFieldNames:fieldNamesByIndex[indexName]];
+
+                for (CDTQSqlParts *insert in insertStatements) {
+                    // partsToIndexRevision:... returns nil if there are no applicable fields to
+                    // index
+                    if (insert) {
+                        success = success && [db executeUpdate:insert.sqlWithPlaceholders
+                                                 withArgumentsInArray:insert.placeholderValues];
+                    }
+
+                    if (!success) {
+                        CDTLogError(CDTQ_LOG_CONTEXT, @"Updating index %@ failed, CDTSqlParts: %@",
+                                    indexName, insert);
+                        break;
+                    }
                 }
 
                 if (!success) {
-                    CDTLogError(CDTQ_LOG_CONTEXT, @"Updating index %@ failed, CDTSqlParts: %@",
-                                indexName, insert);
                     break;
                 }
             }
@@ -235,23 +273,74 @@
                 break;
             }
         }
+
+        if (success) {
+            success = [CDTQIndexUpdater markFieldsUnprojectable:unprojectableFields inDatabase:db];
+            *rollback = !success;
+        }
     }];
 
     return success;
 }
 
-- (BOOL)processDeleteBatch:(NSArray *)deleteBatch forIndex:(NSString *)indexName
+/**
+ Returns whether `value` reads back from an index column just as it is in the
+ document: a string, or a number other than a boolean, which SQLite stores as an
+ integer. Missing and null values are stored as NULL, which makes a projection
+ load the document, so they're projectable too.
+
+ Arrays aren't, as a single-element array is indexed just like a scalar, and
+ nor are sub-documents.
+ */
++ (BOOL)isProjectableValue:(NSObject *)value
+{
+    if (value == nil || value == [NSNull null] || [value isKindOfClass:[NSString class]]) {
+        return YES;
+    }
+    if ([value isKindOfClass:[NSNumber class]]) {
+        return CFGetTypeID((__bridge CFTypeRef)value) != CFBooleanGetTypeID();
+    }
+    return NO;
+}
+
+/**
+ Clear the `projectable` flag in the metadata of each index's fields in
+ `fieldsByIndex` (index name -> NSSet of field names). Once cleared, a field
+ stays unprojectable for the life of the index.
+ */
++ (BOOL)markFieldsUnprojectable:(NSDictionary *)fieldsByIndex inDatabase:(FMDatabase *)db
+{
+    NSString *sql = [NSString stringWithFormat:@"UPDATE %@ SET projectable = 0 "
+                                               @"WHERE index_name = ? AND field_name = ? "
+                                               @"AND projectable != 0;",
+                                               kCDTQIndexMetadataTableName];
+    for (NSString *indexName in fieldsByIndex) {
+        for (NSString *fieldName in fieldsByIndex[indexName]) {
+            if (![db executeUpdate:sql, indexName, fieldName]) {
+                CDTLogError(CDTQ_LOG_CONTEXT, @"Updating metadata of index %@ failed: %@",
+                            indexName, [db lastErrorMessage]);
+                return NO;
+            }
+        }
+    }
+    return YES;
+}
+
+- (BOOL)processDeleteBatch:(NSArray *)deleteBatch
+                forIndexes:(NSDictionary /* NSString -> NSArray[NSString] */ *)fieldNamesByIndex
 {
     __block BOOL success = YES;
 
     [_database inTransaction:^(FMDatabase *db, BOOL *rollback) {
 
         for (NSString *docId in deleteBatch) {
-            // Delete existing values
-            CDTQSqlParts *parts =
-                [CDTQIndexUpdater partsToDeleteIndexEntriesForDocId:docId fromIndex:indexName];
-            [db executeUpdate:parts.sqlWithPlaceholders
-                withArgumentsInArray:parts.placeholderValues];
+            for (NSString *indexName in fieldNamesByIndex) {
+                // Delete existing values
+                CDTQSqlParts *parts =
+                    [CDTQIndexUpdater partsToDeleteIndexEntriesForDocId:docId fromIndex:indexName];
+                [db executeUpdate:parts.sqlWithPlaceholders
+                    withArgumentsInArray:parts.placeholderValues];
+            }
         }
 
     }];
@@ -0,0 +1,77 @@
+//
+//  CDTQPreparedQuery.h
+//
+//  Copyright © 2018 IBM Corporation. All rights reserved.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//  except in compliance with the License. You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+//  Unless required by applicable law or agreed to in writing, software distributed under the
+//  License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//  either express or implied. See the License for the specific language governing permissions
+//  and limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class CDTQIndexManager;
+@class CDTQResultSet;
+
+/**
+ Stands in for a value in a selector passed to -[CDTQIndexManager prepareQuery:...].
+
+ Placeholders can be used wherever a selector takes a single string or number,
+ such as the operand of $eq, $gt or $text's $search, or an element of an $in list.
+ */
+@interface CDTQPlaceholder : NSObject
+
+@property (nonatomic, strong, readonly) NSString *name;
+
++ (instancetype)placeholderNamed:(NSString *)name;
+
+@end
+
+/**
+ A query which has been validated and translated once, to be run many times
+ with different values for its placeholders:
+
+ CDTQPlaceholder *prefix = [CDTQPlaceholder placeholderNamed:@"prefix"];
+ CDTQPreparedQuery *q = [im prepareQuery:@{ @"name" : @{ @"$gte" : prefix } }
+                                    skip:0
+                                   limit:20
+                                  fields:nil
+                                    sort:nil];
+ CDTQResultSet *results = [q findWithValues:@{ @"prefix" : @"mi" }];
+
+ Each run uses the same SQL, so SQLite can reuse its compiled statements. The
+ query is translated again only if the indexes have changed since the last run.
+
+ Safe to run from multiple threads.
+ */
+@interface CDTQPreparedQuery : NSObject
+
+/** The names of the placeholders which need a value to run the query. */
+@property (nonatomic, strong, readonly) NSSet<NSString *> *placeholderNames;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ Run the query with `values` in place of its placeholders.
+
+ @param values a string or number for each of the placeholder names.
+ @return the results, or `nil` if a value is missing or invalid or an error occurred.
+ */
+- (nullable CDTQResultSet *)findWithValues:(NSDictionary<NSString *, NSObject *> *)values;
+
+/** Internal */
++ (nullable instancetype)preparedQueryWithSelector:(NSDictionary *)query
+                                              skip:(NSUInteger)skip
+                                             limit:(NSUInteger)limit
+                                            fields:(nullable NSArray *)fields
+                                              sort:(nullable NSArray *)sortDocument
+                                      indexManager:(CDTQIndexManager *)indexManager;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,179 @@
+//
+//  CDTQPreparedQuery.m
+//
+//  Copyright © 2018 IBM Corporation. All rights reserved.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//  except in compliance with the License. You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+//  Unless required by applicable law or agreed to in writing, software distributed under the
+//  License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//  either express or implied. See the License for the specific language governing permissions
+//  and limitations under the License.
+
+#import "CDTQPreparedQuery.h"
+
+#import "CDTLogging.h"
+#import "CDTQIndexManager.h"
+#import "CDTQQueryExecutor.h"
+#import "CDTQQueryPlanCache.h"
+
+@interface CDTQIndexManager (PreparedQueries)
+- (NSDictionary *)listIndexesWithStatistics;
+- (CDTQQueryExecutor *)queryExecutor;
+@end
+
+@interface CDTQPlaceholder ()
+@property (nonatomic, strong, readwrite) NSString *name;
+@end
+
+@interface CDTQPreparedQuery ()
+
+@property (nonatomic, strong) CDTQIndexManager *indexManager;
+
+// The selector with each placeholder replaced by a token string unique to this
+// query, which stands in for the value through validation and translation.
+@property (nonatomic, strong) NSDictionary *selector;
+@property (nonatomic, strong) NSDictionary *tokensByName;
+
+@property (nonatomic) NSUInteger skip;
+@property (nonatomic) NSUInteger limit;
+@property (nonatomic, strong) NSArray *fields;
+@property (nonatomic, strong) NSArray *sortDocument;
+
+// Plan for the tokenised selector, made with the indexes of the latest run
+@property (strong) CDTQQueryPlan *plan;
+
+@end
+
+@implementation CDTQPlaceholder
+
++ (instancetype)placeholderNamed:(NSString *)name
+{
+    NSParameterAssert(name);
+
+    CDTQPlaceholder *placeholder = [[CDTQPlaceholder alloc] init];
+    placeholder.name = name;
+    return placeholder;
+}
+
+- (NSString *)description { return [NSString stringWithFormat:@"<placeholder %@>", self.name]; }
+
+@end
+
+@implementation CDTQPreparedQuery
+
++ (instancetype)preparedQueryWithSelector:(NSDictionary *)query
+                                     skip:(NSUInteger)skip
+                                    limit:(NSUInteger)limit
+                                   fields:(NSArray *)fields
+                                     sort:(NSArray *)sortDocument
+                             indexManager:(CDTQIndexManager *)indexManager
+{
+    CDTQPreparedQuery *prepared = [[CDTQPreparedQuery alloc] init];
+    prepared.indexManager = indexManager;
+    prepared.skip = skip;
+    prepared.limit = limit;
+    prepared.fields = fields;
+    prepared.sortDocument = sortDocument;
+
+    NSString *prefix = [[NSUUID UUID] UUIDString];
+    NSMutableDictionary *tokensByName = [NSMutableDictionary dictionary];
+    prepared.selector =
+        [CDTQPreparedQuery replacePlaceholdersInObject:query
+                                            withPrefix:prefix
+                                          tokensByName:tokensByName];
+    prepared.tokensByName = [NSDictionary dictionaryWithDictionary:tokensByName];
+
+    // Translate now, so an invalid selector is reported when it's prepared
+    if (![prepared planForIndexes:[indexManager listIndexesWithStatistics]]) {
+        return nil;
+    }
+
+    return prepared;
+}
+
++ (id)replacePlaceholdersInObject:(id)object
+                       withPrefix:(NSString *)prefix
+                     tokensByName:(NSMutableDictionary *)tokensByName
+{
+    if ([object isKindOfClass:[CDTQPlaceholder class]]) {
+        NSString *name = ((CDTQPlaceholder *)object).name;
+        if (!tokensByName[name]) {
+            tokensByName[name] = [NSString stringWithFormat:@"%@:%@", prefix, name];
+        }
+        return tokensByName[name];
+    } else if ([object isKindOfClass:[NSDictionary class]]) {
+        NSMutableDictionary *replaced = [NSMutableDictionary dictionary];
+        for (id key in (NSDictionary *)object) {
+            replaced[key] = [self replacePlaceholdersInObject:object[key]
+                                                   withPrefix:prefix
+                                                 tokensByName:tokensByName];
+        }
+        return [NSDictionary dictionaryWithDictionary:replaced];
+    } else if ([object isKindOfClass:[NSArray class]]) {
+        NSMutableArray *replaced = [NSMutableArray arrayWithCapacity:[object count]];
+        for (id value in (NSArray *)object) {
+            [replaced addObject:[self replacePlaceholdersInObject:value
+                                                       withPrefix:prefix
+                                                     tokensByName:tokensByName]];
+        }
+        return [NSArray arrayWithArray:replaced];
+    } else {
+        return object;
+    }
+}
+
+- (NSSet *)placeholderNames { return [NSSet setWithArray:[self.tokensByName allKeys]]; }
+
+/**
+ Returns the plan for the tokenised selector against `indexes`, translating it
+ again only if the indexes differ from those of the last plan.
+ */
+- (CDTQQueryPlan *)planForIndexes:(NSDictionary *)indexes
+{
+    CDTQQueryPlan *plan = self.plan;
+    if (plan && [plan.indexes isEqualToDictionary:indexes]) {
+        return plan;
+    }
+
+    plan = [[self.indexManager queryExecutor] planQuery:self.selector
+                                           usingIndexes:indexes
+                                                   skip:self.skip
+                                                  limit:self.limit
+                                                 fields:self.fields
+                                                   sort:self.sortDocument];
+    self.plan = plan;
+    return plan;
+}
+
+- (CDTQResultSet *)findWithValues:(NSDictionary *)values
+{
+    NSMutableDictionary *valuesByToken = [NSMutableDictionary dictionary];
+    for (NSString *name in self.tokensByName) {
+        NSObject *value = values[name];
+        if (!value) {
+            CDTLogError(CDTQ_LOG_CONTEXT, @"No value given for placeholder %@", name);
+            return nil;
+        }
+        if (![value isKindOfClass:[NSString class]] && ![value isKindOfClass:[NSNumber class]]) {
+            CDTLogError(CDTQ_LOG_CONTEXT,
+                        @"Only types NSString and NSNumber can be used for placeholder %@", name);
+            return nil;
+        }
+        valuesByToken[self.tokensByName[name]] = value;
+    }
+
+    if (![self.indexManager updateAllIndexes]) {
+        return nil;
+    }
+
+    CDTQQueryPlan *plan = [self planForIndexes:[self.indexManager listIndexesWithStatistics]];
+    if (!plan) {
+        return nil;
+    }
+
+    return [[self.indexManager queryExecutor] executePlan:[plan planByBindingValues:valuesByToken]];
+}
+
+@end
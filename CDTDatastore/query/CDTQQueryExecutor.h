@@ -19,6 +19,9 @@ NS_ASSUME_NONNULL_BEGIN
 @class CDTDatastore;
 @class CDTQResultSet;
 @class CDTQSqlParts;
+@class CDTQQueryNode;
+@class CDTQQueryPlan;
+@class CDTQQueryPlanCache;
 @class FMDatabaseQueue;
 
 /**
@@ -33,6 +36,26 @@ NS_ASSUME_NONNULL_BEGIN
 - (instancetype)initWithDatabase:(FMDatabaseQueue *)database
                        datastore:(CDTDatastore *)datastore;
 
+/**
+ When YES, queries with a projection whose fields are all in one JSON index, and
+ which need no post-hoc matching, build their results from that index's columns
+ instead of loading documents.
+
+ Such revisions are reconstructed from indexed values, so they carry no attachments
+ or sequence. Fields which have been given a value the index can't reproduce
+ exactly, such as an array, a boolean or a sub-document, are still projected by
+ loading documents, as are indexes built before the index database recorded this.
+
+ Defaults to NO.
+ */
+@property (nonatomic) BOOL coveringProjectionsEnabled;
+
+/**
+ Cache of plans from previous queries. When set, repeating a query against the
+ same indexes skips its validation and translation.
+ */
+@property (nullable, nonatomic, strong) CDTQQueryPlanCache *planCache;
+
 /**
  Execute the query passed using the selection of index definition provided.
 
@@ -55,16 +78,49 @@ NS_ASSUME_NONNULL_BEGIN
                                      sortDocument;
 
 /**
- Return SQL to get ordered list of docIds.
+ Validate and translate a query into a plan for executing it against `indexes`,
+ without running it. Parameters are as for
+ -find:usingIndexes:skip:limit:fields:sort:.
+
+ @return the plan, or `nil` if the query is invalid.
+ */
+- (nullable CDTQQueryPlan *)planQuery:(NSDictionary<NSString *, NSObject *> *)query
+                         usingIndexes:(NSDictionary *)indexes
+                                 skip:(NSUInteger)skip
+                                limit:(NSUInteger)limit
+                               fields:(nullable NSArray<NSString *> *)fields
+                                 sort:(nullable NSArray<NSDictionary *> *)sortDocument;
+
+/**
+ Execute a plan from -planQuery:usingIndexes:skip:limit:fields:sort:.
+
+ @return the results, or `nil` if an error occurred.
+ */
+- (nullable CDTQResultSet *)executePlan:(CDTQQueryPlan *)plan;
+
+/**
+ Return the name of a JSON index which contains all of `fields`, or nil if none do.
+ */
++ (nullable NSString *)chooseCoveringIndexForFields:(NSArray<NSString *> *)fields
+                                        fromIndexes:(NSDictionary *)indexes;
+
+/**
+ Return SQL to get the final ordered, skipped and limited list of docIds for a
+ query tree, for queries which don't need post-hoc matching.
 
- @param sortDocument Array of ordering definitions `@[ @{"fieldName": "asc"}, @{@"fieldName2",
- @"asc"} ]`
+ @param root query tree from CDTQQuerySqlTranslator
+ @param sortDocument Array of ordering definitions, nil to have no sorting
  @param indexes dictionary of indexes
+ @param skip how many results to skip (0 for none)
+ @param limit maximum number of results (0 for no limit)
+ @return SQL, or `nil` if the tree or sort can't be executed as a single statement.
  */
-+ (nullable CDTQSqlParts *)sqlToSortIds:(NSSet<NSString *> *)docIdSet
-                             usingOrder:
-                                 (NSArray<NSDictionary<NSString *, NSString *> *> *)sortDocument
-                                indexes:(NSDictionary<NSString *, NSString *> *)indexes;
++ (nullable CDTQSqlParts *)sqlForQueryTree:(CDTQQueryNode *)root
+                                 usingSort:(nullable NSArray<NSDictionary<NSString *, NSString *> *> *)
+                                               sortDocument
+                                   indexes:(NSDictionary *)indexes
+                                      skip:(NSUInteger)skip
+                                     limit:(NSUInteger)limit;
 
 @end
 
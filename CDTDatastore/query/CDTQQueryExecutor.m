@@ -23,10 +23,14 @@
 #import "CDTDatastore.h"
 #import "CDTDocumentRevision.h"
 #import "CDTQQueryValidator.h"
+#import "CDTQQueryPlanCache.h"
+#import "CDTQValueExtractor.h"
 
+#import "FMDatabase+StatementCache.h"
 #import <FMDB/FMDB.h>
 
-const NSUInteger kSmallResultSetSizeThreshold = 500;
+// Number of documents loaded at a time to read unindexed sort fields
+static const NSUInteger kSortDocumentBatchSize = 50;
 
 @interface CDTQQueryExecutor ()
 
@@ -55,6 +59,45 @@ const NSUInteger kSmallResultSetSizeThreshold = 500;
                   limit:(NSUInteger)limit
                  fields:(NSArray *)fields
                    sort:(NSArray *)sortDocument
+{
+    NSString *planKey = nil;
+    CDTQQueryPlan *plan = nil;
+    if (self.planCache) {
+        planKey = [CDTQQueryPlanCache keyForQuery:query
+                                             skip:skip
+                                            limit:limit
+                                           fields:fields
+                                             sort:sortDocument
+                              coveringProjections:self.coveringProjectionsEnabled];
+        if (planKey) {
+            plan = [self.planCache planForKey:planKey indexes:indexes];
+        }
+    }
+
+    if (!plan) {
+        plan = [self planQuery:query
+                  usingIndexes:indexes
+                          skip:skip
+                         limit:limit
+                        fields:fields
+                          sort:sortDocument];
+        if (!plan) {
+            return nil;
+        }
+        if (planKey) {
+            [self.planCache setPlan:plan forKey:planKey];
+        }
+    }
+
+    return [self executePlan:plan];
+}
+
+- (CDTQQueryPlan *)planQuery:(NSDictionary *)query
+                usingIndexes:(NSDictionary *)indexes
+                        skip:(NSUInteger)skip
+                       limit:(NSUInteger)limit
+                      fields:(NSArray *)fields
+                        sort:(NSArray *)sortDocument
 {
     //
     // Validate inputs
@@ -79,7 +122,7 @@ const NSUInteger kSmallResultSetSizeThreshold = 500;
     }
 
     //
-    // Execute the query
+    // Translate the query
     //
 
     // YES if we need to run posthoc matcher
@@ -92,30 +135,58 @@ const NSUInteger kSmallResultSetSizeThreshold = 500;
         return nil;
     }
 
+    CDTQUnindexedMatcher *matcher = [self matcherForIndexCoverage:indexesCoverQuery selector:query];
+
+    // Without a matcher every ID the indexes return is a result, so ordering, skip
+    // and limit can be done by SQLite rather than on the full ID list.
+    CDTQSqlParts *pushedDown = nil;
+    if (!matcher) {
+        pushedDown = [CDTQQueryExecutor sqlForQueryTree:root
+                                              usingSort:sortDocument
+                                                indexes:indexes
+                                                   skip:skip
+                                                  limit:limit];
+    }
+
+    NSString *coveringIndex = nil;
+    if (self.coveringProjectionsEnabled && !matcher && fields) {
+        coveringIndex = [CDTQQueryExecutor chooseCoveringIndexForFields:fields fromIndexes:indexes];
+    }
+
+    CDTQQueryPlan *plan = [[CDTQQueryPlan alloc] init];
+    plan.indexes = indexes;
+    plan.selector = query;
+    plan.fields = fields;
+    plan.sortDocument = sortDocument;
+    plan.skip = skip;
+    plan.limit = limit;
+    plan.root = root;
+    plan.matcher = matcher;
+    plan.pushedDown = pushedDown;
+    plan.coveringIndex = coveringIndex;
+    return plan;
+}
+
+- (CDTQResultSet *)executePlan:(CDTQQueryPlan *)plan
+{
+    CDTQSqlParts *pushedDown = plan.pushedDown;
+
     __block NSArray *docIds;
 
     [_database inTransaction:^(FMDatabase *db, BOOL *rollback) {
-        NSSet *docIdSet = [self executeQueryTree:root inDatabase:db];
-
-        // sorting
-        if (sortDocument != nil && sortDocument.count > 0) {
-            docIds = [CDTQQueryExecutor sortIds:docIdSet
-                                      usingSort:sortDocument
-                                        indexes:indexes
-                                     inDatabase:db];
-        } else {
-            docIds = [docIdSet allObjects];
+        if (![CDTQQueryExecutor createTemporaryTablesInDatabase:db]) {
+            return;
         }
+        docIds = [self docIdsForPlan:plan inDatabase:db];
+        [CDTQQueryExecutor clearTemporaryTablesInDatabase:db];
     }];
 
-    // nil if an error during sorting
+    // nil if an error evaluating or sorting the query
     if (docIds == nil) {
         return nil;
     }
 
-    CDTQUnindexedMatcher *matcher = [self matcherForIndexCoverage:indexesCoverQuery selector:query];
-
-    if (matcher) {
+    if (plan.matcher) {
         CDTLogWarn(CDTQ_LOG_CONTEXT,
                    @"Query could not be executed using indexes alone; falling back to filtering "
                    @"documents themselves. This will be VERY SLOW as each candidate document is "
@@ -123,16 +194,64 @@ const NSUInteger kSmallResultSetSizeThreshold = 500;
     }
 
     CDTDatastore *ds = self.datastore;
+    FMDatabaseQueue *indexDatabase = self.database;
     return [CDTQResultSet resultSetWithBlock:^(CDTQResultSetBuilder *b) {
         b.docIds = docIds;
         b.datastore = ds;
-        b.fields = fields;
-        b.skip = skip;
-        b.limit = limit;
-        b.matcher = matcher;
+        b.fields = plan.fields;
+        b.skip = pushedDown ? 0 : plan.skip;  // already applied by the SQL
+        b.limit = pushedDown ? 0 : plan.limit;
+        b.matcher = plan.matcher;
+        b.coveringIndex = plan.coveringIndex;
+        b.indexDatabase = indexDatabase;
     }];
 }
 
+/**
+ Returns the IDs of the documents matched by a plan's tree, in sort order if
+ the plan has a sort, or `nil` on error.
+ */
+- (NSArray *)docIdsForPlan:(CDTQQueryPlan *)plan inDatabase:(FMDatabase *)db
+{
+    CDTQSqlParts *pushedDown = plan.pushedDown;
+    if (pushedDown) {
+        NSArray *arguments =
+            [CDTQQueryExecutor argumentsForParameters:pushedDown.placeholderValues inDatabase:db];
+        if (!arguments) {
+            return nil;
+        }
+
+        NSMutableArray *resultIds = [NSMutableArray array];
+        FMResultSet *rs =
+            [db executeCachedQuery:pushedDown.sqlWithPlaceholders withArgumentsInArray:arguments];
+        while ([rs next]) {
+            [resultIds addObject:[rs stringForColumnIndex:0]];
+        }
+        [rs close];
+        return [NSArray arrayWithArray:resultIds];
+    }
+
+    if (plan.sortDocument.count == 0) {
+        return [[self executeQueryTree:plan.root inDatabase:db] allObjects];
+    }
+
+    // Sort the candidates where they are, rather than binding them back into SQL
+    if (![self loadCandidatesForQueryTree:plan.root inDatabase:db]) {
+        return nil;
+    }
+
+    // Without a matcher, only the first skip + limit sorted IDs can be results
+    NSUInteger sortLimit = 0;
+    if (!plan.matcher && plan.limit > 0 && plan.limit <= NSUIntegerMax - plan.skip) {
+        sortLimit = plan.skip + plan.limit;
+    }
+    return [CDTQQueryExecutor sortCandidatesUsingSort:plan.sortDocument
+                                              indexes:plan.indexes
+                                                limit:sortLimit
+                                            datastore:self.datastore
+                                           inDatabase:db];
+}
+
 // Method exists so we can override it in testing (to force indexesCoverQuery to false)
 - (CDTQChildrenQueryNode *)translateQuery:(NSDictionary *)query
                                   indexes:(NSDictionary *)indexes
@@ -229,20 +348,51 @@ const NSUInteger kSmallResultSetSizeThreshold = 500;
 #pragma mark Tree walking
 
 - (NSSet *)executeQueryTree:(CDTQQueryNode *)node inDatabase:(FMDatabase *)db
+{
+    // Prefer letting SQLite evaluate the whole tree in one statement, which avoids
+    // materialising the document IDs matched by each node.
+    CDTQSqlParts *compound = [CDTQQuerySqlTranslator selectStatementForQueryTree:node];
+    if (compound) {
+        NSArray *arguments =
+            [CDTQQueryExecutor argumentsForParameters:compound.placeholderValues inDatabase:db];
+        if (!arguments) {
+            return nil;
+        }
+
+        NSMutableSet *docIds = [NSMutableSet set];
+        FMResultSet *rs =
+            [db executeCachedQuery:compound.sqlWithPlaceholders withArgumentsInArray:arguments];
+        while ([rs next]) {
+            [docIds addObject:[rs stringForColumnIndex:0]];
+        }
+        [rs close];
+        return [NSSet setWithSet:docIds];
+    }
+
+    return [self interpretQueryTree:node inDatabase:db];
+}
+
+/**
+ Evaluates a tree node by node, combining document ID sets in code. Only needed
+ when part of the tree has no SQL and so can't be run as a single statement.
+ */
+- (NSSet *)interpretQueryTree:(CDTQQueryNode *)node inDatabase:(FMDatabase *)db
 {
     if ([node isKindOfClass:[CDTQAndQueryNode class]]) {
         NSMutableSet *accumulator = nil;
 
         CDTQAndQueryNode *andNode = (CDTQAndQueryNode *)node;
         for (CDTQQueryNode *node in andNode.children) {
-            NSSet *childIds = [self executeQueryTree:node inDatabase:db];
+            NSSet *childIds = [self interpretQueryTree:node inDatabase:db];
             if (!accumulator) {
                 accumulator = [NSMutableSet setWithSet:childIds];
             } else {
                 [accumulator intersectSet:childIds];
             }
 
-            // TODO optimisation is to bail here if accumlator is empty
+            if (accumulator.count == 0) {
+                break;  // no later child can add results to an empty intersection
+            }
         }
 
         return [NSSet setWithSet:accumulator];
@@ -252,7 +402,7 @@ const NSUInteger kSmallResultSetSizeThreshold = 500;
 
         CDTQOrQueryNode *andNode = (CDTQOrQueryNode *)node;
         for (CDTQQueryNode *node in andNode.children) {
-            NSSet *childIds = [self executeQueryTree:node inDatabase:db];
+            NSSet *childIds = [self interpretQueryTree:node inDatabase:db];
             if (!accumulator) {
                 accumulator = [NSMutableSet setWithSet:childIds];
             } else {
@@ -267,8 +417,10 @@ const NSUInteger kSmallResultSetSizeThreshold = 500;
         NSMutableArray *docIds;
         if (sqlNode.sql) {
             CDTQSqlParts *sqlParts = sqlNode.sql;
-            FMResultSet *rs = [db executeQuery:sqlParts.sqlWithPlaceholders
-                          withArgumentsInArray:sqlParts.placeholderValues];
+            NSArray *arguments =
+                [CDTQQueryExecutor argumentsForParameters:sqlParts.placeholderValues inDatabase:db];
+            FMResultSet *rs = [db executeCachedQuery:sqlParts.sqlWithPlaceholders
+                                withArgumentsInArray:arguments];
             docIds = [NSMutableArray array];
             while ([rs next]) {
                 [docIds addObject:[rs stringForColumn:@"_id"]];
@@ -286,90 +438,305 @@ const NSUInteger kSmallResultSetSizeThreshold = 500;
     }
 }
 
+/**
+ Fills `temp.cdtq_candidates` with the document IDs matched by `node`.
+
+ When the tree is a single statement the IDs go straight from the indexes into
+ the table without being read out of SQLite.
+ */
+- (BOOL)loadCandidatesForQueryTree:(CDTQQueryNode *)node inDatabase:(FMDatabase *)db
+{
+    CDTQSqlParts *compound = [CDTQQuerySqlTranslator selectStatementForQueryTree:node];
+    if (compound) {
+        NSArray *arguments =
+            [CDTQQueryExecutor argumentsForParameters:compound.placeholderValues inDatabase:db];
+        if (!arguments) {
+            return NO;
+        }
+
+        NSString *sql = [NSString stringWithFormat:@"INSERT INTO temp.cdtq_candidates (_id) %@",
+                                                   compound.sqlWithPlaceholders];
+        if (![db executeCachedUpdate:sql withArgumentsInArray:arguments]) {
+            CDTLogError(CDTQ_LOG_CONTEXT, @"Failed to load candidates: %@", [db lastError]);
+            return NO;
+        }
+        return YES;
+    }
+
+    for (NSString *docId in [self interpretQueryTree:node inDatabase:db]) {
+        if (![db executeCachedUpdate:@"INSERT INTO temp.cdtq_candidates (_id) VALUES (?);",
+                                     docId]) {
+            CDTLogError(CDTQ_LOG_CONTEXT, @"Failed to load candidates: %@", [db lastError]);
+            return NO;
+        }
+    }
+    return YES;
+}
+
+#pragma mark Temporary tables
+
+/**
+ Creates the session's temporary tables, if they don't already exist:
+
+ - `cdtq_candidates` holds the IDs matched by a query while they're sorted.
+ - `cdtq_value_lists` holds the values of long `$in` operands, see CDTQValueList.
+ - `cdtq_sort_values` holds the values of unindexed sort fields, see
+   +sortCandidatesByKeyUsingSort:indexes:limit:datastore:inDatabase:.
+
+ They're emptied rather than dropped after each query so the schema, and so
+ SQLite's compiled statements, stay valid between queries.
+ */
++ (BOOL)createTemporaryTablesInDatabase:(FMDatabase *)db
+{
+    NSArray *statements = @[
+        @"CREATE TEMP TABLE IF NOT EXISTS cdtq_candidates (_id TEXT PRIMARY KEY);",
+        @"CREATE TEMP TABLE IF NOT EXISTS cdtq_value_lists (list INTEGER, value NONE);",
+        @"CREATE INDEX IF NOT EXISTS temp.cdtq_value_lists_list "
+        @"ON cdtq_value_lists (list, value);",
+        @"CREATE TEMP TABLE IF NOT EXISTS cdtq_sort_values "
+        @"(_id TEXT, sort_key INTEGER, value NONE);",
+        @"CREATE INDEX IF NOT EXISTS temp.cdtq_sort_values_id "
+        @"ON cdtq_sort_values (_id, sort_key);"
+    ];
+    for (NSString *sql in statements) {
+        if (![db executeUpdate:sql]) {
+            CDTLogError(CDTQ_LOG_CONTEXT, @"Failed to create temporary tables: %@",
+                        [db lastError]);
+            return NO;
+        }
+    }
+    return YES;
+}
+
++ (void)clearTemporaryTablesInDatabase:(FMDatabase *)db
+{
+    [db executeCachedUpdate:@"DELETE FROM temp.cdtq_candidates;"];
+    [db executeCachedUpdate:@"DELETE FROM temp.cdtq_value_lists;"];
+    [db executeCachedUpdate:@"DELETE FROM temp.cdtq_sort_values;"];
+}
+
+/**
+ Returns `parameters` ready to bind to a statement, with each CDTQValueList
+ loaded into `temp.cdtq_value_lists` and replaced by its list ID.
+
+ @return the arguments, or `nil` on error.
+ */
++ (NSArray *)argumentsForParameters:(NSArray *)parameters inDatabase:(FMDatabase *)db
+{
+    NSMutableArray *arguments = [NSMutableArray arrayWithCapacity:parameters.count];
+    for (NSObject *parameter in parameters) {
+        if (![parameter isKindOfClass:[CDTQValueList class]]) {
+            [arguments addObject:parameter];
+            continue;
+        }
+
+        long long listId = [db
+            longLongForCachedQuery:@"SELECT IFNULL(MAX(list), 0) + 1 FROM temp.cdtq_value_lists;"];
+        for (NSObject *value in ((CDTQValueList *)parameter).values) {
+            if (![db executeCachedUpdate:@"INSERT INTO temp.cdtq_value_lists (list, value) "
+                                         @"VALUES (?, ?);",
+                                         @(listId), value]) {
+                CDTLogError(CDTQ_LOG_CONTEXT, @"Failed to load value list: %@", [db lastError]);
+                return nil;
+            }
+        }
+        [arguments addObject:@(listId)];
+    }
+    return [NSArray arrayWithArray:arguments];
+}
+
 #pragma mark Sorting
 
 /**
- Return ordered list of document IDs using provided indexes.
+ Return the IDs in `temp.cdtq_candidates` ordered by `sortDocument`.
+
+ When one index holds all the sort fields, SQLite orders the candidates by
+ joining them to it; otherwise each candidate's sort keys are gathered first,
+ see +sortCandidatesByKeyUsingSort:indexes:limit:datastore:inDatabase:.
 
  Method assumes `sortDocument` is valid.
 
- @param docIdSet Set of current results which are sorted
  @param sortDocument Array of ordering definitions
                      `@[ @{"fieldName": "asc"}, @{@"fieldName2", @"desc"} ]`
  @param indexes dictionary of indexes
+ @param limit the number of sorted IDs needed, or 0 for all.
  @param db database containing `indexes` to use when sorting documents
+ @return the sorted IDs, or `nil` on error.
  */
++ (NSArray *)sortCandidatesUsingSort:(NSArray /*NSDictionary*/ *)sortDocument
+                             indexes:(NSDictionary *)indexes
+                               limit:(NSUInteger)limit
+                           datastore:(CDTDatastore *)datastore
+                          inDatabase:(FMDatabase *)db
+{
+    NSString *chosenIndex = [CDTQQueryExecutor chooseIndexForSort:sortDocument fromIndexes:indexes];
+    if (chosenIndex == nil) {
+        return [CDTQQueryExecutor sortCandidatesByKeyUsingSort:sortDocument
+                                                       indexes:indexes
+                                                         limit:limit
+                                                     datastore:datastore
+                                                    inDatabase:db];
+    }
+
+    // SQLite picks whether to walk the sort index probing the candidates, or
+    // look up the candidates and sort them, from the sizes of the two tables.
+    NSString *sql = [NSString
+        stringWithFormat:@"SELECT DISTINCT _id FROM \"%@\" "
+                         @"WHERE _id IN (SELECT _id FROM temp.cdtq_candidates) "
+                         @"ORDER BY %@ LIMIT ?;",
+                         [CDTQIndexManager tableNameForIndex:chosenIndex],
+                         [CDTQQueryExecutor orderByForSort:sortDocument]];
+    long long sqlLimit = (limit == 0 || limit >= INT64_MAX) ? -1 : (long long)limit;
+
+    FMResultSet *rs = [db executeCachedQuery:sql, @(sqlLimit)];
+    if (!rs) {
+        CDTLogError(CDTQ_LOG_CONTEXT, @"Failed to sort candidates: %@", [db lastError]);
+        return nil;
+    }
+
+    NSMutableArray *sortedIds = [NSMutableArray array];
+    while ([rs next]) {
+        [sortedIds addObject:[rs stringForColumnIndex:0]];
+    }
+    [rs close];
+    return [NSArray arrayWithArray:sortedIds];
+}
+
+/**
+ Sort the IDs in `temp.cdtq_candidates` by having SQLite look up each
+ candidate's sort keys as it orders them.
 
-+ (NSArray *)sortIds:(NSSet /*NSString*/ *)docIdSet
-           usingSort:(NSArray /*NSDictionary*/ *)sortDocument
-             indexes:(NSDictionary *)indexes
-          inDatabase:(FMDatabase *)db
+ Each key comes from the cheapest index containing its field, or, for
+ unindexed fields, from values read out of the documents into
+ `temp.cdtq_sort_values`. As in an index, a document's array field sorts by
+ its lowest value ascending and its highest descending.
+
+ With a limit, SQLite keeps only the first `limit` rows while sorting; without
+ one, its sorter merges sorted runs spilled to temporary files, so large sets
+ don't need to fit in memory.
+
+ @param limit the number of sorted IDs needed, or 0 for all.
+ @return the sorted IDs, or `nil` on error.
+ */
++ (NSArray *)sortCandidatesByKeyUsingSort:(NSArray /*NSDictionary*/ *)sortDocument
+                                  indexes:(NSDictionary *)indexes
+                                    limit:(NSUInteger)limit
+                                datastore:(CDTDatastore *)datastore
+                               inDatabase:(FMDatabase *)db
 {
-    BOOL smallResultSet = (docIdSet.count < kSmallResultSetSizeThreshold);
-    CDTQSqlParts *orderBy =
-        [CDTQQueryExecutor sqlToSortIds:docIdSet usingOrder:sortDocument indexes:indexes];
-    NSArray *sortedIds;
-
-    if (orderBy != nil) {
-        NSMutableArray *sortedDocIds = [NSMutableArray array];
-
-        // The query will iterate through a sorted list of docIds.
-        // This means that if we create a new array and add entries
-        // to that array as we iterate through the result set which
-        // are part of the query's results, we'll end up with an
-        // ordered set of results.
-        FMResultSet *rs = [db executeQuery:orderBy.sqlWithPlaceholders
-                      withArgumentsInArray:orderBy.placeholderValues];
-
-        // The while loop is duplicated to avoid checking the smallResultSet variable every loop
-        if (smallResultSet) {
-            while ([rs next]) {
-                NSString *candidateId = [rs stringForColumnIndex:0];
-                [sortedDocIds addObject:candidateId];
-            }
+    NSMutableArray *orderTerms = [NSMutableArray array];
+    NSMutableDictionary *unindexedFields = [NSMutableDictionary dictionary];  // key -> path
+
+    [sortDocument enumerateObjectsUsingBlock:^(NSDictionary *orderSpecifier, NSUInteger idx,
+                                               BOOL *stop) {
+        NSString *field = [orderSpecifier allKeys][0];
+        BOOL asc = [[orderSpecifier[field] uppercaseString] isEqualToString:@"ASC"];
+        NSString *aggregate = asc ? @"MIN" : @"MAX";
+
+        NSString *index =
+            [CDTQQueryExecutor chooseIndexForSort:@[ orderSpecifier ] fromIndexes:indexes];
+        NSString *value;
+        if (index) {
+            value = [NSString
+                stringWithFormat:@"(SELECT %@(\"%@\") FROM \"%@\" WHERE _id = c._id)",
+                                 aggregate, field, [CDTQIndexManager tableNameForIndex:index]];
         } else {
-            while ([rs next]) {
-                NSString *candidateId = [rs stringForColumnIndex:0];
-                if ([docIdSet containsObject:candidateId]) {
-                    [sortedDocIds addObject:candidateId];
-                }
+            unindexedFields[@(idx)] = [field componentsSeparatedByString:@"."];
+            value = [NSString stringWithFormat:@"(SELECT %@(value) FROM temp.cdtq_sort_values "
+                                               @"WHERE _id = c._id AND sort_key = %lu)",
+                                               aggregate, (unsigned long)idx];
+        }
+        [orderTerms addObject:[NSString stringWithFormat:@"%@ %@", value, asc ? @"ASC" : @"DESC"]];
+    }];
+
+    // Values of unindexed fields come from the documents; like the index updater,
+    // add a row per element of an array.
+    if (unindexedFields.count > 0) {
+        FMResultSet *rs = [db executeQuery:@"SELECT _id FROM temp.cdtq_candidates;"];
+        BOOL more = YES;
+        while (more) {
+            NSMutableArray *batch = [NSMutableArray arrayWithCapacity:kSortDocumentBatchSize];
+            while (batch.count < kSortDocumentBatchSize && (more = [rs next])) {
+                [batch addObject:[rs stringForColumnIndex:0]];
+            }
+            if (![CDTQQueryExecutor insertSortValuesForFields:unindexedFields
+                                                 ofDocuments:batch
+                                                   datastore:datastore
+                                                  inDatabase:db]) {
+                [rs close];
+                return nil;
             }
         }
         [rs close];
-        sortedIds = [NSArray arrayWithArray:sortedDocIds];
-    } else {
-        sortedIds = nil;  // error doing the ordering
     }
 
-    return sortedIds;
-}
+    // The sorter computes each row's keys once, as the row is added to it
+    NSString *sql = [NSString stringWithFormat:@"SELECT _id FROM temp.cdtq_candidates AS c "
+                                               @"ORDER BY %@ LIMIT ?;",
+                                               [orderTerms componentsJoinedByString:@", "]];
+    long long sqlLimit = (limit == 0 || limit >= INT64_MAX) ? -1 : (long long)limit;
 
-/**
- Return SQL to get ordered list of docIds.
+    FMResultSet *rs = [db executeCachedQuery:sql, @(sqlLimit)];
+    if (!rs) {
+        CDTLogError(CDTQ_LOG_CONTEXT, @"Failed to sort candidates: %@", [db lastError]);
+        return nil;
+    }
 
- Method assumes `sortDocument` is valid.
+    NSMutableArray *sortedIds = [NSMutableArray array];
+    while ([rs next]) {
+        [sortedIds addObject:[rs stringForColumnIndex:0]];
+    }
+    [rs close];
+    return [NSArray arrayWithArray:sortedIds];
+}
 
- @param sortDocument Array of ordering definitions
-    `@[ @{"fieldName": "asc"}, @{@"fieldName2", @"desc"} ]`
- @param indexes dictionary of indexes
+/**
+ Insert rows into `temp.cdtq_sort_values` for the values of `fields` (sort key
+ number -> field path) in the documents with IDs `docIds`.
  */
-+ (CDTQSqlParts *)sqlToSortIds:(NSSet /*NSString*/ *)docIdSet
-                    usingOrder:(NSArray /*NSDictionary*/ *)sortDocument
-                       indexes:(NSDictionary *)indexes
++ (BOOL)insertSortValuesForFields:(NSDictionary *)fields
+                      ofDocuments:(NSArray /*NSString*/ *)docIds
+                        datastore:(CDTDatastore *)datastore
+                       inDatabase:(FMDatabase *)db
 {
-    NSString *chosenIndex = [CDTQQueryExecutor chooseIndexForSort:sortDocument fromIndexes:indexes];
-    if (chosenIndex == nil) {
-        CDTLogError(CDTQ_LOG_CONTEXT, @"No single index can satisfy order %@", sortDocument);
-        return nil;
+    if (docIds.count == 0) {
+        return YES;
     }
 
-    NSString *indexTable = [CDTQIndexManager tableNameForIndex:chosenIndex];
+    for (CDTDocumentRevision *rev in [datastore getDocumentsWithIds:docIds]) {
+        for (NSNumber *key in fields) {
+            NSObject *value =
+                [CDTQValueExtractor extractValueForFieldPath:fields[key] fromRevision:rev];
+            NSArray *values = @[];
+            if ([value isKindOfClass:[NSArray class]]) {
+                values = (NSArray *)value;
+            } else if (value) {
+                values = @[ value ];
+            }
+            for (NSObject *v in values) {
+                if (![v isKindOfClass:[NSString class]] && ![v isKindOfClass:[NSNumber class]]) {
+                    continue;
+                }
+                if (![db executeCachedUpdate:@"INSERT INTO temp.cdtq_sort_values "
+                                             @"(_id, sort_key, value) VALUES (?, ?, ?);",
+                                             rev.docId, key, v]) {
+                    CDTLogError(CDTQ_LOG_CONTEXT, @"Failed to insert sort value: %@",
+                                [db lastError]);
+                    return NO;
+                }
+            }
+        }
+    }
+    return YES;
+}
 
-    // for small result sets:
-    // SELECT _id FROM idx WHERE _id IN (?, ?) ORDER BY fieldName ASC, fieldName2 DESC;
-    // for large result sets:
-    // SELECT _id FROM idx ORDER BY fieldName ASC, fieldName2 DESC;
+/**
+ Return the ORDER BY terms for `sortDocument`, e.g., `"fieldName" ASC, "fieldName2" DESC`.
 
+ Method assumes `sortDocument` is valid.
+ */
++ (NSString *)orderByForSort:(NSArray /*NSDictionary*/ *)sortDocument
+{
     NSMutableArray *orderClauses = [NSMutableArray array];
     for (NSDictionary *orderClause in sortDocument) {
         NSString *fieldName = [orderClause allKeys][0];
@@ -379,28 +746,89 @@ const NSUInteger kSmallResultSetSizeThreshold = 500;
             [NSString stringWithFormat:@"\"%@\" %@", fieldName, [direction uppercaseString]];
         [orderClauses addObject:orderClause];
     }
+    return [orderClauses componentsJoinedByString:@", "];
+}
+
+/**
+ Return SQL returning the final, ordered and paged, list of docIds for a query tree.
 
-    // If we have few results, it's more efficient to reduce the search space
-    // for SQLite. 500 placeholders should be a safe value.
-    NSMutableArray *parameters = [NSMutableArray array];
+ Only valid when no post-hoc matching is needed, as skip and limit are applied by
+ the SQL. Returns `nil` if the tree can't be expressed as a single statement or no
+ single index can satisfy the sort, in which case the caller should fall back to
+ evaluating the tree and sorting the resulting IDs.
 
-    NSString *whereClause = @"";
-    if (docIdSet.count < kSmallResultSetSizeThreshold) {
-        NSMutableArray *placeholders = [NSMutableArray array];
-        for (NSString *docId in docIdSet) {
-            [placeholders addObject:@"?"];
-            [parameters addObject:docId];
+ @param root query tree from the translator
+ @param sortDocument Array of ordering definitions, may be nil
+ @param indexes dictionary of indexes
+ @param skip number of results to skip (0 means don't skip)
+ @param limit maximum number of results (0 means no limit)
+ */
++ (CDTQSqlParts *)sqlForQueryTree:(CDTQQueryNode *)root
+                        usingSort:(NSArray /*NSDictionary*/ *)sortDocument
+                          indexes:(NSDictionary *)indexes
+                             skip:(NSUInteger)skip
+                            limit:(NSUInteger)limit
+{
+    CDTQSqlParts *tree = [CDTQQuerySqlTranslator selectStatementForQueryTree:root];
+    if (!tree) {
+        return nil;
+    }
+
+    NSCharacterSet *terminator = [NSCharacterSet characterSetWithCharactersInString:@"; "];
+    NSString *treeSql = [tree.sqlWithPlaceholders stringByTrimmingCharactersInSet:terminator];
+    NSMutableArray *parameters = [NSMutableArray arrayWithArray:tree.placeholderValues];
+
+    NSString *sql;
+    if (sortDocument.count > 0) {
+        NSString *chosenIndex =
+            [CDTQQueryExecutor chooseIndexForSort:sortDocument fromIndexes:indexes];
+        if (chosenIndex == nil) {
+            return nil;
         }
-        whereClause = [NSString
-            stringWithFormat:@"WHERE _id IN (%@)", [placeholders componentsJoinedByString:@", "]];
+
+        // SELECT DISTINCT _id FROM idx WHERE _id IN (tree) ORDER BY fieldName ASC LIMIT ? OFFSET ?;
+        NSString *indexTable = [CDTQIndexManager tableNameForIndex:chosenIndex];
+        sql = [NSString stringWithFormat:@"SELECT DISTINCT _id FROM \"%@\" WHERE _id IN (%@) "
+                                         @"ORDER BY %@ LIMIT ? OFFSET ?;",
+                                         indexTable, treeSql,
+                                         [CDTQQueryExecutor orderByForSort:sortDocument]];
+    } else {
+        sql = [NSString stringWithFormat:@"SELECT _id FROM (%@) LIMIT ? OFFSET ?;", treeSql];
     }
 
-    NSString *sql =
-        [NSString stringWithFormat:@"SELECT DISTINCT _id FROM \"%@\" %@ ORDER BY %@;", indexTable,
-                                   whereClause, [orderClauses componentsJoinedByString:@", "]];
+    // A negative LIMIT means no limit to SQLite; values are bound as signed 64-bit
+    BOOL limited = limit > 0 && limit < (NSUInteger)INT64_MAX;
+    [parameters addObject:(limited ? @(limit) : @(-1))];
+    [parameters addObject:@(MIN(skip, (NSUInteger)INT64_MAX))];
+
     return [CDTQSqlParts partsForSql:sql parameters:parameters];
 }
 
++ (NSString *)chooseCoveringIndexForFields:(NSArray /*NSString*/ *)fields
+                               fromIndexes:(NSDictionary *)indexes
+{
+    NSSet *neededFields = [NSSet setWithArray:fields];
+
+    // _id and _rev are columns of every index but aren't in document bodies, so
+    // projecting them must go through the document to give the same result.
+    if (neededFields.count == 0 || [neededFields containsObject:@"_id"] ||
+        [neededFields containsObject:@"_rev"]) {
+        return nil;
+    }
+
+    for (NSString *indexName in [CDTQQuerySqlTranslator indexNamesByCost:indexes]) {
+        if (![indexes[indexName][@"type"] isEqualToString:@"json"]) {
+            continue;
+        }
+        NSSet *providedFields = [NSSet setWithArray:indexes[indexName][@"fields"]];
+        if ([neededFields isSubsetOfSet:providedFields]) {
+            return indexName;
+        }
+    }
+
+    return nil;
+}
+
 + (NSString *)chooseIndexForSort:(NSArray /*NSDictionary*/ *)sortDocument
                      fromIndexes:(NSDictionary *)indexes
 {
@@ -416,7 +844,7 @@ const NSUInteger kSmallResultSetSizeThreshold = 500;
     }
 
     NSString *chosenIndex = nil;
-    for (NSString *indexName in indexes) {
+    for (NSString *indexName in [CDTQQuerySqlTranslator indexNamesByCost:indexes]) {
         NSSet *providedFields = [NSSet setWithArray:indexes[indexName][@"fields"]];
         if ([neededFields isSubsetOfSet:providedFields]) {
             chosenIndex = indexName;
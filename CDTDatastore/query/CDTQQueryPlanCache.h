@@ -0,0 +1,93 @@
+//
+//  CDTQQueryPlanCache.h
+//
+//  Copyright © 2018 IBM Corporation. All rights reserved.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//  except in compliance with the License. You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+//  Unless required by applicable law or agreed to in writing, software distributed under the
+//  License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//  either express or implied. See the License for the specific language governing permissions
+//  and limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class CDTQChildrenQueryNode;
+@class CDTQSqlParts;
+@class CDTQUnindexedMatcher;
+
+/**
+ The validated and translated form of a query, ready to execute against the
+ indexes it was planned for.
+ */
+@interface CDTQQueryPlan : NSObject
+
+/** Index definitions the plan was made with; it's only valid for these. */
+@property (nonatomic, strong) NSDictionary *indexes;
+
+/** The normalised selector. */
+@property (nonatomic, strong) NSDictionary *selector;
+
+@property (nullable, nonatomic, strong) NSArray<NSString *> *fields;
+@property (nullable, nonatomic, strong) NSArray<NSDictionary *> *sortDocument;
+@property (nonatomic) NSUInteger skip;
+@property (nonatomic) NSUInteger limit;
+
+@property (nonatomic, strong) CDTQChildrenQueryNode *root;
+@property (nullable, nonatomic, strong) CDTQUnindexedMatcher *matcher;
+
+/** Single statement applying order, skip and limit, if the query allows it. */
+@property (nullable, nonatomic, strong) CDTQSqlParts *pushedDown;
+
+@property (nullable, nonatomic, strong) NSString *coveringIndex;
+
+/**
+ Returns a copy of this plan with each SQL parameter and selector value that's
+ a key of `valuesByToken` replaced by the corresponding value.
+
+ This lets a plan be made once for a selector with stand-in values, then
+ executed with different values without translating the selector again.
+ */
+- (CDTQQueryPlan *)planByBindingValues:(NSDictionary<NSString *, NSObject *> *)valuesByToken;
+
+@end
+
+/**
+ A bounded cache of query plans, evicting the least recently used plan when full.
+
+ Safe to use from multiple threads.
+ */
+@interface CDTQQueryPlanCache : NSObject
+
+@property (nonatomic, readonly) NSUInteger capacity;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity;
+
+/**
+ Returns the key identifying a query's plan, or nil if the query can't be
+ cached because it contains values which aren't JSON.
+ */
++ (nullable NSString *)keyForQuery:(NSDictionary *)query
+                              skip:(NSUInteger)skip
+                             limit:(NSUInteger)limit
+                            fields:(nullable NSArray *)fields
+                              sort:(nullable NSArray *)sortDocument
+               coveringProjections:(BOOL)coveringProjections;
+
+/**
+ Returns the plan cached for `key`, if it was made with `indexes`.
+ */
+- (nullable CDTQQueryPlan *)planForKey:(NSString *)key indexes:(NSDictionary *)indexes;
+
+- (void)setPlan:(CDTQQueryPlan *)plan forKey:(NSString *)key;
+
+- (void)removeAllPlans;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,180 @@
+//
+//  CDTQQueryPlanCache.m
+//
+//  Copyright © 2018 IBM Corporation. All rights reserved.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//  except in compliance with the License. You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+//  Unless required by applicable law or agreed to in writing, software distributed under the
+//  License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//  either express or implied. See the License for the specific language governing permissions
+//  and limitations under the License.
+
+#import "CDTQQueryPlanCache.h"
+
+#import "CDTQIndexManager.h"
+#import "CDTQQuerySqlTranslator.h"
+#import "CDTQUnindexedMatcher.h"
+#import "TDCanonicalJSON.h"
+
+@implementation CDTQQueryPlan
+
+- (CDTQQueryPlan *)planByBindingValues:(NSDictionary *)valuesByToken
+{
+    CDTQQueryPlan *plan = [[CDTQQueryPlan alloc] init];
+    plan.indexes = self.indexes;
+    plan.selector = [CDTQQueryPlan bindValues:valuesByToken inObject:self.selector];
+    plan.fields = self.fields;
+    plan.sortDocument = self.sortDocument;
+    plan.skip = self.skip;
+    plan.limit = self.limit;
+    plan.root = (CDTQChildrenQueryNode *)[CDTQQueryPlan bindValues:valuesByToken
+                                                            inNode:self.root];
+    plan.pushedDown = [CDTQQueryPlan bindValues:valuesByToken inParts:self.pushedDown];
+    plan.coveringIndex = self.coveringIndex;
+
+    // The matcher's predicates capture the selector's values, so make a new one
+    if (self.matcher) {
+        plan.matcher = [CDTQUnindexedMatcher matcherWithSelector:plan.selector];
+    }
+
+    return plan;
+}
+
++ (CDTQQueryNode *)bindValues:(NSDictionary *)valuesByToken inNode:(CDTQQueryNode *)node
+{
+    if ([node isKindOfClass:[CDTQSqlQueryNode class]]) {
+        CDTQSqlQueryNode *sqlNode = [[CDTQSqlQueryNode alloc] init];
+        sqlNode.sql = [self bindValues:valuesByToken inParts:((CDTQSqlQueryNode *)node).sql];
+        return sqlNode;
+    }
+
+    CDTQChildrenQueryNode *childrenNode = [[[node class] alloc] init];
+    for (CDTQQueryNode *child in ((CDTQChildrenQueryNode *)node).children) {
+        [childrenNode.children addObject:[self bindValues:valuesByToken inNode:child]];
+    }
+    return childrenNode;
+}
+
++ (CDTQSqlParts *)bindValues:(NSDictionary *)valuesByToken inParts:(CDTQSqlParts *)parts
+{
+    if (!parts) {
+        return nil;
+    }
+    return [CDTQSqlParts partsForSql:parts.sqlWithPlaceholders
+                          parameters:[self bindValues:valuesByToken
+                                             inObject:parts.placeholderValues]];
+}
+
++ (id)bindValues:(NSDictionary *)valuesByToken inObject:(id)object
+{
+    if ([object isKindOfClass:[NSDictionary class]]) {
+        NSMutableDictionary *bound = [NSMutableDictionary dictionary];
+        for (id key in (NSDictionary *)object) {
+            bound[key] = [self bindValues:valuesByToken inObject:object[key]];
+        }
+        return [NSDictionary dictionaryWithDictionary:bound];
+    } else if ([object isKindOfClass:[NSArray class]]) {
+        NSMutableArray *bound = [NSMutableArray arrayWithCapacity:[object count]];
+        for (id value in (NSArray *)object) {
+            [bound addObject:[self bindValues:valuesByToken inObject:value]];
+        }
+        return [NSArray arrayWithArray:bound];
+    } else if ([object isKindOfClass:[CDTQValueList class]]) {
+        NSArray *values = ((CDTQValueList *)object).values;
+        return [CDTQValueList listWithValues:[self bindValues:valuesByToken inObject:values]];
+    } else if ([object isKindOfClass:[NSString class]] && valuesByToken[object]) {
+        return valuesByToken[object];
+    } else {
+        return object;
+    }
+}
+
+@end
+
+@implementation CDTQQueryPlanCache {
+    NSMutableDictionary *_plans;  // key -> CDTQQueryPlan
+    NSMutableArray *_keys;        // least recently used first
+}
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity
+{
+    NSParameterAssert(capacity > 0);
+
+    self = [super init];
+    if (self) {
+        _capacity = capacity;
+        _plans = [NSMutableDictionary dictionaryWithCapacity:capacity];
+        _keys = [NSMutableArray arrayWithCapacity:capacity];
+    }
+    return self;
+}
+
++ (NSString *)keyForQuery:(NSDictionary *)query
+                     skip:(NSUInteger)skip
+                    limit:(NSUInteger)limit
+                   fields:(NSArray *)fields
+                     sort:(NSArray *)sortDocument
+      coveringProjections:(BOOL)coveringProjections
+{
+    NSArray *parts = @[
+        query, fields ?: [NSNull null], sortDocument ?: [NSNull null], @(skip), @(limit),
+        @(coveringProjections)
+    ];
+    if (![NSJSONSerialization isValidJSONObject:parts]) {
+        return nil;
+    }
+
+    // Canonical JSON sorts dictionary keys, so equivalent queries share a key
+    return [TDCanonicalJSON canonicalString:parts];
+}
+
+- (CDTQQueryPlan *)planForKey:(NSString *)key indexes:(NSDictionary *)indexes
+{
+    @synchronized(self)
+    {
+        CDTQQueryPlan *plan = _plans[key];
+        if (!plan) {
+            return nil;
+        }
+
+        // Indexes or their statistics have changed since this plan was made
+        if (![plan.indexes isEqualToDictionary:indexes]) {
+            [_plans removeObjectForKey:key];
+            [_keys removeObject:key];
+            return nil;
+        }
+
+        [_keys removeObject:key];
+        [_keys addObject:key];
+        return plan;
+    }
+}
+
+- (void)setPlan:(CDTQQueryPlan *)plan forKey:(NSString *)key
+{
+    @synchronized(self)
+    {
+        if (_plans[key]) {
+            [_keys removeObject:key];
+        } else if (_keys.count >= _capacity) {
+            [_plans removeObjectForKey:_keys[0]];
+            [_keys removeObjectAtIndex:0];
+        }
+
+        _plans[key] = plan;
+        [_keys addObject:key];
+    }
+}
+
+- (void)removeAllPlans
+{
+    @synchronized(self)
+    {
+        [_plans removeAllObjects];
+        [_keys removeAllObjects];
+    }
+}
+
+@end
@@ -40,6 +40,30 @@ NS_ASSUME_NONNULL_BEGIN
 
 @property (nonatomic, strong) CDTQSqlParts *sql;
 
+/**
+ Estimated number of rows the SQL selects, from the row count in the index's
+ statistics and the selectivity of the clause's predicates, or `nil` if the
+ index has no statistics.
+
+ @see +estimatedRowsForAndClause:inIndexWithRows:
+ */
+@property (nullable, nonatomic, strong) NSNumber *estimatedRows;
+
+@end
+
+/**
+ A list of values bound as a single SQL parameter, used for `$in` operands too
+ long to bind one placeholder per value.
+
+ The SQL selects the values from the `temp.cdtq_value_lists` table by list ID;
+ the executor loads them into the table and binds the ID in place of this object.
+ */
+@interface CDTQValueList : NSObject
+
+@property (nonatomic, strong, readonly) NSArray *values;
+
++ (instancetype)listWithValues:(NSArray *)values;
+
 @end
 
 /**
@@ -52,10 +76,11 @@ NS_ASSUME_NONNULL_BEGIN
  can perform the needed AND and OR operations between the document ID sets returned
  by the SQL queries.
 
- This merging of results in code allows use to make more intelligent use of indexes
- within the SQLite database. As SQLite allows us to use just a single index per query,
+ Using a query per node allows us to make more intelligent use of indexes within
+ the SQLite database. As SQLite allows us to use just a single index per query,
  performing several queries over indexes and then using set operations works out
- more flexible and likely more efficient.
+ more flexible and likely more efficient. +selectStatementForQueryTree: composes the
+ per-node queries into one statement so the set operations also happen in SQLite.
 
  The SQL must be executed separately so we can do it in a transaction so we're doing
  it over a consistent view of the index.
@@ -149,8 +174,35 @@ NS_ASSUME_NONNULL_BEGIN
 + (nullable NSString *)chooseIndexForAndClause:(NSArray *)clause
                                    fromIndexes:(NSDictionary *)indexes;
 
+/**
+ Estimates how many of an index's `rows` match an AND clause.
+
+ Each predicate is assumed independent of the others: `$eq` keeps a tenth of
+ the rows, `$in` a tenth per value, and each range bound (`$gt`, `$gte`, `$lt`,
+ `$lte`) a quarter. Other predicates are assumed to keep every row.
+
+ @return the estimate, at least one if the index has any rows, or `nil` if
+         `rows` is `nil`.
+ */
++ (nullable NSNumber *)estimatedRowsForAndClause:(NSArray *)clause
+                                 inIndexWithRows:(nullable NSNumber *)rows;
+
+/**
+ Orders index names from cheapest to most expensive to scan.
+
+ Indexes are ranked by their estimated row count, taken from the optional `rows`
+ entry of each index definition (from SQLite's `sqlite_stat1`), then by number of
+ fields so the narrowest index wins, then by name. The order therefore doesn't
+ depend on dictionary iteration order and is the same across runs. Indexes with
+ no `rows` entry rank after those with one.
+ */
++ (NSArray<NSString *> *)indexNamesByCost:(NSDictionary *)indexes;
+
 /**
  Selects an index to use for a set of fields.
+
+ Where several indexes contain all the fields, the cheapest according to
+ +indexNamesByCost: is used.
  */
 + (nullable NSString *)chooseIndexForFields:(NSSet *)neededFields
                                 fromIndexes:(NSDictionary *)indexes;
@@ -170,6 +222,22 @@ NS_ASSUME_NONNULL_BEGIN
 + (nullable CDTQSqlParts *)selectStatementForAndClause:(NSArray *)clause
                                             usingIndex:(NSString *)indexName;
 
+/**
+ Returns a single SQL statement which evaluates a whole translated query tree,
+ so SQLite performs the AND and OR set operations rather than the interpreter.
+
+ AND nodes scan their cheapest child and filter by `_id IN (...)` for the rest,
+ so the others are not evaluated at all when it is empty; OR nodes become a UNION.
+ A child's cost is estimated from the `rows` statistics of the indexes it reads,
+ with children of unknown cost kept last in their original order. The statement
+ returns distinct document IDs in an `_id` column.
+
+ @param node root of a tree returned by +translateQuery:toUseIndexes:indexesCoverQuery:
+ @return the statement, or `nil` if part of the tree has no SQL (i.e., there are no
+         indexes and document IDs must come from the datastore).
+ */
++ (nullable CDTQSqlParts *)selectStatementForQueryTree:(CDTQQueryNode *)node;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -30,10 +30,39 @@
 
 @end
 
+// $in operands longer than this are bound as a CDTQValueList
+static const NSUInteger kValueListThreshold = 100;
+
 @implementation CDTQQueryNode
 
 @end
 
+@implementation CDTQValueList
+
++ (instancetype)listWithValues:(NSArray *)values
+{
+    CDTQValueList *list = [[CDTQValueList alloc] init];
+    list->_values = [NSArray arrayWithArray:values];
+    return list;
+}
+
+- (BOOL)isEqual:(id)object
+{
+    if (![object isKindOfClass:[CDTQValueList class]]) {
+        return NO;
+    }
+    return [self.values isEqualToArray:((CDTQValueList *)object).values];
+}
+
+- (NSUInteger)hash { return self.values.hash; }
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<value list of %lu>", (unsigned long)self.values.count];
+}
+
+@end
+
 @implementation CDTQChildrenQueryNode
 
 - (instancetype)init
@@ -183,6 +212,9 @@
                 
                 CDTQSqlQueryNode *sql = [[CDTQSqlQueryNode alloc] init];
                 sql.sql = select;
+                sql.estimatedRows = [CDTQQuerySqlTranslator
+                    estimatedRowsForAndClause:basicClauses
+                              inIndexWithRows:indexes[chosenIndex][@"rows"]];
                 
                 [root.children addObject:sql];
             }
@@ -227,6 +259,9 @@
                     
                     CDTQSqlQueryNode *sql = [[CDTQSqlQueryNode alloc] init];
                     sql.sql = select;
+                    sql.estimatedRows = [CDTQQuerySqlTranslator
+                        estimatedRowsForAndClause:wrappedClause
+                                  inIndexWithRows:indexes[chosenIndex][@"rows"]];
                     
                     [root.children addObject:sql];
                 }
@@ -346,10 +381,65 @@
     return [CDTQQuerySqlTranslator chooseIndexForFields:neededFields fromIndexes:indexes];
 }
 
++ (NSNumber *)estimatedRowsForAndClause:(NSArray *)clause inIndexWithRows:(NSNumber *)rows
+{
+    if (!rows) {
+        return nil;
+    }
+
+    // The SQLite index on an index table leads with _id, so sqlite_stat1 says nothing about
+    // the values of the indexed fields. Instead assume independent predicates, each keeping
+    // a fixed fraction of the rows, much as SQLite does for columns it has no statistics for.
+    double estimate = rows.doubleValue;
+    for (NSDictionary *term in clause) {
+        NSDictionary *predicate = term.count == 1 ? term.allValues[0] : nil;
+        if (![predicate isKindOfClass:[NSDictionary class]] || predicate.count != 1) {
+            continue;
+        }
+
+        NSString *operator= predicate.allKeys[0];
+        if ([operator isEqualToString:EQ]) {
+            estimate /= 10;
+        } else if ([operator isEqualToString:IN]) {
+            NSArray *values = predicate[IN];
+            estimate *= MIN(1.0, values.count / 10.0);
+        } else if ([@[ GT, GTE, LT, LTE ] containsObject:operator]) {
+            estimate /= 4;
+        }
+        // $exists, $mod and negated predicates are assumed to keep every row
+    }
+
+    if (rows.unsignedLongLongValue > 0 && estimate < 1) {
+        estimate = 1;
+    }
+    return @((unsigned long long)ceil(estimate));
+}
+
++ (NSArray *)indexNamesByCost:(NSDictionary *)indexes
+{
+    return [[indexes allKeys] sortedArrayUsingComparator:^NSComparisonResult(NSString *a,
+                                                                             NSString *b) {
+        NSNumber *rowsA = indexes[a][@"rows"] ?: @(UINT64_MAX);
+        NSNumber *rowsB = indexes[b][@"rows"] ?: @(UINT64_MAX);
+        NSComparisonResult result = [rowsA compare:rowsB];
+        if (result != NSOrderedSame) {
+            return result;
+        }
+
+        NSUInteger widthA = [indexes[a][@"fields"] count];
+        NSUInteger widthB = [indexes[b][@"fields"] count];
+        if (widthA != widthB) {
+            return widthA < widthB ? NSOrderedAscending : NSOrderedDescending;
+        }
+
+        return [a compare:b];
+    }];
+}
+
 + (NSString *)chooseIndexForFields:(NSSet *)neededFields fromIndexes:(NSDictionary *)indexes
 {
     NSString *chosenIndex = nil;
-    for (NSString *indexName in indexes) {
+    for (NSString *indexName in [CDTQQuerySqlTranslator indexNamesByCost:indexes]) {
         
         // Don't choose a text index for a non-text query clause
         NSString *indexType = indexes[indexName][@"type"];
@@ -370,7 +460,7 @@
 + (NSString *)getTextIndexFromIndexes:(NSDictionary *)indexes
 {
     NSString *textIndex = nil;
-    for (NSString *indexName in [indexes allKeys]) {
+    for (NSString *indexName in [CDTQQuerySqlTranslator indexNamesByCost:indexes]) {
         NSString *indexType = indexes[indexName][@"type"];
         if ([indexType.lowercaseString isEqualToString:@"text"]) {
             textIndex = indexName;
@@ -523,6 +613,13 @@
 + (NSString *)placeholdersForList:(NSArray *)values
             updatingParameterValues:(NSMutableArray *)sqlParameters
 {
+    // One placeholder per value makes a statement SQLite must compile afresh for
+    // each length, and can exceed its limit on parameters.
+    if (values.count > kValueListThreshold) {
+        [sqlParameters addObject:[CDTQValueList listWithValues:values]];
+        return @"( SELECT value FROM temp.cdtq_value_lists WHERE list = ? )";
+    }
+
     NSMutableArray *operands = [NSMutableArray array];
     for (NSObject *value in values) {
         [operands addObject:@"?"];
@@ -595,6 +692,119 @@
     return parts;
 }
 
+#pragma mark Compound statements for query trees
+
++ (CDTQSqlParts *)selectStatementForQueryTree:(CDTQQueryNode *)node
+{
+    CDTQSqlParts *tree = [CDTQQuerySqlTranslator selectPartsForNode:node];
+    if (!tree) {
+        return nil;
+    }
+
+    NSString *sql =
+        [NSString stringWithFormat:@"SELECT DISTINCT _id FROM (%@);", tree.sqlWithPlaceholders];
+    return [CDTQSqlParts partsForSql:sql parameters:tree.placeholderValues];
+}
+
+/**
+ Returns a SELECT (without trailing semi-colon) yielding the `_id`s for `node`.
+ */
++ (CDTQSqlParts *)selectPartsForNode:(CDTQQueryNode *)node
+{
+    if ([node isKindOfClass:[CDTQSqlQueryNode class]]) {
+        CDTQSqlParts *parts = ((CDTQSqlQueryNode *)node).sql;
+        if (!parts) {
+            return nil;
+        }
+        NSCharacterSet *terminator = [NSCharacterSet characterSetWithCharactersInString:@"; "];
+        NSString *sql = [parts.sqlWithPlaceholders stringByTrimmingCharactersInSet:terminator];
+        return [CDTQSqlParts partsForSql:sql parameters:parts.placeholderValues];
+    }
+
+    if (![node isKindOfClass:[CDTQChildrenQueryNode class]]) {
+        return nil;
+    }
+
+    NSArray *children = ((CDTQChildrenQueryNode *)node).children;
+    if (children.count == 0) {
+        // Matches the interpreter, which treats a node with no children as no results.
+        return [CDTQSqlParts partsForSql:@"SELECT NULL AS _id WHERE 0" parameters:@[]];
+    }
+
+    BOOL isAnd = [node isKindOfClass:[CDTQAndQueryNode class]];
+    if (isAnd) {
+        // Stable, so children of equal or unknown cost keep the translator's order.
+        children = [children
+            sortedArrayWithOptions:NSSortStable
+                   usingComparator:^NSComparisonResult(CDTQQueryNode *a, CDTQQueryNode *b) {
+                       unsigned long long costA = [CDTQQuerySqlTranslator estimatedRowsForNode:a];
+                       unsigned long long costB = [CDTQQuerySqlTranslator estimatedRowsForNode:b];
+                       if (costA == costB) {
+                           return NSOrderedSame;
+                       }
+                       return costA < costB ? NSOrderedAscending : NSOrderedDescending;
+                   }];
+    }
+
+    NSMutableArray *clauses = [NSMutableArray array];
+    NSMutableArray *parameters = [NSMutableArray array];
+
+    for (CDTQQueryNode *child in children) {
+        CDTQSqlParts *childParts = [CDTQQuerySqlTranslator selectPartsForNode:child];
+        if (!childParts) {
+            return nil;
+        }
+
+        // The first, cheapest, child of an AND drives the scan.
+        NSString *format = (isAnd && clauses.count > 0) ? @"_id IN (%@)" : @"SELECT _id FROM (%@)";
+        [clauses addObject:[NSString stringWithFormat:format, childParts.sqlWithPlaceholders]];
+        [parameters addObjectsFromArray:childParts.placeholderValues];
+    }
+
+    NSString *sql;
+    if (isAnd) {
+        sql = clauses[0];
+        if (clauses.count > 1) {
+            NSArray *filters = [clauses subarrayWithRange:NSMakeRange(1, clauses.count - 1)];
+            sql = [NSString
+                stringWithFormat:@"%@ WHERE %@", sql, [filters componentsJoinedByString:@" AND "]];
+        }
+    } else {
+        sql = [clauses componentsJoinedByString:@" UNION "];
+    }
+
+    return [CDTQSqlParts partsForSql:sql parameters:parameters];
+}
+
+/**
+ Returns an upper bound on the number of `_id`s `node` selects, from the `rows`
+ statistics of the indexes it reads, or `ULLONG_MAX` if it isn't known.
+ */
++ (unsigned long long)estimatedRowsForNode:(CDTQQueryNode *)node
+{
+    if ([node isKindOfClass:[CDTQSqlQueryNode class]]) {
+        NSNumber *rows = ((CDTQSqlQueryNode *)node).estimatedRows;
+        return rows ? rows.unsignedLongLongValue : ULLONG_MAX;
+    }
+
+    if (![node isKindOfClass:[CDTQChildrenQueryNode class]]) {
+        return ULLONG_MAX;
+    }
+
+    // An AND selects no more than its smallest child, an OR no more than all of them.
+    BOOL isAnd = [node isKindOfClass:[CDTQAndQueryNode class]];
+    unsigned long long estimate = isAnd ? ULLONG_MAX : 0;
+    for (CDTQQueryNode *child in ((CDTQChildrenQueryNode *)node).children) {
+        unsigned long long rows = [CDTQQuerySqlTranslator estimatedRowsForNode:child];
+        if (isAnd) {
+            estimate = MIN(estimate, rows);
+        } else {
+            estimate = (rows > ULLONG_MAX - estimate) ? ULLONG_MAX : estimate + rows;
+        }
+    }
+    return estimate;
+}
+
 + (CDTQSqlParts *)selectStatementForTextClause:(NSDictionary *)textClause
                                     usingIndex:(NSString *)indexName
 {
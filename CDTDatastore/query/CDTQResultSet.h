@@ -18,8 +18,10 @@ NS_ASSUME_NONNULL_BEGIN
 
 @class CDTDatastore;
 @class CDTQResultSetBuilder;
+@class CDTQResultCursor;
 @class CDTDocumentRevision;
 @class CDTQUnindexedMatcher;
+@class FMDatabaseQueue;
 
 typedef void (^CDTQResultSetBuilderBlock)(CDTQResultSetBuilder *configuration);
 
@@ -35,6 +37,14 @@ typedef void (^CDTQResultSetBuilderBlock)(CDTQResultSetBuilder *configuration);
 @property (nonatomic) NSUInteger limit;
 @property (nullable, nonatomic, strong) CDTQUnindexedMatcher *matcher;
 
+/**
+ Name of an index containing every projected field. When set along with
+ `indexDatabase`, projected revisions are built from the index's columns
+ rather than by loading documents. Only valid with `fields` and no `matcher`.
+ */
+@property (nullable, nonatomic, strong) NSString *coveringIndex;
+@property (nullable, nonatomic, strong) FMDatabaseQueue *indexDatabase;
+
 @end
 
 /**
@@ -47,6 +57,9 @@ typedef void (^CDTQResultSetBuilderBlock)(CDTQResultSetBuilder *configuration);
     // idx: the index of this result.
     // stop: set to YES to stop the iteration.
  }];
+
+ Or use -cursorWithPageSize: to fetch pages of results without blocking the
+ calling thread.
  */
 @interface CDTQResultSet : NSObject {
     CDTDatastore *_datastore;
@@ -60,8 +73,43 @@ typedef void (^CDTQResultSetBuilderBlock)(CDTQResultSetBuilder *configuration);
 - (void)enumerateObjectsUsingBlock:(void (^)(CDTDocumentRevision *rev, NSUInteger idx,
                                              BOOL *stop))block;
 
+/**
+ Returns a cursor which loads the results in pages of `pageSize` documents
+ on a background queue.
+
+ Skip, limit, post hoc matching and projection apply as for
+ -enumerateObjectsUsingBlock:.
+ */
+- (CDTQResultCursor *)cursorWithPageSize:(NSUInteger)pageSize;
+
 @property (nonatomic, strong, readonly) NSArray<NSString *> *documentIds;
 
 @end
 
+/**
+ Fetches pages of results from a CDTQResultSet asynchronously.
+
+ While the caller is handling a page, the cursor loads the following one so
+ it's ready when requested:
+
+ [cursor nextPageOnQueue:dispatch_get_main_queue()
+       completionHandler:^(NSArray<CDTDocumentRevision *> *page) {
+    // page: the next results; an empty array once all results are returned.
+ }];
+
+ Requests are served in the order they are made. The cursor is retained until
+ its outstanding requests complete.
+ */
+@interface CDTQResultCursor : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ Loads the next page of results, calling `completionHandler` on `queue` with it.
+ */
+- (void)nextPageOnQueue:(dispatch_queue_t)queue
+      completionHandler:(void (^)(NSArray<CDTDocumentRevision *> *page))completionHandler;
+
+@end
+
 NS_ASSUME_NONNULL_END
\ No newline at end of file
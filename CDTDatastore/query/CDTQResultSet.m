@@ -14,18 +14,38 @@
 
 #import "CDTQResultSet.h"
 #import "CDTLogging.h"
+#import "CDTQIndexManager.h"
 #import "CDTQProjectedDocumentRevision.h"
 #import "CDTQUnindexedMatcher.h"
 
 #import <CloudantSync.h>
+#import <FMDB/FMDB.h>
 
 @interface CDTQResultSet ()
 @property (nonatomic, strong, readwrite) NSArray *fields;
 @property (nonatomic) NSUInteger skip;
 @property (nonatomic) NSUInteger limit;
 @property (nonatomic, strong) CDTQUnindexedMatcher *matcher;
+@property (nonatomic, strong) NSString *coveringIndex;
+@property (nonatomic, strong) FMDatabaseQueue *indexDatabase;
+@property (nonatomic, strong, readonly) NSArray *originalDocumentIds;
+@property (nonatomic, strong, readonly) CDTDatastore *datastore;
+
+- (NSArray *)candidateRevisionsForIds:(NSArray *)docIds;
+- (dispatch_group_t)matchBatchesInRange:(NSRange)batchRange intoArray:(NSMutableArray **)results;
++ (CDTDocumentRevision *)projectFields:(NSArray *)fields
+                          fromRevision:(CDTDocumentRevision *)rev
+                             datastore:(CDTDatastore *)datastore;
+@end
+
+@interface CDTQResultCursor ()
+- (instancetype)initWithResultSet:(CDTQResultSet *)resultSet
+                         pageSize:(NSUInteger)pageSize;
 @end
 
+// Number of documents loaded from the datastore at a time
+static const NSUInteger kCDTQResultSetBatchSize = 50;
+
 @implementation CDTQResultSetBuilder
 
 - (CDTQResultSet *)build;
@@ -47,6 +67,10 @@
         _skip = builder.skip;
         _limit = builder.limit;
         _matcher = builder.matcher;
+        if (builder.coveringIndex && builder.indexDatabase && builder.fields && !builder.matcher) {
+            _coveringIndex = builder.coveringIndex;
+            _indexDatabase = builder.indexDatabase;
+        }
     }
     return self;
 }
@@ -62,8 +86,20 @@
 
 - (NSArray /* NSString */ *)documentIds
 {
+    if (!self.matcher) {
+        // Every candidate is a result, so skip and limit can be applied to the
+        // ids directly without loading any documents.
+        NSUInteger count = _originalDocumentIds.count;
+        NSUInteger location = MIN(self.skip, count);
+        NSUInteger length = count - location;
+        if (self.limit > 0) {
+            length = MIN(length, self.limit);
+        }
+        return [_originalDocumentIds subarrayWithRange:NSMakeRange(location, length)];
+    }
+
     // This is implemented using -enumerateObjectsUsingBlock so that when we're using
-    // skip, limit or post hoc matching the documentIds array is output correctly.
+    // post hoc matching the documentIds array is output correctly.
     NSMutableArray *accumulator = [NSMutableArray array];
     [self enumerateObjectsUsingBlock:^(CDTDocumentRevision *rev, NSUInteger idx, BOOL *stop) {
         [accumulator addObject:rev.docId];
@@ -71,37 +107,31 @@
     return [NSArray arrayWithArray:accumulator];
 }
 
+- (CDTQResultCursor *)cursorWithPageSize:(NSUInteger)pageSize
+{
+    return [[CDTQResultCursor alloc] initWithResultSet:self pageSize:pageSize];
+}
+
 - (void)enumerateObjectsUsingBlock:(void (^)(CDTDocumentRevision *rev, NSUInteger idx,
                                              BOOL *stop))block
 {
-    NSUInteger idx = 0;
+    __block NSUInteger idx = 0;
 
-    NSUInteger nSkipped = 0;   // used for skip
-    NSUInteger nReturned = 0;  // used for limit
+    __block NSUInteger nSkipped = 0;   // used for skip
+    __block NSUInteger nReturned = 0;  // used for limit
 
     // Avoid method calls in the loop
     NSUInteger skip = self.skip;
     NSUInteger limit = self.limit;
-    CDTQUnindexedMatcher *matcher = self.matcher;
     NSArray *fields = self.fields;
+    BOOL covering = (self.coveringIndex != nil);  // revisions come back already projected
+    CDTDatastore *datastore = _datastore;
 
-    BOOL stop = NO;  // user stopped, or we returned `limit` results
-    NSUInteger batchSize = 50;
-    NSRange range = NSMakeRange(0, batchSize);
-    while (range.location < _originalDocumentIds.count) {
-        range.length = MIN(batchSize, _originalDocumentIds.count - range.location);
-        NSArray *batch = [_originalDocumentIds subarrayWithRange:range];
-
-        NSArray *docs = [_datastore getDocumentsWithIds:batch];
-
+    // Called in order with each batch of candidate revisions which passed the matcher.
+    void (^consumeBatch)(NSArray *, BOOL *) = ^(NSArray *docs, BOOL *stop) {
         for (CDTDocumentRevision *rev in docs) {
             CDTDocumentRevision *innerRev = rev;  // allows us to replace later if projecting
 
-            // Apply post-hoc matcher
-            if (matcher && ![matcher matches:innerRev]) {
-                continue;
-            }
-
             // Apply skip (skip == 0 means disable)
             if (skip > 0 && nSkipped < skip) {
                 nSkipped++;
@@ -109,14 +139,13 @@
             }
 
             // Apply projection if result matches
-            if (fields) {
-                innerRev =
-                    [CDTQResultSet projectFields:self.fields fromRevision:rev datastore:_datastore];
+            if (fields && !covering) {
+                innerRev = [CDTQResultSet projectFields:fields fromRevision:rev datastore:datastore];
             }
 
             // Run callback
-            block(innerRev, idx, &stop);
-            if (stop) {
+            block(innerRev, idx, stop);
+            if (*stop) {
                 break;
             }
             idx++;
@@ -124,11 +153,32 @@
             // Apply limit (limit == 0 means disable)
             nReturned++;
             if (limit > 0 && nReturned >= limit) {
-                stop = YES;
+                *stop = YES;
                 break;
             }
         }
+    };
+
+    if (self.matcher) {
+        [self enumerateMatchedBatchesUsingBlock:consumeBatch];
+    } else {
+        [self enumerateBatchesUsingBlock:consumeBatch];
+    }
+}
 
+/**
+ Loads the candidate documents in batches on the calling thread.
+ */
+- (void)enumerateBatchesUsingBlock:(void (^)(NSArray *docs, BOOL *stop))batchBlock
+{
+    BOOL stop = NO;  // user stopped, or we returned `limit` results
+    NSRange range = NSMakeRange(0, kCDTQResultSetBatchSize);
+    while (range.location < _originalDocumentIds.count) {
+        range.length = MIN(kCDTQResultSetBatchSize, _originalDocumentIds.count - range.location);
+        NSArray *batch = [_originalDocumentIds subarrayWithRange:range];
+        NSArray *docs = [self candidateRevisionsForIds:batch];
+
+        batchBlock(docs, &stop);
         if (stop) {
             break;
         }
@@ -137,6 +187,235 @@
     }
 }
 
+/**
+ Loads the revisions for a batch of candidate ids, without post hoc matching.
+ */
+- (NSArray /* CDTDocumentRevision */ *)candidateRevisionsForIds:(NSArray *)docIds
+{
+    if (self.coveringIndex) {
+        return [self projectedRevisionsFromIndexForIds:docIds];
+    } else {
+        return [_datastore getDocumentsWithIds:docIds];
+    }
+}
+
+/**
+ Loads and matches candidate documents on a concurrent queue, passing the matching
+ revisions of each batch to `batchBlock` on the calling thread in candidate order.
+
+ Batches are processed a window at a time, and the next window is loaded and
+ matched while the caller consumes the current one. This bounds the number of
+ documents held in memory and stops work soon after the caller stops.
+ */
+- (void)enumerateMatchedBatchesUsingBlock:(void (^)(NSArray *docs, BOOL *stop))batchBlock
+{
+    NSUInteger nBatches =
+        (_originalDocumentIds.count + kCDTQResultSetBatchSize - 1) / kCDTQResultSetBatchSize;
+    NSUInteger nCores = [NSProcessInfo processInfo].activeProcessorCount;
+    NSUInteger windowSize = MAX((NSUInteger)2, nCores * 2);
+
+    NSMutableArray *results = nil;
+    dispatch_group_t group = [self matchBatchesInRange:NSMakeRange(0, MIN(windowSize, nBatches))
+                                             intoArray:&results];
+
+    BOOL stop = NO;
+    NSUInteger first = 0;
+    while (first < nBatches) {
+        dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+        NSArray *ready = results;
+
+        // Prefetch the next window while the caller handles this one
+        NSUInteger next = first + windowSize;
+        if (next < nBatches) {
+            group = [self matchBatchesInRange:NSMakeRange(next, MIN(windowSize, nBatches - next))
+                                    intoArray:&results];
+        }
+
+        for (NSArray *docs in ready) {
+            batchBlock(docs, &stop);
+            if (stop) {
+                break;
+            }
+        }
+
+        if (stop) {
+            // Don't leave the prefetched window running once we've returned
+            dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+            break;
+        }
+
+        first = next;
+    }
+}
+
+/**
+ Starts loading and matching the batches in `batchRange` on a concurrent queue.
+
+ @param results set to an array with an entry per batch, filled in with the
+                matching revisions once the returned group completes.
+ */
+- (dispatch_group_t)matchBatchesInRange:(NSRange)batchRange intoArray:(NSMutableArray **)results
+{
+    NSMutableArray *batchResults = [NSMutableArray arrayWithCapacity:batchRange.length];
+    for (NSUInteger i = 0; i < batchRange.length; i++) {
+        [batchResults addObject:@[]];
+    }
+    *results = batchResults;
+
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+
+    NSArray *docIds = _originalDocumentIds;
+    CDTDatastore *datastore = _datastore;
+    CDTQUnindexedMatcher *matcher = self.matcher;
+
+    for (NSUInteger i = 0; i < batchRange.length; i++) {
+        NSUInteger location = (batchRange.location + i) * kCDTQResultSetBatchSize;
+        NSRange range =
+            NSMakeRange(location, MIN(kCDTQResultSetBatchSize, docIds.count - location));
+
+        dispatch_group_async(group, queue, ^{
+            NSArray *docs = [datastore getDocumentsWithIds:[docIds subarrayWithRange:range]];
+            NSMutableArray *matched = [NSMutableArray arrayWithCapacity:docs.count];
+            for (CDTDocumentRevision *rev in docs) {
+                if ([matcher matches:rev]) {
+                    [matched addObject:rev];
+                }
+            }
+
+            @synchronized(batchResults) { batchResults[i] = matched; }
+        });
+    }
+
+    return group;
+}
+
+/**
+ Build projected revisions for `docIds` from the covering index's columns, in
+ the order of `docIds`.
+
+ Documents which can't be rebuilt from the index are loaded and projected as
+ usual: all of them if any of the fields has had a value the index can't
+ reproduce, like an array or a boolean (see the index metadata's `projectable`
+ flag); otherwise those with more than one index row, which have an array in
+ another field; those with a NULL column, which are missing a field; and those
+ with no index row at all.
+ */
+- (NSArray /* CDTDocumentRevision */ *)projectedRevisionsFromIndexForIds:(NSArray *)docIds
+{
+    NSMutableArray *columns = [NSMutableArray arrayWithObjects:@"_id", @"_rev", nil];
+    for (NSString *field in _fields) {
+        [columns addObject:[NSString stringWithFormat:@"\"%@\"", field]];
+    }
+    NSMutableArray *placeholders = [NSMutableArray array];
+    for (NSUInteger i = 0; i < docIds.count; i++) {
+        [placeholders addObject:@"?"];
+    }
+
+    NSString *sql = @"SELECT %@, COUNT(*) AS _rows FROM \"%@\" WHERE _id IN (%@) GROUP BY _id;";
+    sql = [NSString stringWithFormat:sql, [columns componentsJoinedByString:@", "],
+                                     [CDTQIndexManager tableNameForIndex:_coveringIndex],
+                                     [placeholders componentsJoinedByString:@", "]];
+
+    NSMutableDictionary *revsById = [NSMutableDictionary dictionary];
+    NSArray *fields = _fields;
+    CDTDatastore *datastore = _datastore;
+
+    [_indexDatabase inDatabase:^(FMDatabase *db) {
+        if (![CDTQResultSet fields:fields
+                areProjectableFromIndex:self->_coveringIndex
+                             inDatabase:db]) {
+            return;
+        }
+
+        FMResultSet *rs = [db executeQuery:sql withArgumentsInArray:docIds];
+        if (!rs) {
+            CDTLogError(CDTQ_LOG_CONTEXT, @"Failed to read projected fields from index %@: %@",
+                        self->_coveringIndex, [db lastErrorMessage]);
+        }
+        while ([rs next]) {
+            if ([rs intForColumn:@"_rows"] > 1) {
+                continue;
+            }
+
+            __block BOOL hasNull = NO;
+            NSMutableDictionary *body = [NSMutableDictionary dictionary];
+            [fields enumerateObjectsUsingBlock:^(NSString *field, NSUInteger idx, BOOL *stop) {
+                id value = [rs objectForColumnIndex:(int)idx + 2];
+                if (value == [NSNull null]) {
+                    hasNull = YES;
+                    *stop = YES;
+                }
+                body[field] = value;
+            }];
+            if (hasNull) {
+                continue;
+            }
+
+            NSString *docId = [rs stringForColumnIndex:0];
+
+            revsById[docId] =
+                [[CDTQProjectedDocumentRevision alloc] initWithDocId:docId
+                                                          revisionId:[rs stringForColumnIndex:1]
+                                                                body:body
+                                                             deleted:NO
+                                                         attachments:@{}
+                                                            sequence:0
+                                                           datastore:datastore];
+        }
+        [rs close];
+    }];
+
+    NSMutableArray *docIdsToLoad = [NSMutableArray array];
+    for (NSString *docId in docIds) {
+        if (!revsById[docId]) {
+            [docIdsToLoad addObject:docId];
+        }
+    }
+
+    if (docIdsToLoad.count > 0) {
+        for (CDTDocumentRevision *rev in [datastore getDocumentsWithIds:docIdsToLoad]) {
+            revsById[rev.docId] =
+                [CDTQResultSet projectFields:fields fromRevision:rev datastore:datastore];
+        }
+    }
+
+    NSMutableArray *revs = [NSMutableArray arrayWithCapacity:docIds.count];
+    for (NSString *docId in docIds) {
+        CDTDocumentRevision *rev = revsById[docId];
+        if (rev) {
+            [revs addObject:rev];
+        }
+    }
+    return revs;
+}
+
+/**
+ Returns whether every value `indexName` holds for `fields` reads back just as
+ it is in its document.
+ */
++ (BOOL)fields:(NSArray *)fields
+    areProjectableFromIndex:(NSString *)indexName
+                 inDatabase:(FMDatabase *)db
+{
+    NSSet *fieldSet = [NSSet setWithArray:fields];
+    NSMutableArray *placeholders = [NSMutableArray array];
+    for (NSUInteger i = 0; i < fieldSet.count; i++) {
+        [placeholders addObject:@"?"];
+    }
+
+    NSString *sql = @"SELECT COUNT(DISTINCT field_name) FROM %@ "
+                    @"WHERE index_name = ? AND projectable != 0 AND field_name IN (%@);";
+    sql = [NSString stringWithFormat:sql, kCDTQIndexMetadataTableName,
+                                     [placeholders componentsJoinedByString:@", "]];
+    NSArray *arguments = [@[ indexName ] arrayByAddingObjectsFromArray:fieldSet.allObjects];
+
+    FMResultSet *rs = [db executeQuery:sql withArgumentsInArray:arguments];
+    NSUInteger projectable = [rs next] ? (NSUInteger)[rs longLongIntForColumnIndex:0] : 0;
+    [rs close];
+    return projectable == fieldSet.count;
+}
+
 + (CDTDocumentRevision *)projectFields:(NSArray *)fields
                           fromRevision:(CDTDocumentRevision *)rev
                              datastore:(CDTDatastore *)datastore
@@ -153,3 +432,150 @@
 }
 
 @end
+
+@implementation CDTQResultCursor {
+    CDTQResultSet *_resultSet;
+    NSUInteger _pageSize;
+
+    // Serial queue on which all loading and cursor state changes happen
+    dispatch_queue_t _loadingQueue;
+
+    NSUInteger _nextBatch;  // index of the next batch of candidate ids to load
+    NSUInteger _nSkipped;   // used for skip
+    NSUInteger _nReturned;  // used for limit
+    BOOL _exhausted;
+
+    // Results loaded, matched and projected, but not yet put into a page
+    NSMutableArray *_buffered;
+
+    // The page loaded ahead of the caller asking for it
+    NSArray *_prefetchedPage;
+}
+
+- (instancetype)initWithResultSet:(CDTQResultSet *)resultSet pageSize:(NSUInteger)pageSize
+{
+    NSParameterAssert(resultSet);
+    NSParameterAssert(pageSize > 0);
+
+    self = [super init];
+    if (self) {
+        _resultSet = resultSet;
+        _pageSize = pageSize;
+        _loadingQueue =
+            dispatch_queue_create("com.cloudant.sync.query.cursor", DISPATCH_QUEUE_SERIAL);
+        _buffered = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (void)nextPageOnQueue:(dispatch_queue_t)queue
+      completionHandler:(void (^)(NSArray<CDTDocumentRevision *> *page))completionHandler
+{
+    NSParameterAssert(queue);
+    NSParameterAssert(completionHandler);
+
+    dispatch_async(_loadingQueue, ^{
+        NSArray *page = self->_prefetchedPage ?: [self loadPage];
+        self->_prefetchedPage = nil;
+
+        dispatch_async(queue, ^{
+            completionHandler(page);
+        });
+
+        // Have the following page ready for when the caller is done with this one
+        if (page.count > 0) {
+            self->_prefetchedPage = [self loadPage];
+        }
+    });
+}
+
+/**
+ Fills a page from the buffered results, loading more candidates as needed.
+ Called on the loading queue.
+ */
+- (NSArray *)loadPage
+{
+    NSUInteger limit = _resultSet.limit;
+
+    NSMutableArray *page = [NSMutableArray arrayWithCapacity:_pageSize];
+    while (page.count < _pageSize && !_exhausted) {
+        if (_buffered.count == 0 && ![self bufferMoreResults]) {
+            _exhausted = YES;
+            break;
+        }
+
+        NSUInteger n = MIN(_pageSize - page.count, _buffered.count);
+        if (limit > 0) {
+            n = MIN(n, limit - _nReturned);
+        }
+        NSRange range = NSMakeRange(0, n);
+        [page addObjectsFromArray:[_buffered subarrayWithRange:range]];
+        [_buffered removeObjectsInRange:range];
+
+        // Apply limit (limit == 0 means disable)
+        _nReturned += n;
+        if (limit > 0 && _nReturned >= limit) {
+            _exhausted = YES;
+        }
+    }
+
+    return [NSArray arrayWithArray:page];
+}
+
+/**
+ Loads the next candidates, adding those which pass the matcher and skip to the
+ buffer. Returns NO when there are no candidates left.
+ */
+- (BOOL)bufferMoreResults
+{
+    CDTQResultSet *resultSet = _resultSet;
+    NSArray *docIds = resultSet.originalDocumentIds;
+    NSUInteger nBatches = (docIds.count + kCDTQResultSetBatchSize - 1) / kCDTQResultSetBatchSize;
+    if (_nextBatch >= nBatches) {
+        return NO;
+    }
+
+    NSArray *batches;
+    if (resultSet.matcher) {
+        // Matching is the expensive part, so spread a batch per core
+        NSUInteger nCores = [NSProcessInfo processInfo].activeProcessorCount;
+        NSRange batchRange = NSMakeRange(_nextBatch, MIN(MAX(nCores, (NSUInteger)1),
+                                                         nBatches - _nextBatch));
+        NSMutableArray *results = nil;
+        dispatch_group_t group = [resultSet matchBatchesInRange:batchRange intoArray:&results];
+        dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+        batches = results;
+        _nextBatch += batchRange.length;
+    } else {
+        NSUInteger location = _nextBatch * kCDTQResultSetBatchSize;
+        NSRange range =
+            NSMakeRange(location, MIN(kCDTQResultSetBatchSize, docIds.count - location));
+        batches = @[ [resultSet candidateRevisionsForIds:[docIds subarrayWithRange:range]] ];
+        _nextBatch++;
+    }
+
+    NSUInteger skip = resultSet.skip;
+    NSArray *fields = resultSet.fields;
+    BOOL covering = (resultSet.coveringIndex != nil);  // revisions come back already projected
+    for (NSArray *docs in batches) {
+        for (CDTDocumentRevision *rev in docs) {
+            // Apply skip (skip == 0 means disable)
+            if (skip > 0 && _nSkipped < skip) {
+                _nSkipped++;
+                continue;
+            }
+
+            if (fields && !covering) {
+                [_buffered addObject:[CDTQResultSet projectFields:fields
+                                                     fromRevision:rev
+                                                        datastore:resultSet.datastore]];
+            } else {
+                [_buffered addObject:rev];
+            }
+        }
+    }
+
+    return YES;
+}
+
+@end
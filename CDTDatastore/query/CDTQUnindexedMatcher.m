@@ -27,10 +27,16 @@
 
 @end
 
+typedef BOOL (^CDTQMatcherPredicate)(CDTDocumentRevision *rev);
+typedef BOOL (^CDTQValueComparator)(NSObject *actual, NSObject *expected);
+
 @interface CDTQUnindexedMatcher ()
 
 @property (nonatomic, strong) CDTQChildrenQueryNode *root;
 
+// The tree compiled into nested blocks, evaluated for each document
+@property (nonatomic, copy) CDTQMatcherPredicate predicate;
+
 @end
 
 @implementation CDTQUnindexedMatcher
@@ -47,6 +53,7 @@
 
     CDTQUnindexedMatcher *matcher = [[CDTQUnindexedMatcher alloc] init];
     matcher.root = root;
+    matcher.predicate = [CDTQUnindexedMatcher predicateForNode:root];
     return matcher;
 }
 
@@ -122,153 +129,178 @@
 
 #pragma mark Matching documents
 
-- (BOOL)matches:(CDTDocumentRevision *)rev
-{
-    return [self executeSelectorTree:self.root onRevision:rev];
-}
-
-#pragma mark Tree walking
+- (BOOL)matches:(CDTDocumentRevision *)rev { return self.predicate(rev); }
 
-- (BOOL)executeSelectorTree:(CDTQQueryNode *)node onRevision:(CDTDocumentRevision *)rev
-{
-    if ([node isKindOfClass:[CDTQAndQueryNode class]]) {
-        BOOL passed = YES;
+#pragma mark Compiling the tree
 
-        CDTQAndQueryNode *andNode = (CDTQAndQueryNode *)node;
+/**
+ Compile a node of the selector tree into a block that evaluates it.
 
-//        if ([andNode.children count] == 0) {
-//            // well this isn't right, something has gone wrong
-//            return NO;
-//        }
-
-        for (CDTQQueryNode *child in andNode.children) {
-            passed = passed && [self executeSelectorTree:child onRevision:rev];
+ The tree is walked, and operators and field names resolved, once per query
+ rather than once per candidate document.
+ */
++ (CDTQMatcherPredicate)predicateForNode:(CDTQQueryNode *)node
+{
+    if ([node isKindOfClass:[CDTQAndQueryNode class]] ||
+        [node isKindOfClass:[CDTQOrQueryNode class]]) {
+        NSMutableArray *childPredicates = [NSMutableArray array];
+        for (CDTQQueryNode *child in ((CDTQChildrenQueryNode *)node).children) {
+            [childPredicates addObject:[CDTQUnindexedMatcher predicateForNode:child]];
+        }
+        NSArray *children = [NSArray arrayWithArray:childPredicates];
+
+        if ([node isKindOfClass:[CDTQAndQueryNode class]]) {
+            return ^BOOL(CDTDocumentRevision *rev) {
+                for (CDTQMatcherPredicate child in children) {
+                    if (!child(rev)) {
+                        return NO;
+                    }
+                }
+                return YES;
+            };
+        } else {
+            return ^BOOL(CDTDocumentRevision *rev) {
+                for (CDTQMatcherPredicate child in children) {
+                    if (child(rev)) {
+                        return YES;
+                    }
+                }
+                return NO;
+            };
         }
 
-        return passed;
-    }
-    if ([node isKindOfClass:[CDTQOrQueryNode class]]) {
-        BOOL passed = NO;
+    } else if ([node isKindOfClass:[CDTQOperatorExpressionNode class]]) {
+        return [CDTQUnindexedMatcher
+            predicateForExpression:((CDTQOperatorExpressionNode *)node).expression];
 
-        CDTQOrQueryNode *orNode = (CDTQOrQueryNode *)node;
-        for (CDTQQueryNode *child in orNode.children) {
-            passed = passed || [self executeSelectorTree:child onRevision:rev];
-        }
+    } else {
+        // We constructed the tree, so shouldn't end up here; error if we do.
+        CDTLogError(CDTQ_LOG_CONTEXT, @"Found unexpected selector execution tree: %@", node);
+        return ^BOOL(CDTDocumentRevision *rev) { return NO; };
+    }
+}
 
-        return passed;
++ (CDTQMatcherPredicate)predicateForExpression:(NSDictionary *)expression
+{
+    // Here we could have:
+    //   { fieldName: { operator: value } }
+    // or
+    //   { fieldName: { $not: { operator: value } } }
 
-    } else if ([node isKindOfClass:[CDTQOperatorExpressionNode class]]) {
-        NSDictionary *expression = ((CDTQOperatorExpressionNode *)node).expression;
+    NSString *fieldName = expression.allKeys[0];
+    NSDictionary *operatorExpression = expression[fieldName];
 
-        // Here we could have:
-        //   { fieldName: { operator: value } }
-        // or
-        //   { fieldName: { $not: { operator: value } } }
+    NSString *operator= operatorExpression.allKeys[0];
 
-        // Next evaluate the result
-        NSString *fieldName = expression.allKeys[0];
-        NSDictionary *operatorExpression = expression[fieldName];
+    // First work out whether we need to invert the result when done
+    BOOL invertResult = [operator isEqualToString:NOT];
+    if (invertResult) {
+        operatorExpression = operatorExpression[NOT];
+        operator = operatorExpression.allKeys[0];
+    }
 
-        NSString *operator= operatorExpression.allKeys[0];
+    NSObject *expected = operatorExpression[operator];
+    NSArray *fieldPath = [fieldName componentsSeparatedByString:@"."];
+
+    if ([@[ MOD, SIZE ] containsObject:operator]) {
+        // If an operator like $mod or $size is found we need to treat the
+        // comparison as a special case.
+        //
+        // $mod: perform modulo arithmetic on the actual value using the first
+        //       element in the expected array as the divisor before comparing
+        //       the result to the second element in the expected array.
+        //
+        // $size: check whether the actual value is an array, then compare the
+        //        actual array size with the expected value.
+        CDTQValueComparator comparator = [CDTQUnindexedMatcher comparatorForOperator:operator];
+        return ^BOOL(CDTDocumentRevision *rev) {
+            NSObject *actual = [CDTQValueExtractor extractValueForFieldPath:fieldPath
+                                                               fromRevision:rev];
+            BOOL passed = comparator(actual, expected);
+            return invertResult ? !passed : passed;
+        };
+    }
 
-        // First work out whether we need to invert the result when done
-        BOOL invertResult = [operator isEqualToString:NOT];
-        if (invertResult) {
-            operatorExpression = operatorExpression[NOT];
-            operator = operatorExpression.allKeys[0];
+    // Since $in is the same as a series of $eq comparisons -
+    // Treat them the same by:
+    // - Ensuring that both expected and actual are NSArrays.
+    // - Convert the $in operator to the $eq operator.
+    NSArray *expectedItems =
+        [expected isKindOfClass:[NSArray class]] ? (NSArray *)expected : @[ expected ];
+    if ([operator isEqualToString:IN]) {
+        operator = EQ;
+    }
+    CDTQValueComparator comparator = [CDTQUnindexedMatcher comparatorForOperator:operator];
+
+    return ^BOOL(CDTDocumentRevision *rev) {
+        NSObject *actual = [CDTQValueExtractor extractValueForFieldPath:fieldPath
+                                                           fromRevision:rev];
+        NSArray *actualItems;
+        if ([actual isKindOfClass:[NSArray class]]) {
+            actualItems = (NSArray *)actual;
+        } else {
+            actualItems = actual ? @[ actual ] : @[ [NSNull null] ];
         }
 
-        NSObject *expected = operatorExpression[operator];
-        NSObject *actual = [CDTQValueExtractor extractValueForFieldName:fieldName fromRevision:rev];
-        
+        // Any actual item can match any value in the expected NSArray
         BOOL passed = NO;
-        NSArray *specialCaseOperators = @[ MOD, SIZE ];
-        if ([specialCaseOperators containsObject:operator]) {
-            // If an operator like $mod or $size is found we need to treat the
-            // comparison as a special case.
-            //
-            // $mod: perform modulo arithmetic on the actual value using the first
-            //       element in the expected array as the divisor before comparing
-            //       the result to the second element in the expected array.
-            //
-            // $size: check whether the actual value is an array, then compare the
-            //        actual array size with the expected value.
-            passed = [self actualValue:actual matchesOperator:operator andExpectedValue:expected];
-        } else {
-            // Since $in is the same as a series of $eq comparisons -
-            // Treat them the same by:
-            // - Ensuring that both expected and actual are NSArrays.
-            // - Convert the $in operator to the $eq operator.
-            if (![expected isKindOfClass:[NSArray class]]) {
-                expected = @[ expected ];
-            }
-            if (![actual isKindOfClass:[NSArray class]]) {
-                actual = actual ? @[ actual ] : @[ [NSNull null] ];
-            }
-            if ([operator isEqualToString:IN]) {
-                operator = EQ;
-            }
-            
-            for (NSObject *expectedItem in (NSArray *)expected) {
-                for (NSObject *actualItem in (NSArray *)actual) {
-                    // OR since any actual item can match any value in the expected NSArray
-                    passed = passed || [self actualValue:actualItem
-                                         matchesOperator:operator
-                                        andExpectedValue:expectedItem];
+        for (NSObject *expectedItem in expectedItems) {
+            for (NSObject *actualItem in actualItems) {
+                if (comparator(actualItem, expectedItem)) {
+                    passed = YES;
+                    break;
                 }
             }
+            if (passed) {
+                break;
+            }
         }
         return invertResult ? !passed : passed;
-    } else {
-        // We constructed the tree, so shouldn't end up here; error if we do.
-        CDTLogError(CDTQ_LOG_CONTEXT, @"Found unexpected selector execution tree: %@", node);
-        return NO;
-    }
+    };
 }
 
-- (BOOL)actualValue:(NSObject *)actual
-     matchesOperator:(NSString *) operator
-    andExpectedValue:(NSObject *)expected
+/**
+ Resolve an operator to the block comparing an actual value with an expected one.
+ */
++ (CDTQValueComparator)comparatorForOperator:(NSString *)operator
 {
-    BOOL passed = NO;
-
     if ([operator isEqualToString:EQ]) {
-        passed = [self eqL:actual R:expected];
+        return ^BOOL(NSObject *l, NSObject *r) { return [self eqL:l R:r]; };
 
     } else if ([operator isEqualToString:LT]) {
-        passed = [self ltL:actual R:expected];
+        return ^BOOL(NSObject *l, NSObject *r) { return [self ltL:l R:r]; };
 
     } else if ([operator isEqualToString:LTE]) {
-        passed = [self lteL:actual R:expected];
+        return ^BOOL(NSObject *l, NSObject *r) { return [self lteL:l R:r]; };
 
     } else if ([operator isEqualToString:GT]) {
-        passed = [self gtL:actual R:expected];
+        return ^BOOL(NSObject *l, NSObject *r) { return [self gtL:l R:r]; };
 
     } else if ([operator isEqualToString:GTE]) {
-        passed = [self gteL:actual R:expected];
+        return ^BOOL(NSObject *l, NSObject *r) { return [self gteL:l R:r]; };
 
     } else if ([operator isEqualToString:MOD]) {
-        passed = [self modL:actual R:expected];
-        
+        return ^BOOL(NSObject *l, NSObject *r) { return [self modL:l R:r]; };
+
     } else if ([operator isEqualToString:SIZE]) {
-        passed = [self sizeL:actual R:expected];
-        
+        return ^BOOL(NSObject *l, NSObject *r) { return [self sizeL:l R:r]; };
+
     } else if ([operator isEqualToString:EXISTS]) {
-        BOOL expectedBool = [((NSNumber *)expected)boolValue];
-        BOOL exists = (![actual isEqual:[NSNull null]]);
-        passed = (exists == expectedBool);
+        return ^BOOL(NSObject *l, NSObject *r) {
+            BOOL expectedBool = [((NSNumber *)r)boolValue];
+            BOOL exists = (![l isEqual:[NSNull null]]);
+            return (exists == expectedBool);
+        };
 
     } else {
         CDTLogWarn(CDTQ_LOG_CONTEXT, @"Found unexpected operator in selector: %@", operator);
-        passed = NO;  // didn't understand
+        return ^BOOL(NSObject *l, NSObject *r) { return NO; };  // didn't understand
     }
-
-    return passed;
 }
 
 #pragma mark matchers
 
-- (BOOL)eqL:(NSObject *)l R:(NSObject *)r { return [l isEqual:r]; }
++ (BOOL)eqL:(NSObject *)l R:(NSObject *)r { return [l isEqual:r]; }
 
 //
 // Try to respect SQLite's ordering semantics:
@@ -276,7 +308,7 @@
 //  2. INT/REAL
 //  3. TEXT
 //  4. BLOB
-- (BOOL)ltL:(NSObject *)l R:(NSObject *)r
++ (BOOL)ltL:(NSObject *)l R:(NSObject *)r
 {
     if ([l isEqual:[NSNull null]]) {
         return NO;  // NSNull fails all lt/gt/lte/gte tests
@@ -312,7 +344,7 @@
     }
 }
 
-- (BOOL)lteL:(NSObject *)l R:(NSObject *)r
++ (BOOL)lteL:(NSObject *)l R:(NSObject *)r
 {
     if ([l isEqual:[NSNull null]]) {
         return NO;  // NSNull fails all lt/gt/lte/gte tests
@@ -326,7 +358,7 @@
     return [self ltL:l R:r] || [l isEqual:r];
 }
 
-- (BOOL)gtL:(NSObject *)l R:(NSObject *)r
++ (BOOL)gtL:(NSObject *)l R:(NSObject *)r
 {
     if ([l isEqual:[NSNull null]]) {
         return NO;  // NSNull fails all lt/gt/lte/gte tests
@@ -340,7 +372,7 @@
     return ![self lteL:l R:r];
 }
 
-- (BOOL)gteL:(NSObject *)l R:(NSObject *)r
++ (BOOL)gteL:(NSObject *)l R:(NSObject *)r
 {
     if ([l isEqual:[NSNull null]]) {
         return NO;  // NSNull fails all lt/gt/lte/gte tests
@@ -354,7 +386,7 @@
     return ![self ltL:l R:r];
 }
 
-- (BOOL)modL:(NSObject *)l R:(NSObject *)r
++ (BOOL)modL:(NSObject *)l R:(NSObject *)r
 {
     if (![l isKindOfClass:[NSNumber class]]) {
         return NO;
@@ -374,7 +406,7 @@
     return actualRemainder == expectedRemainder;
 }
 
-- (BOOL)sizeL:(NSObject *)l R:(NSObject *)r
++ (BOOL)sizeL:(NSObject *)l R:(NSObject *)r
 {
     // The actual value must be an array and the expected value must be a number in
     // order to perform a size comparison.
@@ -29,6 +29,16 @@ NS_ASSUME_NONNULL_BEGIN
 + (nullable NSObject *)extractValueForFieldName:(NSString *)fieldName
                                  fromDictionary:(NSDictionary *)body;
 
+/**
+ As +extractValueForFieldName:fromRevision:, but taking a field name already split
+ on `.`, so callers evaluating the same field many times only split it once.
+ */
++ (nullable NSObject *)extractValueForFieldPath:(NSArray<NSString *> *)fieldPath
+                                   fromRevision:(CDTDocumentRevision *)rev;
+
++ (nullable NSObject *)extractValueForFieldPath:(NSArray<NSString *> *)fieldPath
+                                 fromDictionary:(NSDictionary *)body;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -36,6 +36,28 @@
 
 + (NSObject *)extractValueForFieldName:(NSString *)possiblyDottedField
                         fromDictionary:(NSDictionary *)body
+{
+    return [CDTQValueExtractor
+        extractValueForFieldPath:[possiblyDottedField componentsSeparatedByString:@"."]
+                  fromDictionary:body];
+}
+
++ (NSObject *)extractValueForFieldPath:(NSArray *)fieldPath fromRevision:(CDTDocumentRevision *)rev
+{
+    // _id and _rev are special fields which come from attributes
+    // of the revision and not its body.
+    if (fieldPath.count == 1) {
+        NSString *field = fieldPath[0];
+        if ([field isEqualToString:@"_id"]) {
+            return rev.docId;
+        } else if ([field isEqualToString:@"_rev"]) {
+            return rev.revId;
+        }
+    }
+    return [CDTQValueExtractor extractValueForFieldPath:fieldPath fromDictionary:rev.body];
+}
+
++ (NSObject *)extractValueForFieldPath:(NSArray *)fieldPath fromDictionary:(NSDictionary *)body
 {
     // The algorithm here is to split the fields into a "path" and a "lastSegment".
     // The path leads us to the final sub-document. We know that if we have either
@@ -44,25 +66,23 @@
     // that each level of the `path` results in a document rather than a value,
     // because if it's a value, we can't continue the selection process.
 
-    NSArray *fields = [possiblyDottedField componentsSeparatedByString:@"."];
+    if (fieldPath.count == 0) {
+        return nil;
+    }
 
-    NSRange pathLen;
-    pathLen.location = 0;
-    pathLen.length = fields.count - 1;
-    NSArray *path = [fields subarrayWithRange:pathLen];
-    NSString *lastSegment = [fields lastObject];
+    NSUInteger pathLength = fieldPath.count - 1;
 
     NSDictionary *currentLevel = body;
-    for (NSString *field in path) {
-        currentLevel = currentLevel[field];
+    for (NSUInteger i = 0; i < pathLength; i++) {
+        currentLevel = currentLevel[fieldPath[i]];
         if (currentLevel == nil || ![currentLevel isKindOfClass:[NSDictionary class]]) {
             CDTLogVerbose(CDTQ_LOG_CONTEXT, @"Could not extract field %@ from document %@",
-                          possiblyDottedField, body);
+                          [fieldPath componentsJoinedByString:@"."], body);
             return nil;  // we ran out of stuff before we reached the full path length
         }
     }
 
-    return currentLevel[lastSegment];
+    return currentLevel[[fieldPath lastObject]];
 }
 
 @end
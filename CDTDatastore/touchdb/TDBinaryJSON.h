@@ -0,0 +1,55 @@
+//
+//  TDBinaryJSON.h
+//
+//  Copyright © 2018 IBM Corporation. All rights reserved.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//  except in compliance with the License. You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+//  Unless required by applicable law or agreed to in writing, software distributed under the
+//  License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//  either express or implied. See the License for the specific language governing permissions
+//  and limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+/** A compact binary encoding of JSON objects, used to store revision bodies.
+
+    The data starts with a header that can't begin JSON text, so stored bodies in either format
+    can be told apart. The header is followed by a table of every distinct key in the document,
+    stored once, and then the top-level object. Each value is a type tag followed by its data;
+    strings, arrays and objects are prefixed by their length, so any value can be skipped without
+    decoding it. Objects have a table giving each key's index and the offset of its value, so
+    reading one property doesn't involve decoding the ones before it.
+
+    Decoded values are immutable Foundation objects, the same types TDJSON produces. */
+@interface TDBinaryJSON : NSObject
+
+/** Returns YES if the data is in the binary format rather than JSON text. */
++ (BOOL)isBinaryJSON:(NSData*)data;
+
+/** Encodes a dictionary of JSON-compatible values. Returns nil if it contains anything that
+    can't be written as JSON. */
++ (NSData*)dataWithJSONObject:(NSDictionary*)object;
+
+/** Decodes the whole of binary data. Returns nil if it isn't well-formed. */
++ (NSDictionary*)JSONObjectWithData:(NSData*)data;
+
+@end
+
+/** Decodes parts of binary data, reading its key table once for any number of values. */
+@interface TDBinaryJSONReader : NSObject
+
+/** Returns nil if the data doesn't have a well-formed header. The data isn't copied, so it must
+    not change or be freed while the reader is in use. */
+- (id)initWithData:(NSData*)data;
+
+/** Returns the keys of the top-level object in the order they're stored, and sets *outRanges to
+    an NSRange per key giving where its value is in the data. Returns nil if the object isn't
+    well-formed; its values are only checked when they're decoded. */
+- (NSArray*)keysWithValueRanges:(NSData**)outRanges;
+
+/** Decodes the value at the given range, or returns nil if it isn't well-formed. */
+- (id)valueInRange:(NSRange)range;
+
+@end
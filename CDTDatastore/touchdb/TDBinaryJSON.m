@@ -0,0 +1,436 @@
+//
+//  TDBinaryJSON.m
+//
+//  Copyright © 2018 IBM Corporation. All rights reserved.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//  except in compliance with the License. You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+//  Unless required by applicable law or agreed to in writing, software distributed under the
+//  License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//  either express or implied. See the License for the specific language governing permissions
+//  and limitations under the License.
+
+#import "TDBinaryJSON.h"
+#import "CollectionUtils.h"
+
+// Layout (integers are little-endian; varints are unsigned LEB128):
+//
+//   data   := magic version keyCount:varint (length:varint utf8)* object
+//   value  := tag payload
+//   null, false, true      -- no payload
+//   integer                -- zigzag varint
+//   double                 -- 8 bytes, IEEE 754
+//   string, decimal        -- length:varint utf8 (a decimal is a number too big for the others)
+//   array  := count:varint length:varint value*
+//   object := count:varint length:varint (keyIndex:uint32 offset:uint32)* value*
+//
+// An array's or object's length covers everything after it. An object's offsets are from the
+// start of its first value, and its values are stored in the same order as its table.
+
+static const uint8_t kMagic[] = {0x00, 'T', 'D', 'B'};  // a NUL byte can't begin JSON text
+static const uint8_t kVersion = 1;
+
+// Deeper nesting than this is rejected, rather than risk overflowing the stack
+static const NSUInteger kMaxDepth = 512;
+
+enum {
+    kTagNull = 0,
+    kTagFalse,
+    kTagTrue,
+    kTagInteger,
+    kTagDouble,
+    kTagString,
+    kTagDecimal,
+    kTagArray,
+    kTagObject
+};
+
+typedef uint32_t TDBinaryJSONTableEntry[2];  // key index, value offset
+
+@interface TDBinaryJSONReader ()
+- (NSDictionary*)rootObject;
+@end
+
+#pragma mark - ENCODING:
+
+static void writeVarint(NSMutableData* out, uint64_t n)
+{
+    uint8_t buf[10];
+    size_t length = 0;
+    do {
+        uint8_t byte = n & 0x7F;
+        n >>= 7;
+        buf[length++] = byte | (n ? 0x80 : 0);
+    } while (n);
+    [out appendBytes:buf length:length];
+}
+
+static void writeTag(NSMutableData* out, uint8_t tag) { [out appendBytes:&tag length:1]; }
+
+static BOOL writeUTF8(NSMutableData* out, NSString* str)
+{
+    NSData* utf8 = [str dataUsingEncoding:NSUTF8StringEncoding];
+    if (!utf8) return NO;
+    writeVarint(out, utf8.length);
+    [out appendData:utf8];
+    return YES;
+}
+
+static BOOL writeNumber(NSMutableData* out, NSNumber* number)
+{
+    if ([number isKindOfClass:[NSDecimalNumber class]]) {
+        writeTag(out, kTagDecimal);
+        return writeUTF8(out, number.stringValue);
+    } else if (CFGetTypeID((__bridge CFTypeRef)number) == CFBooleanGetTypeID()) {
+        writeTag(out, number.boolValue ? kTagTrue : kTagFalse);
+    } else if (CFNumberIsFloatType((__bridge CFNumberRef)number)) {
+        double d = number.doubleValue;
+        if (!isfinite(d)) return NO;  // JSON has no NaN or infinity
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        bits = CFSwapInt64HostToLittle(bits);
+        writeTag(out, kTagDouble);
+        [out appendBytes:&bits length:sizeof(bits)];
+    } else if (strcmp(number.objCType, @encode(unsigned long long)) == 0 &&
+               number.unsignedLongLongValue > INT64_MAX) {
+        writeTag(out, kTagDecimal);
+        return writeUTF8(out, number.stringValue);
+    } else {
+        // Zigzag encoding keeps small negative numbers short
+        int64_t n = number.longLongValue;
+        writeTag(out, kTagInteger);
+        writeVarint(out, ((uint64_t)n << 1) ^ (uint64_t)(n >> 63));
+    }
+    return YES;
+}
+
+/** Encodes one document, collecting the keys of all its objects into one table. */
+@interface TDBinaryJSONWriter : NSObject {
+   @public
+    NSMutableArray* _keys;
+    NSMutableDictionary* _indexByKey;  // key -> index in _keys
+}
+@end
+
+@implementation TDBinaryJSONWriter
+
+- (id)init
+{
+    self = [super init];
+    if (self) {
+        _keys = [NSMutableArray array];
+        _indexByKey = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (BOOL)writeValue:(id)value to:(NSMutableData*)out depth:(NSUInteger)depth
+{
+    if (depth > kMaxDepth) return NO;
+    if ([value isKindOfClass:[NSString class]]) {
+        writeTag(out, kTagString);
+        return writeUTF8(out, value);
+    } else if ([value isKindOfClass:[NSNumber class]]) {
+        return writeNumber(out, value);
+    } else if ([value isKindOfClass:[NSNull class]]) {
+        writeTag(out, kTagNull);
+        return YES;
+    } else if ([value isKindOfClass:[NSArray class]]) {
+        NSMutableData* elements = [NSMutableData data];
+        for (id element in value) {
+            if (![self writeValue:element to:elements depth:depth + 1]) return NO;
+        }
+        writeTag(out, kTagArray);
+        writeVarint(out, [value count]);
+        writeVarint(out, elements.length);
+        [out appendData:elements];
+        return YES;
+    } else if ([value isKindOfClass:[NSDictionary class]]) {
+        return [self writeObject:value to:out depth:depth];
+    }
+    return NO;
+}
+
+- (BOOL)writeObject:(NSDictionary*)object to:(NSMutableData*)out depth:(NSUInteger)depth
+{
+    NSMutableData* table =
+        [NSMutableData dataWithCapacity:object.count * sizeof(TDBinaryJSONTableEntry)];
+    NSMutableData* values = [NSMutableData data];
+    for (NSString* key in object) {
+        if (![key isKindOfClass:[NSString class]] || values.length > UINT32_MAX) return NO;
+        NSNumber* index = _indexByKey[key];
+        if (!index) {
+            index = @(_keys.count);
+            _indexByKey[key] = index;
+            [_keys addObject:key];
+        }
+        TDBinaryJSONTableEntry entry = {CFSwapInt32HostToLittle(index.unsignedIntValue),
+                                        CFSwapInt32HostToLittle((uint32_t)values.length)};
+        [table appendBytes:entry length:sizeof(entry)];
+        if (![self writeValue:object[key] to:values depth:depth + 1]) return NO;
+    }
+    writeTag(out, kTagObject);
+    writeVarint(out, object.count);
+    writeVarint(out, table.length + values.length);
+    [out appendData:table];
+    [out appendData:values];
+    return YES;
+}
+
+@end
+
+@implementation TDBinaryJSON
+
++ (BOOL)isBinaryJSON:(NSData*)data
+{
+    return data.length >= sizeof(kMagic) && memcmp(data.bytes, kMagic, sizeof(kMagic)) == 0;
+}
+
++ (NSData*)dataWithJSONObject:(NSDictionary*)object
+{
+    if (![object isKindOfClass:[NSDictionary class]]) return nil;
+    TDBinaryJSONWriter* writer = [[TDBinaryJSONWriter alloc] init];
+    NSMutableData* root = [NSMutableData data];
+    if (![writer writeObject:object to:root depth:0]) return nil;
+
+    NSMutableData* data = [NSMutableData dataWithCapacity:root.length + 64];
+    [data appendBytes:kMagic length:sizeof(kMagic)];
+    [data appendBytes:&kVersion length:1];
+    writeVarint(data, writer->_keys.count);
+    for (NSString* key in writer->_keys) {
+        if (!writeUTF8(data, key)) return nil;
+    }
+    [data appendData:root];
+    return data;
+}
+
++ (NSDictionary*)JSONObjectWithData:(NSData*)data
+{
+    return [[[TDBinaryJSONReader alloc] initWithData:data] rootObject];
+}
+
+@end
+
+#pragma mark - DECODING:
+
+static BOOL readVarint(const uint8_t** pos, const uint8_t* end, uint64_t* outValue)
+{
+    uint64_t n = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (*pos >= end) return NO;
+        uint8_t byte = *(*pos)++;
+        n |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *outValue = n;
+            return YES;
+        }
+    }
+    return NO;
+}
+
+// Reads a length, checking that there are that many bytes after it.
+static BOOL readLength(const uint8_t** pos, const uint8_t* end, uint64_t* outLength)
+{
+    return readVarint(pos, end, outLength) && *outLength <= (uint64_t)(end - *pos);
+}
+
+static NSString* readUTF8(const uint8_t** pos, const uint8_t* end)
+{
+    uint64_t length;
+    if (!readLength(pos, end, &length)) return nil;
+    NSString* str = [[NSString alloc] initWithBytes:*pos
+                                             length:(NSUInteger)length
+                                           encoding:NSUTF8StringEncoding];
+    *pos += length;
+    return str;
+}
+
+// Reads the count and length following an array's or object's tag.
+static BOOL readContainer(const uint8_t** pos, const uint8_t* end, uint64_t* outCount,
+                          const uint8_t** outEnd)
+{
+    uint64_t length;
+    if (!readVarint(pos, end, outCount) || !readLength(pos, end, &length)) return NO;
+    *outEnd = *pos + length;
+    return YES;
+}
+
+@implementation TDBinaryJSONReader {
+    NSData* _data;
+    NSArray* _keys;          // the document's key table
+    NSUInteger _rootOffset;  // where the top-level object starts
+}
+
+- (id)initWithData:(NSData*)data
+{
+    if (![TDBinaryJSON isBinaryJSON:data]) return nil;
+    self = [super init];
+    if (self) {
+        _data = data;
+        const uint8_t* start = data.bytes;
+        const uint8_t* end = start + data.length;
+        const uint8_t* pos = start + sizeof(kMagic);
+        if (pos >= end || *pos++ != kVersion) return nil;
+
+        uint64_t count;
+        if (!readVarint(&pos, end, &count) || count > (uint64_t)(end - pos)) return nil;
+        NSMutableArray* keys = [NSMutableArray arrayWithCapacity:(NSUInteger)count];
+        for (uint64_t i = 0; i < count; ++i) {
+            NSString* key = readUTF8(&pos, end);
+            if (!key) return nil;
+            [keys addObject:key];
+        }
+        _keys = keys;
+        _rootOffset = pos - start;
+    }
+    return self;
+}
+
+- (NSDictionary*)rootObject
+{
+    return $castIf(NSDictionary,
+                   [self valueInRange:NSMakeRange(_rootOffset, _data.length - _rootOffset)]);
+}
+
+- (NSArray*)keysWithValueRanges:(NSData**)outRanges
+{
+    const uint8_t* start = _data.bytes;
+    const uint8_t* end = start + _data.length;
+    const uint8_t* pos = start + _rootOffset;
+    uint64_t count;
+    const uint8_t* objectEnd;
+    if (pos >= end || *pos++ != kTagObject || !readContainer(&pos, end, &count, &objectEnd) ||
+        objectEnd != end)
+        return nil;
+
+    NSMutableArray* keys = [NSMutableArray arrayWithCapacity:(NSUInteger)count];
+    NSMutableData* ranges = [NSMutableData dataWithCapacity:(NSUInteger)count * sizeof(NSRange)];
+    BOOL ok = [self enumerateObjectWithCount:count
+                                       table:pos
+                                         end:objectEnd
+                                  usingBlock:^BOOL(NSString* key, const uint8_t* valueStart,
+                                                   const uint8_t* valueEnd) {
+                                      NSRange range = NSMakeRange(valueStart - start,
+                                                                  valueEnd - valueStart);
+                                      [keys addObject:key];
+                                      [ranges appendBytes:&range length:sizeof(range)];
+                                      return YES;
+                                  }];
+    if (!ok) return nil;
+    if (outRanges) *outRanges = ranges;
+    return keys;
+}
+
+- (id)valueInRange:(NSRange)range
+{
+    if (NSMaxRange(range) > _data.length) return nil;
+    const uint8_t* pos = (const uint8_t*)_data.bytes + range.location;
+    const uint8_t* end = pos + range.length;
+    id value = [self decodeValueAt:&pos end:end depth:0];
+    return pos == end ? value : nil;
+}
+
+// Calls the block with the key and value bounds of each entry of an object, given the start of
+// its table. Stops, returning NO, if the table is malformed or the block returns NO.
+- (BOOL)enumerateObjectWithCount:(uint64_t)count
+                           table:(const uint8_t*)table
+                             end:(const uint8_t*)end
+                      usingBlock:(BOOL (^)(NSString* key, const uint8_t* valueStart,
+                                           const uint8_t* valueEnd))block
+{
+    if (count > (uint64_t)(end - table) / sizeof(TDBinaryJSONTableEntry)) return NO;
+    const uint8_t* values = table + count * sizeof(TDBinaryJSONTableEntry);
+    if (count == 0) return values == end;
+
+    TDBinaryJSONTableEntry entry;
+    memcpy(entry, table, sizeof(entry));
+    for (uint64_t i = 0; i < count; ++i) {
+        uint32_t keyIndex = CFSwapInt32LittleToHost(entry[0]);
+        uint64_t offset = CFSwapInt32LittleToHost(entry[1]);
+        uint64_t nextOffset = end - values;
+        if (i + 1 < count) {
+            memcpy(entry, table + (i + 1) * sizeof(entry), sizeof(entry));
+            nextOffset = CFSwapInt32LittleToHost(entry[1]);
+        }
+        if (keyIndex >= _keys.count || offset >= nextOffset ||
+            nextOffset > (uint64_t)(end - values))
+            return NO;
+        if (!block(_keys[keyIndex], values + offset, values + nextOffset)) return NO;
+    }
+    return YES;
+}
+
+- (id)decodeValueAt:(const uint8_t**)pos end:(const uint8_t*)end depth:(NSUInteger)depth
+{
+    if (*pos >= end || depth > kMaxDepth) return nil;
+    switch (*(*pos)++) {
+        case kTagNull:
+            return [NSNull null];
+        case kTagFalse:
+            return @NO;
+        case kTagTrue:
+            return @YES;
+        case kTagInteger: {
+            uint64_t zigzag;
+            if (!readVarint(pos, end, &zigzag)) return nil;
+            return @((int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1));
+        }
+        case kTagDouble: {
+            uint64_t bits;
+            double d;
+            if ((size_t)(end - *pos) < sizeof(bits)) return nil;
+            memcpy(&bits, *pos, sizeof(bits));
+            *pos += sizeof(bits);
+            bits = CFSwapInt64LittleToHost(bits);
+            memcpy(&d, &bits, sizeof(d));
+            return @(d);
+        }
+        case kTagString:
+            return readUTF8(pos, end);
+        case kTagDecimal: {
+            NSString* str = readUTF8(pos, end);
+            return str ? [NSDecimalNumber decimalNumberWithString:str] : nil;
+        }
+        case kTagArray: {
+            uint64_t count;
+            const uint8_t* arrayEnd;
+            if (!readContainer(pos, end, &count, &arrayEnd) || count > (uint64_t)(arrayEnd - *pos))
+                return nil;
+            NSMutableArray* array = [NSMutableArray arrayWithCapacity:(NSUInteger)count];
+            for (uint64_t i = 0; i < count; ++i) {
+                id element = [self decodeValueAt:pos end:arrayEnd depth:depth + 1];
+                if (!element) return nil;
+                [array addObject:element];
+            }
+            return *pos == arrayEnd ? [array copy] : nil;
+        }
+        case kTagObject: {
+            uint64_t count;
+            const uint8_t* objectEnd;
+            if (!readContainer(pos, end, &count, &objectEnd)) return nil;
+            NSMutableDictionary* object = [NSMutableDictionary dictionary];
+            BOOL ok = [self enumerateObjectWithCount:count
+                                               table:*pos
+                                                 end:objectEnd
+                                          usingBlock:^BOOL(NSString* key,
+                                                           const uint8_t* valueStart,
+                                                           const uint8_t* valueEnd) {
+                                              const uint8_t* valuePos = valueStart;
+                                              id value = [self decodeValueAt:&valuePos
+                                                                         end:valueEnd
+                                                                       depth:depth + 1];
+                                              if (!value || valuePos != valueEnd) return NO;
+                                              object[key] = value;
+                                              return YES;
+                                          }];
+            if (!ok) return nil;
+            *pos = objectEnd;
+            return [object copy];
+        }
+        default:
+            return nil;
+    }
+}
+
+@end
@@ -0,0 +1,51 @@
+//
+//  TDDocumentCache.h
+//
+//  Copyright © 2018 IBM Corporation. All rights reserved.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//  except in compliance with the License. You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+//  Unless required by applicable law or agreed to in writing, software distributed under the
+//  License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//  either express or implied. See the License for the specific language governing permissions
+//  and limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+/** A size-bounded cache of decoded document bodies, holding at most one revision per document,
+    so that frequently read documents aren't parsed from their stored JSON every time.
+
+    Bodies are stored immutable and without the special "_"-prefixed properties TD_Database adds
+    when reading a revision; callers wanting to change a body must copy it first.
+
+    Backed by an NSCache, whose cost is the length of the JSON each body was decoded from. Bodies
+    are evicted, roughly least recently used first, once the total cost exceeds maxCost, and
+    whenever the system is short of memory.
+
+    Safe to use from multiple threads. */
+@interface TDDocumentCache : NSObject
+
+- (id)initWithMaxCost:(NSUInteger)maxCost;
+
+@property (readonly) NSUInteger maxCost;
+
+/** Number of lookups which found the requested revision, and which didn't. */
+@property (readonly) NSUInteger hits;
+@property (readonly) NSUInteger misses;
+
+/** Returns the cached body of the revision, or nil if the cache holds no body or a different
+    revision of the document. */
+- (NSDictionary*)bodyForDocID:(NSString*)docID revID:(NSString*)revID;
+
+/** Caches an immutable body for a revision, replacing any body cached for the document. */
+- (void)setBody:(NSDictionary*)body
+       forDocID:(NSString*)docID
+          revID:(NSString*)revID
+           cost:(NSUInteger)cost;
+
+- (void)removeDocID:(NSString*)docID;
+
+- (void)removeAll;
+
+@end
@@ -0,0 +1,106 @@
+//
+//  TDDocumentCache.m
+//
+//  Copyright © 2018 IBM Corporation. All rights reserved.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//  except in compliance with the License. You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+//  Unless required by applicable law or agreed to in writing, software distributed under the
+//  License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//  either express or implied. See the License for the specific language governing permissions
+//  and limitations under the License.
+
+#import "TDDocumentCache.h"
+
+/** A cached body, with the revision it belongs to. */
+@interface TDDocumentCacheEntry : NSObject {
+   @public
+    NSString* _revID;
+    NSDictionary* _body;
+}
+@end
+
+@implementation TDDocumentCacheEntry
+@end
+
+@implementation TDDocumentCache {
+    NSCache* _entries;  // docID -> TDDocumentCacheEntry
+    NSUInteger _hits;
+    NSUInteger _misses;
+}
+
+- (id)initWithMaxCost:(NSUInteger)maxCost
+{
+    NSParameterAssert(maxCost > 0);
+
+    self = [super init];
+    if (self) {
+        _maxCost = maxCost;
+        _entries = [[NSCache alloc] init];
+        _entries.name = @"TDDocumentCache";
+        _entries.totalCostLimit = maxCost;
+    }
+    return self;
+}
+
+- (NSUInteger)hits
+{
+    @synchronized(self) { return _hits; }
+}
+
+- (NSUInteger)misses
+{
+    @synchronized(self) { return _misses; }
+}
+
+- (NSString*)description
+{
+    @synchronized(self)
+    {
+        return [NSString stringWithFormat:@"%@[%lu bytes, %lu hits, %lu misses]", [self class],
+                                          (unsigned long)_maxCost, (unsigned long)_hits,
+                                          (unsigned long)_misses];
+    }
+}
+
+#pragma mark - Lookup and update
+
+- (NSDictionary*)bodyForDocID:(NSString*)docID revID:(NSString*)revID
+{
+    TDDocumentCacheEntry* entry = [_entries objectForKey:docID];
+    BOOL hit = entry && [entry->_revID isEqualToString:revID];
+    @synchronized(self)
+    {
+        if (hit)
+            _hits++;
+        else
+            _misses++;
+    }
+    return hit ? entry->_body : nil;
+}
+
+- (void)setBody:(NSDictionary*)body
+       forDocID:(NSString*)docID
+          revID:(NSString*)revID
+           cost:(NSUInteger)cost
+{
+    NSParameterAssert(body);
+    NSParameterAssert(docID);
+    NSParameterAssert(revID);
+
+    if (cost > _maxCost) {  // would evict everything else
+        [_entries removeObjectForKey:docID];
+        return;
+    }
+    TDDocumentCacheEntry* entry = [[TDDocumentCacheEntry alloc] init];
+    entry->_revID = [revID copy];
+    entry->_body = body;
+    [_entries setObject:entry forKey:[docID copy] cost:cost];
+}
+
+- (void)removeDocID:(NSString*)docID { [_entries removeObjectForKey:docID]; }
+
+- (void)removeAll { [_entries removeAllObjects]; }
+
+@end
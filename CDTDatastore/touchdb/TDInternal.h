@@ -23,6 +23,10 @@
 
 @property (readwrite, copy) NSString* name;  // make it settable
 
+/** Whether new revision bodies are being stored in the binary format; the value that
+    storesBinaryBodies had when the database was opened. */
+@property (readonly) BOOL writesBinaryBodies;
+
 - (BOOL)openFMDBWithEncryptionKeyProvider:(id<CDTEncryptionKeyProvider>)provider;
 
 /** Must be called from within a queue -inDatabase: or -inTransaction: **/
@@ -51,18 +55,27 @@
 /** Must be called from within a queue -inDatabase: or -inTransaction: **/
 - (TDStatus)deleteViewNamed:(NSString*)name;
 
-- (NSMutableDictionary*)documentPropertiesFromJSON:(NSData*)json
-                                             docID:(NSString*)docID
-                                             revID:(NSString*)revID
-                                           deleted:(BOOL)deleted
-                                          sequence:(SequenceNumber)sequence
-                                           options:(TDContentOptions)options
-                                        inDatabase:(FMDatabase*)db;
+/** Returns the properties of a stored revision, whose values are only parsed as they're read.
+    Must be called from within a queue -inDatabase: or -inTransaction: **/
+- (NSDictionary*)documentPropertiesFromJSON:(NSData*)json
+                                      docID:(NSString*)docID
+                                      revID:(NSString*)revID
+                                    deleted:(BOOL)deleted
+                                   sequence:(SequenceNumber)sequence
+                                    options:(TDContentOptions)options
+                                 inDatabase:(FMDatabase*)db;
 
 /** Must be called from within a queue -inDatabase: or -inTransaction: **/
 - (NSString*)winningRevIDOfDocNumericID:(SInt64)docNumericID
                               isDeleted:(BOOL*)outIsDeleted
                                database:(FMDatabase*)database;
+
+/** Returns the values padded with NSNulls to the next power of two, or to maxCount if that's
+    smaller, so that binding lists of any length to `IN (...)` only needs a few SQL texts. */
++ (NSArray*)paddedBatchOfValues:(NSArray*)values maxCount:(NSUInteger)maxCount;
+
+/** Returns "?, ?, ..." with a placeholder per value. */
++ (NSString*)placeholdersForValues:(NSArray*)values;
 @end
 
 @interface TD_Database (Insertion_Internal)
@@ -75,3 +75,28 @@ typedef NSUInteger TDJSONWritingOptions;
 }
 - (id)initWithArray:(NSMutableArray *)array;
 @end
+
+/** Immutable dictionary over the JSON data of an object, that finds the object's top-level keys up
+    front but only parses each value the first time it's accessed. Reading a few properties of a
+    large document is then much cheaper than parsing all of it. Making a mutable copy, the only
+    way to change it, parses every value.
+
+    JSON text is checked to be well-formed when the dictionary is made, without parsing it. Only
+    invalid UTF-8 in a string, or a corrupt value in the binary format, is found when the value is
+    parsed; it's logged as an error and reads as NSNull, so there's still an object for every
+    key. */
+@interface TDLazyJSONDictionary : NSDictionary
+
+/** Returns nil if the data isn't a well-formed JSON object, or isn't an object with a valid key
+    table in the binary format of TDBinaryJSON, which it may also be in. The data is copied, so
+    it may point into a buffer that won't outlive this call. */
+- (id)initWithJSON:(NSData *)json;
+
+/** Returns a dictionary sharing this one's parsed values, with the given entries added, replacing
+    any with the same keys. */
+- (TDLazyJSONDictionary *)dictionaryByAddingEntries:(NSDictionary *)entries;
+
+/** Returns a dictionary sharing this one's parsed values, without the given keys. */
+- (TDLazyJSONDictionary *)dictionaryByRemovingKeys:(NSArray *)keys;
+
+@end
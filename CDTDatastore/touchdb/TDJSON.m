@@ -16,8 +16,10 @@
 //  Modifications for this distribution by Cloudant, Inc., Copyright (c) 2014 Cloudant, Inc.
 
 #import "TDJSON.h"
+#import "TDBinaryJSON.h"
 #import "CollectionUtils.h"
 #import "Test.h"
+#import "CDTLogging.h"
 
 #if !USE_NSJSON
 #import "JSONKit.h"
@@ -120,3 +122,354 @@
 }
 
 @end
+
+#pragma mark - LAZY DICTIONARY:
+
+static const uint8_t* skipJSONWhitespace(const uint8_t* pos, const uint8_t* end)
+{
+    while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r')) ++pos;
+    return pos;
+}
+
+// Given the opening quote of a string, returns the position after its closing quote, or NULL if
+// the string is unterminated or has an invalid escape or control character. The UTF-8 itself is
+// only checked when the string is parsed.
+static const uint8_t* scanJSONString(const uint8_t* pos, const uint8_t* end, BOOL* outEscaped)
+{
+    for (++pos; pos < end; ++pos) {
+        uint8_t c = *pos;
+        if (c == '\\') {
+            *outEscaped = YES;
+            if (++pos >= end) return NULL;
+            if (*pos == 'u') {
+                if (end - pos <= 4) return NULL;
+                for (int i = 1; i <= 4; ++i) {
+                    if (!isxdigit(pos[i])) return NULL;
+                }
+                pos += 4;
+            } else if (!strchr("\"\\/bfnrt", *pos) || *pos == 0) {
+                return NULL;
+            }
+        } else if (c == '"') {
+            return pos + 1;
+        } else if (c < 0x20) {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+// Given the start of a number, returns the position after it, or NULL if it isn't valid JSON.
+static const uint8_t* scanJSONNumber(const uint8_t* pos, const uint8_t* end)
+{
+    if (pos < end && *pos == '-') ++pos;
+    if (pos >= end || !isdigit(*pos)) return NULL;
+    if (*pos == '0')
+        ++pos;
+    else
+        while (pos < end && isdigit(*pos)) ++pos;
+    if (pos < end && *pos == '.') {
+        if (++pos >= end || !isdigit(*pos)) return NULL;
+        while (pos < end && isdigit(*pos)) ++pos;
+    }
+    if (pos < end && (*pos == 'e' || *pos == 'E')) {
+        ++pos;
+        if (pos < end && (*pos == '+' || *pos == '-')) ++pos;
+        if (pos >= end || !isdigit(*pos)) return NULL;
+        while (pos < end && isdigit(*pos)) ++pos;
+    }
+    return pos;
+}
+
+// Deeper nesting than this is rejected, rather than risk overflowing the stack
+#define kMaxJSONNesting 512
+
+// Given the start of a value, returns the position after it, or NULL if it isn't valid JSON. The
+// value is checked without building any objects, so it's cheap enough to do for every value up
+// front, and a lazily parsed value can then only fail to parse if it has invalid UTF-8.
+static const uint8_t* scanJSONValue(const uint8_t* pos, const uint8_t* end, int depth)
+{
+    BOOL escaped;
+    if (pos >= end) return NULL;
+    switch (*pos) {
+        case '"':
+            return scanJSONString(pos, end, &escaped);
+        case '{':
+        case '[': {
+            if (depth >= kMaxJSONNesting) return NULL;
+            BOOL isObject = (*pos == '{');
+            uint8_t close = isObject ? '}' : ']';
+            pos = skipJSONWhitespace(pos + 1, end);
+            if (pos < end && *pos == close) return pos + 1;
+            while (YES) {
+                if (isObject) {
+                    if (pos >= end || *pos != '"') return NULL;
+                    pos = scanJSONString(pos, end, &escaped);
+                    if (!pos) return NULL;
+                    pos = skipJSONWhitespace(pos, end);
+                    if (pos >= end || *pos != ':') return NULL;
+                    pos = skipJSONWhitespace(pos + 1, end);
+                }
+                pos = scanJSONValue(pos, end, depth + 1);
+                if (!pos) return NULL;
+                pos = skipJSONWhitespace(pos, end);
+                if (pos >= end) return NULL;
+                if (*pos == close) return pos + 1;
+                if (*pos != ',') return NULL;
+                pos = skipJSONWhitespace(pos + 1, end);
+            }
+        }
+        case 't':
+            return (end - pos >= 4 && memcmp(pos, "true", 4) == 0) ? pos + 4 : NULL;
+        case 'f':
+            return (end - pos >= 5 && memcmp(pos, "false", 5) == 0) ? pos + 5 : NULL;
+        case 'n':
+            return (end - pos >= 4 && memcmp(pos, "null", 4) == 0) ? pos + 4 : NULL;
+        default:
+            return scanJSONNumber(pos, end);
+    }
+}
+
+/** The top-level keys of a JSON object and where their values are, with each value kept once it's
+    parsed. Shared by all the TDLazyJSONDictionaries made from one object. */
+@interface TDLazyJSONObject : NSObject {
+   @public
+    NSData* _json;
+    NSArray* _keys;               // in order of appearance; the last of any duplicate wins
+    NSDictionary* _indexByKey;    // key -> index in _keys
+    NSData* _ranges;              // NSRange of each key's value in _json
+    NSPointerArray* _values;      // parsed value of each key, or NULL if not parsed yet
+    TDBinaryJSONReader* _reader;  // decodes the values if _json is in the binary format
+}
+@end
+
+@implementation TDLazyJSONObject
+
+- (id)initWithJSON:(NSData*)json
+{
+    self = [super init];
+    if (self) {
+        // Not -copy, which keeps the bytes of data made with -dataWithBytesNoCopy:
+        _json = [[NSData alloc] initWithBytes:json.bytes length:json.length];
+        if ([TDBinaryJSON isBinaryJSON:_json]) {
+            if (![self readBinaryKeys]) return nil;
+        } else {
+            if (![self scanJSONKeys]) return nil;
+        }
+        _values = [NSPointerArray strongObjectsPointerArray];
+        _values.count = _keys.count;
+    }
+    return self;
+}
+
+// The binary format has a table of the keys and where their values are, which just needs reading.
+- (BOOL)readBinaryKeys
+{
+    _reader = [[TDBinaryJSONReader alloc] initWithData:_json];
+    NSData* ranges = nil;
+    NSArray* keys = [_reader keysWithValueRanges:&ranges];
+    if (!keys) return NO;
+
+    NSMutableDictionary* indexByKey = [NSMutableDictionary dictionaryWithCapacity:keys.count];
+    for (NSUInteger i = 0; i < keys.count; ++i) {
+        if (indexByKey[keys[i]]) return NO;  // written from a dictionary, so never duplicated
+        indexByKey[keys[i]] = @(i);
+    }
+    _keys = keys;
+    _indexByKey = indexByKey;
+    _ranges = ranges;
+    return YES;
+}
+
+// JSON text has to be scanned to find where each value ends and check it's well-formed, but not
+// parsed.
+- (BOOL)scanJSONKeys
+{
+    const uint8_t* start = _json.bytes;
+    const uint8_t* end = start + _json.length;
+
+    NSMutableArray* keys = [NSMutableArray array];
+    NSMutableDictionary* indexByKey = [NSMutableDictionary dictionary];
+    NSMutableData* ranges = [NSMutableData data];
+
+    const uint8_t* pos = skipJSONWhitespace(start, end);
+    if (pos >= end || *pos != '{') return NO;
+    pos = skipJSONWhitespace(pos + 1, end);
+    if (pos < end && *pos == '}') {
+        ++pos;
+    } else {
+        while (YES) {
+            if (pos >= end || *pos != '"') return NO;
+            BOOL escaped = NO;
+            const uint8_t* keyEnd = scanJSONString(pos, end, &escaped);
+            if (!keyEnd) return NO;
+            NSString* key;
+            if (escaped) {
+                NSData* keyJSON = [NSData dataWithBytesNoCopy:(void*)pos
+                                                       length:keyEnd - pos
+                                                 freeWhenDone:NO];
+                key = $castIf(NSString, [TDJSON JSONObjectWithData:keyJSON
+                                                           options:TDJSONReadingAllowFragments
+                                                             error:NULL]);
+            } else {
+                key = [[NSString alloc] initWithBytes:pos + 1
+                                               length:keyEnd - pos - 2
+                                             encoding:NSUTF8StringEncoding];
+            }
+            if (!key) return NO;
+
+            pos = skipJSONWhitespace(keyEnd, end);
+            if (pos >= end || *pos != ':') return NO;
+            const uint8_t* valueStart = skipJSONWhitespace(pos + 1, end);
+            const uint8_t* valueEnd = scanJSONValue(valueStart, end, 1);
+            if (!valueEnd) return NO;
+
+            NSRange range = NSMakeRange(valueStart - start, valueEnd - valueStart);
+            NSNumber* index = indexByKey[key];
+            if (index) {
+                NSUInteger offset = index.unsignedIntegerValue * sizeof(NSRange);
+                [ranges replaceBytesInRange:NSMakeRange(offset, sizeof(NSRange))
+                                  withBytes:&range];
+            } else {
+                indexByKey[key] = @(keys.count);
+                [keys addObject:key];
+                [ranges appendBytes:&range length:sizeof(NSRange)];
+            }
+
+            pos = skipJSONWhitespace(valueEnd, end);
+            if (pos < end && *pos == ',') {
+                pos = skipJSONWhitespace(pos + 1, end);
+            } else if (pos < end && *pos == '}') {
+                ++pos;
+                break;
+            } else {
+                return NO;
+            }
+        }
+    }
+    if (skipJSONWhitespace(pos, end) != end) return NO;
+
+    _keys = keys;
+    _indexByKey = indexByKey;
+    _ranges = ranges;
+    return YES;
+}
+
+- (id)valueAtIndex:(NSUInteger)index
+{
+    @synchronized(self)
+    {
+        id value = (__bridge id)[_values pointerAtIndex:index];
+        if (!value) {
+            NSRange range = ((const NSRange*)_ranges.bytes)[index];
+            if (_reader) {
+                value = [_reader valueInRange:range];
+                if (!value) {
+                    CDTLogError(CDTDATASTORE_LOG_CONTEXT, @"Malformed binary value for key %@",
+                                _keys[index]);
+                }
+            } else {
+                const uint8_t* bytes = (const uint8_t*)_json.bytes + range.location;
+                NSData* json = [NSData dataWithBytesNoCopy:(void*)bytes
+                                                    length:range.length
+                                              freeWhenDone:NO];
+                value = [TDJSON JSONObjectWithData:json
+                                           options:TDJSONReadingAllowFragments
+                                             error:NULL];
+                if (!value) {
+                    CDTLogError(CDTDATASTORE_LOG_CONTEXT, @"Unparseable JSON value for key %@: %@",
+                                _keys[index], [json my_UTF8ToString]);
+                }
+            }
+            // Scanning checked the JSON's syntax, so this is only reached for invalid UTF-8 or a
+            // corrupt binary body. The value then reads as null, so every key still has an
+            // object; the key was already counted and enumerated before its value was parsed.
+            if (!value) value = [NSNull null];
+            [_values replacePointerAtIndex:index withPointer:(__bridge void*)value];
+        }
+        return value;
+    }
+}
+
+@end
+
+@implementation TDLazyJSONDictionary {
+    TDLazyJSONObject* _object;
+    NSDictionary* _addedEntries;  // added to, or replacing, the object's
+    NSSet* _removedKeys;          // of the object's
+    NSArray* _keys;
+}
+
+- (id)initWithJSON:(NSData*)json
+{
+    TDLazyJSONObject* object = [[TDLazyJSONObject alloc] initWithJSON:json];
+    if (!object) return nil;
+    return [self initWithObject:object addedEntries:nil removedKeys:nil];
+}
+
+- (id)initWithObject:(TDLazyJSONObject*)object
+        addedEntries:(NSDictionary*)addedEntries
+         removedKeys:(NSSet*)removedKeys
+{
+    self = [super init];
+    if (self) {
+        _object = object;
+        _addedEntries = [addedEntries copy];
+        _removedKeys = [removedKeys copy];
+
+        NSMutableArray* keys =
+            [NSMutableArray arrayWithCapacity:object->_keys.count + addedEntries.count];
+        for (NSString* key in object->_keys) {
+            if (!_addedEntries[key] && ![_removedKeys containsObject:key]) [keys addObject:key];
+        }
+        [keys addObjectsFromArray:_addedEntries.allKeys];
+        _keys = keys;
+    }
+    return self;
+}
+
+- (TDLazyJSONDictionary*)dictionaryByAddingEntries:(NSDictionary*)entries
+{
+    if (entries.count == 0) return self;
+    NSMutableDictionary* added = _addedEntries ? [_addedEntries mutableCopy] : $mdict();
+    [added addEntriesFromDictionary:entries];
+    NSMutableSet* removed = [_removedKeys mutableCopy];
+    [removed minusSet:[NSSet setWithArray:entries.allKeys]];
+    return [[TDLazyJSONDictionary alloc] initWithObject:_object
+                                           addedEntries:added
+                                            removedKeys:removed];
+}
+
+- (TDLazyJSONDictionary*)dictionaryByRemovingKeys:(NSArray*)keys
+{
+    if (keys.count == 0) return self;
+    NSMutableDictionary* added = [_addedEntries mutableCopy];
+    [added removeObjectsForKeys:keys];
+    NSMutableSet* removed = _removedKeys ? [_removedKeys mutableCopy] : [NSMutableSet set];
+    [removed addObjectsFromArray:keys];
+    return [[TDLazyJSONDictionary alloc] initWithObject:_object
+                                           addedEntries:added
+                                            removedKeys:removed];
+}
+
+- (NSUInteger)count { return _keys.count; }
+
+- (id)objectForKey:(id)key
+{
+    id value = _addedEntries[key];
+    if (value || [_removedKeys containsObject:key]) return value;
+    NSNumber* index = _object->_indexByKey[key];
+    return index ? [_object valueAtIndex:index.unsignedIntegerValue] : nil;
+}
+
+- (NSEnumerator*)keyEnumerator { return [_keys objectEnumerator]; }
+
+// Overridden so that listing the keys doesn't parse the values:
+- (NSArray*)allKeys { return [_keys copy]; }
+
+- (id)copyWithZone:(NSZone*)zone { return self; }
+
+// Archived as a plain dictionary, since it can't be made from objects and keys:
+- (Class)classForCoder { return [NSDictionary class]; }
+
+@end
@@ -623,14 +623,14 @@ static NSString* joinQuotedEscaped(NSArray* strings);
                (unsigned)downloads.count);
     CFAbsoluteTime time = CFAbsoluteTimeGetCurrent();
 
-    //    [_db beginTransaction];
-    //    BOOL success = NO;
     @try {
         downloads = [downloads sortedArrayUsingSelector:@selector(compareSequences:)];
+        NSMutableArray* revsToInsert = [NSMutableArray arrayWithCapacity:downloads.count];
+        NSMutableArray* histories = [NSMutableArray arrayWithCapacity:downloads.count];
+        NSMutableArray* fakeSequences = [NSMutableArray arrayWithCapacity:downloads.count];
         for (TD_Revision* rev in downloads) {
             @autoreleasepool
             {
-                SequenceNumber fakeSequence = rev.sequence;
                 NSArray* history = [TD_Database parseCouchDBRevisionHistory:rev.properties];
                 if (!history && rev.generation > 1) {
                     CDTLogWarn(CDTREPLICATION_LOG_CONTEXT,
@@ -641,25 +641,38 @@ static NSString* joinQuotedEscaped(NSArray* strings);
                 }
                 CDTLogVerbose(CDTREPLICATION_LOG_CONTEXT, @"%@ inserting %@ %@", self, rev.docID,
                            [history my_compactDescription]);
+                [revsToInsert addObject:rev];
+                [histories addObject:(history ?: [NSNull null])];
+                // Inserting the revision assigns it a local sequence, so remember the fake one:
+                [fakeSequences addObject:@(rev.sequence)];
+            }
+        }
 
-                // Insert the revision:
-                int status = [_db forceInsert:rev revisionHistory:history source:_remote];
-                if (TDStatusIsError(status)) {
-                    if (status == kTDStatusForbidden)
-                        CDTLogInfo(CDTREPLICATION_LOG_CONTEXT, @"%@: Remote rev failed validation: %@",
-                                self, rev);
-                    else {
-                        CDTLogWarn(CDTREPLICATION_LOG_CONTEXT, @"%@ failed to write %@: status=%d", self,
-                                rev, status);
-                        [self revisionFailed];
-                        self.error = TDStatusToNSError(status, nil);
-                        continue;
-                    }
+        // Insert the revisions, all in one transaction:
+        NSArray* statuses = nil;
+        [_db forceInsertRevisions:revsToInsert
+                revisionHistories:histories
+                           source:_remote
+                         statuses:&statuses];
+
+        for (NSUInteger i = 0; i < revsToInsert.count; i++) {
+            TD_Revision* rev = revsToInsert[i];
+            int status = [statuses[i] intValue];
+            if (TDStatusIsError(status)) {
+                if (status == kTDStatusForbidden)
+                    CDTLogInfo(CDTREPLICATION_LOG_CONTEXT, @"%@: Remote rev failed validation: %@",
+                            self, rev);
+                else {
+                    CDTLogWarn(CDTREPLICATION_LOG_CONTEXT, @"%@ failed to write %@: status=%d", self,
+                            rev, status);
+                    [self revisionFailed];
+                    self.error = TDStatusToNSError(status, nil);
+                    continue;
                 }
-
-                // Mark this revision's fake sequence as processed:
-                [_pendingSequences removeSequence:fakeSequence];
             }
+
+            // Mark this revision's fake sequence as processed:
+            [_pendingSequences removeSequence:[fakeSequences[i] longLongValue]];
         }
 
         [_db clearPendingAttachments];
@@ -669,13 +682,8 @@ static NSString* joinQuotedEscaped(NSArray* strings);
 
         // Checkpoint:
         self.lastSequence = _pendingSequences.checkpointedValue;
-
-        //        success = YES;
     }
     @catch (NSException* x) { MYReportException(x, @"%@: Exception inserting revisions", self); }
-    //    @finally {
-    //        [_db endTransaction: success];
-    //    }
 
     time = CFAbsoluteTimeGetCurrent() - time;
     CDTLogInfo(CDTREPLICATION_LOG_CONTEXT, @"%@ inserted %u revs in %.3f sec (%.1f/sec)", self,
@@ -18,7 +18,7 @@
 
 - (id)initWithProperties:(NSDictionary*)properties;
 - (id)initWithArray:(NSArray*)array;
-- (id)initWithJSON:(NSData*)json;
+- (id)initWithJSON:(NSData*)json;  // also accepts the binary format of TDBinaryJSON
 
 + (TD_Body*)bodyWithProperties:(id)properties;
 + (TD_Body*)bodyWithJSON:(NSData*)json;
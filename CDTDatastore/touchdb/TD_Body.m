@@ -17,6 +17,7 @@
 
 #import "TD_Body.h"
 #import "TDJSON.h"
+#import "TDBinaryJSON.h"
 #import "CDTLogging.h"
 #import "CollectionUtils.h"
 
@@ -38,7 +39,16 @@
 {
     self = [super init];
     if (self) {
-        _json = json ? [json copy] : [[NSData alloc] init];
+        if ([TDBinaryJSON isBinaryJSON:json]) {
+            // A body stored in the binary format; -asJSON writes it out as JSON when it's needed
+            _object = [[TDLazyJSONDictionary alloc] initWithJSON:json];
+            if (!_object) {
+                CDTLogVerbose(CDTDOCUMENT_REVISION_LOG_CONTEXT, @"TD_Body: malformed binary body");
+                _error = YES;
+            }
+        } else {
+            _json = json ? [json copy] : [[NSData alloc] init];
+        }
     }
     return self;
 }
@@ -95,13 +105,17 @@
 - (id)asObject
 {
     if (!_object && !_error) {
-        NSError* error = nil;
-        _object = [[TDJSON JSONObjectWithData:_json options:0 error:&error] copy];
+        // Callers usually read only a few properties, so an object's values are parsed on demand:
+        _object = [[TDLazyJSONDictionary alloc] initWithJSON:_json];
         if (!_object) {
-            CDTLogVerbose(CDTDOCUMENT_REVISION_LOG_CONTEXT,
-                       @"TD_Body: couldn't parse JSON: %@ (error=%@)", [_json my_UTF8ToString],
-                       error);
-            _error = YES;
+            NSError* error = nil;
+            _object = [[TDJSON JSONObjectWithData:_json options:0 error:&error] copy];
+            if (!_object) {
+                CDTLogVerbose(CDTDOCUMENT_REVISION_LOG_CONTEXT,
+                           @"TD_Body: couldn't parse JSON: %@ (error=%@)", [_json my_UTF8ToString],
+                           error);
+                _error = YES;
+            }
         }
     }
     return _object;
@@ -39,6 +39,13 @@
                                        options:(TDContentOptions)options
                                     inDatabase:(FMDatabase *)db;
 
+/** Constructs the "_attachments" dictionaries for many revisions with one query per page of
+ * sequences. Returns a dictionary from sequence to "_attachments" dictionary, without entries
+ * for sequences which have no attachments, or nil on a database error. */
+- (NSDictionary *)getAttachmentDictsForSequences:(NSArray *)sequences
+                                         options:(TDContentOptions)options
+                                      inDatabase:(FMDatabase *)db;
+
 /** Modifies a TD_Revision's _attachments dictionary by changing all attachments with revpos <
  * minRevPos into stubs; and if 'attachmentsFollow' is true, the remaining attachments will be
  * modified to _not_ be stubs but include a "follows" key instead of a body. */
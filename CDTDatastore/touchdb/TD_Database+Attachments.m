@@ -36,6 +36,7 @@
 #import "TDMultipartWriter.h"
 #import "TDMisc.h"
 #import "TDInternal.h"
+#import "FMDatabase+StatementCache.h"
 
 #import "CollectionUtils.h"
 #import <FMDB/FMDatabase.h>
@@ -50,6 +51,10 @@
 // Length that constitutes a 'big' attachment
 #define kBigAttachmentLength (16 * 1024)
 
+// Number of sequences whose attachments are read by one query. They're bound as parameters,
+// padded to a few fixed counts, so this is also the most placeholders a query can have.
+#define kAttachmentSequencesPageSize 500
+
 @implementation TD_Database (Attachments)
 
 - (TDBlobStoreWriter*)attachmentWriter
@@ -397,66 +402,86 @@
                                    inDatabase:(FMDatabase*)db
 {
     Assert(sequence > 0);
-    __block NSMutableDictionary* attachments;
-
-    FMResultSet* r =
-        [db executeQuery:@"SELECT filename, key, type, encoding, length, encoded_length, revpos "
-                          "FROM attachments WHERE sequence=?",
-                         @(sequence)];
-    if (!r) return nil;
-    if (![r next]) {
-        [r close];
-        return nil;
-    }
+    return [self getAttachmentDictsForSequences:@[ @(sequence) ]
+                                        options:options
+                                     inDatabase:db][@(sequence)];
+}
+
+- (NSDictionary*)getAttachmentDictsForSequences:(NSArray*)sequences
+                                        options:(TDContentOptions)options
+                                     inDatabase:(FMDatabase*)db
+{
+    NSMutableDictionary* attachmentsBySequence = $mdict();
     BOOL decodeAttachments = !(options & kTDLeaveAttachmentsEncoded);
-    attachments = $mdict();
-    do {
-        NSData* keyData = [r dataNoCopyForColumnIndex:1];
-        NSString* digestStr = [@"sha1-" stringByAppendingString:[TDBase64 encode:keyData]];
-        TDAttachmentEncoding encoding = [r intForColumnIndex:3];
-        UInt64 length = [r longLongIntForColumnIndex:4];
-        UInt64 encodedLength = [r longLongIntForColumnIndex:5];
-
-        // Get the attachment contents if asked to:
-        NSData* data = nil;
-        BOOL dataSuppressed = NO;
-        if (options & kTDIncludeAttachments) {
-            UInt64 effectiveLength = (encoding && !decodeAttachments) ? encodedLength : length;
-            if ((options & kTDBigAttachmentsFollow) && effectiveLength >= kBigAttachmentLength) {
-                dataSuppressed = YES;
-            } else {
-                id<CDTBlobReader> blob = [_attachments blobForKey:*(TDBlobKey*)keyData.bytes
-                                                     withDatabase:db];
-                data = (blob ? [blob dataWithError:nil] : nil);
-                if (!data)
-                    CDTLogWarn(CDTDATASTORE_LOG_CONTEXT,
-                            @"TD_Database: Failed to get attachment for key %@", keyData);
+
+    for (NSUInteger start = 0; start < sequences.count; start += kAttachmentSequencesPageSize) {
+        NSRange range = NSMakeRange(
+            start, MIN((NSUInteger)kAttachmentSequencesPageSize, sequences.count - start));
+        NSArray* batch = [TD_Database paddedBatchOfValues:[sequences subarrayWithRange:range]
+                                                 maxCount:kAttachmentSequencesPageSize];
+        NSString* sql =
+            $sprintf(@"SELECT sequence, filename, key, type, encoding, length, encoded_length, "
+                      "revpos FROM attachments WHERE sequence IN (%@)",
+                     [TD_Database placeholdersForValues:batch]);
+        FMResultSet* r = [db executeCachedQuery:sql withArgumentsInArray:batch];
+        if (!r) return nil;
+
+        while ([r next]) {
+            NSNumber* sequence = @([r longLongIntForColumnIndex:0]);
+            NSMutableDictionary* attachments = attachmentsBySequence[sequence];
+            if (!attachments) {
+                attachments = $mdict();
+                attachmentsBySequence[sequence] = attachments;
             }
-        }
 
-        NSString* encodingStr = nil;
-        id encodedLengthObj = nil;
-        if (encoding != kTDAttachmentEncodingNone) {
-            // Decode the attachment if it's included in the dict:
-            if (data && decodeAttachments) {
-                data = [self decodeAttachment:data encoding:encoding];
-            } else {
-                encodingStr = @"gzip";  // the only encoding I know
-                encodedLengthObj = @(encodedLength);
+            NSData* keyData = [r dataNoCopyForColumnIndex:2];
+            NSString* digestStr = [@"sha1-" stringByAppendingString:[TDBase64 encode:keyData]];
+            TDAttachmentEncoding encoding = [r intForColumnIndex:4];
+            UInt64 length = [r longLongIntForColumnIndex:5];
+            UInt64 encodedLength = [r longLongIntForColumnIndex:6];
+
+            // Get the attachment contents if asked to:
+            NSData* data = nil;
+            BOOL dataSuppressed = NO;
+            if (options & kTDIncludeAttachments) {
+                UInt64 effectiveLength = (encoding && !decodeAttachments) ? encodedLength : length;
+                if ((options & kTDBigAttachmentsFollow) &&
+                    effectiveLength >= kBigAttachmentLength) {
+                    dataSuppressed = YES;
+                } else {
+                    id<CDTBlobReader> blob = [_attachments blobForKey:*(TDBlobKey*)keyData.bytes
+                                                         withDatabase:db];
+                    data = (blob ? [blob dataWithError:nil] : nil);
+                    if (!data)
+                        CDTLogWarn(CDTDATASTORE_LOG_CONTEXT,
+                                @"TD_Database: Failed to get attachment for key %@", keyData);
+                }
             }
-        }
 
-        attachments[[r stringForColumnIndex:0]] =
-            $dict({ @"stub", ((data || dataSuppressed) ? nil : $true) },
-                  { @"data", (data ? [TDBase64 encode:data] : nil) },
-                  { @"follows", (dataSuppressed ? $true : nil) }, { @"digest", digestStr },
-                  { @"content_type", [r stringForColumnIndex:2] }, { @"encoding", encodingStr },
-                  { @"length", @(length) }, { @"encoded_length", encodedLengthObj },
-                  { @"revpos", @([r intForColumnIndex:6]) });
-    } while ([r next]);
-    [r close];
+            NSString* encodingStr = nil;
+            id encodedLengthObj = nil;
+            if (encoding != kTDAttachmentEncodingNone) {
+                // Decode the attachment if it's included in the dict:
+                if (data && decodeAttachments) {
+                    data = [self decodeAttachment:data encoding:encoding];
+                } else {
+                    encodingStr = @"gzip";  // the only encoding I know
+                    encodedLengthObj = @(encodedLength);
+                }
+            }
+
+            attachments[[r stringForColumnIndex:1]] =
+                $dict({ @"stub", ((data || dataSuppressed) ? nil : $true) },
+                      { @"data", (data ? [TDBase64 encode:data] : nil) },
+                      { @"follows", (dataSuppressed ? $true : nil) }, { @"digest", digestStr },
+                      { @"content_type", [r stringForColumnIndex:3] }, { @"encoding", encodingStr },
+                      { @"length", @(length) }, { @"encoded_length", encodedLengthObj },
+                      { @"revpos", @([r intForColumnIndex:7]) });
+        }
+        [r close];
+    }
 
-    return attachments;
+    return attachmentsBySequence;
 }
 
 /**
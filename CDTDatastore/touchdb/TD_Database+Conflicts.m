@@ -23,10 +23,11 @@
 /** Only call from within a queued transaction **/
 - (NSArray *)getConflictedDocumentIdsWithDatabase:(FMDatabase *)db
 {
-    NSString *sql = @"SELECT docs.docid, COUNT(*) " @"FROM docs,revs "
-        @"WHERE revs.doc_id = docs.doc_id AND deleted = 0 " @"AND revs.sequence NOT IN "
-        @"(SELECT DISTINCT parent FROM revs " @"WHERE parent NOT NULL) "
-        @"GROUP BY docs.docid HAVING COUNT(*) > 1";
+    // A document is conflicted when a non-deleted leaf isn't its winner. Those revisions are
+    // exactly the revs_losing_leaves index range (current=1, winner=0, deleted=0).
+    NSString *sql = @"SELECT DISTINCT docs.docid FROM revs, docs "
+        @"WHERE revs.current=1 AND revs.winner=0 AND revs.deleted=0 "
+        @"AND docs.doc_id = revs.doc_id ORDER BY docs.docid";
     FMResultSet *r = [db executeQuery:sql];
     if (!r) return nil;
     NSMutableArray *docs = [[NSMutableArray alloc] init];
@@ -41,7 +42,7 @@
 {
     __block NSArray *result;
     __weak TD_Database *weakSelf = self;
-    [_fmdbQueue inDatabase:^(FMDatabase *db) {
+    [self inReadTransaction:^(FMDatabase *db) {
         TD_Database *strongSelf = weakSelf;
         result = [strongSelf getConflictedDocumentIdsWithDatabase:db];
     }];
@@ -42,6 +42,22 @@ typedef BOOL (^TD_ValidationBlock)(TD_Revision* newRevision, id<TD_ValidationCon
  * IDs that don't already exist locally will create phantom revisions with no content. */
 - (TDStatus)forceInsert:(TD_Revision*)rev revisionHistory:(NSArray*)history source:(NSURL*)source;
 
+/** Inserts a batch of revisions replicated from a remote database, as by
+   -forceInsert:revisionHistory:source:, but within a single transaction. Each revision is inserted
+   inside its own savepoint, so one that fails is rolled back without affecting the rest of the
+   batch. Change notifications are only posted for the revisions that were inserted.
+    @param revs  The revisions to insert.
+    @param histories  The revision history of each revision, in the same order as revs. Use NSNull
+   for a revision that has no history.
+    @param source  The URL of the remote database the revisions came from.
+    @param outStatuses  On return, an array of NSNumbers holding the TDStatus of each revision.
+    @return  An error status if the transaction itself failed, in which case nothing was inserted;
+   otherwise kTDStatusOK. */
+- (TDStatus)forceInsertRevisions:(NSArray*)revs
+               revisionHistories:(NSArray*)histories
+                          source:(NSURL*)source
+                        statuses:(NSArray**)outStatuses;
+
 /** Parses the _revisions dict from a document into an array of revision ID strings */
 + (NSArray*)parseCouchDBRevisionHistory:(NSDictionary*)docProperties;
 
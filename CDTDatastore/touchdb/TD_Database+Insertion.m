@@ -23,6 +23,8 @@
 #import "TD_Database+Attachments.h"
 #import "TD_Revision.h"
 #import "TDCanonicalJSON.h"
+#import "TDBinaryJSON.h"
+#import "TDDocumentCache.h"
 #import "TD_Attachment.h"
 #import "TDInternal.h"
 #import "TDMisc.h"
@@ -31,6 +33,8 @@
 #import <FMDB/FMDatabase.h>
 #import <FMDB/FMDatabaseAdditions.h>
 #import <FMDB/FMDatabaseQueue.h>
+#import <FMDB/FMDatabasePool.h>
+#import "FMDatabase+StatementCache.h"
 
 #import "CDTLogging.h"
 
@@ -38,6 +42,8 @@
 
 NSString* const TD_DatabaseChangeNotification = @"TD_DatabaseChange";
 
+static NSString* const kForceInsertSavePoint = @"forceInsert";
+
 @interface TD_ValidationContext : NSObject <TD_ValidationContext> {
    @private
     TD_Database* _db;
@@ -122,8 +128,8 @@ NSString* const TD_DatabaseChangeNotification = @"TD_DatabaseChange";
 {
     Assert([TD_Database isValidDocumentID:docID]);  // this should be caught before I get here
 
-    if (![db executeUpdate:@"INSERT INTO docs (docid) VALUES (?)"
-            withErrorAndBindings:error, docID]) {
+    if (![db executeCachedUpdate:@"INSERT INTO docs (docid) VALUES (?)"
+                  withErrorAndBindings:error, docID]) {
         return -1;
     }
     return db.lastInsertRowId;
@@ -143,9 +149,9 @@ NSString* const TD_DatabaseChangeNotification = @"TD_DatabaseChange";
 
 #pragma mark - INSERTION:
 
-/** Returns the JSON to be stored into the 'json' column for a given TD_Revision.
-    This has all the special keys like "_id" stripped out. */
-- (NSData*)encodeDocumentJSON:(TD_Revision*)rev
+/** Returns the properties of a TD_Revision that are stored in its body, i.e. all but the special
+    keys like "_id". Returns nil if it has no properties or has an invalid special key. */
+- (NSDictionary*)storedPropertiesOfRevision:(TD_Revision*)rev
 {
     static NSSet* sSpecialKeysToRemove, *sSpecialKeysToLeave;
     if (!sSpecialKeysToRemove) {
@@ -174,6 +180,14 @@ NSString* const TD_DatabaseChangeNotification = @"TD_DatabaseChange";
             return nil;
         }
     }
+    return properties;
+}
+
+/** Returns the JSON of a given TD_Revision's body, as for -storedPropertiesOfRevision:. */
+- (NSData*)encodeDocumentJSON:(TD_Revision*)rev
+{
+    NSDictionary* properties = [self storedPropertiesOfRevision:rev];
+    if (!properties) return nil;
 
     // Create canonical JSON -- this is important, because the JSON data returned here will be used
     // to create the new revision ID, and we need to guarantee that equivalent revision bodies
@@ -182,6 +196,25 @@ NSString* const TD_DatabaseChangeNotification = @"TD_DatabaseChange";
     return json;
 }
 
+/** Returns the data to store into the 'json' column for a TD_Revision: its canonical JSON, or
+    its body in the binary format if that's how bodies are stored. Returns nil if the revision
+    has invalid properties. If `outJSON` is non-NULL it's set to the canonical JSON, as needed
+    to generate a revision ID; otherwise a binary body is encoded without making any JSON. */
+- (NSData*)encodeStoredBodyOfRevision:(TD_Revision*)rev JSON:(NSData**)outJSON
+{
+    NSDictionary* properties = [self storedPropertiesOfRevision:rev];
+    if (!properties) return nil;
+
+    NSData* json = nil;
+    if (outJSON || !self.writesBinaryBodies) {
+        json = [TDCanonicalJSON canonicalData:properties];
+        if (outJSON) *outJSON = json;
+    }
+    if (!self.writesBinaryBodies) return json;
+    NSData* binary = [TDBinaryJSON dataWithJSONObject:properties];
+    return binary ?: json ?: [TDCanonicalJSON canonicalData:properties];
+}
+
 - (TD_Revision*)winnerWithDocID:(SInt64)docNumericID
                       oldWinner:(NSString*)oldWinningRevID
                      oldDeleted:(BOOL)oldWinnerWasDeletion
@@ -214,6 +247,19 @@ NSString* const TD_DatabaseChangeNotification = @"TD_DatabaseChange";
     return nil;  // no change
 }
 
+/** Sets revs.winner on the document's winning revision and clears it everywhere else. The winner
+    is picked the same way as -winningRevIDOfDocNumericID:isDeleted:database: does.
+    Only call from within a queued transaction **/
+- (BOOL)updateWinnerOfDocNumericID:(SInt64)docNumericID database:(FMDatabase*)db
+{
+    return [db executeCachedUpdate:@"UPDATE revs SET winner = (sequence = "
+                                    "(SELECT sequence FROM revs AS leaf "
+                                    "WHERE leaf.doc_id=? AND leaf.current=1 "
+                                    "ORDER BY leaf.deleted ASC, leaf.revid DESC LIMIT 1)) "
+                                    "WHERE doc_id=? AND (current=1 OR winner=1)",
+                                   @(docNumericID), @(docNumericID)];
+}
+
 /** Posts a local NSNotification of a new revision of a document. */
 - (void)notifyChange:(TD_Revision*)rev source:(NSURL*)source winningRev:(TD_Revision*)winningRev
 {
@@ -224,7 +270,8 @@ NSString* const TD_DatabaseChangeNotification = @"TD_DatabaseChange";
                                                       userInfo:userInfo];
 }
 
-// Raw row insertion. Returns new sequence, or 0 on error
+// Raw row insertion. `json` is the data to store in the 'json' column, as returned by
+// -encodeStoredBodyOfRevision:JSON:. Returns new sequence, or 0 on error
 - (SequenceNumber)insertRevision:(TD_Revision*)rev
                     docNumericID:(SInt64)docNumericID
                   parentSequence:(SequenceNumber)parentSequence
@@ -233,13 +280,15 @@ NSString* const TD_DatabaseChangeNotification = @"TD_DatabaseChange";
                         database:(FMDatabase*)db
                            error:(NSError* __autoreleasing*)error
 {
-    if (![db executeUpdate:@"INSERT INTO revs (doc_id, revid, parent, current, deleted, json) "
-                            "VALUES (?, ?, ?, ?, ?, ?)"
-            withErrorAndBindings:error, @(docNumericID), rev.revID,
-                                 (parentSequence ? @(parentSequence) : nil), @(current),
-                                 @(rev.deleted), json]) {
+    if (![db executeCachedUpdate:@"INSERT INTO revs (doc_id, revid, parent, current, deleted, json) "
+                                  "VALUES (?, ?, ?, ?, ?, ?)"
+                  withErrorAndBindings:error, @(docNumericID), rev.revID,
+                                       (parentSequence ? @(parentSequence) : nil), @(current),
+                                       @(rev.deleted), json]) {
         return 0;
     }
+    // The document's winning revision may have changed:
+    [self.documentCache removeDocID:rev.docID];
     return rev.sequence = db.lastInsertRowId;
 }
 
@@ -419,13 +468,14 @@ NSString* const TD_DatabaseChangeNotification = @"TD_DatabaseChange";
 
     // Bump the revID and update the JSON:
     NSData* json = nil;
+    NSData* body = nil;
     if (rev.properties) {
-        json = [self encodeDocumentJSON:rev];
-        if (!json) {
+        body = [self encodeStoredBodyOfRevision:rev JSON:&json];
+        if (!body) {
             *outStatus = kTDStatusBadJSON;
             return nil;
         }
-        if (json.length == 2 && memcmp(json.bytes, "{}", 2) == 0) json = nil;
+        if (json.length == 2 && memcmp(json.bytes, "{}", 2) == 0) json = body = nil;
     }
     NSString* newRevID =
         [self generateIDForRevision:rev withJSON:json attachments:attachments prevID:previousRevID];
@@ -440,14 +490,14 @@ NSString* const TD_DatabaseChangeNotification = @"TD_DatabaseChange";
     // Don't store a SQL null in the 'json' column -- I reserve it to mean that the revision data
     // is missing due to compaction or replication.
     // Instead, store an empty zero-length blob.
-    if (json == nil) json = [NSData data];
+    if (body == nil) body = [NSData data];
 
     //// PART III: In which the actual insertion finally takes place:
     SequenceNumber sequence = [self insertRevision:rev
                                       docNumericID:docNumericID
                                     parentSequence:parentSequence
                                            current:YES
-                                              JSON:json
+                                              JSON:body
                                           database:db
                                              error:nil];
     if (!sequence) {
@@ -471,7 +521,8 @@ NSString* const TD_DatabaseChangeNotification = @"TD_DatabaseChange";
 
     // Make replaced rev non-current:
     if (parentSequence > 0) {
-        if (![db executeUpdate:@"UPDATE revs SET current=0 WHERE sequence=?", @(parentSequence)]) {
+        if (![db executeCachedUpdate:@"UPDATE revs SET current=0 WHERE sequence=?",
+                                     @(parentSequence)]) {
             if (db.lastErrorCode == SQLITE_FULL) {
                 *outStatus = kTDStatusInsufficientStorage;
             } else {
@@ -491,6 +542,12 @@ NSString* const TD_DatabaseChangeNotification = @"TD_DatabaseChange";
         return nil;
     }
 
+    if (![self updateWinnerOfDocNumericID:docNumericID database:db]) {
+        *outStatus = (db.lastErrorCode == SQLITE_FULL) ? kTDStatusInsufficientStorage
+                                                       : kTDStatusDBError;
+        return nil;
+    }
+
     // Success!
     *outStatus = deleted ? kTDStatusOK : kTDStatusCreated;
 
@@ -549,13 +606,7 @@ NSString* const TD_DatabaseChangeNotification = @"TD_DatabaseChange";
     NSString* docID = rev.docID;
     NSString* revID = rev.revID;
     if (![TD_Database isValidDocumentID:docID] || !revID) return kTDStatusBadID;
-
-    NSUInteger historyCount = history.count;
-    if (historyCount == 0) {
-        history = @[ revID ];
-        historyCount = 1;
-    } else if (!$equal(history[0], revID))
-        return kTDStatusBadID;
+    if (history.count > 0 && !$equal(history[0], revID)) return kTDStatusBadID;
 
     __block TD_Revision* winningRev = nil;
     __block TDStatus result = kTDStatusCreated;
@@ -564,150 +615,240 @@ NSString* const TD_DatabaseChangeNotification = @"TD_DatabaseChange";
         TD_Database* strongSelf = weakSelf;
         BOOL success = NO;
         @try {
-            // First look up the document's row-id and all locally-known revisions of it:
-            TD_RevisionList* localRevs = nil;
-            SInt64 docNumericID = [strongSelf getDocNumericID:docID database:db];
-            if (docNumericID > 0) {
-                localRevs = [strongSelf getAllRevisionsOfDocumentID:docID
-                                                          numericID:docNumericID
-                                                        onlyCurrent:NO
-                                                     excludeDeleted:NO
-                                                           database:db];
-                if (!localRevs) {
-                    result = kTDStatusDBError;
-                    return;
+            TD_Revision* newWinningRev = nil;
+            result = [strongSelf forceInsert:rev
+                             revisionHistory:history
+                                  winningRev:&newWinningRev
+                                    database:db];
+            winningRev = newWinningRev;
+            success = !TDStatusIsError(result);
+        }
+        @finally { *rollback = !success; }
+    }];
+
+    // Notify and return:
+    [self notifyChange:rev source:source winningRev:winningRev];
+    return result;
+}
+
+/** Public method to add a batch of existing revisions (probably being pulled). */
+- (TDStatus)forceInsertRevisions:(NSArray*)revs
+               revisionHistories:(NSArray*)histories
+                          source:(NSURL*)source
+                        statuses:(NSArray**)outStatuses
+{
+    NSUInteger count = revs.count;
+    Assert(histories.count == count);
+    if (count == 0) {
+        if (outStatuses) *outStatuses = @[];
+        return kTDStatusOK;
+    }
+
+    NSMutableArray* statuses = [[NSMutableArray alloc] initWithCapacity:count];
+    NSMutableArray* winningRevs = [[NSMutableArray alloc] initWithCapacity:count];
+    __weak TD_Database* weakSelf = self;
+    TDStatus result = [self inTransaction:^TDStatus(FMDatabase* db) {
+        TD_Database* strongSelf = weakSelf;
+        [statuses removeAllObjects];
+        [winningRevs removeAllObjects];
+        for (NSUInteger i = 0; i < count; i++) {
+            @autoreleasepool
+            {
+                TD_Revision* rev = revs[i];
+                NSArray* history = $castIf(NSArray, histories[i]);
+
+                // Each revision gets its own savepoint, so a failure only undoes that revision's
+                // partial writes and the rest of the batch can still be committed:
+                NSError* error = nil;
+                if (![db startSavePointWithName:kForceInsertSavePoint error:&error]) {
+                    CDTLogWarn(CDTDATASTORE_LOG_CONTEXT, @"Couldn't start savepoint: %@", error);
+                    return kTDStatusDBError;
                 }
-            } else {
-                docNumericID = [strongSelf insertDocumentID:docID inDatabase:db error:NULL];
-                if (docNumericID <= 0) {
-                    if (db.lastErrorCode == SQLITE_FULL)
-                        result = kTDStatusInsufficientStorage;
-                    else
-                        result = kTDStatusDBError;
-                    return;
+
+                TD_Revision* winningRev = nil;
+                TDStatus status;
+                if (![TD_Database isValidDocumentID:rev.docID] || !rev.revID ||
+                    (history.count > 0 && !$equal(history[0], rev.revID))) {
+                    status = kTDStatusBadID;
+                } else {
+                    status = [strongSelf forceInsert:rev
+                                     revisionHistory:history
+                                          winningRev:&winningRev
+                                            database:db];
                 }
-            }
 
-            // Validate against the latest common ancestor:
-            if (_validations.count > 0) {
-                TD_Revision* oldRev = nil;
-                for (NSUInteger i = 1; i < historyCount; ++i) {
-                    oldRev = [localRevs revWithDocID:docID revID:history[i]];
-                    if (oldRev) break;
+                if (TDStatusIsError(status) &&
+                    ![db rollbackToSavePointWithName:kForceInsertSavePoint error:&error]) {
+                    CDTLogWarn(CDTDATASTORE_LOG_CONTEXT, @"Couldn't roll back savepoint: %@", error);
+                    return kTDStatusDBError;
                 }
-                TDStatus status = [strongSelf validateRevision:rev previousRevision:oldRev];
-                if (TDStatusIsError(status)) {
-                    result = status;
-                    return;
+                if (![db releaseSavePointWithName:kForceInsertSavePoint error:&error]) {
+                    CDTLogWarn(CDTDATASTORE_LOG_CONTEXT, @"Couldn't release savepoint: %@", error);
+                    return kTDStatusDBError;
                 }
+
+                [statuses addObject:@(status)];
+                [winningRevs addObject:(winningRev ?: [NSNull null])];
             }
+        }
+        return kTDStatusOK;
+    }];
 
-            // Look up which rev is the winner, before this insertion
-            // OPT: This rev ID could be cached in the 'docs' row
-            BOOL oldWinnerWasDeletion;
-            NSString* oldWinningRevID = [strongSelf winningRevIDOfDocNumericID:docNumericID
-                                                                     isDeleted:&oldWinnerWasDeletion
-                                                                      database:db];
-
-            // Walk through the remote history in chronological order, matching each revision ID to
-            // a local revision. When the list diverges, start creating blank local revisions to
-            // fill
-            // in the local history:
-            SequenceNumber sequence = 0;
-            SequenceNumber localParentSequence = 0;
-            for (NSInteger i = historyCount - 1; i >= 0; --i) {
-                NSString* revID = history[i];
-                TD_Revision* localRev = [localRevs revWithDocID:docID revID:revID];
-                if (localRev) {
-                    // This revision is known locally. Remember its sequence as the parent of the
-                    // next one:
-                    sequence = localRev.sequence;
-                    Assert(sequence > 0);
-                    localParentSequence = sequence;
+    if (TDStatusIsError(result)) {
+        // The whole batch was rolled back, so no revision was inserted:
+        [statuses removeAllObjects];
+        for (NSUInteger i = 0; i < count; i++) [statuses addObject:@(result)];
+    } else {
+        // Notify about the revisions that made it into the database:
+        for (NSUInteger i = 0; i < count; i++) {
+            if (TDStatusIsError([statuses[i] intValue])) continue;
+            @autoreleasepool
+            {
+                [self notifyChange:revs[i]
+                            source:source
+                        winningRev:$castIf(TD_Revision, winningRevs[i])];
+            }
+        }
+    }
 
-                } else {
-                    // This revision isn't known, so add it:
-                    TD_Revision* newRev;
-                    NSData* json = nil;
-                    BOOL current = NO;
-                    if (i == 0) {
-                        // Hey, this is the leaf revision we're inserting:
-                        newRev = rev;
-                        json = [strongSelf encodeDocumentJSON:rev];
-                        if (!json) {
-                            result = kTDStatusBadJSON;
-                            return;
-                        }
-                        current = YES;
-                    } else {
-                        // It's an intermediate parent, so insert a stub:
-                        newRev = [[TD_Revision alloc] initWithDocID:docID revID:revID deleted:NO];
-                    }
+    if (outStatuses) *outStatuses = statuses;
+    return result;
+}
 
-                    // Insert it:
-                    sequence = [strongSelf insertRevision:newRev
-                                             docNumericID:docNumericID
-                                           parentSequence:sequence
-                                                  current:current
-                                                     JSON:json
-                                                 database:db
-                                                    error:NULL];
-                    if (sequence <= 0) {
-                        if (db.lastErrorCode == SQLITE_FULL)
-                            result = kTDStatusInsufficientStorage;
-                        else
-                            result = kTDStatusDBError;
-                        return;
-                    }
-                    newRev.sequence = sequence;
-
-                    if (i == 0) {
-                        // Write any changed attachments for the new revision. As the parent
-                        // sequence use
-                        // the latest local revision (this is to copy attachments from):
-                        TDStatus status;
-                        NSDictionary* attachments =
-                            [strongSelf attachmentsFromRevision:rev inDatabase:db status:&status];
-                        if (attachments)
-                            status = [strongSelf processAttachments:attachments
-                                                        forRevision:rev
-                                                 withParentSequence:localParentSequence
-                                                         inDatabase:db];
-                        if (TDStatusIsError(status)) {
-                            result = status;
-                            return;
-                        }
-                    }
-                }
-            }
+/**
+ Inserts an existing revision and its missing ancestors. The caller has already checked the
+ revision's docID and revID, and is responsible for rolling back on error.
+ Must be called from within an FMDatabaseQueue block
+ */
+- (TDStatus)forceInsert:(TD_Revision*)rev
+        revisionHistory:(NSArray*)history  // in *reverse* order, starting with rev's revID
+             winningRev:(TD_Revision**)outWinningRev
+               database:(FMDatabase*)db
+{
+    NSString* docID = rev.docID;
+    NSUInteger historyCount = history.count;
+    if (historyCount == 0) {
+        history = @[ rev.revID ];
+        historyCount = 1;
+    }
 
-            // Mark the latest local rev as no longer current:
-            if (localParentSequence > 0 && localParentSequence != sequence) {
-                if (![db executeUpdate:@"UPDATE revs SET current=0 WHERE sequence=?",
-                                       @(localParentSequence)]) {
-                    if (db.lastErrorCode == SQLITE_FULL)
-                        result = kTDStatusInsufficientStorage;
-                    else
-                        result = kTDStatusDBError;
-                    return;
-                }
+    // First look up the document's row-id and all locally-known revisions of it:
+    TD_RevisionList* localRevs = nil;
+    SInt64 docNumericID = [self getDocNumericID:docID database:db];
+    if (docNumericID > 0) {
+        localRevs = [self getAllRevisionsOfDocumentID:docID
+                                            numericID:docNumericID
+                                          onlyCurrent:NO
+                                       excludeDeleted:NO
+                                             database:db];
+        if (!localRevs) return kTDStatusDBError;
+    } else {
+        docNumericID = [self insertDocumentID:docID inDatabase:db error:NULL];
+        if (docNumericID <= 0) {
+            return (db.lastErrorCode == SQLITE_FULL) ? kTDStatusInsufficientStorage
+                                                     : kTDStatusDBError;
+        }
+    }
+
+    // Validate against the latest common ancestor:
+    if (_validations.count > 0) {
+        TD_Revision* oldRev = nil;
+        for (NSUInteger i = 1; i < historyCount; ++i) {
+            oldRev = [localRevs revWithDocID:docID revID:history[i]];
+            if (oldRev) break;
+        }
+        TDStatus status = [self validateRevision:rev previousRevision:oldRev];
+        if (TDStatusIsError(status)) return status;
+    }
+
+    // Look up which rev is the winner, before this insertion
+    // OPT: This rev ID could be cached in the 'docs' row
+    BOOL oldWinnerWasDeletion;
+    NSString* oldWinningRevID = [self winningRevIDOfDocNumericID:docNumericID
+                                                       isDeleted:&oldWinnerWasDeletion
+                                                        database:db];
+
+    // Walk through the remote history in chronological order, matching each revision ID to
+    // a local revision. When the list diverges, start creating blank local revisions to fill
+    // in the local history:
+    SequenceNumber sequence = 0;
+    SequenceNumber localParentSequence = 0;
+    for (NSInteger i = historyCount - 1; i >= 0; --i) {
+        NSString* revID = history[i];
+        TD_Revision* localRev = [localRevs revWithDocID:docID revID:revID];
+        if (localRev) {
+            // This revision is known locally. Remember its sequence as the parent of the next one:
+            sequence = localRev.sequence;
+            Assert(sequence > 0);
+            localParentSequence = sequence;
+
+        } else {
+            // This revision isn't known, so add it:
+            TD_Revision* newRev;
+            NSData* json = nil;
+            BOOL current = NO;
+            if (i == 0) {
+                // Hey, this is the leaf revision we're inserting:
+                newRev = rev;
+                json = [self encodeStoredBodyOfRevision:rev JSON:NULL];
+                if (!json) return kTDStatusBadJSON;
+                current = YES;
+            } else {
+                // It's an intermediate parent, so insert a stub:
+                newRev = [[TD_Revision alloc] initWithDocID:docID revID:revID deleted:NO];
             }
 
-            // Figure out what the new winning rev ID is:
-            winningRev = [strongSelf winnerWithDocID:docNumericID
-                                           oldWinner:oldWinningRevID
-                                          oldDeleted:oldWinnerWasDeletion
-                                              newRev:rev
-                                            database:db];
+            // Insert it:
+            sequence = [self insertRevision:newRev
+                               docNumericID:docNumericID
+                             parentSequence:sequence
+                                    current:current
+                                       JSON:json
+                                   database:db
+                                      error:NULL];
+            if (sequence <= 0) {
+                return (db.lastErrorCode == SQLITE_FULL) ? kTDStatusInsufficientStorage
+                                                         : kTDStatusDBError;
+            }
+            newRev.sequence = sequence;
+
+            if (i == 0) {
+                // Write any changed attachments for the new revision. As the parent sequence use
+                // the latest local revision (this is to copy attachments from):
+                TDStatus status;
+                NSDictionary* attachments =
+                    [self attachmentsFromRevision:rev inDatabase:db status:&status];
+                if (attachments)
+                    status = [self processAttachments:attachments
+                                          forRevision:rev
+                                   withParentSequence:localParentSequence
+                                           inDatabase:db];
+                if (TDStatusIsError(status)) return status;
+            }
+        }
+    }
 
-            success = YES;
+    // Mark the latest local rev as no longer current:
+    if (localParentSequence > 0 && localParentSequence != sequence) {
+        if (![db executeCachedUpdate:@"UPDATE revs SET current=0 WHERE sequence=?",
+                                     @(localParentSequence)]) {
+            return (db.lastErrorCode == SQLITE_FULL) ? kTDStatusInsufficientStorage
+                                                     : kTDStatusDBError;
         }
-        @finally { *rollback = !success; }
-    }];
+    }
 
-    // Notify and return:
-    [self notifyChange:rev source:source winningRev:winningRev];
-    return result;
+    if (![self updateWinnerOfDocNumericID:docNumericID database:db]) {
+        return (db.lastErrorCode == SQLITE_FULL) ? kTDStatusInsufficientStorage
+                                                 : kTDStatusDBError;
+    }
+
+    // Figure out what the new winning rev ID is:
+    *outWinningRev = [self winnerWithDocID:docNumericID
+                                 oldWinner:oldWinningRevID
+                                oldDeleted:oldWinnerWasDeletion
+                                    newRev:rev
+                                  database:db];
+    return kTDStatusCreated;
 }
 
 #pragma mark - PURGING / COMPACTING:
@@ -753,7 +894,11 @@ NSString* const TD_DatabaseChangeNotification = @"TD_DatabaseChange";
 
     // TODO syncronise the open/close?
 
+    // Bodies of revisions which are no longer current have just been deleted:
+    [self.documentCache removeAll];
+
     CDTLogInfo(CDTDATASTORE_LOG_CONTEXT, @"Closing and re-opening database...");
+    [_readerPool releaseAllDatabases];
     [_fmdbQueue close];
 
     if (![self openFMDBWithEncryptionKeyProvider:_keyProviderToOpenDB]) return kTDStatusDBError;
@@ -837,7 +982,11 @@ NSString* const TD_DatabaseChangeNotification = @"TD_DatabaseChange";
                                 [seqsToPurge.allObjects componentsJoinedByString:@","]);
                 }
                 revsPurged = revsToPurge.allObjects;
+                if (![strongSelf updateWinnerOfDocNumericID:docNumericID database:db]) {
+                    return kTDStatusDBError;
+                }
             }
+            [strongSelf.documentCache removeDocID:docID];
             result[docID] = revsPurged;
         }
         return kTDStatusOK;
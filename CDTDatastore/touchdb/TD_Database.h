@@ -23,7 +23,7 @@
 
 @protocol CDTEncryptionKeyProvider;
 
-@class FMDatabase, FMDatabaseQueue, TD_View, TDBlobStore;
+@class FMDatabase, FMDatabaseQueue, FMDatabasePool, TD_View, TDBlobStore, TDDocumentCache;
 
 struct TDQueryOptions;  // declared in TD_View.h
 
@@ -49,6 +49,7 @@ enum {
     kTDLeaveAttachmentsEncoded = 32,  // i.e. don't decode
     kTDBigAttachmentsFollow = 64,     // i.e. add 'follows' key instead of data for big ones
     kTDNoBody = 128,                  // omit regular doc body properties
+    kTDNoAttachments = 256,           // omit '_attachments' property
 };
 
 /** Options for _changes feed (-changesSinceSequence:). */
@@ -70,6 +71,8 @@ extern const TDChangesOptions kDefaultTDChangesOptions;
     NSString* _path;
     NSString* _name;
     FMDatabaseQueue* _fmdbQueue;
+    FMDatabasePool* _readerPool;
+    dispatch_semaphore_t _readerSlots;
     id<CDTEncryptionKeyProvider> _keyProviderToOpenDB;
     BOOL _readOnly;
     int _transactionLevel;
@@ -158,11 +161,30 @@ extern const TDChangesOptions kDefaultTDChangesOptions;
 @property (readonly) NSString* privateUUID;
 @property (readonly) NSString* publicUUID;
 
+/** Optional cache of the decoded bodies of winning revisions, consulted when reading documents
+    by ID so hot documents aren't parsed again on every read. nil (the default) disables it.
+    TD_Database keeps the cache up to date as revisions are inserted, purged and compacted. */
+@property (strong) TDDocumentCache* documentCache;
+
+/** Should revision bodies be stored in the binary format of TDBinaryJSON instead of as JSON?
+    It's smaller, and reading one property doesn't mean scanning the whole body. Takes effect when
+    the database is opened, which upgrades it to a version that older releases can't read.
+    Bodies already stored in either format can be read whatever the setting; they're still
+    returned, and replicated, as JSON. */
+@property BOOL storesBinaryBodies;
+
 /** Executes the block within a database transaction.
     If the block returns a non-OK status, the transaction is aborted/rolled back.
     Any exception raised by the block will be caught and treated as kTDStatusException. */
 - (TDStatus)inTransaction:(TDStatus (^)(FMDatabase*))block;
 
+/** Executes the block on one of a small pool of read-only connections, inside a deferred
+    transaction, so every statement in the block sees the same WAL snapshot. Readers don't wait
+    for the writer connection, but they don't see changes that haven't been committed yet.
+    A call nested in another on the same thread runs on the outer call's connection.
+    The block must not write to the database. */
+- (void)inReadTransaction:(void (^)(FMDatabase*))block;
+
 // DOCUMENTS:
 
 - (TD_Revision*)getDocumentWithID:(NSString*)docID
@@ -234,6 +256,23 @@ extern const TDChangesOptions kDefaultTDChangesOptions;
 
 - (NSDictionary*)getDocsWithIDs:(NSArray*)docIDs options:(const struct TDQueryOptions*)options;
 
+/** As -getDocsWithIDs:options:. The IDs are bound in batches padded to a few fixed sizes, so
+    there are only a few shapes of SQL for any list of IDs and their compiled statements are
+    reused. Given IDs, skip and limit apply to the rows of output, which are in the IDs' order.
+    Only call from within a queued transaction **/
+- (NSDictionary*)getDocsWithIDs:(NSArray*)docIDs
+                        options:(const struct TDQueryOptions*)options
+                       database:(FMDatabase*)db;
+
+/** Returns up to `limit` winning, non-deleted revisions of the documents whose IDs sort after
+    docID (or of the first documents, if docID is nil), in document ID order. Pass the last
+    returned docID back in to get the next page. Bodies are loaded unless options has kTDNoBody.
+    Only call from within a queued transaction **/
+- (NSArray*)winningRevisionsAfterDocID:(NSString*)docID
+                                 limit:(unsigned)limit
+                               options:(TDContentOptions)options
+                              database:(FMDatabase*)db;
+
 - (TD_View*)viewNamed:(NSString*)name;
 
 - (TD_View*)existingViewNamed:(NSString*)name;
@@ -28,21 +28,65 @@
 #import "TD_Revision.h"
 #import "TDCollateJSON.h"
 #import "TDBlobStore.h"
+#import "TDDocumentCache.h"
 #import "TDMisc.h"
 #import "TDJSON.h"
+#import "TDBinaryJSON.h"
 #import "Test.h"
 
 #import <FMDB/FMDatabase.h>
 #import <FMDB/FMDatabaseAdditions.h>
 #import "FMDatabase+LongLong.h"
+#import "FMDatabase+StatementCache.h"
 #import "FMDatabase+EncryptionKey.h"
 #import <FMDB/FMDatabaseQueue.h>
+#import <FMDB/FMDatabasePool.h>
 #import "CDTEncryptionKeyProvider.h"
 #import "CDTLogging.h"
 
 NSString* const TD_DatabaseWillCloseNotification = @"TD_DatabaseWillClose";
 NSString* const TD_DatabaseWillBeDeletedNotification = @"TD_DatabaseWillBeDeleted";
 
+/** Maximum number of read-only connections opened alongside the writer connection. */
+static const long kTDReaderConnectionCount = 3;
+
+/** Number of documents read before their attachment metadata is looked up with one query. */
+static const NSUInteger kTDExpandPageSize = 100;
+
+/** Maximum number of document IDs bound to each statement looking documents up by ID. */
+static const NSUInteger kTDDocIDBatchSize = 64;
+
+// Fixed SQL for -getDocumentWithID:revisionID:options:status:database:, so that each variant
+// reuses one compiled statement per connection.
+static NSString* const kGetRevisionSQL =
+    @"SELECT revid, deleted, sequence, json FROM revs, docs "
+     "WHERE docs.docid=? AND revs.doc_id=docs.doc_id AND revid=? AND json notnull LIMIT 1";
+static NSString* const kGetRevisionNoBodySQL =
+    @"SELECT revid, deleted, sequence FROM revs, docs "
+     "WHERE docs.docid=? AND revs.doc_id=docs.doc_id AND revid=? AND json notnull LIMIT 1";
+static NSString* const kGetCurrentRevisionSQL =
+    @"SELECT revid, deleted, sequence, json FROM revs, docs "
+     "WHERE docs.docid=? AND revs.doc_id=docs.doc_id and current=1 and deleted=0 "
+     "ORDER BY revid DESC LIMIT 1";
+static NSString* const kGetCurrentRevisionNoBodySQL =
+    @"SELECT revid, deleted, sequence FROM revs, docs "
+     "WHERE docs.docid=? AND revs.doc_id=docs.doc_id and current=1 and deleted=0 "
+     "ORDER BY revid DESC LIMIT 1";
+
+// Fixed SQL for -winningRevisionsAfterDocID:limit:options:database:
+static NSString* const kWinningRevisionsPageSQL =
+    @"SELECT docid, revid, sequence, json FROM docs, revs "
+     "WHERE docs.docid > ? AND revs.sequence = (SELECT sequence FROM revs AS leaf "
+     "WHERE leaf.doc_id = docs.doc_id AND leaf.current=1 AND leaf.deleted=0 "
+     "ORDER BY leaf.revid DESC LIMIT 1) "
+     "ORDER BY docs.docid LIMIT ?";
+static NSString* const kWinningRevisionsPageNoBodySQL =
+    @"SELECT docid, revid, sequence FROM docs, revs "
+     "WHERE docs.docid > ? AND revs.sequence = (SELECT sequence FROM revs AS leaf "
+     "WHERE leaf.doc_id = docs.doc_id AND leaf.current=1 AND leaf.deleted=0 "
+     "ORDER BY leaf.revid DESC LIMIT 1) "
+     "ORDER BY docs.docid LIMIT ?";
+
 //@interface FMDatabaseCreator : NSObject
 //@end
 //@implementation FMDatabaseCreator
@@ -249,15 +293,7 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
 
         // Register CouchDB-compatible JSON collation functions:
         if (result) {
-            [queue inDatabase:^(FMDatabase* db) {
-                sqlite3_create_collation(db.sqliteHandle, "JSON", SQLITE_UTF8, kTDCollateJSON_Unicode,
-                        TDCollateJSON);
-                sqlite3_create_collation(db.sqliteHandle, "JSON_RAW", SQLITE_UTF8, kTDCollateJSON_Raw,
-                        TDCollateJSON);
-                sqlite3_create_collation(db.sqliteHandle, "JSON_ASCII", SQLITE_UTF8, kTDCollateJSON_ASCII,
-                        TDCollateJSON);
-                sqlite3_create_collation(db.sqliteHandle, "REVID", SQLITE_UTF8, NULL, TDCollateRevIDs);
-            }];
+            [queue inDatabase:^(FMDatabase* db) { [TD_Database registerCollationsInDatabase:db]; }];
         }
 
         // Stuff we need to initialize every time the database opens:
@@ -275,6 +311,11 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
         if (result) {
             _fmdbQueue = queue;
             _keyProviderToOpenDB = provider;
+
+            // Readers are opened lazily, see -databasePool:didAddDatabase:
+            _readerPool = [TD_Database readerPoolForDatabaseAtPath:_path];
+            _readerPool.delegate = self;
+            _readerSlots = dispatch_semaphore_create(kTDReaderConnectionCount);
         } else if (queue) {
             [queue close];
         }
@@ -285,6 +326,18 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
     return result;
 }
 
+// callers: -openFMDBWithEncryptionKeyProvider:, -databasePool:didAddDatabase:
++ (void)registerCollationsInDatabase:(FMDatabase*)db
+{
+    sqlite3_create_collation(db.sqliteHandle, "JSON", SQLITE_UTF8, kTDCollateJSON_Unicode,
+                             TDCollateJSON);
+    sqlite3_create_collation(db.sqliteHandle, "JSON_RAW", SQLITE_UTF8, kTDCollateJSON_Raw,
+                             TDCollateJSON);
+    sqlite3_create_collation(db.sqliteHandle, "JSON_ASCII", SQLITE_UTF8, kTDCollateJSON_ASCII,
+                             TDCollateJSON);
+    sqlite3_create_collation(db.sqliteHandle, "REVID", SQLITE_UTF8, NULL, TDCollateRevIDs);
+}
+
 // callers: many things
 - (BOOL)isOpenWithEncryptionKeyProvider:(id<CDTEncryptionKeyProvider>)provider
 {
@@ -343,7 +396,7 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
         int dbVersion = [db intForQuery:@"PRAGMA user_version"];
 
         // Incompatible version changes increment the hundreds' place:
-        if (dbVersion >= 300) {
+        if (dbVersion >= 500) {
             CDTLogWarn(CDTDATASTORE_LOG_CONTEXT,
                     @"TD_Database: Database version (%d) is newer than I know how to work with",
                     dbVersion);
@@ -517,9 +570,39 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
                     return;
                 }
             }
-            
-            // dbVersion = 200;
+
+            dbVersion = 200;
         }
+
+        if (dbVersion < 300) {
+            // Version 300: revs.winner flags the winning revision of each document, and
+            // revs_losing_leaves finds the non-deleted leaves that lost, i.e. the conflicts.
+            // Incompatible because older versions wouldn't keep the flag up to date.
+            NSString* sql = @"ALTER TABLE revs ADD COLUMN winner BOOLEAN DEFAULT 0; \
+                              UPDATE revs SET winner = 1 WHERE sequence IN ( \
+                                  SELECT (SELECT sequence FROM revs AS leaf \
+                                          WHERE leaf.doc_id = docs.doc_id AND leaf.current=1 \
+                                          ORDER BY leaf.deleted ASC, leaf.revid DESC LIMIT 1) \
+                                  FROM docs); \
+                              CREATE INDEX revs_losing_leaves ON revs(current, winner, deleted, doc_id)";
+            if (![strongSelf migrateWithUpdates:sql queries:nil version:300 inDatabase:db]) {
+                result = NO;
+                return;
+            }
+            dbVersion = 300;
+        }
+
+        if (dbVersion < 400 && strongSelf.storesBinaryBodies) {
+            // Version 400: revs.json may hold bodies in the binary format of TDBinaryJSON as well
+            // as JSON. Nothing needs converting, since bodies are told apart by their first bytes.
+            // Incompatible because older versions can only read JSON.
+            if (![strongSelf migrateWithUpdates:nil queries:nil version:400 inDatabase:db]) {
+                result = NO;
+                return;
+            }
+            dbVersion = 400;
+        }
+        strongSelf->_writesBinaryBodies = strongSelf.storesBinaryBodies;
         
 #if DEBUG
         db.crashOnErrors = YES;
@@ -582,6 +665,10 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
 
     _activeReplicators = nil;
 
+    [_readerPool releaseAllDatabases];
+    _readerPool = nil;
+    _readerSlots = nil;
+
     [_fmdbQueue close];
     _fmdbQueue = nil;
 
@@ -589,6 +676,8 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
 
     _attachments = nil;
 
+    [self.documentCache removeAll];
+
     self.open = NO;
     _transactionLevel = 0;
     return YES;
@@ -670,10 +759,44 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
     return status;
 }
 
+- (void)inReadTransaction:(void (^)(FMDatabase*))block
+{
+    FMDatabasePool* pool = _readerPool;
+    dispatch_semaphore_t slots = _readerSlots;
+    if (!pool) {
+        [_fmdbQueue inDatabase:block];
+        return;
+    }
+
+    // A read nested inside another on this thread joins its transaction. Waiting for a slot of
+    // its own would deadlock once every slot was held by reads waiting on nested ones.
+    NSMutableDictionary* threadReaders = [NSThread currentThread].threadDictionary;
+    NSString* key = $sprintf(@"TD_Database reader %p", self);
+    FMDatabase* current = threadReaders[key];
+    if (current) {
+        block(current);
+        return;
+    }
+
+    // FMDatabasePool hands out a nil database once its limit is reached, so wait for a free slot
+    // rather than letting the block run without a connection.
+    dispatch_semaphore_wait(slots, DISPATCH_TIME_FOREVER);
+    @try {
+        [pool inDeferredTransaction:^(FMDatabase* db, BOOL* rollback) {
+            threadReaders[key] = db;
+            @try {
+                block(db);
+            }
+            @finally { [threadReaders removeObjectForKey:key]; }
+        }];
+    }
+    @finally { dispatch_semaphore_signal(slots); }
+}
+
 - (NSString*)privateUUID
 {
     __block NSString* result;
-    [_fmdbQueue inDatabase:^(FMDatabase* db) {
+    [self inReadTransaction:^(FMDatabase* db) {
         result = [db stringForQuery:@"SELECT value FROM info WHERE key='privateUUID'"];
     }];
     return result;
@@ -682,7 +805,7 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
 - (NSString*)publicUUID
 {
     __block NSString* result;
-    [_fmdbQueue inDatabase:^(FMDatabase* db) {
+    [self inReadTransaction:^(FMDatabase* db) {
         result = [db stringForQuery:@"SELECT value FROM info WHERE key='publicUUID'"];
     }];
     return result;
@@ -693,9 +816,9 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
 - (NSUInteger)documentCount
 {
     __block NSUInteger result = NSNotFound;
-    [_fmdbQueue inDatabase:^(FMDatabase* db) {
-        FMResultSet* r = [db executeQuery:@"SELECT COUNT(DISTINCT doc_id) FROM revs "
-                                           "WHERE current=1 AND deleted=0"];
+    [self inReadTransaction:^(FMDatabase* db) {
+        FMResultSet* r = [db executeCachedQuery:@"SELECT COUNT(DISTINCT doc_id) FROM revs "
+                                                 "WHERE current=1 AND deleted=0"];
         if ([r next]) {
             result = [r intForColumnIndex:0];
         }
@@ -707,20 +830,23 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
 - (SequenceNumber)lastSequence
 {
     __block SequenceNumber result = 0;
-    [_fmdbQueue inDatabase:^(FMDatabase* db) { result = [self lastSequenceInDatabase:db]; }];
+    [self inReadTransaction:^(FMDatabase* db) { result = [self lastSequenceInDatabase:db]; }];
     return result;
 }
 
 /** Always call from within FMDatabaseQueue block */
 - (SequenceNumber)lastSequenceInDatabase:(FMDatabase*)db
 {
-    return [db longLongForQuery:@"SELECT MAX(sequence) FROM revs"];
+    return [db longLongForCachedQuery:@"SELECT MAX(sequence) FROM revs"];
 }
 
 /** Inserts the _id, _rev and _attachments properties into the JSON data and stores it in rev.
-    Rev must already have its revID and sequence properties set. */
+    Rev must already have its revID and sequence properties set.
+    attachmentDicts, if not nil, is the result of -getAttachmentDictsForSequences:... for a page
+    of revisions including this one, so a sequence missing from it has no attachments. */
 - (NSDictionary*)extraPropertiesForRevision:(TD_Revision*)rev
                                     options:(TDContentOptions)options
+                            attachmentDicts:(NSDictionary*)attachmentDicts
                                  inDatabase:(FMDatabase*)db
 {
     NSString* docID = rev.docID;
@@ -730,8 +856,13 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
     Assert(sequence > 0);
 
     // Get attachment metadata, and optionally the contents:
-    NSDictionary* attachmentsDict =
-        [self getAttachmentDictForSequence:sequence options:options inDatabase:db];
+    NSDictionary* attachmentsDict = nil;
+    if (attachmentDicts) {
+        attachmentsDict = attachmentDicts[@(sequence)];
+    } else if (!(options & kTDNoAttachments)) {
+        attachmentsDict =
+            [self getAttachmentDictForSequence:sequence options:options inDatabase:db];
+    }
 
     // Get more optional stuff to put in the properties:
     // OPT: This probably ends up making redundant SQL queries if multiple options are enabled.
@@ -775,10 +906,20 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
 - (void)expandStoredJSON:(NSData*)json
             intoRevision:(TD_Revision*)rev
                  options:(TDContentOptions)options
+         attachmentDicts:(NSDictionary*)attachmentDicts
               inDatabase:(FMDatabase*)db
 {
-    NSDictionary* extra = [self extraPropertiesForRevision:rev options:options inDatabase:db];
-    if (json.length > 0) {
+    NSDictionary* extra = [self extraPropertiesForRevision:rev
+                                                   options:options
+                                           attachmentDicts:attachmentDicts
+                                                inDatabase:db];
+    if ([TDBinaryJSON isBinaryJSON:json]) {
+        TDLazyJSONDictionary* body = [[TDLazyJSONDictionary alloc] initWithJSON:json];
+        if (!body)
+            CDTLogWarn(CDTDATASTORE_LOG_CONTEXT, @"Malformed binary body for doc=%@, rev=%@",
+                       rev.docID, rev.revID);
+        rev.properties = body ? [body dictionaryByAddingEntries:extra] : extra;
+    } else if (json.length > 0) {
         rev.asJSON = [TDJSON appendDictionary:extra toJSONDictionaryData:json];
     } else {
         rev.properties = extra;
@@ -786,6 +927,39 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
     }
 }
 
+/** Returns the "_attachments" dictionaries for a page of revisions, as for
+    -getAttachmentDictsForSequences:options:inDatabase:, or nil if options excludes them.
+    Only call from within a queued transaction **/
+- (NSDictionary*)attachmentDictsForRevisions:(NSArray*)revs
+                                     options:(TDContentOptions)options
+                                  inDatabase:(FMDatabase*)db
+{
+    if ((options & kTDNoAttachments) || revs.count == 0) return nil;
+    NSMutableArray* sequences = [NSMutableArray arrayWithCapacity:revs.count];
+    for (TD_Revision* rev in revs) [sequences addObject:@(rev.sequence)];
+    return [self getAttachmentDictsForSequences:sequences options:options inDatabase:db];
+}
+
+/** Like -expandStoredJSON:intoRevision:options:attachmentDicts:inDatabase: for a page of
+    revisions, reading all their attachment metadata with one query. jsons holds each revision's
+    stored JSON, or NSNull if it has none.
+    Only call from within a queued transaction **/
+- (void)expandStoredJSONs:(NSArray*)jsons
+            intoRevisions:(NSArray*)revs
+                  options:(TDContentOptions)options
+               inDatabase:(FMDatabase*)db
+{
+    NSDictionary* attachmentDicts =
+        [self attachmentDictsForRevisions:revs options:options inDatabase:db];
+    [revs enumerateObjectsUsingBlock:^(TD_Revision* rev, NSUInteger i, BOOL* stop) {
+        [self expandStoredJSON:$castIf(NSData, jsons[i])
+                  intoRevision:rev
+                       options:options
+               attachmentDicts:attachmentDicts
+                    inDatabase:db];
+    }];
+}
+
 - (NSDictionary*)documentPropertiesFromJSON:(NSData*)json
                                       docID:(NSString*)docID
                                       revID:(NSString*)revID
@@ -793,24 +967,85 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
                                    sequence:(SequenceNumber)sequence
                                     options:(TDContentOptions)options
                                  inDatabase:(FMDatabase*)db
+{
+    return [self documentPropertiesFromJSON:json
+                                      docID:docID
+                                      revID:revID
+                                    deleted:deleted
+                                   sequence:sequence
+                                    options:options
+                            attachmentDicts:nil
+                                 inDatabase:db];
+}
+
+- (NSDictionary*)documentPropertiesFromJSON:(NSData*)json
+                                      docID:(NSString*)docID
+                                      revID:(NSString*)revID
+                                    deleted:(BOOL)deleted
+                                   sequence:(SequenceNumber)sequence
+                                    options:(TDContentOptions)options
+                            attachmentDicts:(NSDictionary*)attachmentDicts
+                                 inDatabase:(FMDatabase*)db
 {
     TD_Revision* rev = [[TD_Revision alloc] initWithDocID:docID revID:revID deleted:deleted];
     rev.sequence = sequence;
     rev.missing = (json == nil);
-    NSDictionary* extra = [self extraPropertiesForRevision:rev options:options inDatabase:db];
+    NSDictionary* extra = [self extraPropertiesForRevision:rev
+                                                   options:options
+                                           attachmentDicts:attachmentDicts
+                                                inDatabase:db];
     if (json.length == 0 || (json.length == 2 && memcmp(json.bytes, "{}", 2) == 0))
         return extra;  // optimization, and workaround for issue #44
-    NSMutableDictionary* docProperties =
-        [TDJSON JSONObjectWithData:json options:TDJSONReadingMutableContainers error:NULL];
+    // Only the properties that are read get parsed, which for indexing is usually very few:
+    TDLazyJSONDictionary* docProperties = [[TDLazyJSONDictionary alloc] initWithJSON:json];
     if (!docProperties) {
         CDTLogWarn(CDTDATASTORE_LOG_CONTEXT, @"Unparseable JSON for doc=%@, rev=%@: %@", docID, revID,
                 [json my_UTF8ToString]);
         return extra;
     }
+    return [docProperties dictionaryByAddingEntries:extra];
+}
+
+/** Like -documentPropertiesFromJSON:...attachmentDicts:inDatabase: for a body taken from the
+    document cache, which is copied rather than changed. */
+- (NSDictionary*)documentPropertiesFromBody:(NSDictionary*)body
+                                      docID:(NSString*)docID
+                                      revID:(NSString*)revID
+                                   sequence:(SequenceNumber)sequence
+                                    options:(TDContentOptions)options
+                            attachmentDicts:(NSDictionary*)attachmentDicts
+                                 inDatabase:(FMDatabase*)db
+{
+    TD_Revision* rev = [[TD_Revision alloc] initWithDocID:docID revID:revID deleted:NO];
+    rev.sequence = sequence;
+    NSDictionary* extra = [self extraPropertiesForRevision:rev
+                                                   options:options
+                                           attachmentDicts:attachmentDicts
+                                                inDatabase:db];
+    if (body.count == 0) return extra;
+    NSMutableDictionary* docProperties = [body mutableCopy];
     [docProperties addEntriesFromDictionary:extra];
     return docProperties;
 }
 
+/** Parses the stored JSON of a document's winning revision into immutable containers and adds
+    it to the document cache. Returns nil, caching nothing, if the JSON is missing or can't be
+    parsed; the caller then falls back to reading the JSON as usual. */
+- (NSDictionary*)cacheBodyFromJSON:(NSData*)json docID:(NSString*)docID revID:(NSString*)revID
+{
+    TDDocumentCache* cache = self.documentCache;
+    if (!cache || json.length == 0) return nil;
+    NSDictionary* body;
+    if (json.length == 2 && memcmp(json.bytes, "{}", 2) == 0)
+        body = @{};
+    else if ([TDBinaryJSON isBinaryJSON:json])
+        body = [TDBinaryJSON JSONObjectWithData:json];
+    else
+        body = $castIf(NSDictionary, [TDJSON JSONObjectWithData:json options:0 error:NULL]);
+    if (body) [cache setBody:body forDocID:docID revID:revID cost:json.length];
+    return body;
+}
+
 /** public method, don't call when in FMDatabaseQueue block, or it will deadlock */
 - (TD_Revision*)getDocumentWithID:(NSString*)docID
                        revisionID:(NSString*)revID
@@ -819,7 +1054,7 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
 {
     __block TD_Revision* result;
     __weak TD_Database* weakSelf = self;
-    [_fmdbQueue inDatabase:^(FMDatabase* db) {
+    [self inReadTransaction:^(FMDatabase* db) {
         TD_Database* strongSelf = weakSelf;
         result = [strongSelf getDocumentWithID:docID
                                     revisionID:revID
@@ -838,18 +1073,12 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
                          database:(FMDatabase*)db
 {
     TD_Revision* result = nil;
-    NSMutableString* sql = [NSMutableString stringWithString:@"SELECT revid, deleted, sequence"];
-    if (!(options & kTDNoBody)) [sql appendString:@", json"];
-    if (revID)
-        [sql appendString:@" FROM revs, docs "
-                           "WHERE docs.docid=? AND revs.doc_id=docs.doc_id AND revid=? AND json "
-                           "notnull LIMIT 1"];
+    NSString* sql;
+    if (options & kTDNoBody)
+        sql = revID ? kGetRevisionNoBodySQL : kGetCurrentRevisionNoBodySQL;
     else
-        [sql appendString:
-                 @" FROM revs, docs "
-                  "WHERE docs.docid=? AND revs.doc_id=docs.doc_id and current=1 and deleted=0 "
-                  "ORDER BY revid DESC LIMIT 1"];
-    FMResultSet* r = [db executeQuery:sql, docID, revID];
+        sql = revID ? kGetRevisionSQL : kGetCurrentRevisionSQL;
+    FMResultSet* r = [db executeCachedQuery:sql, docID, revID];
     if (!r) {
         *outStatus = kTDStatusDBError;
     } else if (![r next]) {
@@ -858,15 +1087,42 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
         else
             *outStatus = kTDStatusNotFound;
     } else {
+        BOOL winning = (revID == nil);
         if (!revID) revID = [r stringForColumnIndex:0];
         BOOL deleted = [r boolForColumnIndex:1];
         result = [[TD_Revision alloc] initWithDocID:docID revID:revID deleted:deleted];
         result.sequence = [r longLongIntForColumnIndex:2];
 
         if (options != kTDNoBody) {
-            NSData* json = nil;
-            if (!(options & kTDNoBody)) json = [r dataNoCopyForColumnIndex:3];
-            [self expandStoredJSON:json intoRevision:result options:options inDatabase:db];
+            // SQLite only reads the json column when it's asked for, so selecting it costs
+            // nothing when the body turns out to be cached:
+            NSDictionary* body = nil;
+            TDDocumentCache* cache = (options & kTDNoBody) ? nil : self.documentCache;
+            if (cache) {
+                body = [cache bodyForDocID:docID revID:revID];
+                // The cache holds one revision per document, so only winning bodies go in it
+                if (!body && winning && !deleted)
+                    body = [self cacheBodyFromJSON:[r dataForColumnIndex:3]
+                                             docID:docID
+                                             revID:revID];
+            }
+            if (body) {
+                result.properties = [self documentPropertiesFromBody:body
+                                                               docID:docID
+                                                               revID:revID
+                                                            sequence:result.sequence
+                                                             options:options
+                                                     attachmentDicts:nil
+                                                          inDatabase:db];
+            } else {
+                NSData* json = nil;
+                if (!(options & kTDNoBody)) json = [r dataNoCopyForColumnIndex:3];
+                [self expandStoredJSON:json
+                          intoRevision:result
+                               options:options
+                       attachmentDicts:nil
+                            inDatabase:db];
+            }
         }
         *outStatus = kTDStatusOK;
     }
@@ -879,7 +1135,7 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
 {
     __block TD_Revision* result;
     __weak TD_Database* weakSelf = self;
-    [_fmdbQueue inDatabase:^(FMDatabase* db) {
+    [self inReadTransaction:^(FMDatabase* db) {
         TD_Database* strongSelf = weakSelf;
         result = [strongSelf getDocumentWithID:docID revisionID:revID database:db];
     }];
@@ -920,7 +1176,7 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
 
     if ([self isOpen]) {
         __weak TD_Database* weakSelf = self;
-        [_fmdbQueue inDatabase:^(FMDatabase* db) {
+        [self inReadTransaction:^(FMDatabase* db) {
           __strong TD_Database* strongSelf = weakSelf;
           if (strongSelf) {
               result = [strongSelf loadRevisionBody:rev options:options database:db];
@@ -941,9 +1197,9 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
     if (rev.body && options == 0) return kTDStatusOK;
     Assert(rev.docID && rev.revID);
     FMResultSet* r =
-        [db executeQuery:@"SELECT sequence, json FROM revs, docs "
-                          "WHERE revid=? AND docs.docid=? AND revs.doc_id=docs.doc_id LIMIT 1",
-                         rev.revID, rev.docID];
+        [db executeCachedQuery:@"SELECT sequence, json FROM revs, docs "
+                                "WHERE revid=? AND docs.docid=? AND revs.doc_id=docs.doc_id LIMIT 1",
+                               rev.revID, rev.docID];
     if (!r) return kTDStatusDBError;
     TDStatus status = kTDStatusNotFound;
     if ([r next]) {
@@ -953,6 +1209,7 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
         [self expandStoredJSON:[r dataNoCopyForColumnIndex:1]
                   intoRevision:rev
                        options:options
+               attachmentDicts:nil
                     inDatabase:db];
     }
     [r close];
@@ -963,7 +1220,7 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
 - (SInt64)getDocNumericID:(NSString*)docID database:(FMDatabase*)db
 {
     Assert(docID);
-    return [db longLongForQuery:@"SELECT doc_id FROM docs WHERE docid=?", docID];
+    return [db longLongForCachedQuery:@"SELECT doc_id FROM docs WHERE docid=?", docID];
 }
 
 /** Only call from within a queued transaction **/
@@ -972,9 +1229,10 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
                             onlyCurrent:(BOOL)onlyCurrent
                                database:(FMDatabase*)db
 {
-    NSString* sql = $sprintf(@"SELECT sequence FROM revs WHERE doc_id=? AND revid=? %@ LIMIT 1",
-                             (onlyCurrent ? @"AND current=1" : @""));
-    return [db longLongForQuery:sql, @(docNumericID), revID];
+    NSString* sql = onlyCurrent
+                        ? @"SELECT sequence FROM revs WHERE doc_id=? AND revid=? AND current=1 LIMIT 1"
+                        : @"SELECT sequence FROM revs WHERE doc_id=? AND revid=? LIMIT 1";
+    return [db longLongForCachedQuery:sql, @(docNumericID), revID];
 }
 
 #pragma mark - HISTORY:
@@ -1001,7 +1259,7 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
 
     sql = [sql stringByAppendingString:@"ORDER BY sequence DESC"];
 
-    FMResultSet* r = [db executeQuery:sql, @(docNumericID)];
+    FMResultSet* r = [db executeCachedQuery:sql, @(docNumericID)];
     if (!r) {
         return nil;
     }
@@ -1024,7 +1282,7 @@ static BOOL removeItemIfExists(NSString* path, NSError** outError)
 {
     __block TD_RevisionList* result;
     __weak TD_Database* weakSelf = self;
-    [_fmdbQueue inDatabase:^(FMDatabase* db) {
+    [self inReadTransaction:^(FMDatabase* db) {
         TD_Database* strongSelf = weakSelf;
         result = [strongSelf getAllRevisionsOfDocumentID:docID
                                              onlyCurrent:onlyCurrent
@@ -1068,7 +1326,7 @@ static NSArray* revIDsFromResultSet(FMResultSet* r)
 {
     __block NSArray* result;
     __weak TD_Database* weakSelf = self;
-    [_fmdbQueue inDatabase:^(FMDatabase* db) {
+    [self inReadTransaction:^(FMDatabase* db) {
         TD_Database* strongSelf = weakSelf;
         result = [strongSelf getPossibleAncestorRevisionIDs:rev limit:limit database:db];
     }];
@@ -1111,7 +1369,7 @@ static NSArray* revIDsFromResultSet(FMResultSet* r)
 {
     __block NSArray* result;
     __weak TD_Database* weakSelf = self;
-    [_fmdbQueue inDatabase:^(FMDatabase* db) {
+    [self inReadTransaction:^(FMDatabase* db) {
         TD_Database* strongSelf = weakSelf;
         result = [strongSelf getRevisionHistory:rev database:db];
     }];
@@ -1216,10 +1474,10 @@ extern NSDictionary* makeRevisionHistoryDict(NSArray* history)
                                database:(FMDatabase*)db
 {
     Assert(docNumericID > 0);
-    FMResultSet* r = [db executeQuery:@"SELECT revid, deleted FROM revs"
-                                       " WHERE doc_id=? and current=1"
-                                       " ORDER BY deleted asc, revid desc LIMIT 1",
-                                      @(docNumericID)];
+    FMResultSet* r = [db executeCachedQuery:@"SELECT revid, deleted FROM revs"
+                                             " WHERE doc_id=? and current=1"
+                                             " ORDER BY deleted asc, revid desc LIMIT 1",
+                                            @(docNumericID)];
     NSString* revID = nil;
     if ([r next]) {
         revID = [r stringForColumnIndex:0];
@@ -1240,7 +1498,7 @@ const TDChangesOptions kDefaultTDChangesOptions = {UINT_MAX, 0, NO, NO, YES};
 {
     __block TD_RevisionList* result;
     __weak TD_Database* weakSelf = self;
-    [_fmdbQueue inDatabase:^(FMDatabase* db) {
+    [self inReadTransaction:^(FMDatabase* db) {
         TD_Database* strongSelf = weakSelf;
         result = [strongSelf changesSinceSequence:lastSequence
                                           options:options
@@ -1260,6 +1518,98 @@ const TDChangesOptions kDefaultTDChangesOptions = {UINT_MAX, 0, NO, NO, YES};
 {
     // http://wiki.apache.org/couchdb/HTTP_database_API#Changes
     if (!options) options = &kDefaultTDChangesOptions;
+    if (!options->sortBySequence) {
+        return [self unsortedChangesSinceSequence:lastSequence
+                                          options:options
+                                           filter:filter
+                                           params:filterParams
+                                         database:db];
+    }
+    BOOL includeDocs = options->includeDocs || (filter != NULL);
+
+    // revs.sequence is the table's rowid, so ordering by it walks the revs b-tree from
+    // lastSequence onwards and SQLite can stop as soon as the LIMIT is satisfied.
+    NSMutableString* sql =
+        [NSMutableString stringWithFormat:@"SELECT sequence, revs.doc_id, docid, revid, deleted%@ "
+                                           "FROM revs, docs "
+                                           "WHERE sequence > ? AND current=1 "
+                                           "AND revs.doc_id = docs.doc_id",
+                                          (includeDocs ? @", json" : @"")];
+    NSMutableArray* args = [NSMutableArray arrayWithObject:@(lastSequence)];
+    if (!options->includeConflicts) {
+        // Only report the current rev with the highest rev ID for a given doc (the rest will be
+        // losing conflicts). The subquery is answered from the revs_current index.
+        [sql appendString:@" AND NOT EXISTS (SELECT 1 FROM revs AS other "
+                           "WHERE other.doc_id = revs.doc_id AND other.current=1 "
+                           "AND other.sequence > ? AND other.revid > revs.revid)"];
+        [args addObject:@(lastSequence)];
+    }
+    // A filter rejects rows after they are read, so in that case the limit is applied below.
+    [sql appendString:@" ORDER BY sequence LIMIT ?"];
+    [args addObject:(filter ? @(-1) : @(options->limit))];
+
+    FMResultSet* r = [db executeCachedQuery:sql withArgumentsInArray:args];
+    if (!r) return nil;
+    TD_RevisionList* changes = [[TD_RevisionList alloc] init];
+    BOOL more = YES;
+    while (more && changes.count < options->limit) {
+        @autoreleasepool
+        {
+            // Read a page of revisions, so their bodies can be expanded together
+            NSMutableArray* page = [NSMutableArray arrayWithCapacity:kTDExpandPageSize];
+            NSMutableArray* jsons = [NSMutableArray arrayWithCapacity:kTDExpandPageSize];
+            while (page.count < kTDExpandPageSize && (more = [r next])) {
+                TD_Revision* rev = [[TD_Revision alloc] initWithDocID:[r stringForColumnIndex:2]
+                                                                revID:[r stringForColumnIndex:3]
+                                                              deleted:[r boolForColumnIndex:4]];
+                rev.sequence = [r longLongIntForColumnIndex:0];
+                [page addObject:rev];
+                if (includeDocs) [jsons addObject:([r dataForColumnIndex:5] ?: [NSNull null])];
+            }
+            [self addChanges:page
+                   withJSONs:(includeDocs ? jsons : nil)
+                      toList:changes
+                     options:options
+                      filter:filter
+                      params:filterParams
+                    database:db];
+        }
+    }
+    [r close];
+    return changes;
+}
+
+/** Expands the bodies of a page of changes, if jsons is given, and adds those passing the filter
+    to changes until it reaches the limit.
+    Only call from within a queued transaction **/
+- (void)addChanges:(NSArray*)page
+         withJSONs:(NSArray*)jsons
+            toList:(TD_RevisionList*)changes
+           options:(const TDChangesOptions*)options
+            filter:(TD_FilterBlock)filter
+            params:(NSDictionary*)filterParams
+          database:(FMDatabase*)db
+{
+    if (jsons) {
+        [self expandStoredJSONs:jsons
+                  intoRevisions:page
+                        options:options->contentOptions
+                     inDatabase:db];
+    }
+    for (TD_Revision* rev in page) {
+        if (changes.count >= options->limit) break;
+        if (!filter || filter(rev, filterParams)) [changes addRev:rev];
+    }
+}
+
+/** Changes in doc_id order, as used when the caller doesn't ask for sequence ordering.
+    Only call from within a queued transaction **/
+- (TD_RevisionList*)unsortedChangesSinceSequence:(SequenceNumber)lastSequence
+                                         options:(const TDChangesOptions*)options
+                                          filter:(TD_FilterBlock)filter
+                                          params:(NSDictionary*)filterParams
+                                        database:(FMDatabase*)db
+{
     BOOL includeDocs = options->includeDocs || (filter != NULL);
 
     NSString* sql =
@@ -1268,39 +1618,42 @@ const TDChangesOptions kDefaultTDChangesOptions = {UINT_MAX, 0, NO, NO, YES};
                   "AND revs.doc_id = docs.doc_id "
                   "ORDER BY revs.doc_id, revid DESC",
                  (includeDocs ? @", json" : @""));
-    FMResultSet* r = [db executeQuery:sql, @(lastSequence)];
+    FMResultSet* r = [db executeCachedQuery:sql, @(lastSequence)];
     if (!r) return nil;
     TD_RevisionList* changes = [[TD_RevisionList alloc] init];
     int64_t lastDocID = 0;
-    while ([r next]) {
+    BOOL more = YES;
+    while (more && changes.count < options->limit) {
         @autoreleasepool
         {
-            if (!options->includeConflicts) {
-                // Only count the first rev for a given doc (the rest will be losing conflicts):
-                int64_t docNumericID = [r longLongIntForColumnIndex:1];
-                if (docNumericID == lastDocID) continue;
-                lastDocID = docNumericID;
-            }
+            NSMutableArray* page = [NSMutableArray arrayWithCapacity:kTDExpandPageSize];
+            NSMutableArray* jsons = [NSMutableArray arrayWithCapacity:kTDExpandPageSize];
+            while (page.count < kTDExpandPageSize && (more = [r next])) {
+                if (!options->includeConflicts) {
+                    // Only count the first rev for a given doc (the rest will be losing
+                    // conflicts):
+                    int64_t docNumericID = [r longLongIntForColumnIndex:1];
+                    if (docNumericID == lastDocID) continue;
+                    lastDocID = docNumericID;
+                }
 
-            TD_Revision* rev = [[TD_Revision alloc] initWithDocID:[r stringForColumnIndex:2]
-                                                            revID:[r stringForColumnIndex:3]
-                                                          deleted:[r boolForColumnIndex:4]];
-            rev.sequence = [r longLongIntForColumnIndex:0];
-            if (includeDocs) {
-                [self expandStoredJSON:[r dataNoCopyForColumnIndex:5]
-                          intoRevision:rev
-                               options:options->contentOptions
-                            inDatabase:db];
+                TD_Revision* rev = [[TD_Revision alloc] initWithDocID:[r stringForColumnIndex:2]
+                                                                revID:[r stringForColumnIndex:3]
+                                                              deleted:[r boolForColumnIndex:4]];
+                rev.sequence = [r longLongIntForColumnIndex:0];
+                [page addObject:rev];
+                if (includeDocs) [jsons addObject:([r dataForColumnIndex:5] ?: [NSNull null])];
             }
-            if (!filter || filter(rev, filterParams)) [changes addRev:rev];
+            [self addChanges:page
+                   withJSONs:(includeDocs ? jsons : nil)
+                      toList:changes
+                     options:options
+                      filter:filter
+                      params:filterParams
+                    database:db];
         }
     }
     [r close];
-
-    if (options->sortBySequence) {
-        [changes sortBySequence];
-        [changes limit:options->limit];
-    }
     return changes;
 }
 
@@ -1395,16 +1748,34 @@ const TDChangesOptions kDefaultTDChangesOptions = {UINT_MAX, 0, NO, NO, YES};
 
 // FIX: This has a lot of code in common with -[TD_View queryWithOptions:status:]. Unify the two!
 - (NSDictionary*)getDocsWithIDs:(NSArray*)docIDs options:(const TDQueryOptions*)options
+{
+    __block NSDictionary* result;
+    [self inReadTransaction:^(FMDatabase* db) {
+        result = [self getDocsWithIDs:docIDs options:options database:db];
+    }];
+    return result;
+}
+
+- (NSDictionary*)getDocsWithIDs:(NSArray*)docIDs
+                        options:(const TDQueryOptions*)options
+                       database:(FMDatabase*)db
 {
     if (!options) options = &kDefaultTDQueryOptions;
 
-    // Generate the SELECT statement, based on the options:
-    NSMutableString* sql = [@"SELECT revs.doc_id, docid, revid" mutableCopy];
-    if (options->includeDocs) [sql appendString:@", json, sequence"];
-    if (options->includeDeletedDocs) [sql appendString:@", deleted"];
-    [sql appendString:@" FROM revs, docs WHERE"];
-    if (docIDs) [sql appendFormat:@" docid IN (%@) AND", [TD_Database joinQuotedStrings:docIDs]];
-    [sql appendString:@" docs.doc_id = revs.doc_id AND current=1"];
+    // Given doc IDs, skip and limit apply to them, since the output is in their order
+    if (docIDs) {
+        NSUInteger skip = MIN((NSUInteger)options->skip, docIDs.count);
+        NSUInteger limit = MIN((NSUInteger)options->limit, docIDs.count - skip);
+        docIDs = [docIDs subarrayWithRange:NSMakeRange(skip, limit)];
+    }
+
+    // Generate the SELECT statement, based on the options. Doc IDs are bound in batches, to
+    // `docid IN (...)` conditions inserted after the WHERE.
+    NSMutableString* select = [@"SELECT revs.doc_id, docid, revid" mutableCopy];
+    if (options->includeDocs) [select appendString:@", json, sequence"];
+    if (options->includeDeletedDocs) [select appendString:@", deleted"];
+    [select appendString:@" FROM revs, docs WHERE"];
+    NSMutableString* sql = [@" docs.doc_id = revs.doc_id AND current=1" mutableCopy];
     if (!options->includeDeletedDocs) [sql appendString:@" AND deleted=0"];
 
     NSMutableArray* args = $marray();
@@ -1430,99 +1801,254 @@ const TDChangesOptions kDefaultTDChangesOptions = {UINT_MAX, 0, NO, NO, YES};
     [sql appendFormat:@" ORDER BY docid %@, %@ revid DESC LIMIT ? OFFSET ?",
                       (options->descending ? @"DESC" : @"ASC"),
                       (options->includeDeletedDocs ? @"deleted ASC," : @"")];
-    [args addObject:@(options->limit)];
-    [args addObject:@(options->skip)];
 
-    __block SequenceNumber update_seq = 0;
-    __block NSMutableArray* rows = $marray();
+    SequenceNumber update_seq = 0;
+    NSMutableArray* rows = $marray();
 
-    [_fmdbQueue inTransaction:^(FMDatabase* db, BOOL* rollback) {
-        if (options->updateSeq)
-            update_seq = self.lastSequence;  // TODO: needs to be atomic with the following SELECT
+    if (options->updateSeq) update_seq = [self lastSequenceInDatabase:db];
 
-        // Now run the database query:
-        FMResultSet* r = [db executeQuery:sql withArgumentsInArray:args];
-        if (!r) return;
+    // Now run the database query:
+    if (!docIDs) {
+        [args addObject:@(options->limit)];
+        [args addObject:@(options->skip)];
+        FMResultSet* r =
+            [db executeCachedQuery:[select stringByAppendingString:sql] withArgumentsInArray:args];
+        if (r) {
+            [self addAllDocsRowsFromResultSet:r options:options toRows:rows orDocs:nil database:db];
+        }
+        return [self allDocsResultWithRows:rows options:options updateSeq:update_seq];
+    }
 
-        int64_t lastDocID = 0;
-        NSMutableDictionary* docs = docIDs ? $mdict() : nil;
-        while ([r next]) {
-            @autoreleasepool
-            {
-                // Only count the first rev for a given doc (the rest will be losing conflicts):
+    [args addObject:@(-1)];  // no limit or offset, they've been applied to docIDs
+    [args addObject:@0];
+    NSMutableDictionary* docs = $mdict();
+    for (NSUInteger start = 0; start < docIDs.count; start += kTDDocIDBatchSize) {
+        NSRange range = NSMakeRange(start, MIN(kTDDocIDBatchSize, docIDs.count - start));
+        NSArray* batch = [TD_Database paddedBatchOfValues:[docIDs subarrayWithRange:range]
+                                                 maxCount:kTDDocIDBatchSize];
+        NSString* batchSQL = $sprintf(@"%@ docid IN (%@) AND%@", select,
+                                      [TD_Database placeholdersForValues:batch], sql);
+        FMResultSet* r = [db executeCachedQuery:batchSQL
+                           withArgumentsInArray:[batch arrayByAddingObjectsFromArray:args]];
+        if (!r) return [self allDocsResultWithRows:rows options:options updateSeq:update_seq];
+        [self addAllDocsRowsFromResultSet:r options:options toRows:nil orDocs:docs database:db];
+    }
+
+    // Sort the output into the order of docIDs, and add entries for missing docs. Winning
+    // revisions of the docs not found above, which exist but are deleted (or were outside the
+    // key range), are looked up only if there are any.
+    NSMutableArray* missingDocIDs = $marray();
+    for (NSString* docID in docIDs) {
+        if (!docs[docID]) [missingDocIDs addObject:docID];
+    }
+    NSDictionary* winners = nil;
+    if (missingDocIDs.count > 0) winners = [self winningRevIDsOfDocIDs:missingDocIDs database:db];
+
+    for (NSString* docID in docIDs) {
+        NSDictionary* change = docs[docID];
+        if (!change) {
+            NSString* revID = winners[docID];
+            if (revID) {
+                change = $dict({ @"id", docID }, { @"key", docID },
+                               { @"value", $dict({ @"rev", revID }, { @"deleted", $true }) });
+            } else {
+                change = $dict({ @"key", docID }, { @"error", @"not_found" });
+            }
+        }
+        [rows addObject:change];
+    }
+
+    return [self allDocsResultWithRows:rows options:options updateSeq:update_seq];
+}
+
+/** Reads the rows of a -getDocsWithIDs:options:database: query and closes it. Adds the output
+    row for each document to docs, keyed by doc ID, if that's given, else to rows.
+    Only call from within a queued transaction **/
+- (void)addAllDocsRowsFromResultSet:(FMResultSet*)r
+                            options:(const TDQueryOptions*)options
+                             toRows:(NSMutableArray*)rows
+                             orDocs:(NSMutableDictionary*)docs
+                           database:(FMDatabase*)db
+{
+    int64_t lastDocID = 0;
+    TDDocumentCache* cache = options->includeDocs ? self.documentCache : nil;
+    BOOL more = YES;
+    while (more) {
+        @autoreleasepool
+        {
+            // Read a page of rows, so the attachments of their documents can be looked up
+            // together. jsons holds each document's cached body, or else its stored JSON.
+            NSMutableArray* page = [NSMutableArray arrayWithCapacity:kTDExpandPageSize];
+            NSMutableArray* jsons = [NSMutableArray arrayWithCapacity:kTDExpandPageSize];
+            while (page.count < kTDExpandPageSize && (more = [r next])) {
+                // Only count the first rev for a given doc (the rest will be losing
+                // conflicts):
                 int64_t docNumericID = [r longLongIntForColumnIndex:0];
                 if (docNumericID == lastDocID) continue;
                 lastDocID = docNumericID;
 
-                NSString* docID = [r stringForColumnIndex:1];
-                NSString* revID = [r stringForColumnIndex:2];
                 BOOL deleted = options->includeDeletedDocs && [r boolForColumn:@"deleted"];
+                TD_Revision* rev = [[TD_Revision alloc] initWithDocID:[r stringForColumnIndex:1]
+                                                                revID:[r stringForColumnIndex:2]
+                                                              deleted:deleted];
+                if (options->includeDocs) {
+                    rev.sequence = [r longLongIntForColumnIndex:4];
+                    NSDictionary* body =
+                        deleted ? nil : [cache bodyForDocID:rev.docID revID:rev.revID];
+                    [jsons addObject:(body ?: [r dataForColumnIndex:3] ?: [NSNull null])];
+                }
+                [page addObject:rev];
+            }
+
+            NSDictionary* attachmentDicts = nil;
+            if (options->includeDocs) {
+                attachmentDicts = [self attachmentDictsForRevisions:page
+                                                            options:options->content
+                                                         inDatabase:db];
+            }
+
+            [page enumerateObjectsUsingBlock:^(TD_Revision* rev, NSUInteger i, BOOL* stop) {
+                NSString* docID = rev.docID;
+                NSString* revID = rev.revID;
+                BOOL deleted = rev.deleted;
                 NSDictionary* docContents = nil;
                 if (options->includeDocs) {
                     // Fill in the document contents:
-                    NSData* json = [r dataNoCopyForColumnIndex:3];
-                    SequenceNumber sequence = [r longLongIntForColumnIndex:4];
-                    docContents = [self documentPropertiesFromJSON:json
-                                                             docID:docID
-                                                             revID:revID
-                                                           deleted:deleted
-                                                          sequence:sequence
-                                                           options:options->content
-                                                        inDatabase:db];
+                    NSData* json = $castIf(NSData, jsons[i]);
+                    NSDictionary* body = $castIf(NSDictionary, jsons[i]);
+                    if (!body && cache && !deleted)
+                        body = [self cacheBodyFromJSON:json docID:docID revID:revID];
+                    if (body) {
+                        docContents = [self documentPropertiesFromBody:body
+                                                                 docID:docID
+                                                                 revID:revID
+                                                              sequence:rev.sequence
+                                                               options:options->content
+                                                       attachmentDicts:attachmentDicts
+                                                            inDatabase:db];
+                    } else {
+                        docContents = [self documentPropertiesFromJSON:json
+                                                                 docID:docID
+                                                                 revID:revID
+                                                               deleted:deleted
+                                                              sequence:rev.sequence
+                                                               options:options->content
+                                                       attachmentDicts:attachmentDicts
+                                                            inDatabase:db];
+                    }
                     Assert(docContents);
                 }
                 NSDictionary* change = $dict(
                     { @"id", docID }, { @"key", docID },
-                    { @"value", $dict({ @"rev", revID }, { @"deleted", (deleted ? $true : nil) }) },
+                    { @"value",
+                      $dict({ @"rev", revID }, { @"deleted", (deleted ? $true : nil) }) },
                     { @"doc", docContents });
-                if (docIDs)
+                if (docs)
                     [docs setObject:change forKey:docID];
                 else
                     [rows addObject:change];
-            }
-        }
-        [r close];
-
-        // If given doc IDs, sort the output into that order, and add entries for missing docs:
-        if (docIDs) {
-            for (NSString* docID in docIDs) {
-                NSDictionary* change = docs[docID];
-                if (!change) {
-                    NSString* revID = nil;
-                    SInt64 docNumericID = [self getDocNumericID:docID database:db];
-                    if (docNumericID > 0) {
-                        BOOL deleted;
-                        revID = [self winningRevIDOfDocNumericID:docNumericID
-                                                       isDeleted:&deleted
-                                                        database:db];
-                    }
-                    if (revID) {
-                        change =
-                            $dict({ @"id", docID }, { @"key", docID },
-                                  { @"value", $dict({ @"rev", revID }, { @"deleted", $true }) });
-                    } else {
-                        change = $dict({ @"key", docID }, { @"error", @"not_found" });
-                    }
-                }
-                [rows addObject:change];
-            }
+            }];
         }
-    }];
+    }
+    [r close];
+}
 
+- (NSDictionary*)allDocsResultWithRows:(NSArray*)rows
+                               options:(const TDQueryOptions*)options
+                             updateSeq:(SequenceNumber)update_seq
+{
     NSUInteger totalRows = rows.count;  //??? Is this true, or does it ignore limit/offset?
     return $dict({ @"rows", rows }, { @"total_rows", @(totalRows) },
                  { @"offset", @(options->skip) },
                  { @"update_seq", update_seq ? @(update_seq) : nil });
 }
 
++ (NSArray*)paddedBatchOfValues:(NSArray*)values maxCount:(NSUInteger)maxCount
+{
+    NSUInteger count = 1;
+    while (count < values.count) count *= 2;
+    count = MAX(MIN(count, maxCount), values.count);
+
+    NSMutableArray* batch = [NSMutableArray arrayWithCapacity:count];
+    [batch addObjectsFromArray:values];
+    while (batch.count < count) [batch addObject:[NSNull null]];  // NULL never matches IN
+    return batch;
+}
+
++ (NSString*)placeholdersForValues:(NSArray*)values
+{
+    NSMutableString* placeholders = [NSMutableString stringWithCapacity:3 * values.count];
+    for (NSUInteger i = 0; i < values.count; i++) {
+        [placeholders appendString:(i == 0 ? @"?" : @", ?")];
+    }
+    return placeholders;
+}
+
+/** Returns the winning revision ID of each of the documents which exists, preferring a
+    non-deleted revision as -winningRevIDOfDocNumericID:isDeleted:database: does.
+    Only call from within a queued transaction **/
+- (NSDictionary*)winningRevIDsOfDocIDs:(NSArray*)docIDs database:(FMDatabase*)db
+{
+    NSMutableDictionary* winners = $mdict();
+    for (NSUInteger start = 0; start < docIDs.count; start += kTDDocIDBatchSize) {
+        NSRange range = NSMakeRange(start, MIN(kTDDocIDBatchSize, docIDs.count - start));
+        NSArray* batch = [TD_Database paddedBatchOfValues:[docIDs subarrayWithRange:range]
+                                                 maxCount:kTDDocIDBatchSize];
+        NSString* sql = $sprintf(@"SELECT docid, (SELECT revid FROM revs "
+                                  "WHERE revs.doc_id = docs.doc_id AND current=1 "
+                                  "ORDER BY deleted ASC, revid DESC LIMIT 1) "
+                                  "FROM docs WHERE docid IN (%@)",
+                                 [TD_Database placeholdersForValues:batch]);
+        FMResultSet* r = [db executeCachedQuery:sql withArgumentsInArray:batch];
+        if (!r) return nil;
+        while ([r next]) {
+            NSString* revID = [r stringForColumnIndex:1];
+            if (revID) winners[[r stringForColumnIndex:0]] = revID;
+        }
+        [r close];
+    }
+    return winners;
+}
+
 - (NSDictionary*)getAllDocs:(const TDQueryOptions*)options
 {
     return [self getDocsWithIDs:nil options:options];
 }
 
+/** Only call from within a queued transaction **/
+- (NSArray*)winningRevisionsAfterDocID:(NSString*)docID
+                                 limit:(unsigned)limit
+                               options:(TDContentOptions)options
+                              database:(FMDatabase*)db
+{
+    // Walks the docs_docid index from docID onwards, so each page costs the same however far
+    // into the database it is. The winner of each document is picked by the subquery, which
+    // means there's exactly one row per document and the LIMIT counts documents.
+    BOOL includeBody = !(options & kTDNoBody);
+    NSString* sql = includeBody ? kWinningRevisionsPageSQL : kWinningRevisionsPageNoBodySQL;
+    FMResultSet* r = [db executeCachedQuery:sql, (docID ?: @""), @(limit)];
+    if (!r) return nil;
+
+    NSMutableArray* revs = [NSMutableArray arrayWithCapacity:limit];
+    while ([r next]) {
+        TD_Revision* rev = [[TD_Revision alloc] initWithDocID:[r stringForColumnIndex:0]
+                                                        revID:[r stringForColumnIndex:1]
+                                                      deleted:NO];
+        rev.sequence = [r longLongIntForColumnIndex:2];
+        if (includeBody) {
+            NSData* json = [r dataForColumnIndex:3];
+            rev.body = json.length ? [[TD_Body alloc] initWithJSON:json]
+                                   : [[TD_Body alloc] initWithProperties:@{}];
+        }
+        [revs addObject:rev];
+    }
+    [r close];
+    return revs;
+}
+
 #pragma mark - QUEUE:
 
-+ (FMDatabaseQueue *)queueForDatabaseAtPath:(NSString *)path readOnly:(BOOL)readOnly
++ (int)openFlagsForReadOnly:(BOOL)readOnly
 {
 #ifdef SQLITE_OPEN_FILEPROTECTION_COMPLETEUNLESSOPEN
     int flags = SQLITE_OPEN_FILEPROTECTION_COMPLETEUNLESSOPEN;
@@ -1534,6 +2060,12 @@ const TDChangesOptions kDefaultTDChangesOptions = {UINT_MAX, 0, NO, NO, YES};
     } else {
         flags |= SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
     }
+    return flags;
+}
+
++ (FMDatabaseQueue *)queueForDatabaseAtPath:(NSString *)path readOnly:(BOOL)readOnly
+{
+    int flags = [self openFlagsForReadOnly:readOnly];
     CDTLogDebug(CDTDATASTORE_LOG_CONTEXT, @"Open %@ (flags=%X)", path, flags);
 
     FMDatabaseQueue *queue = [FMDatabaseQueue databaseQueueWithPath:path flags:flags];
@@ -1541,5 +2073,28 @@ const TDChangesOptions kDefaultTDChangesOptions = {UINT_MAX, 0, NO, NO, YES};
     return queue;
 }
 
+/** Readers are opened read-only whether or not the database is; the writer connection in
+    _fmdbQueue owns all updates. */
++ (FMDatabasePool *)readerPoolForDatabaseAtPath:(NSString *)path
+{
+    FMDatabasePool *pool =
+        [FMDatabasePool databasePoolWithPath:path flags:[self openFlagsForReadOnly:YES]];
+    pool.maximumNumberOfDatabasesToCreate = kTDReaderConnectionCount;
+    return pool;
+}
+
+#pragma mark - READER POOL:
+
+/** FMDatabasePool delegate method, called once for each reader connection the pool opens. */
+- (void)databasePool:(FMDatabasePool *)pool didAddDatabase:(FMDatabase *)db
+{
+    NSError *error = nil;
+    if (![db setKeyWithProvider:_keyProviderToOpenDB error:&error]) {
+        CDTLogError(CDTDATASTORE_LOG_CONTEXT, @"Key not set for reader of DB at %@: %@", _path,
+                    error);
+    }
+    [TD_Database registerCollationsInDatabase:db];
+}
+
 - (void)clearPendingAttachments { _pendingAttachmentsByDigest = nil; }
 @end
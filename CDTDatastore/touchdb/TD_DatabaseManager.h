@@ -18,6 +18,8 @@ typedef struct TD_DatabaseManagerOptions
 {
     bool readOnly;
     bool noReplicator;
+    bool binaryBodies;  // sets storesBinaryBodies on each database
+    NSUInteger documentCacheSize;  // if nonzero, gives each database a TDDocumentCache this big
 } TD_DatabaseManagerOptions;
 
 extern const TD_DatabaseManagerOptions kTD_DatabaseManagerDefaultOptions;
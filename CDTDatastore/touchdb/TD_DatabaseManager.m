@@ -20,6 +20,7 @@
 
 #import "TD_DatabaseManager.h"
 #import "TD_Database.h"
+#import "TDDocumentCache.h"
 #import "TDPusher.h"
 #import "TDInternal.h"
 #import "TDMisc.h"
@@ -137,6 +138,10 @@ static NSCharacterSet* kIllegalNameChars;
                 } else {
                     db.name = name;
                     db.readOnly = _options.readOnly;
+                    db.storesBinaryBodies = _options.binaryBodies;
+                    if (_options.documentCacheSize > 0)
+                        db.documentCache = [[TDDocumentCache alloc]
+                            initWithMaxCost:_options.documentCacheSize];
                     
                     _databases[name] = db;
                 }
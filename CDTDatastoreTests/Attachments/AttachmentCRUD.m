@@ -22,7 +22,9 @@
 #import "DBQueryUtils.h"
 #import "AmazonMD5Util.h"
 
+#import "TD_Database+Attachments.h"
 #import "TD_Database+BlobFilenames.h"
+#import "FMDatabase+StatementCache.h"
 
 #import "CDTMisc.h"
 
@@ -1093,6 +1095,72 @@
     }
 }
 
+- (void)testRetrieveAttachmentsForManyDocumentsById
+{
+    NSError *error = nil;
+    NSMutableArray *docIds = [NSMutableArray array];
+
+    // Enough documents to span several pages, only some of which have attachments
+    for (int i = 0; i < 250; i++) {
+        CDTDocumentRevision *document =
+            [CDTDocumentRevision revisionWithDocId:[NSString stringWithFormat:@"doc%03d", i]];
+        document.body = [@{ @"index" : @(i) } mutableCopy];
+        if (i % 3 == 0) {
+            NSData *data = [[NSString stringWithFormat:@"attachment %d", i]
+                dataUsingEncoding:NSUTF8StringEncoding];
+            CDTAttachment *attachment =
+                [[CDTUnsavedDataAttachment alloc] initWithData:data
+                                                          name:@"text"
+                                                          type:@"text/plain"];
+            document.attachments = [@{attachment.name : attachment} mutableCopy];
+        }
+        XCTAssertNotNil([self.datastore createDocumentFromRevision:document error:&error]);
+        [docIds addObject:document.docId];
+    }
+
+    NSArray *documents = [self.datastore getDocumentsWithIds:docIds];
+    XCTAssertEqual([documents count], (NSUInteger)250);
+
+    [documents enumerateObjectsUsingBlock:^(CDTDocumentRevision *revision, NSUInteger i,
+                                            BOOL *stop) {
+        XCTAssertEqualObjects(revision.docId, docIds[i]);
+        if (i % 3 == 0) {
+            XCTAssertEqual([revision.attachments count], (NSUInteger)1);
+            NSData *expected = [[NSString stringWithFormat:@"attachment %lu", (unsigned long)i]
+                dataUsingEncoding:NSUTF8StringEncoding];
+            XCTAssertEqualObjects([revision.attachments[@"text"] dataFromAttachmentContent],
+                                  expected);
+        } else {
+            XCTAssertEqual([revision.attachments count], (NSUInteger)0);
+        }
+    }];
+
+    // Pages of different sizes are padded to a few fixed shapes of SQL, so reuse statements
+    NSMutableArray *sequences = [NSMutableArray array];
+    for (CDTDocumentRevision *revision in documents) {
+        [sequences addObject:@(revision.sequence)];
+    }
+    TD_Database *database = self.datastore.database;
+    [database.fmdbQueue inDatabase:^(FMDatabase *db) {
+        NSArray *first = [sequences subarrayWithRange:NSMakeRange(0, 3)];
+        NSDictionary *dicts = [database getAttachmentDictsForSequences:first
+                                                                options:kTDIncludeAttachments
+                                                             inDatabase:db];
+        XCTAssertEqual(dicts.count, (NSUInteger)1);
+        XCTAssertNotNil(dicts[sequences[0]][@"text"][@"data"]);
+
+        NSUInteger misses = db.statementCacheMisses;
+        NSUInteger cached = db.cachedStatements.count;
+        NSArray *second = [sequences subarrayWithRange:NSMakeRange(3, 4)];
+        dicts = [database getAttachmentDictsForSequences:second
+                                                 options:kTDIncludeAttachments
+                                              inDatabase:db];
+        XCTAssertEqual(dicts.count, (NSUInteger)2);
+        XCTAssertEqual(db.statementCacheMisses, misses);
+        XCTAssertEqual(db.cachedStatements.count, cached);
+    }];
+}
+
 
 #pragma mark - Utilities
 
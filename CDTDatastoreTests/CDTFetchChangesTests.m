@@ -22,6 +22,7 @@
 #import "CDTDatastore.h"
 #import "CDTDatastoreManager.h"
 #import "CDTDocumentRevision.h"
+#import "TD_Database.h"
 
 #define CDTFETCHANGESTESTS_TOTALDOCCOUNT 1100
 #define CDTFETCHANGESTESTS_DELETEDOCCOUNT 5
@@ -238,6 +239,32 @@
                    @"%i documents were deleted", 0);
 }
 
+- (void)testChangesSinceSequenceReturnsOnePageInSequenceOrder
+{
+    TDChangesOptions options = kDefaultTDChangesOptions;
+    options.limit = 10;
+
+    TD_RevisionList *changes =
+        [self.datastore.database changesSinceSequence:[self.startSequenceValue longLongValue]
+                                              options:&options
+                                               filter:nil
+                                               params:nil];
+
+    // Assert
+    XCTAssertEqual(changes.count, 10);
+    SequenceNumber previousSequence = [self.startSequenceValue longLongValue];
+    NSMutableSet *docIds = [NSMutableSet set];
+    for (TD_Revision *change in changes) {
+        XCTAssertGreaterThan(change.sequence, previousSequence);
+        previousSequence = change.sequence;
+        [docIds addObject:change.docID];
+    }
+    XCTAssertEqual(docIds.count, changes.count, @"Each document is reported only once");
+
+    // The deleted documents were updated last, so they are not part of the first page
+    XCTAssertFalse([docIds containsObject:[CDTFetchChangesTests docIdWithIndex:0]]);
+}
+
 #pragma mark - Private class methods
 + (void)populateDatastore:(CDTDatastore *)datastore withDocuments:(NSUInteger)counter
 {
@@ -9,6 +9,7 @@
 #import <CDTDatastore/CDTQIndexCreator.h>
 #import <CDTDatastore/CDTQIndexManager.h>
 #import <CDTDatastore/CDTQIndexUpdater.h>
+#import <CDTDatastore/CDTQProjectedDocumentRevision.h>
 #import <CDTDatastore/CDTQQueryExecutor.h>
 #import <CDTDatastore/CDTQResultSet.h>
 #import <CDTDatastore/CloudantSync.h>
@@ -153,6 +154,99 @@ SpecBegin(CDTQFilterFieldsTest)
             }];
         });
 
+        it(@"projects from a covering index the same as from documents", ^{
+            NSDictionary *query = @{ @"name" : @"fred" };
+            NSArray *fields = @[ @"name", @"pet" ];
+
+            NSMutableDictionary *fromDocuments = [NSMutableDictionary dictionary];
+            [[im find:query skip:0 limit:0 fields:fields sort:nil]
+                enumerateObjectsUsingBlock:^(CDTDocumentRevision *rev, NSUInteger i, BOOL *s) {
+                    fromDocuments[rev.docId] = rev;
+                }];
+
+            im.coveringProjectionsEnabled = YES;
+            CDTQResultSet *result = [im find:query skip:0 limit:0 fields:fields sort:nil];
+            expect([NSSet setWithArray:result.documentIds])
+                .to.equal([NSSet setWithArray:fromDocuments.allKeys]);
+
+            [result enumerateObjectsUsingBlock:^(CDTDocumentRevision *rev, NSUInteger i, BOOL *s) {
+                CDTDocumentRevision *expected = fromDocuments[rev.docId];
+                expect(rev).to.beKindOf([CDTQProjectedDocumentRevision class]);
+                expect(rev.revId).to.equal(expected.revId);
+                expect(rev.body).to.equal(expected.body);
+            }];
+
+            // fred12 has no pet, so projects a null just like a loaded document
+            expect(fromDocuments[@"fred12"].body[@"pet"]).to.equal([NSNull null]);
+        });
+
+        it(@"projects empty arrays when using a covering index", ^{
+            CDTDocumentRevision *rev = [CDTDocumentRevision revisionWithDocId:@"fred56"];
+            rev.body = [@{ @"name" : @"fred", @"age" : @56, @"pet" : @[] } mutableCopy];
+            [ds createDocumentFromRevision:rev error:nil];
+
+            im.coveringProjectionsEnabled = YES;
+            NSDictionary *query = @{ @"name" : @"fred" };
+            CDTQResultSet *result =
+                [im find:query skip:0 limit:0 fields:@[ @"name", @"pet" ] sort:nil];
+
+            NSMutableDictionary *bodies = [NSMutableDictionary dictionary];
+            [result enumerateObjectsUsingBlock:^(CDTDocumentRevision *rev, NSUInteger i, BOOL *s) {
+                bodies[rev.docId] = rev.body;
+            }];
+            expect(bodies.count).to.equal(3);
+            expect(bodies[@"fred56"][@"pet"]).to.equal(@[]);
+            expect(bodies[@"fred12"][@"pet"]).to.equal([NSNull null]);
+            expect(bodies[@"fred34"][@"pet"]).to.equal(@"cat");
+        });
+
+        it(@"projects arrays, booleans and sub-documents the same as from documents", ^{
+            NSArray *bodies = @[
+                @{ @"name" : @"bob", @"pet" : @[ @"cat" ], @"vip" : @YES },
+                @{ @"name" : @"bob", @"pet" : @"dog", @"vip" : @NO },
+                @{ @"name" : @"bob", @"pet" : @"fish", @"owner" : @{ @"town" : @"bristol" } }
+            ];
+            for (NSDictionary *body in bodies) {
+                CDTDocumentRevision *rev = [CDTDocumentRevision revision];
+                rev.body = [body mutableCopy];
+                [ds createDocumentFromRevision:rev error:nil];
+            }
+            expect([im ensureIndexed:@[ @"name", @"vip" ] withName:@"vip"]).toNot.beNil();
+            expect([im ensureIndexed:@[ @"name", @"owner", @"owner.town" ] withName:@"owner"])
+                .toNot.beNil();
+
+            NSDictionary *query = @{ @"name" : @"bob" };
+            for (NSArray *fields in @[ @[ @"name", @"pet" ], @[ @"name", @"vip" ],
+                                       @[ @"name", @"owner" ] ]) {
+                NSMutableDictionary *fromDocuments = [NSMutableDictionary dictionary];
+                im.coveringProjectionsEnabled = NO;
+                [[im find:query skip:0 limit:0 fields:fields sort:nil]
+                    enumerateObjectsUsingBlock:^(CDTDocumentRevision *rev, NSUInteger i,
+                                                 BOOL *s) {
+                        fromDocuments[rev.docId] = rev.body;
+                    }];
+
+                NSMutableDictionary *fromIndex = [NSMutableDictionary dictionary];
+                im.coveringProjectionsEnabled = YES;
+                [[im find:query skip:0 limit:0 fields:fields sort:nil]
+                    enumerateObjectsUsingBlock:^(CDTDocumentRevision *rev, NSUInteger i,
+                                                 BOOL *s) {
+                        fromIndex[rev.docId] = rev.body;
+                    }];
+
+                expect(fromDocuments.count).to.equal(3);
+                expect(fromIndex).to.equal(fromDocuments);
+                // Equal bodies can still differ in type, as @YES equals @1
+                for (NSString *docId in fromIndex) {
+                    for (NSString *field in fields) {
+                        CFTypeRef value = (__bridge CFTypeRef)fromIndex[docId][field];
+                        CFTypeRef expected = (__bridge CFTypeRef)fromDocuments[docId][field];
+                        expect(CFGetTypeID(value)).to.equal(CFGetTypeID(expected));
+                    }
+                }
+            }
+        });
+
         context(@"projected revisions", ^{
 
             it(@"cannot be saved until copied", ^{
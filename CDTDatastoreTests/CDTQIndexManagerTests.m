@@ -8,12 +8,14 @@
 #import <CDTDatastore/CDTQIndexCreator.h>
 #import <CDTDatastore/CDTQIndexManager.h>
 #import <CDTDatastore/CDTQIndexUpdater.h>
+#import <CDTDatastore/CDTQPreparedQuery.h>
 #import <CDTDatastore/CDTQQueryExecutor.h>
 #import <CDTDatastore/CDTQResultSet.h>
 #import <CDTDatastore/CloudantSync.h>
 #import <Expecta/Expecta.h>
 #import <Specta/Specta.h>
 #import "DBQueryUtils.h"
+#import "FMDatabase+StatementCache.h"
 
 SpecBegin(CDTQIndexManager)
 
@@ -201,6 +203,17 @@ SpecBegin(CDTQIndexManager)
             expect([im listIndexes][@"basic"]).to.beNil();
         });
 
+        it(@"index deleted by another manager", ^{
+            expect([im listIndexes][@"basic"]).to.beNil();
+
+            CDTQIndexManager *other = [CDTQIndexManager managerUsingDatastore:ds error:nil];
+            expect([other ensureIndexed:@[ @"name" ] withName:@"basic"]).toNot.beNil();
+            expect([im listIndexes][@"basic"]).toNot.beNil();
+
+            expect([other deleteIndexNamed:@"basic"]).to.equal(@YES);
+            expect([im listIndexes][@"basic"]).to.beNil();
+        });
+
     });
 
     describe(@"when performing text search check", ^{
@@ -254,6 +267,76 @@ SpecBegin(CDTQIndexManager)
             
             expect([im isTextSearchEnabled]).to.equal(@YES);
         });
+
+        it(@"caches only the statements of prepared queries", ^{
+            CDTDocumentRevision *rev = [CDTDocumentRevision revisionWithDocId:@"mike12"];
+            rev.body = [@{ @"name" : @"mike", @"age" : @12 } mutableCopy];
+            [ds createDocumentFromRevision:rev error:nil];
+            expect([im ensureIndexed:@[ @"name", @"age" ] withName:@"basic"]).toNot.beNil();
+
+            NSDictionary *query = @{ @"name" : @"mike", @"age" : @{ @"$gt" : @10 } };
+            expect([im find:query].documentIds).to.equal(@[ @"mike12" ]);
+
+            __block NSUInteger hits;
+            __block NSUInteger cached;
+            [im.database inDatabase:^(FMDatabase *db) {
+                hits = db.statementCacheHits;
+                cached = db.cachedStatements.count;
+                expect(db.shouldCacheStatements).to.beFalsy();
+            }];
+
+            expect([im find:query].documentIds).to.equal(@[ @"mike12" ]);
+            [im.database inDatabase:^(FMDatabase *db) {
+                expect(db.statementCacheHits).to.beGreaterThan(hits);
+                expect(db.cachedStatements.count).to.equal(cached);
+
+                [[db executeQuery:@"SELECT 'not cached';"] close];
+                expect(db.cachedStatements.count).to.equal(cached);
+            }];
+        });
+
+        it(@"reuses the cached statements of a prepared query between runs", ^{
+            for (NSNumber *age in @[ @12, @34 ]) {
+                NSString *docId = [NSString stringWithFormat:@"mike%@", age];
+                CDTDocumentRevision *rev = [CDTDocumentRevision revisionWithDocId:docId];
+                rev.body = [@{ @"name" : @"mike", @"age" : age } mutableCopy];
+                [ds createDocumentFromRevision:rev error:nil];
+            }
+            expect([im ensureIndexed:@[ @"name", @"age" ] withName:@"basic"]).toNot.beNil();
+
+            CDTQPlaceholder *minAge = [CDTQPlaceholder placeholderNamed:@"minAge"];
+            CDTQPreparedQuery *prepared =
+                [im prepareQuery:@{ @"name" : @"mike", @"age" : @{ @"$gt" : minAge } }
+                            skip:0
+                           limit:0
+                          fields:nil
+                            sort:@[ @{ @"age" : @"asc" } ]];
+            expect(prepared).toNot.beNil();
+
+            NSArray *expected = @[ @"mike12", @"mike34" ];
+            expect([prepared findWithValues:@{ @"minAge" : @10 }].documentIds).to.equal(expected);
+
+            __block NSUInteger hits;
+            __block NSUInteger cached;
+            [im.database inDatabase:^(FMDatabase *db) {
+                hits = db.statementCacheHits;
+                cached = db.cachedStatements.count;
+            }];
+            expect(cached).to.beGreaterThan(0);
+
+            // Each run binds different values to the same statements
+            NSDictionary *expectedByAge = @{ @20 : @[ @"mike34" ], @0 : expected, @40 : @[] };
+            for (NSNumber *value in @[ @20, @0, @40 ]) {
+                expect([prepared findWithValues:@{ @"minAge" : value }].documentIds)
+                    .to.equal(expectedByAge[value]);
+
+                [im.database inDatabase:^(FMDatabase *db) {
+                    expect(db.statementCacheHits).to.beGreaterThan(hits);
+                    expect(db.cachedStatements.count).to.equal(cached);
+                    hits = db.statementCacheHits;
+                }];
+            }
+        });
         
     });
 
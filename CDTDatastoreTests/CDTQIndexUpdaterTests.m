@@ -392,6 +392,56 @@ SpecBegin(CDTQIndexUpdater)
 
             });
 
+            it(@"updates indexes at different sequences in one pass", ^{
+                expect([im ensureIndexed:@[ @"age" ] withName:@"behind"]).toNot.beNil();
+                FMDatabaseQueue *queue =
+                    (FMDatabaseQueue *)[im performSelector:@selector(database)];
+                CDTQIndexUpdater *updater =
+                    [[CDTQIndexUpdater alloc] initWithDatabase:queue datastore:ds];
+
+                CDTDocumentRevision *rev;
+                rev = [CDTDocumentRevision revisionWithDocId:@"newdoc"];
+                rev.body = [@{ @"name" : @"fred", @"age" : @12 } mutableCopy];
+                [ds createDocumentFromRevision:rev error:nil];
+
+                // "ahead" is created at sequence 7, "behind" has only seen up to 6
+                expect([im ensureIndexed:@[ @"name" ] withName:@"ahead"]).toNot.beNil();
+                expect([updater sequenceNumberForIndex:@"behind"]).to.equal(6);
+                expect([updater sequenceNumberForIndex:@"ahead"]).to.equal(7);
+
+                rev = [CDTDocumentRevision revisionWithDocId:@"otherdoc"];
+                rev.body = [@{ @"name" : @"bill", @"age" : @21 } mutableCopy];
+                [ds createDocumentFromRevision:rev error:nil];
+
+                expect([updater updateAllIndexes:[im listIndexes]]).to.beTruthy();
+
+                expect([updater sequenceNumberForIndex:@"behind"]).to.equal(8);
+                expect([updater sequenceNumberForIndex:@"ahead"]).to.equal(8);
+                expect([im find:@{ @"age" : @12 }].documentIds).to.contain(@"newdoc");
+                expect([im find:@{ @"name" : @"bill" }].documentIds).to.contain(@"otherdoc");
+            });
+
+            it(@"updates indexes in the background after writes", ^{
+                expect([im ensureIndexed:@[ @"name" ] withName:@"basic"]).toNot.beNil();
+                FMDatabaseQueue *queue =
+                    (FMDatabaseQueue *)[im performSelector:@selector(database)];
+                CDTQIndexUpdater *updater =
+                    [[CDTQIndexUpdater alloc] initWithDatabase:queue datastore:ds];
+                expect([updater sequenceNumberForIndex:@"basic"]).to.equal(6);
+
+                im.updatesIndexesInBackground = YES;
+
+                CDTDocumentRevision *rev;
+                rev = [CDTDocumentRevision revisionWithDocId:@"newdoc"];
+                rev.body = [@{ @"name" : @"fred", @"age" : @12 } mutableCopy];
+                [ds createDocumentFromRevision:rev error:nil];
+
+                // No query or explicit update; the background queue catches up on its own
+                expect([updater sequenceNumberForIndex:@"basic"]).will.equal(7);
+
+                im.updatesIndexesInBackground = NO;
+            });
+
             describe(
                 @"when using a text index", ^{
                   it(@"sets correct sequence number", ^{
@@ -15,6 +15,7 @@
 #import <CDTDatastore/CDTQIndexCreator.h>
 #import <CDTDatastore/CDTQIndexManager.h>
 #import <CDTDatastore/CDTQIndexUpdater.h>
+#import <CDTDatastore/CDTQPreparedQuery.h>
 #import <CDTDatastore/CDTQQueryExecutor.h>
 #import <CDTDatastore/CDTQResultSet.h>
 #import <CDTDatastore/CloudantSync.h>
@@ -234,6 +235,70 @@ SharedExamplesBegin(QueryExecution)
                 });
             });
 
+            context(@"when using prepared queries", ^{
+
+                it(@"runs with different values", ^{
+                    NSDictionary* query = @{
+                        @"name" : [CDTQPlaceholder placeholderNamed:@"name"],
+                        @"age" : @{@"$gt" : [CDTQPlaceholder placeholderNamed:@"age"]}
+                    };
+                    CDTQPreparedQuery* prepared =
+                        [im prepareQuery:query skip:0 limit:0 fields:nil sort:nil];
+                    expect(prepared).toNot.beNil();
+                    expect(prepared.placeholderNames)
+                        .to.equal([NSSet setWithArray:@[ @"name", @"age" ]]);
+
+                    CDTQResultSet* result =
+                        [prepared findWithValues:@{ @"name" : @"mike", @"age" : @12 }];
+                    expect(result.documentIds).to.containsInAnyOrder(@[ @"mike34", @"mike72" ]);
+
+                    result = [prepared findWithValues:@{ @"name" : @"fred", @"age" : @0 }];
+                    expect(result.documentIds).to.containsInAnyOrder(@[ @"fred12", @"fred34" ]);
+                });
+
+                it(@"returns the same results as find", ^{
+                    NSDictionary* query = @{
+                        @"$or" : @[
+                            @{ @"pet" : [CDTQPlaceholder placeholderNamed:@"pet"] },
+                            @{ @"age" : [CDTQPlaceholder placeholderNamed:@"age"] }
+                        ]
+                    };
+                    NSDictionary* literalQuery =
+                        @{ @"$or" : @[ @{ @"pet" : @"dog" }, @{ @"age" : @12 } ] };
+                    NSArray* sort = @[ @{@"name" : @"asc"} ];
+
+                    CDTQPreparedQuery* prepared =
+                        [im prepareQuery:query skip:1 limit:2 fields:@[ @"name" ] sort:sort];
+                    CDTQResultSet* expected =
+                        [im find:literalQuery skip:1 limit:2 fields:@[ @"name" ] sort:sort];
+
+                    CDTQResultSet* result =
+                        [prepared findWithValues:@{ @"pet" : @"dog", @"age" : @12 }];
+                    expect(result.documentIds.count).to.equal(2);
+                    expect(result.documentIds).to.equal(expected.documentIds);
+                });
+
+                it(@"returns nil when a value is missing or invalid", ^{
+                    NSDictionary* query =
+                        @{ @"name" : [CDTQPlaceholder placeholderNamed:@"name"] };
+                    CDTQPreparedQuery* prepared =
+                        [im prepareQuery:query skip:0 limit:0 fields:nil sort:nil];
+                    expect(prepared).toNot.beNil();
+
+                    expect([prepared findWithValues:@{}]).to.beNil();
+                    expect([prepared findWithValues:@{ @"name" : @[ @"mike" ] }]).to.beNil();
+                });
+
+                it(@"returns nil for an invalid selector", ^{
+                    NSDictionary* query = @{
+                        @"age" : @{@"$mod" : @[ [CDTQPlaceholder placeholderNamed:@"d"], @0 ]}
+                    };
+                    CDTQPreparedQuery* prepared =
+                        [im prepareQuery:query skip:0 limit:0 fields:nil sort:nil];
+                    expect(prepared).to.beNil();
+                });
+            });
+
             // TODO fill in when separate validation class written
             xdescribe(@"when using unsupported operator", ^{
                 it(@"fails", ^{
@@ -1484,6 +1549,41 @@ SharedExamplesBegin(QueryExecution)
                                                                     @"fred34",
                                                                     @"john44" ]);
             });
+
+            it(@"can find documents using a long $in list", ^{
+                NSMutableArray* pets = [NSMutableArray arrayWithArray:@[ @"fish", @"hamster" ]];
+                for (int i = 0; i < 1000; i++) {
+                    [pets addObject:[NSString stringWithFormat:@"pet%d", i]];
+                }
+
+                NSDictionary* query = @{ @"pet" : @{ @"$in" : pets } };
+                CDTQResultSet* result = [im find:query];
+                expect(result).toNot.beNil();
+                expect(result.documentIds).to.containsInAnyOrder(@[ @"mike34", @"john44" ]);
+
+                query = @{ @"pet" : @{ @"$not" : @{ @"$in" : pets } } };
+                result = [im find:query];
+                expect(result).toNot.beNil();
+                expect(result.documentIds).to.containsInAnyOrder(@[ @"mike12",
+                                                                    @"fred34",
+                                                                    @"fred12",
+                                                                    @"john22" ]);
+            });
+
+            it(@"can find documents using several long $in lists", ^{
+                NSMutableArray* names = [NSMutableArray arrayWithArray:@[ @"mike" ]];
+                NSMutableArray* ages = [NSMutableArray arrayWithArray:@[ @34 ]];
+                for (int i = 0; i < 500; i++) {
+                    [names addObject:[NSString stringWithFormat:@"name%d", i]];
+                    [ages addObject:@(1000 + i)];
+                }
+
+                NSDictionary* query =
+                    @{ @"name" : @{ @"$in" : names }, @"age" : @{ @"$in" : ages } };
+                CDTQResultSet* result = [im find:query];
+                expect(result).toNot.beNil();
+                expect(result.documentIds).to.equal(@[ @"mike34" ]);
+            });
         });
 
         describe(@"stopping enumeration", ^{
@@ -2015,6 +2115,75 @@ sharedExamplesFor(@"queries without covering indexes", ^(NSDictionary* data) {
         });
         
     });
+
+    describe(@"when matching many documents", ^{
+
+        __block CDTDatastore* ds;
+        __block CDTQIndexManager* im;
+
+        beforeEach(^{
+            ds = [factory datastoreNamed:@"test" error:nil];
+            expect(ds).toNot.beNil();
+
+            // Enough documents for several windows of concurrently matched batches
+            for (int i = 0; i < 1000; i++) {
+                NSString* docId = [NSString stringWithFormat:@"doc%04d", i];
+                CDTDocumentRevision* rev = [CDTDocumentRevision revisionWithDocId:docId];
+                rev.body = [@{ @"n" : @(i) } mutableCopy];
+                [ds createDocumentFromRevision:rev error:nil];
+            }
+
+            im = [imClass managerUsingDatastore:ds error:nil];
+            expect(im).toNot.beNil();
+        });
+
+        it(@"keeps candidate order with skip and limit", ^{
+            NSDictionary* query = @{ @"n" : @{@"$mod" : @[ @3, @0 ]} };
+
+            NSArray* all = [im find:query skip:0 limit:0 fields:nil sort:nil].documentIds;
+            expect(all.count).to.equal(334);
+
+            NSArray* page = [im find:query skip:100 limit:150 fields:nil sort:nil].documentIds;
+            expect(page).to.equal([all subarrayWithRange:NSMakeRange(100, 150)]);
+
+            page = [im find:query skip:300 limit:100 fields:nil sort:nil].documentIds;
+            expect(page).to.equal([all subarrayWithRange:NSMakeRange(300, 34)]);
+        });
+
+        it(@"returns the same results in pages from a cursor", ^{
+            NSDictionary* query = @{ @"n" : @{@"$mod" : @[ @3, @0 ]} };
+            NSArray* expected =
+                [im find:query skip:10 limit:300 fields:nil sort:nil].documentIds;
+
+            CDTQResultSet* results = [im find:query skip:10 limit:300 fields:nil sort:nil];
+            CDTQResultCursor* cursor = [results cursorWithPageSize:64];
+
+            NSMutableArray* docIds = [NSMutableArray array];
+            NSMutableArray* pageSizes = [NSMutableArray array];
+            __block BOOL finished = NO;
+            __block void (^fetchNext)(void);
+            fetchNext = ^{
+                [cursor nextPageOnQueue:dispatch_get_main_queue()
+                      completionHandler:^(NSArray<CDTDocumentRevision*>* page) {
+                          [pageSizes addObject:@(page.count)];
+                          for (CDTDocumentRevision* rev in page) {
+                              [docIds addObject:rev.docId];
+                          }
+                          if (page.count > 0) {
+                              fetchNext();
+                          } else {
+                              finished = YES;
+                              fetchNext = nil;
+                          }
+                      }];
+            };
+            fetchNext();
+
+            expect(finished).will.beTruthy();
+            expect(docIds).to.equal(expected);
+            expect(pageSizes).to.equal(@[ @64, @64, @64, @64, @44, @0 ]);
+        });
+    });
     
 });
 
@@ -0,0 +1,156 @@
+//
+//  CDTQQueryPlanCacheTests.m
+//
+//  Copyright © 2018 IBM Corporation. All rights reserved.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//  except in compliance with the License. You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+//  Unless required by applicable law or agreed to in writing, software distributed under the
+//  License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//  either express or implied. See the License for the specific language governing permissions
+//  and limitations under the License.
+
+#import <CDTDatastore/CDTQQueryPlanCache.h>
+#import <CDTDatastore/CloudantSync.h>
+#import <Expecta/Expecta.h>
+#import <Specta/Specta.h>
+
+SpecBegin(CDTQQueryPlanCache)
+
+    describe(@"keys", ^{
+
+        it(@"are the same for dictionaries with keys in a different order", ^{
+            NSMutableDictionary *query1 = [NSMutableDictionary dictionary];
+            query1[@"name"] = @"mike";
+            query1[@"age"] = @12;
+            NSMutableDictionary *query2 = [NSMutableDictionary dictionary];
+            query2[@"age"] = @12;
+            query2[@"name"] = @"mike";
+
+            NSString *key1 = [CDTQQueryPlanCache keyForQuery:query1
+                                                        skip:0
+                                                       limit:0
+                                                      fields:nil
+                                                        sort:nil
+                                         coveringProjections:NO];
+            NSString *key2 = [CDTQQueryPlanCache keyForQuery:query2
+                                                        skip:0
+                                                       limit:0
+                                                      fields:nil
+                                                        sort:nil
+                                         coveringProjections:NO];
+            expect(key1).toNot.beNil();
+            expect(key1).to.equal(key2);
+        });
+
+        it(@"differ by skip, limit, fields and sort", ^{
+            NSDictionary *query = @{ @"name" : @"mike" };
+            NSString *key = [CDTQQueryPlanCache keyForQuery:query
+                                                       skip:0
+                                                      limit:0
+                                                     fields:nil
+                                                       sort:nil
+                                        coveringProjections:NO];
+
+            expect([CDTQQueryPlanCache keyForQuery:query
+                                              skip:1
+                                             limit:0
+                                            fields:nil
+                                              sort:nil
+                               coveringProjections:NO])
+                .toNot.equal(key);
+            expect([CDTQQueryPlanCache keyForQuery:query
+                                              skip:0
+                                             limit:1
+                                            fields:nil
+                                              sort:nil
+                               coveringProjections:NO])
+                .toNot.equal(key);
+            expect([CDTQQueryPlanCache keyForQuery:query
+                                              skip:0
+                                             limit:0
+                                            fields:@[ @"name" ]
+                                              sort:nil
+                               coveringProjections:NO])
+                .toNot.equal(key);
+            expect([CDTQQueryPlanCache keyForQuery:query
+                                              skip:0
+                                             limit:0
+                                            fields:nil
+                                              sort:@[ @{@"name" : @"asc"} ]
+                               coveringProjections:NO])
+                .toNot.equal(key);
+        });
+
+        it(@"are nil for queries which aren't JSON", ^{
+            NSString *key = [CDTQQueryPlanCache keyForQuery:@{ @"name" : [NSDate date] }
+                                                       skip:0
+                                                      limit:0
+                                                     fields:nil
+                                                       sort:nil
+                                        coveringProjections:NO];
+            expect(key).to.beNil();
+        });
+    });
+
+    describe(@"cached plans", ^{
+
+        __block CDTQQueryPlanCache *cache;
+        __block NSDictionary *indexes;
+
+        beforeEach(^{
+            cache = [[CDTQQueryPlanCache alloc] initWithCapacity:2];
+            indexes = @{
+                @"basic" : @{@"name" : @"basic", @"type" : @"json", @"fields" : @[ @"name" ]}
+            };
+        });
+
+        it(@"are returned for the indexes they were made with", ^{
+            CDTQQueryPlan *plan = [[CDTQQueryPlan alloc] init];
+            plan.indexes = indexes;
+            [cache setPlan:plan forKey:@"a"];
+
+            expect([cache planForKey:@"a" indexes:indexes]).to.beIdenticalTo(plan);
+            expect([cache planForKey:@"b" indexes:indexes]).to.beNil();
+        });
+
+        it(@"are dropped when the indexes change", ^{
+            CDTQQueryPlan *plan = [[CDTQQueryPlan alloc] init];
+            plan.indexes = indexes;
+            [cache setPlan:plan forKey:@"a"];
+
+            expect([cache planForKey:@"a" indexes:@{}]).to.beNil();
+            expect([cache planForKey:@"a" indexes:indexes]).to.beNil();
+        });
+
+        it(@"evicts the least recently used plan", ^{
+            for (NSString *key in @[ @"a", @"b" ]) {
+                CDTQQueryPlan *plan = [[CDTQQueryPlan alloc] init];
+                plan.indexes = indexes;
+                [cache setPlan:plan forKey:key];
+            }
+
+            // Using "a" makes "b" the least recently used
+            expect([cache planForKey:@"a" indexes:indexes]).toNot.beNil();
+
+            CDTQQueryPlan *plan = [[CDTQQueryPlan alloc] init];
+            plan.indexes = indexes;
+            [cache setPlan:plan forKey:@"c"];
+
+            expect([cache planForKey:@"a" indexes:indexes]).toNot.beNil();
+            expect([cache planForKey:@"b" indexes:indexes]).to.beNil();
+            expect([cache planForKey:@"c" indexes:indexes]).to.beIdenticalTo(plan);
+        });
+
+        it(@"are all removed", ^{
+            CDTQQueryPlan *plan = [[CDTQQueryPlan alloc] init];
+            plan.indexes = indexes;
+            [cache setPlan:plan forKey:@"a"];
+            [cache removeAllPlans];
+
+            expect([cache planForKey:@"a" indexes:indexes]).to.beNil();
+        });
+    });
+
+SpecEnd
@@ -9,6 +9,8 @@
 #import <CDTDatastore/CDTQIndexManager.h>
 #import <CDTDatastore/CDTQIndexUpdater.h>
 #import <CDTDatastore/CDTQQueryExecutor.h>
+#import <CDTDatastore/CDTQQuerySqlTranslator.h>
+#import <CDTDatastore/CDTQQueryValidator.h>
 #import <CDTDatastore/CDTQResultSet.h>
 #import <CDTDatastore/CloudantSync.h>
 #import <Expecta/Expecta.h>
@@ -118,6 +120,57 @@ SpecBegin(CDTQQueryExecutorSorting)
                 expect(result.documentIds).to.equal(@[ @"mike12", @"fred11", @"fred34" ]);
             });
 
+            it(@"skips and limits sorted results", ^{
+                NSDictionary *query = @{ @"same" : @"all" };
+                NSArray *order = @[ @{ @"name" : @"asc" }, @{ @"age" : @"desc" } ];
+                CDTQResultSet *result = [im find:query skip:1 limit:1 fields:nil sort:order];
+                expect(result.documentIds).to.equal(@[ @"fred11" ]);
+
+                result = [im find:query skip:2 limit:5 fields:nil sort:order];
+                expect(result.documentIds).to.equal(@[ @"mike12" ]);
+            });
+
+            it(@"pushes sort, skip and limit into the SQL", ^{
+                NSDictionary *query = @{ @"same" : @"all" };
+                NSArray *order = @[ @{ @"name" : @"asc" } ];
+                NSDictionary *indexes = [im listIndexes];
+                BOOL indexesCoverQuery;
+                CDTQQueryNode *root = [CDTQQuerySqlTranslator
+                       translateQuery:[CDTQQueryValidator normaliseAndValidateQuery:query]
+                         toUseIndexes:indexes
+                    indexesCoverQuery:&indexesCoverQuery];
+                expect(indexesCoverQuery).to.beTruthy();
+
+                CDTQSqlParts *parts = [CDTQQueryExecutor sqlForQueryTree:root
+                                                               usingSort:order
+                                                                 indexes:indexes
+                                                                    skip:10
+                                                                   limit:20];
+                NSString *sql = @"SELECT DISTINCT _id FROM \"_t_cloudant_sync_query_index_pet\" "
+                                @"WHERE _id IN (SELECT DISTINCT _id FROM (SELECT _id FROM ("
+                                @"SELECT _id FROM \"_t_cloudant_sync_query_index_pet\" "
+                                @"WHERE \"same\" = ?))) ORDER BY \"name\" ASC LIMIT ? OFFSET ?;";
+                expect(parts.sqlWithPlaceholders).to.equal(sql);
+                expect(parts.placeholderValues).to.equal(@[ @"all", @20, @10 ]);
+            });
+
+            it(@"sorts large sets of candidates", ^{
+                for (int i = 0; i < 600; i++) {
+                    CDTDocumentRevision *rev = [CDTDocumentRevision
+                        revisionWithDocId:[NSString stringWithFormat:@"doc%03d", i]];
+                    rev.body = [@{ @"name" : @"zed", @"age" : @(1000 + i), @"same" : @"many" }
+                        mutableCopy];
+                    [ds createDocumentFromRevision:rev error:nil];
+                }
+
+                // The unindexed field needs a matcher, so the candidates are sorted
+                // before they're matched rather than in one statement
+                NSDictionary *query = @{ @"same" : @"many", @"town" : @{ @"$exists" : @NO } };
+                NSArray *order = @[ @{ @"age" : @"desc" } ];
+                CDTQResultSet *result = [im find:query skip:10 limit:3 fields:nil sort:order];
+                expect(result.documentIds).to.equal(@[ @"doc589", @"doc588", @"doc587" ]);
+            });
+
             it(@"returns nil using not asc/desc", ^{
                 NSDictionary *query = @{ @"same" : @"all" };
                 NSArray *order = @[ @{ @"name" : @"blah" }, @{ @"age" : @"desc" } ];
@@ -136,50 +189,128 @@ SpecBegin(CDTQQueryExecutorSorting)
 
         });
 
-        describe(@"when generating ordering SQL", ^{
+        describe(@"when no single index covers the sort", ^{
+
+            __block CDTDatastore *ds;
+            __block CDTQIndexManager *im;
+
+            beforeEach(^{
+                ds = [factory datastoreNamed:@"test" error:nil];
+                expect(ds).toNot.beNil();
+
+                NSArray *bodies = @[
+                    @{ @"name" : @"mike", @"age" : @12, @"town" : @"bristol" },
+                    @{ @"name" : @"fred", @"age" : @34, @"town" : @[ @"cardiff", @"york" ] },
+                    @{ @"name" : @"fred", @"age" : @11, @"town" : @"aberdeen" },
+                    @{ @"name" : @"anne", @"age" : @20 }
+                ];
+                NSArray *docIds = @[ @"mike12", @"fred34", @"fred11", @"anne20" ];
+                [docIds enumerateObjectsUsingBlock:^(NSString *docId, NSUInteger idx, BOOL *stop) {
+                    CDTDocumentRevision *rev = [CDTDocumentRevision revisionWithDocId:docId];
+                    rev.body = [bodies[idx] mutableCopy];
+                    [ds createDocumentFromRevision:rev error:nil];
+                }];
+
+                im = [CDTQIndexManager managerUsingDatastore:ds error:nil];
+                expect(im).toNot.beNil();
+
+                expect([im ensureIndexed:@[ @"name" ] withName:@"names"]).toNot.beNil();
+                expect([im ensureIndexed:@[ @"age" ] withName:@"ages"]).toNot.beNil();
+            });
+
+            it(@"sorts on fields from different indexes", ^{
+                NSArray *order = @[ @{ @"name" : @"asc" }, @{ @"age" : @"desc" } ];
+                CDTQResultSet *result = [im find:@{} skip:0 limit:0 fields:nil sort:order];
+                expect(result.documentIds)
+                    .to.equal(@[ @"anne20", @"fred34", @"fred11", @"mike12" ]);
+            });
 
-            __block NSDictionary *indexes = @{
-                @"a" :
-                    @{@"name" : @"a", @"type" : @"json", @"fields" : @[ @"name", @"age", @"pet" ]},
-                @"b" : @{@"name" : @"b", @"type" : @"json", @"fields" : @[ @"x", @"y", @"z" ]},
-            };
+            it(@"sorts on an unindexed field", ^{
+                NSArray *order = @[ @{ @"town" : @"asc" } ];
+                CDTQResultSet *result = [im find:@{} skip:0 limit:0 fields:nil sort:order];
+                expect(result.documentIds)
+                    .to.equal(@[ @"anne20", @"fred11", @"mike12", @"fred34" ]);
 
-            __block NSSet *smallDocIdSet = [NSSet setWithArray:@[ @"mike", @"john" ]];
-            __block NSMutableSet *largeDocIdSet;
+                order = @[ @{ @"town" : @"desc" } ];
+                result = [im find:@{} skip:0 limit:0 fields:nil sort:order];
+                expect(result.documentIds)
+                    .to.equal(@[ @"fred34", @"mike12", @"fred11", @"anne20" ]);
+            });
 
-            beforeAll(^{
-                largeDocIdSet = [NSMutableSet set];
-                for (int i = 0; i < 501; i++) {  // 500 max id set for placeholders
-                    [largeDocIdSet addObject:[NSString stringWithFormat:@"doc-%d", i]];
+            it(@"skips and limits sorted results", ^{
+                NSArray *order = @[ @{ @"name" : @"asc" }, @{ @"age" : @"desc" } ];
+                CDTQResultSet *result = [im find:@{} skip:1 limit:2 fields:nil sort:order];
+                expect(result.documentIds).to.equal(@[ @"fred34", @"fred11" ]);
+            });
+
+            it(@"sorts large sets of documents", ^{
+                for (int i = 0; i < 600; i++) {
+                    CDTDocumentRevision *rev = [CDTDocumentRevision
+                        revisionWithDocId:[NSString stringWithFormat:@"doc%03d", i]];
+                    rev.body = [@{ @"name" : @"zed", @"age" : @(1000 + i) } mutableCopy];
+                    [ds createDocumentFromRevision:rev error:nil];
                 }
+
+                NSDictionary *query = @{ @"name" : @"zed" };
+                NSArray *order = @[ @{ @"name" : @"asc" }, @{ @"age" : @"desc" } ];
+                CDTQResultSet *result = [im find:query skip:10 limit:3 fields:nil sort:order];
+                expect(result.documentIds).to.equal(@[ @"doc589", @"doc588", @"doc587" ]);
             });
+        });
+
+        describe(@"when sorting candidates", ^{
+
+            __block CDTDatastore *ds;
+            __block CDTQIndexManager *im;
+
+            beforeEach(^{
+                ds = [factory datastoreNamed:@"test" error:nil];
+                expect(ds).toNot.beNil();
+
+                im = [CDTQIndexManager managerUsingDatastore:ds error:nil];
+                expect(im).toNot.beNil();
+
+                expect([im ensureIndexed:@[ @"name", @"age", @"pet" ] withName:@"a"])
+                    .toNot.beNil();
+                expect([im ensureIndexed:@[ @"x", @"y", @"z" ] withName:@"b"]).toNot.beNil();
+            });
+
+            // The unindexed field needs a matcher, so the matching IDs are loaded into
+            // temp.cdtq_candidates and sorted there rather than in one statement.
 
             context(@"two doc IDs", ^{
 
+                __block NSDictionary *query =
+                    @{ @"name" : @{@"$in" : @[ @"mike", @"john" ]}, @"town" : @{@"$exists" : @NO} };
+
+                beforeEach(^{
+                    NSArray *bodies = @[
+                        @{ @"name" : @"mike", @"age" : @12, @"x" : @1, @"y" : @2 },
+                        @{ @"name" : @"john", @"age" : @30, @"x" : @2, @"y" : @2 },
+                        @{ @"name" : @"fred", @"age" : @40, @"x" : @0, @"y" : @0 }
+                    ];
+                    for (NSDictionary *body in bodies) {
+                        CDTDocumentRevision *rev =
+                            [CDTDocumentRevision revisionWithDocId:body[@"name"]];
+                        rev.body = [body mutableCopy];
+                        [ds createDocumentFromRevision:rev error:nil];
+                    }
+                });
+
                 context(@"for single field", ^{
 
                     it(@"asc", ^{
                         NSArray *order = @[ @{ @"name" : @"asc" } ];
-                        CDTQSqlParts *parts = [CDTQQueryExecutor sqlToSortIds:smallDocIdSet
-                                                                   usingOrder:order
-                                                                      indexes:indexes];
-
-                        NSString *sql = @"SELECT DISTINCT _id FROM \"_t_cloudant_sync_query_index_a\" "
-                                        @"WHERE _id IN (?, ?) ORDER BY \"name\" ASC;";
-                        expect(parts.sqlWithPlaceholders).to.equal(sql);
-                        expect(parts.placeholderValues).to.equal([smallDocIdSet allObjects]);
+                        CDTQResultSet *result =
+                            [im find:query skip:0 limit:0 fields:nil sort:order];
+                        expect(result.documentIds).to.equal(@[ @"john", @"mike" ]);
                     });
 
                     it(@"desc", ^{
-                        NSArray *order = @[ @{ @"y" : @"desc" } ];
-                        CDTQSqlParts *parts = [CDTQQueryExecutor sqlToSortIds:smallDocIdSet
-                                                                   usingOrder:order
-                                                                      indexes:indexes];
-
-                        NSString *sql = @"SELECT DISTINCT _id FROM \"_t_cloudant_sync_query_index_b\" "
-                                        @"WHERE _id IN (?, ?) ORDER BY \"y\" DESC;";
-                        expect(parts.sqlWithPlaceholders).to.equal(sql);
-                        expect(parts.placeholderValues).to.equal([smallDocIdSet allObjects]);
+                        NSArray *order = @[ @{ @"x" : @"desc" } ];
+                        CDTQResultSet *result =
+                            [im find:query skip:0 limit:0 fields:nil sort:order];
+                        expect(result.documentIds).to.equal(@[ @"john", @"mike" ]);
                     });
 
                 });
@@ -188,38 +319,30 @@ SpecBegin(CDTQQueryExecutorSorting)
 
                     it(@"asc", ^{
                         NSArray *order = @[ @{ @"y" : @"asc" }, @{ @"x" : @"asc" } ];
-                        CDTQSqlParts *parts = [CDTQQueryExecutor sqlToSortIds:smallDocIdSet
-                                                                   usingOrder:order
-                                                                      indexes:indexes];
-
-                        NSString *sql = @"SELECT DISTINCT _id FROM \"_t_cloudant_sync_query_index_b\" "
-                                        @"WHERE _id IN (?, ?) ORDER BY \"y\" ASC, \"x\" ASC;";
-                        expect(parts.sqlWithPlaceholders).to.equal(sql);
-                        expect(parts.placeholderValues).to.equal([smallDocIdSet allObjects]);
+                        CDTQResultSet *result =
+                            [im find:query skip:0 limit:0 fields:nil sort:order];
+                        expect(result.documentIds).to.equal(@[ @"mike", @"john" ]);
                     });
 
                     it(@"desc", ^{
                         NSArray *order = @[ @{ @"y" : @"desc" }, @{ @"x" : @"desc" } ];
-                        CDTQSqlParts *parts = [CDTQQueryExecutor sqlToSortIds:smallDocIdSet
-                                                                   usingOrder:order
-                                                                      indexes:indexes];
-
-                        NSString *sql = @"SELECT DISTINCT _id FROM \"_t_cloudant_sync_query_index_b\" "
-                                        @"WHERE _id IN (?, ?) ORDER BY \"y\" DESC, \"x\" DESC;";
-                        expect(parts.sqlWithPlaceholders).to.equal(sql);
-                        expect(parts.placeholderValues).to.equal([smallDocIdSet allObjects]);
+                        CDTQResultSet *result =
+                            [im find:query skip:0 limit:0 fields:nil sort:order];
+                        expect(result.documentIds).to.equal(@[ @"john", @"mike" ]);
                     });
 
                     it(@"mixed", ^{
                         NSArray *order = @[ @{ @"y" : @"desc" }, @{ @"x" : @"asc" } ];
-                        CDTQSqlParts *parts = [CDTQQueryExecutor sqlToSortIds:smallDocIdSet
-                                                                   usingOrder:order
-                                                                      indexes:indexes];
-
-                        NSString *sql = @"SELECT DISTINCT _id FROM \"_t_cloudant_sync_query_index_b\" "
-                                        @"WHERE _id IN (?, ?) ORDER BY \"y\" DESC, \"x\" ASC;";
-                        expect(parts.sqlWithPlaceholders).to.equal(sql);
-                        expect(parts.placeholderValues).to.equal([smallDocIdSet allObjects]);
+                        CDTQResultSet *result =
+                            [im find:query skip:0 limit:0 fields:nil sort:order];
+                        expect(result.documentIds).to.equal(@[ @"mike", @"john" ]);
+                    });
+
+                    it(@"in different indexes", ^{
+                        NSArray *order = @[ @{ @"y" : @"asc" }, @{ @"age" : @"desc" } ];
+                        CDTQResultSet *result =
+                            [im find:query skip:0 limit:0 fields:nil sort:order];
+                        expect(result.documentIds).to.equal(@[ @"john", @"mike" ]);
                     });
 
                 });
@@ -228,30 +351,39 @@ SpecBegin(CDTQQueryExecutorSorting)
 
             context(@"501 doc IDs", ^{
 
+                __block NSDictionary *query =
+                    @{ @"name" : @"zed", @"town" : @{@"$exists" : @NO} };
+
+                beforeEach(^{
+                    for (int i = 0; i < 501; i++) {
+                        CDTDocumentRevision *rev = [CDTDocumentRevision
+                            revisionWithDocId:[NSString stringWithFormat:@"doc-%03d", i]];
+                        rev.body = [@{
+                            @"name" : @"zed",
+                            @"age" : @(1000 - i),
+                            @"x" : @(i % 2),
+                            @"y" : @(i)
+                        } mutableCopy];
+                        [ds createDocumentFromRevision:rev error:nil];
+                    }
+                });
+
                 context(@"for single field", ^{
 
                     it(@"asc", ^{
-                        NSArray *order = @[ @{ @"name" : @"asc" } ];
-                        CDTQSqlParts *parts = [CDTQQueryExecutor sqlToSortIds:largeDocIdSet
-                                                                   usingOrder:order
-                                                                      indexes:indexes];
-
-                        NSString *sql = @"SELECT DISTINCT _id FROM \"_t_cloudant_sync_query_index_a\"  "
-                                        @"ORDER BY \"name\" ASC;";
-                        expect(parts.sqlWithPlaceholders).to.equal(sql);
-                        expect(parts.placeholderValues).to.equal(@[]);
+                        NSArray *order = @[ @{ @"age" : @"asc" } ];
+                        CDTQResultSet *result =
+                            [im find:query skip:0 limit:3 fields:nil sort:order];
+                        expect(result.documentIds)
+                            .to.equal(@[ @"doc-500", @"doc-499", @"doc-498" ]);
                     });
 
                     it(@"desc", ^{
                         NSArray *order = @[ @{ @"y" : @"desc" } ];
-                        CDTQSqlParts *parts = [CDTQQueryExecutor sqlToSortIds:largeDocIdSet
-                                                                   usingOrder:order
-                                                                      indexes:indexes];
-
-                        NSString *sql = @"SELECT DISTINCT _id FROM \"_t_cloudant_sync_query_index_b\"  "
-                                        @"ORDER BY \"y\" DESC;";
-                        expect(parts.sqlWithPlaceholders).to.equal(sql);
-                        expect(parts.placeholderValues).to.equal(@[]);
+                        CDTQResultSet *result =
+                            [im find:query skip:0 limit:3 fields:nil sort:order];
+                        expect(result.documentIds)
+                            .to.equal(@[ @"doc-500", @"doc-499", @"doc-498" ]);
                     });
 
                 });
@@ -259,232 +391,60 @@ SpecBegin(CDTQQueryExecutorSorting)
                 context(@"for multiple fields", ^{
 
                     it(@"asc", ^{
-                        NSArray *order = @[ @{ @"y" : @"asc" }, @{ @"x" : @"asc" } ];
-                        CDTQSqlParts *parts = [CDTQQueryExecutor sqlToSortIds:largeDocIdSet
-                                                                   usingOrder:order
-                                                                      indexes:indexes];
-
-                        NSString *sql = @"SELECT DISTINCT _id FROM \"_t_cloudant_sync_query_index_b\"  "
-                                        @"ORDER BY \"y\" ASC, \"x\" ASC;";
-                        expect(parts.sqlWithPlaceholders).to.equal(sql);
-                        expect(parts.placeholderValues).to.equal(@[]);
+                        NSArray *order = @[ @{ @"x" : @"asc" }, @{ @"y" : @"asc" } ];
+                        CDTQResultSet *result =
+                            [im find:query skip:0 limit:3 fields:nil sort:order];
+                        expect(result.documentIds)
+                            .to.equal(@[ @"doc-000", @"doc-002", @"doc-004" ]);
                     });
 
                     it(@"desc", ^{
-                        NSArray *order = @[ @{ @"y" : @"desc" }, @{ @"x" : @"desc" } ];
-                        CDTQSqlParts *parts = [CDTQQueryExecutor sqlToSortIds:largeDocIdSet
-                                                                   usingOrder:order
-                                                                      indexes:indexes];
-
-                        NSString *sql = @"SELECT DISTINCT _id FROM \"_t_cloudant_sync_query_index_b\"  "
-                                        @"ORDER BY \"y\" DESC, \"x\" DESC;";
-                        expect(parts.sqlWithPlaceholders).to.equal(sql);
-                        expect(parts.placeholderValues).to.equal(@[]);
+                        NSArray *order = @[ @{ @"x" : @"desc" }, @{ @"y" : @"desc" } ];
+                        CDTQResultSet *result =
+                            [im find:query skip:0 limit:3 fields:nil sort:order];
+                        expect(result.documentIds)
+                            .to.equal(@[ @"doc-499", @"doc-497", @"doc-495" ]);
                     });
 
                     it(@"mixed", ^{
-                        NSArray *order = @[ @{ @"y" : @"desc" }, @{ @"x" : @"asc" } ];
-                        CDTQSqlParts *parts = [CDTQQueryExecutor sqlToSortIds:largeDocIdSet
-                                                                   usingOrder:order
-                                                                      indexes:indexes];
-
-                        NSString *sql = @"SELECT DISTINCT _id FROM \"_t_cloudant_sync_query_index_b\"  "
-                                        @"ORDER BY \"y\" DESC, \"x\" ASC;";
-                        expect(parts.sqlWithPlaceholders).to.equal(sql);
-                        expect(parts.placeholderValues).to.equal(@[]);
+                        NSArray *order = @[ @{ @"x" : @"asc" }, @{ @"y" : @"desc" } ];
+                        CDTQResultSet *result =
+                            [im find:query skip:0 limit:3 fields:nil sort:order];
+                        expect(result.documentIds)
+                            .to.equal(@[ @"doc-500", @"doc-498", @"doc-496" ]);
                     });
 
-                });
-
-            });
+                    it(@"in different indexes", ^{
+                        NSArray *order = @[ @{ @"x" : @"desc" }, @{ @"age" : @"asc" } ];
+                        CDTQResultSet *result =
+                            [im find:query skip:0 limit:3 fields:nil sort:order];
+                        expect(result.documentIds)
+                            .to.equal(@[ @"doc-499", @"doc-497", @"doc-495" ]);
+                    });
 
-            it(@"fails when unindexed field", ^{
-                NSArray *order = @[ @{ @"apples" : @"asc" } ];
-                CDTQSqlParts *parts =
-                    [CDTQQueryExecutor sqlToSortIds:smallDocIdSet usingOrder:order indexes:indexes];
-                expect(parts).to.beNil();
-            });
+                });
 
-            it(@"fails when fields not in single index", ^{
-                NSArray *order = @[ @{ @"x" : @"asc" }, @{ @"age" : @"asc" } ];
-                CDTQSqlParts *parts =
-                    [CDTQQueryExecutor sqlToSortIds:smallDocIdSet usingOrder:order indexes:indexes];
-                expect(parts).to.beNil();
             });
 
-            it(@"returns nil when no order", ^{
-                CDTQSqlParts *parts;
-                parts =
-                    [CDTQQueryExecutor sqlToSortIds:smallDocIdSet usingOrder:@[] indexes:indexes];
-                expect(parts).to.beNil();
-                parts =
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wnonnull"
-                    [CDTQQueryExecutor sqlToSortIds:smallDocIdSet usingOrder:nil indexes:indexes];
-#pragma clang diagnostic pop
-                expect(parts).to.beNil();
-            });
+            it(@"sorts on an unindexed field", ^{
+                NSArray *bodies = @[
+                    @{ @"name" : @"mike", @"pet" : @"cat", @"colour" : @"red" },
+                    @{ @"name" : @"john", @"pet" : @"dog", @"colour" : @"blue" }
+                ];
+                for (NSDictionary *body in bodies) {
+                    CDTDocumentRevision *rev =
+                        [CDTDocumentRevision revisionWithDocId:body[@"name"]];
+                    rev.body = [body mutableCopy];
+                    [ds createDocumentFromRevision:rev error:nil];
+                }
 
-            it(@"returns nil when no indexes", ^{
-                CDTQSqlParts *parts;
-                NSArray *order = @[ @{ @"y" : @"desc" } ];
-                parts = [CDTQQueryExecutor sqlToSortIds:smallDocIdSet usingOrder:order indexes:@{}];
-                expect(parts).to.beNil();
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wnonnull"
-                parts = [CDTQQueryExecutor sqlToSortIds:smallDocIdSet usingOrder:order indexes:nil];
-#pragma clang diagnostic pop
-                expect(parts).to.beNil();
+                NSDictionary *query = @{ @"pet" : @{@"$in" : @[ @"cat", @"dog" ]} };
+                NSArray *order = @[ @{ @"colour" : @"asc" } ];
+                CDTQResultSet *result = [im find:query skip:0 limit:0 fields:nil sort:order];
+                expect(result.documentIds).to.equal(@[ @"john", @"mike" ]);
             });
 
         });
-
-        /*
-         xdescribe(@"when generating ordering SQL for doc id set", ^{
-
-         __block NSDictionary *indexes = @{@"a": @{@"name": @"a",
-         @"type": @"json",
-         @"fields": @[@"name", @"age", @"pet"]},
-         @"b": @{@"name": @"b",
-         @"type": @"json",
-         @"fields": @[@"x", @"y", @"z"]},
-         };
-         __block NSArray *ids = @[@"a", @"b", @"c", @"d"];
-
-         context(@"for single field", ^{
-
-         it (@"asc", ^{
-         NSArray *order = @[ @{ @"name": @"asc" } ];
-         CDTQSqlParts *parts = [CDTQQueryExecutor sqlToSortIds:ids
-         usingOrder:order
-         usingIndexes:indexes];
-
-         NSString *sql = @"SELECT DISTINCT _id FROM _t_cloudant_sync_query_index_a ORDER BY \"name\"
-         ASC;";
-         expect(parts.sqlWithPlaceholders).to.equal(sql);
-         expect(parts.placeholderValues).to.equal(@[]);
-         });
-
-         it (@"desc", ^{
-         NSArray *order = @[ @{ @"y": @"desc" } ];
-         CDTQSqlParts *parts = [CDTQQueryExecutor sqlToSortIds:ids
-         usingOrder:order
-         usingIndexes:indexes];
-
-         NSString *sql = @"SELECT DISTINCT _id FROM _t_cloudant_sync_query_index_b ORDER BY \"y\"
-         DESC;";
-         expect(parts.sqlWithPlaceholders).to.equal(sql);
-         expect(parts.placeholderValues).to.equal(@[]);
-         });
-
-         });
-
-         context(@"for multiple fields", ^{
-
-
-         it (@"asc", ^{
-         NSArray *order = @[ @{ @"y": @"asc" }, @{ @"x": @"asc" } ];
-         CDTQSqlParts *parts = [CDTQQueryExecutor sqlToSortIds:ids
-         usingOrder:order
-         usingIndexes:indexes];
-
-         NSString *sql = @"SELECT DISTINCT _id FROM _t_cloudant_sync_query_index_b ORDER BY \"y\"
-         ASC, \"x\" ASC;";
-         expect(parts.sqlWithPlaceholders).to.equal(sql);
-         expect(parts.placeholderValues).to.equal(@[]);
-         });
-
-         it (@"desc", ^{
-         NSArray *order = @[ @{ @"y": @"desc" }, @{ @"x": @"desc" } ];
-         CDTQSqlParts *parts = [CDTQQueryExecutor sqlToSortIds:ids
-         usingOrder:order
-         usingIndexes:indexes];
-
-         NSString *sql = @"SELECT DISTINCT _id FROM _t_cloudant_sync_query_index_b ORDER BY \"y\"
-         DESC, \"x\" DESC;";
-         expect(parts.sqlWithPlaceholders).to.equal(sql);
-         expect(parts.placeholderValues).to.equal(@[]);
-         });
-
-         it (@"mixed", ^{
-         NSArray *order = @[ @{ @"y": @"desc" }, @{ @"x": @"asc" } ];
-         CDTQSqlParts *parts = [CDTQQueryExecutor sqlToSortIds:ids
-         usingOrder:order
-         usingIndexes:indexes];
-
-         NSString *sql = @"SELECT DISTINCT _id FROM _t_cloudant_sync_query_index_b ORDER BY \"y\"
-         DESC, \"x\" ASC;";
-         expect(parts.sqlWithPlaceholders).to.equal(sql);
-         expect(parts.placeholderValues).to.equal(@[]);
-         });
-
-         });
-
-         it(@"fails for invalid direction", ^{
-         NSArray *order = @[ @{ @"name": @"blah" } ];
-         CDTQSqlParts *parts = [CDTQQueryExecutor sqlToSortIds:ids
-         usingOrder:order
-         usingIndexes:indexes];
-         expect(parts).to.beNil();
-
-         });
-
-         it(@"fails when unindexed field", ^{
-         NSArray *order = @[ @{ @"apples": @"asc" } ];
-         CDTQSqlParts *parts = [CDTQQueryExecutor sqlToSortIds:ids
-         usingOrder:order
-         usingIndexes:indexes];
-         expect(parts).to.beNil();
-         });
-
-         it(@"fails when fields not in single index", ^{
-         NSArray *order = @[ @{ @"x": @"asc" }, @{ @"age": @"asc" } ];
-         CDTQSqlParts *parts = [CDTQQueryExecutor sqlToSortIds:ids
-         usingOrder:order
-         usingIndexes:indexes];
-         expect(parts).to.beNil();
-         });
-
-         it(@"returns nil when no doc ids", ^{
-         CDTQSqlParts *parts;
-         NSArray *order = @[ @{ @"y": @"desc" } ];
-         parts = [CDTQQueryExecutor sqlToSortIds:@[]
-         usingOrder:order
-         usingIndexes:indexes];
-         expect(parts).to.beNil();
-         parts = [CDTQQueryExecutor sqlToSortIds:nil
-         usingOrder:order
-         usingIndexes:indexes];
-         expect(parts).to.beNil();
-         });
-
-         it(@"returns nil when no order", ^{
-         CDTQSqlParts *parts;
-         parts = [CDTQQueryExecutor sqlToSortIds:ids
-         usingOrder:@[]
-         usingIndexes:indexes];
-         expect(parts).to.beNil();
-         parts = [CDTQQueryExecutor sqlToSortIds:ids
-         usingOrder:nil
-         usingIndexes:indexes];
-         expect(parts).to.beNil();
-         });
-
-         it(@"returns nil when no indexes", ^{
-         CDTQSqlParts *parts;
-         NSArray *order = @[ @{ @"y": @"desc" } ];
-         parts = [CDTQQueryExecutor sqlToSortIds:ids
-         usingOrder:order
-         usingIndexes:@{}];
-         expect(parts).to.beNil();
-         parts = [CDTQQueryExecutor sqlToSortIds:ids
-         usingOrder:order
-         usingIndexes:nil];
-         expect(parts).to.beNil();
-         });
-
-         });
-         */
     });
 
 SpecEnd
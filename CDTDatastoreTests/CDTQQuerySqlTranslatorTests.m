@@ -435,6 +435,81 @@ SpecBegin(CDTQQuerySqlTranslator) describe(@"cdtq", ^{
             expect(sqlNode.sql.sqlWithPlaceholders).to.equal(sqlAnd);
             expect(sqlNode.sql.placeholderValues).to.equal(@[ @"mike", @"cat" ]);
         });
+
+        it(@"composes a tree into a single statement", ^{
+            NSDictionary *query = [CDTQQueryValidator normaliseAndValidateQuery:@{
+                @"$and" : @[
+                    @{@"name" : @"mike"},
+                    @{ @"$or" : @[ @{@"pet" : @"cat"}, @{@"pet" : @"dog"} ] }
+                ]
+            }];
+            BOOL indexesCoverQuery;
+            CDTQQueryNode *node = [CDTQQuerySqlTranslator translateQuery:query
+                                                            toUseIndexes:indexes
+                                                       indexesCoverQuery:&indexesCoverQuery];
+            CDTQSqlParts *parts = [CDTQQuerySqlTranslator selectStatementForQueryTree:node];
+
+            //         AND
+            //        /   \
+            //      sql    OR
+            //            /  \
+            //          sql  sql
+
+            NSString *sql = @"SELECT DISTINCT _id FROM ("
+                             "SELECT _id FROM ("
+                             "SELECT _id FROM \"_t_cloudant_sync_query_index_basic\" "
+                             "WHERE \"name\" = ?) "
+                             "WHERE _id IN ("
+                             "SELECT _id FROM ("
+                             "SELECT _id FROM \"_t_cloudant_sync_query_index_basic\" "
+                             "WHERE \"pet\" = ?) "
+                             "UNION "
+                             "SELECT _id FROM ("
+                             "SELECT _id FROM \"_t_cloudant_sync_query_index_basic\" "
+                             "WHERE \"pet\" = ?)));";
+            expect(parts.sqlWithPlaceholders).to.equal(sql);
+            expect(parts.placeholderValues).to.equal(@[ @"mike", @"cat", @"dog" ]);
+        });
+
+        it(@"scans the cheapest child of an AND first", ^{
+            CDTQSqlQueryNode *unknown = [[CDTQSqlQueryNode alloc] init];
+            unknown.sql = [CDTQSqlParts partsForSql:@"SELECT _id FROM a;" parameters:@[ @1 ]];
+
+            CDTQSqlQueryNode *large = [[CDTQSqlQueryNode alloc] init];
+            large.sql = [CDTQSqlParts partsForSql:@"SELECT _id FROM b;" parameters:@[ @2 ]];
+            large.estimatedRows = @1000;
+
+            CDTQSqlQueryNode *small = [[CDTQSqlQueryNode alloc] init];
+            small.sql = [CDTQSqlParts partsForSql:@"SELECT _id FROM c;" parameters:@[ @3 ]];
+            small.estimatedRows = @10;
+
+            CDTQSqlQueryNode *medium = [[CDTQSqlQueryNode alloc] init];
+            medium.sql = [CDTQSqlParts partsForSql:@"SELECT _id FROM d;" parameters:@[ @4 ]];
+            medium.estimatedRows = @50;
+
+            // An OR costs the sum of its children: 10 + 50 > 50
+            CDTQOrQueryNode *or = [[CDTQOrQueryNode alloc] init];
+            [or.children addObjectsFromArray:@[ small, medium ]];
+
+            CDTQAndQueryNode *and = [[CDTQAndQueryNode alloc] init];
+            [and.children addObjectsFromArray:@[ unknown, or, large, medium ]];
+
+            CDTQSqlParts *parts = [CDTQQuerySqlTranslator selectStatementForQueryTree:and];
+            NSString *sql = @"SELECT DISTINCT _id FROM ("
+                             "SELECT _id FROM (SELECT _id FROM d) "
+                             "WHERE _id IN (SELECT _id FROM (SELECT _id FROM c) "
+                             "UNION SELECT _id FROM (SELECT _id FROM d)) "
+                             "AND _id IN (SELECT _id FROM b) "
+                             "AND _id IN (SELECT _id FROM a));";
+            expect(parts.sqlWithPlaceholders).to.equal(sql);
+            expect(parts.placeholderValues).to.equal(@[ @4, @3, @4, @2, @1 ]);
+        });
+
+        it(@"cannot compose a tree when a node has no SQL", ^{
+            CDTQAndQueryNode *and = [[CDTQAndQueryNode alloc] init];
+            [and.children addObject:[[CDTQSqlQueryNode alloc] init]];
+            expect([CDTQQuerySqlTranslator selectStatementForQueryTree:and]).to.beNil();
+        });
     });
     
     describe(@"when dealing with text searches", ^{
@@ -597,6 +672,90 @@ SpecBegin(CDTQQuerySqlTranslator) describe(@"cdtq", ^{
                 .to.beNil();
         });
 
+        it(@"selects the cheapest of several covering indexes", ^{
+            NSDictionary *indexes = @{
+                @"wide" : @{@"name" : @"wide",
+                            @"type" : @"json",
+                            @"fields" : @[ @"_id", @"_rev", @"name", @"age", @"pet" ]},
+                @"narrow" : @{@"name" : @"narrow",
+                              @"type" : @"json",
+                              @"fields" : @[ @"_id", @"_rev", @"name" ]},
+                @"alsoNarrow" : @{@"name" : @"alsoNarrow",
+                                  @"type" : @"json",
+                                  @"fields" : @[ @"_id", @"_rev", @"name" ]}
+            };
+            NSArray *clause = @[ @{ @"name" : @"mike" } ];
+
+            // Without statistics the narrowest wins, with ties broken by name
+            expect([CDTQQuerySqlTranslator chooseIndexForAndClause:clause fromIndexes:indexes])
+                .to.equal(@"alsoNarrow");
+
+            // With statistics the index with the fewest rows wins
+            NSMutableDictionary *withRows = [indexes mutableCopy];
+            NSMutableDictionary *wide = [indexes[@"wide"] mutableCopy];
+            wide[@"rows"] = @10;
+            withRows[@"wide"] = wide;
+            NSMutableDictionary *narrow = [indexes[@"narrow"] mutableCopy];
+            narrow[@"rows"] = @100;
+            withRows[@"narrow"] = narrow;
+            expect([CDTQQuerySqlTranslator indexNamesByCost:withRows])
+                .to.equal(@[ @"wide", @"narrow", @"alsoNarrow" ]);
+        });
+
+        it(@"estimates the rows a clause selects from its predicates", ^{
+            NSArray *eq = @[ @{ @"name" : @{ @"$eq" : @"mike" } } ];
+            NSArray *range = @[ @{ @"age" : @{ @"$gt" : @12 } }, @{ @"age" : @{ @"$lte" : @20 } } ];
+            NSArray *in = @[ @{ @"pet" : @{ @"$in" : @[ @"cat", @"dog" ] } } ];
+            NSArray *exists = @[ @{ @"pet" : @{ @"$exists" : @YES } } ];
+
+            expect([CDTQQuerySqlTranslator estimatedRowsForAndClause:eq inIndexWithRows:nil])
+                .to.beNil();
+            expect([CDTQQuerySqlTranslator estimatedRowsForAndClause:eq inIndexWithRows:@1000])
+                .to.equal(@100);
+            expect([CDTQQuerySqlTranslator estimatedRowsForAndClause:range inIndexWithRows:@1000])
+                .to.equal(@63);
+            expect([CDTQQuerySqlTranslator estimatedRowsForAndClause:in inIndexWithRows:@1000])
+                .to.equal(@200);
+            expect([CDTQQuerySqlTranslator estimatedRowsForAndClause:exists
+                                                     inIndexWithRows:@1000])
+                .to.equal(@1000);
+
+            // Predicates combine, but never estimate fewer than one row
+            NSArray *both = [eq arrayByAddingObjectsFromArray:range];
+            expect([CDTQQuerySqlTranslator estimatedRowsForAndClause:both inIndexWithRows:@1000])
+                .to.equal(@7);
+            expect([CDTQQuerySqlTranslator estimatedRowsForAndClause:both inIndexWithRows:@5])
+                .to.equal(@1);
+            expect([CDTQQuerySqlTranslator estimatedRowsForAndClause:both inIndexWithRows:@0])
+                .to.equal(@0);
+        });
+
+        it(@"estimates each OR branch from its own index and predicate", ^{
+            NSDictionary *indexes = @{
+                @"names" : @{@"name" : @"names",
+                             @"type" : @"json",
+                             @"fields" : @[ @"_id", @"_rev", @"name" ],
+                             @"rows" : @1000},
+                @"ages" : @{@"name" : @"ages",
+                            @"type" : @"json",
+                            @"fields" : @[ @"_id", @"_rev", @"age" ],
+                            @"rows" : @200}
+            };
+            NSDictionary *query = [CDTQQueryValidator normaliseAndValidateQuery:@{
+                @"$or" : @[ @{ @"name" : @"mike" }, @{ @"age" : @{ @"$gt" : @12 } } ]
+            }];
+            BOOL indexesCoverQuery;
+            CDTQQueryNode *node = [CDTQQuerySqlTranslator translateQuery:query
+                                                            toUseIndexes:indexes
+                                                       indexesCoverQuery:&indexesCoverQuery];
+            expect(indexesCoverQuery).to.beTruthy();
+
+            CDTQOrQueryNode *or = (CDTQOrQueryNode *)node;
+            expect(or.children.count).to.equal(2);
+            expect(((CDTQSqlQueryNode *)or.children[0]).estimatedRows).to.equal(@100);
+            expect(((CDTQSqlQueryNode *)or.children[1]).estimatedRows).to.equal(@50);
+        });
+
         it(@"selects an index for single field queries", ^{
             NSDictionary *indexes = @{
                 @"named" : @{@"name" : @"named", @"type" : @"json", @"fields" : @[ @"name" ]}
@@ -852,6 +1011,20 @@ SpecBegin(CDTQQuerySqlTranslator) describe(@"cdtq", ^{
                 expect(parts.sqlWithPlaceholders).to.equal(@"\"name\" IN ( ?, ? )");
                 expect(parts.placeholderValues).to.equal(@[ @"mike", @"fred" ]);
             });
+            it(@"binds a long array as a single value list", ^{
+                NSMutableArray *names = [NSMutableArray array];
+                for (int i = 0; i < 150; i++) {
+                    [names addObject:[NSString stringWithFormat:@"name%d", i]];
+                }
+                CDTQSqlParts *parts = [CDTQQuerySqlTranslator
+                    wherePartsForAndClause:@[@{ @"name" : @{ @"$in" : names} }]
+                                usingIndex:@"named"];
+                expect(parts.sqlWithPlaceholders)
+                    .to.equal(@"\"name\" IN ( SELECT value FROM temp.cdtq_value_lists "
+                              @"WHERE list = ? )");
+                expect(parts.placeholderValues)
+                    .to.equal(@[ [CDTQValueList listWithValues:names] ]);
+            });
         });
         
         describe(@"when using the $mod operator", ^{
@@ -92,6 +92,19 @@ describe(@"when extracting single fields", ^{
         expect(v).to.equal(@{ @"ccc" : @"mike" });
     });
 
+    it(@"returns values for pre-split field paths", ^{
+        NSDictionary *d = @{ @"aaa" : @{@"bbb" : @{@"ccc" : @"mike"}} };
+        NSObject *v = [CDTQValueExtractor extractValueForFieldPath:@[ @"aaa", @"bbb", @"ccc" ]
+                                                    fromDictionary:d];
+        expect(v).to.equal(@"mike");
+
+        v = [CDTQValueExtractor extractValueForFieldPath:@[ @"aaa", @"ccc" ] fromDictionary:d];
+        expect(v).to.beNil();
+
+        v = [CDTQValueExtractor extractValueForFieldPath:@[] fromDictionary:d];
+        expect(v).to.beNil();
+    });
+
 });
 
 SpecEnd
@@ -32,6 +32,9 @@
 #import "TD_Body.h"
 #import "CollectionUtils.h"
 #import "TD_Database+Insertion.h"
+#import "TDDocumentCache.h"
+#import "TD_View.h"
+#import "FMDatabase+StatementCache.h"
 #import "TDStatus.h"
 #import "DBQueryUtils.h"
 #import "CDTAttachment.h"
@@ -348,6 +351,37 @@
     
 }
 
+- (void)testCreateDocumentsFromRevisionsReportsPerDocumentResults
+{
+    CDTDocumentRevision *first = [CDTDocumentRevision revisionWithDocId:@"bulk1"];
+    first.body = [@{ @"n" : @1 } mutableCopy];
+    CDTDocumentRevision *invalid = [CDTDocumentRevision revisionWithDocId:@"bulk2"];
+    invalid.body = [@{ @"_n" : @2 } mutableCopy];
+    CDTDocumentRevision *second = [CDTDocumentRevision revisionWithDocId:@"bulk3"];
+    second.body = [@{ @"n" : @3 } mutableCopy];
+
+    NSError *error = nil;
+    NSArray *results =
+        [self.datastore createDocumentsFromRevisions:@[ first, invalid, second ] error:&error];
+    XCTAssertNil(error);
+    XCTAssertEqual(results.count, (NSUInteger)3);
+    XCTAssertTrue([results[0] isKindOfClass:[CDTDocumentRevision class]]);
+    XCTAssertTrue([results[1] isKindOfClass:[NSError class]]);
+    XCTAssertTrue([results[2] isKindOfClass:[CDTDocumentRevision class]]);
+    XCTAssertEqual(self.datastore.documentCount, (NSUInteger)2);
+
+    // Both updates replace the same revision, so the second one conflicts with the first
+    CDTDocumentRevision *update = [results[2] copy];
+    update.body[@"n"] = @30;
+    CDTDocumentRevision *conflicting = [results[2] copy];
+    conflicting.body[@"n"] = @31;
+    results = [self.datastore updateDocumentsFromRevisions:@[ update, conflicting ] error:&error];
+    XCTAssertNil(error);
+    XCTAssertTrue([results[0] isKindOfClass:[CDTDocumentRevision class]]);
+    XCTAssertEqual([(NSError *)results[1] code], (NSInteger)kTDStatusConflict);
+    XCTAssertEqualObjects([self.datastore getDocumentWithId:@"bulk3" error:nil].body[@"n"], @30);
+}
+
 - (void)testCreateWithoutBodyInCDTDocumentRevision
 {
     NSError *error;
@@ -764,6 +798,46 @@
     
 }
 
+-(void)testEnumerateAllDocumentsPagesInDocIdOrder
+{
+    int objectCount = 1200;
+    NSMutableArray *revisions = [NSMutableArray arrayWithCapacity:objectCount];
+    for (int i = 0; i < objectCount; i++) {
+        CDTDocumentRevision *rev =
+            [CDTDocumentRevision revisionWithDocId:[NSString stringWithFormat:@"doc-%04d", i]];
+        rev.body = [@{ @"index" : @(i) } mutableCopy];
+        [revisions addObject:rev];
+    }
+    NSArray *created = [self.datastore createDocumentsFromRevisions:revisions error:nil];
+    XCTAssertEqual(created.count, (NSUInteger)objectCount);
+
+    // Deleted documents are skipped without shortening the page they fall in
+    for (int i = 400; i < 600; i++) {
+        XCTAssertNotNil([self.datastore deleteDocumentFromRevision:created[i] error:nil]);
+    }
+
+    __block int expected = 0;
+    NSError *error = nil;
+    BOOL ok = [self.datastore enumerateAllDocumentsUsingBlock:^(CDTDocumentRevision *revision,
+                                                                BOOL *stop) {
+        if (expected == 400) {
+            expected = 600;
+        }
+        XCTAssertEqualObjects(revision.docId, ([NSString stringWithFormat:@"doc-%04d", expected]));
+        XCTAssertEqualObjects(revision.body[@"index"], @(expected));
+        expected++;
+    } error:&error];
+    XCTAssertTrue(ok);
+    XCTAssertNil(error);
+    XCTAssertEqual(expected, objectCount);
+
+    __block int seen = 0;
+    [self.datastore enumerateAllDocumentIdsUsingBlock:^(NSString *docId, BOOL *stop) {
+        *stop = (++seen == 10);
+    } error:nil];
+    XCTAssertEqual(seen, 10);
+}
+
 -(void)assertIdAndRevisionAndShallowContentExpected:(CDTDocumentRevision *)expected actual:(CDTDocumentRevision *)actual
 {
     XCTAssertEqualObjects([actual docId], [expected docId], @"docIDs don't match");
@@ -1862,4 +1936,204 @@
     XCTAssertTrue([TDStatusToNSError( statusResults, nil) code] == 200, @"TDStatusAsNSError: %@", TDStatusToNSError( statusResults, nil));
     
 }
+
+-(void)testReadsDoNotWaitForAnOpenWriteTransaction
+{
+    CDTDocumentRevision *rev = [CDTDocumentRevision revisionWithDocId:@"doc1"];
+    rev.body = [@{ @"hello" : @"world" } mutableCopy];
+    XCTAssertNotNil([self.datastore createDocumentFromRevision:rev error:nil]);
+
+    dispatch_semaphore_t writerStarted = dispatch_semaphore_create(0);
+    dispatch_semaphore_t readerFinished = dispatch_semaphore_create(0);
+    FMDatabaseQueue *writer = self.datastore.database.fmdbQueue;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [writer inTransaction:^(FMDatabase *db, BOOL *rollback) {
+            [db executeUpdate:@"DELETE FROM revs"];
+            dispatch_semaphore_signal(writerStarted);
+            dispatch_semaphore_wait(readerFinished,
+                                    dispatch_time(DISPATCH_TIME_NOW, 10 * NSEC_PER_SEC));
+            *rollback = YES;
+        }];
+    });
+    dispatch_semaphore_wait(writerStarted, DISPATCH_TIME_FOREVER);
+
+    NSDate *start = [NSDate date];
+    CDTDocumentRevision *read = [self.datastore getDocumentWithId:@"doc1" error:nil];
+    NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+    dispatch_semaphore_signal(readerFinished);
+
+    // The reader sees the last committed snapshot, not the uncommitted delete
+    XCTAssertEqualObjects(read.body[@"hello"], @"world");
+    XCTAssertLessThan(elapsed, 5.0, @"Read waited for the writer transaction");
+}
+
+-(void)testRepeatedDocumentReadsReuseCompiledStatements
+{
+    CDTDocumentRevision *rev = [CDTDocumentRevision revisionWithDocId:@"doc1"];
+    rev.body = [@{ @"hello" : @"world" } mutableCopy];
+    XCTAssertNotNil([self.datastore createDocumentFromRevision:rev error:nil]);
+
+    TD_Database *database = self.datastore.database;
+    [database.fmdbQueue inDatabase:^(FMDatabase *db) {
+        TDStatus status;
+        [database getDocumentWithID:@"doc1" revisionID:nil options:0 status:&status database:db];
+        NSUInteger hits = db.statementCacheHits;
+        NSUInteger misses = db.statementCacheMisses;
+
+        TD_Revision *read = [database getDocumentWithID:@"doc1"
+                                             revisionID:nil
+                                                options:0
+                                                 status:&status
+                                               database:db];
+        XCTAssertEqualObjects(read.body[@"hello"], @"world");
+        XCTAssertGreaterThan(db.statementCacheHits, hits);
+        XCTAssertEqual(db.statementCacheMisses, misses);
+    }];
+}
+
+-(void)testStatementCacheHoldsOnlyRecentlyUsedCachedStatements
+{
+    TD_Database *database = self.datastore.database;
+    [database.fmdbQueue inDatabase:^(FMDatabase *db) {
+        // Statements run through the ordinary methods aren't cached
+        NSUInteger cached = db.cachedStatements.count;
+        for (int i = 0; i < 100; i++) {
+            [[db executeQuery:[NSString stringWithFormat:@"SELECT %d", i]] close];
+        }
+        XCTAssertEqual(db.cachedStatements.count, cached);
+
+        // A statement in constant use survives a stream of one-off ones
+        NSString *hot = @"SELECT count(*) FROM docs";
+        for (int i = 0; i < 100; i++) {
+            [db longLongForCachedQuery:hot];
+            [db longLongForCachedQuery:[NSString stringWithFormat:@"SELECT %d", i]];
+        }
+        XCTAssertLessThanOrEqual(db.cachedStatements.count, 64);
+        NSUInteger hits = db.statementCacheHits;
+        [db longLongForCachedQuery:hot];
+        XCTAssertEqual(db.statementCacheHits, hits + 1);
+    }];
+}
+
+-(void)testNestedReadsShareTheirConnection
+{
+    TD_Database *database = self.datastore.database;
+    __block NSUInteger depth = 0;
+    __block FMDatabase *outer = nil;
+    __block __weak void (^weakRead)(FMDatabase *);
+    void (^read)(FMDatabase *);
+    weakRead = read = ^(FMDatabase *db) {
+        if (!outer) outer = db;
+        XCTAssertEqual(db, outer);
+        XCTAssertFalse([db executeUpdate:@"DELETE FROM docs"], @"readers are read-only");
+
+        // Deeper than the number of reader connections, which would otherwise deadlock
+        if (++depth < 5) [database inReadTransaction:weakRead];
+    };
+    [database inReadTransaction:read];
+    XCTAssertEqual(depth, (NSUInteger)5);
+}
+
+-(void)testGetDocsWithIDsReusesCompiledStatementsForAnyNumberOfIDs
+{
+    NSMutableArray *docIds = [NSMutableArray array];
+    for (int i = 0; i < 120; i++) {
+        CDTDocumentRevision *rev =
+            [CDTDocumentRevision revisionWithDocId:[NSString stringWithFormat:@"doc%03d", i]];
+        rev.body = [@{ @"index" : @(i) } mutableCopy];
+        CDTDocumentRevision *saved = [self.datastore createDocumentFromRevision:rev error:nil];
+        XCTAssertNotNil(saved);
+        if (i == 1) {
+            XCTAssertNotNil([self.datastore deleteDocumentFromRevision:saved error:nil]);
+        }
+        [docIds addObject:rev.docId];
+    }
+
+    // Reads go through the read-only reader connections
+    NSArray *ids = @[ @"doc002", @"doc001", @"nodoc", @"doc000" ];
+    NSArray *docs = [self.datastore getDocumentsWithIds:ids];
+    XCTAssertEqual(docs.count, (NSUInteger)3);
+    XCTAssertEqualObjects([docs[0] body][@"index"], @2);
+    XCTAssertTrue([docs[1] deleted]);
+    XCTAssertEqualObjects([docs[2] docId], @"doc000");
+    XCTAssertEqual([self.datastore getDocumentsWithIds:docIds].count, docIds.count);
+
+    TD_Database *database = self.datastore.database;
+    struct TDQueryOptions options = kDefaultTDQueryOptions;
+    options.includeDocs = YES;
+    [database inReadTransaction:^(FMDatabase *db) {
+        NSArray *first = [@[ @"doc000", @"doc001", @"nodoc" ]
+            arrayByAddingObjectsFromArray:[docIds subarrayWithRange:NSMakeRange(10, 60)]];
+        NSArray *rows = [database getDocsWithIDs:first options:&options database:db][@"rows"];
+        XCTAssertEqual(rows.count, first.count);
+        XCTAssertEqualObjects(rows[0][@"id"], @"doc000");
+        XCTAssertEqualObjects(rows[0][@"doc"][@"index"], @0);
+        XCTAssertEqualObjects(rows[1][@"id"], @"doc001");
+        XCTAssertEqualObjects(rows[1][@"value"][@"deleted"], @YES);
+        XCTAssertEqualObjects(rows[2][@"error"], @"not_found");
+        XCTAssertEqualObjects(rows[3][@"id"], @"doc010");
+
+        NSUInteger misses = db.statementCacheMisses;
+
+        // A different number of IDs, and some missing documents, use the same statements
+        NSArray *second = [[docIds subarrayWithRange:NSMakeRange(3, 117)]
+            arrayByAddingObjectsFromArray:@[ @"doc001", @"nodoc" ]];
+        rows = [database getDocsWithIDs:second options:&options database:db][@"rows"];
+        XCTAssertEqual(rows.count, second.count);
+        [second enumerateObjectsUsingBlock:^(NSString *docId, NSUInteger i, BOOL *stop) {
+            XCTAssertEqualObjects(rows[i][@"key"], docId);
+        }];
+        XCTAssertEqualObjects(rows[117][@"value"][@"deleted"], @YES);
+        XCTAssertEqualObjects(rows[118][@"error"], @"not_found");
+        XCTAssertEqual(db.statementCacheMisses, misses);
+    }];
+}
+
+-(void)testDocumentCacheServesWinningRevisionsUntilTheyChange
+{
+    TDDocumentCache *cache = [[TDDocumentCache alloc] initWithMaxCost:1024 * 1024];
+    self.datastore.database.documentCache = cache;
+
+    CDTDocumentRevision *rev = [CDTDocumentRevision revisionWithDocId:@"cached"];
+    rev.body = [@{ @"name" : @"zambia", @"tags" : @[ @"a" ] } mutableCopy];
+    CDTDocumentRevision *saved = [self.datastore createDocumentFromRevision:rev error:nil];
+    XCTAssertNotNil(saved);
+
+    CDTDocumentRevision *first = [self.datastore getDocumentWithId:@"cached" error:nil];
+    XCTAssertEqual(cache.misses, 1u);
+    XCTAssertEqual(cache.hits, 0u);
+
+    // Changing a revision read from the cache doesn't change the cached body
+    first.body[@"name"] = @"changed";
+    CDTDocumentRevision *second = [self.datastore getDocumentWithId:@"cached" error:nil];
+    XCTAssertEqual(cache.hits, 1u);
+    XCTAssertEqualObjects(second.body[@"name"], @"zambia");
+    XCTAssertEqualObjects(second.revId, saved.revId);
+
+    NSArray *docs = [self.datastore getDocumentsWithIds:@[ @"cached" ]];
+    XCTAssertEqual(cache.hits, 2u);
+    XCTAssertEqualObjects([docs[0] body][@"tags"], @[ @"a" ]);
+
+    // Updating the document replaces its cached body
+    second.body = [@{ @"name" : @"zimbabwe" } mutableCopy];
+    CDTDocumentRevision *updated = [self.datastore updateDocumentFromRevision:second error:nil];
+    XCTAssertNotNil(updated);
+    CDTDocumentRevision *third = [self.datastore getDocumentWithId:@"cached" error:nil];
+    XCTAssertEqualObjects(third.revId, updated.revId);
+    XCTAssertEqualObjects(third.body, @{ @"name" : @"zimbabwe" });
+    XCTAssertEqual(cache.misses, 2u);
+
+    // The previous revision is still readable by ID, from the database
+    CDTDocumentRevision *old = [self.datastore getDocumentWithId:@"cached"
+                                                             rev:saved.revId
+                                                           error:nil];
+    XCTAssertEqualObjects(old.body[@"name"], @"zambia");
+    NSUInteger hits = cache.hits;
+    XCTAssertNotNil([self.datastore getDocumentWithId:@"cached" error:nil]);
+    XCTAssertEqual(cache.hits, hits + 1);
+
+    // Deleting the document removes it from the cache
+    XCTAssertNotNil([self.datastore deleteDocumentWithId:@"cached" error:nil]);
+    XCTAssertNil([cache bodyForDocID:@"cached" revID:updated.revId]);
+}
 @end
@@ -531,6 +531,33 @@
     
 }
 
+-(void)testWinnerFlagFollowsWinningRevision
+{
+    [self addConflictingDocumentWithId:@"doc0" toDatastore:self.datastore];
+    CDTDocumentRevision *winner = [self.datastore getDocumentWithId:@"doc0" error:nil];
+
+    NSArray *(^winnerRevIds)(void) = ^NSArray * {
+        NSMutableArray *revIds = [NSMutableArray array];
+        [self.datastore.database.fmdbQueue inDatabase:^(FMDatabase *db) {
+            FMResultSet *r = [db executeQuery:@"SELECT revid FROM revs WHERE winner=1"];
+            while ([r next]) {
+                [revIds addObject:[r stringForColumnIndex:0]];
+            }
+            [r close];
+        }];
+        return revIds;
+    };
+    NSArray *flagged = winnerRevIds();
+    XCTAssertEqualObjects(flagged, @[ winner.revId ]);
+
+    // Deleting every leaf leaves a tombstone as the winner and no conflicts
+    XCTAssertEqual([self.datastore deleteDocumentWithId:@"doc0" error:nil].count, (NSUInteger)2);
+    XCTAssertEqual([self.datastore getConflictedDocumentIds].count, (NSUInteger)0);
+    flagged = winnerRevIds();
+    XCTAssertEqual(flagged.count, (NSUInteger)1);
+    XCTAssertTrue([flagged.firstObject hasPrefix:@"4-"], @"Winner was %@", flagged.firstObject);
+}
+
 -(void) testEnumerateConflicts
 {
     //add a non-conflicting document
@@ -934,4 +961,27 @@
                    (unsigned long)(oddNumberOfConflictingDocuments + 1));
 }
 
+- (void)testForceInsertRevisionsRollsBackOnlyTheFailedRevision
+{
+    TD_Revision *good = [[TD_Revision alloc] initWithDocID:@"doc0" revID:@"2-b" deleted:NO];
+    good.properties = @{ @"_id" : @"doc0", @"_rev" : @"2-b", @"foo" : @"bar" };
+    TD_Revision *bad = [[TD_Revision alloc] initWithDocID:@"doc1" revID:@"2-b" deleted:NO];
+    bad.properties = @{ @"_id" : @"doc1", @"_rev" : @"2-b", @"foo" : @"bar" };
+
+    NSArray *statuses = nil;
+    TDStatus status = [self.datastore.database forceInsertRevisions:@[ good, bad ]
+                                                  revisionHistories:@[ @[ @"2-b", @"1-a" ], @[ @"1-a" ] ]
+                                                             source:nil
+                                                           statuses:&statuses];
+
+    XCTAssertEqual(status, kTDStatusOK);
+    XCTAssertEqualObjects(statuses, (@[ @(kTDStatusCreated), @(kTDStatusBadID) ]));
+    XCTAssertNotNil([self.datastore getDocumentWithId:@"doc0" error:nil]);
+    XCTAssertNil([self.datastore getDocumentWithId:@"doc1" error:nil]);
+    XCTAssertEqual([self.datastore getRevisionHistory:[self.datastore getDocumentWithId:@"doc0"
+                                                                                  error:nil]]
+                       .count,
+                   2);
+}
+
 @end
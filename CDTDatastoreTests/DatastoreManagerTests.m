@@ -18,6 +18,8 @@
 #import <CDTDatastore/CloudantSync.h>
 #import "CloudantSyncTests.h"
 #import "TDInternal.h"
+#import "TDBinaryJSON.h"
+#import "TDDocumentCache.h"
 #import "FMDatabase.h"
 #import "FMDatabaseQueue.h"
 // for testDatastoreClosesFilehandles
@@ -72,6 +74,54 @@
                    (unsigned long)[datastores count]);
 }
 
+- (void)testBinaryBodiesOption
+{
+    NSString *path = [self.factoryPath stringByAppendingPathComponent:@"binary"];
+    NSError *error;
+    CDTDatastoreManager *manager = [[CDTDatastoreManager alloc]
+        initWithDirectory:path
+                  options:@{CDTDatastoreManagerOptionBinaryBodies : @YES}
+                    error:&error];
+    XCTAssertNotNil(manager, @"%@", error);
+    CDTDatastore *ds = [manager datastoreNamed:@"test" error:&error];
+    XCTAssertNotNil(ds, @"%@", error);
+
+    CDTDocumentRevision *rev = [CDTDocumentRevision revisionWithDocId:@"doc"];
+    rev.body = [@{ @"hello" : @"world" } mutableCopy];
+    XCTAssertNotNil([ds createDocumentFromRevision:rev error:&error], @"%@", error);
+
+    __block NSData *stored;
+    [ds.database.fmdbQueue inDatabase:^(FMDatabase *db) {
+        stored = [db dataForQuery:@"SELECT json FROM revs"];
+    }];
+    XCTAssertTrue([TDBinaryJSON isBinaryJSON:stored]);
+    XCTAssertEqualObjects([ds getDocumentWithId:@"doc" error:nil].body, rev.body);
+}
+
+- (void)testDocumentCacheSizeOption
+{
+    NSString *path = [self.factoryPath stringByAppendingPathComponent:@"cached"];
+    NSError *error;
+    CDTDatastoreManager *manager = [[CDTDatastoreManager alloc]
+        initWithDirectory:path
+                  options:@{CDTDatastoreManagerOptionDocumentCacheSize : @4096}
+                    error:&error];
+    XCTAssertNotNil(manager, @"%@", error);
+    CDTDatastore *ds = [manager datastoreNamed:@"test" error:&error];
+    XCTAssertNotNil(ds, @"%@", error);
+    XCTAssertEqual(ds.database.documentCache.maxCost, (NSUInteger)4096);
+
+    CDTDocumentRevision *rev = [CDTDocumentRevision revisionWithDocId:@"doc"];
+    rev.body = [@{ @"hello" : @"world" } mutableCopy];
+    XCTAssertNotNil([ds createDocumentFromRevision:rev error:&error], @"%@", error);
+    XCTAssertEqualObjects([ds getDocumentWithId:@"doc" error:nil].body, rev.body);
+    XCTAssertEqualObjects([ds getDocumentWithId:@"doc" error:nil].body, rev.body);
+    XCTAssertEqual(ds.database.documentCache.hits, (NSUInteger)1);
+
+    CDTDatastore *uncached = [self.factory datastoreNamed:@"test" error:&error];
+    XCTAssertNil(uncached.database.documentCache);
+}
+
 -(void) testSchema6ToSchema100Upgrade {
     NSError *err;
     NSBundle *bundle = [NSBundle bundleForClass:[self class]];
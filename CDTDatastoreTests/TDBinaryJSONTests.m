@@ -0,0 +1,174 @@
+//
+//  TDBinaryJSONTests.m
+//  Tests
+//
+//  Copyright © 2018 IBM Corporation. All rights reserved.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//  except in compliance with the License. You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+//  Unless required by applicable law or agreed to in writing, software distributed under the
+//  License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//  either express or implied. See the License for the specific language governing permissions
+//  and limitations under the License.
+
+#import <Foundation/Foundation.h>
+#import <FMDB/FMDB.h>
+#import "CollectionUtils.h"
+#import "TDBinaryJSON.h"
+#import "TDJSON.h"
+#import "TD_Database+Insertion.h"
+#import "TD_Revision.h"
+#import "CDTEncryptionKeyNilProvider.h"
+#import "CloudantTests.h"
+
+@interface TDBinaryJSONTests : CloudantTests
+
+@end
+
+@implementation TDBinaryJSONTests
+
+- (NSDictionary*)sampleObject
+{
+    return @{
+        @"name" : @"mi\"ke ☃",
+        @"age" : @12,
+        @"negative" : @(-300),
+        @"big" : @(INT64_MAX),
+        @"huge" : @(UINT64_MAX),
+        @"ratio" : @(-1.5e3),
+        @"ok" : @YES,
+        @"pet" : [NSNull null],
+        @"tags" : @[ @"a", @[], @{ @"name" : @"nested", @"ok" : @NO } ],
+        @"empty" : @{}
+    };
+}
+
+- (void)testRoundTripsJSONValues
+{
+    NSDictionary* object = [self sampleObject];
+    NSData* data = [TDBinaryJSON dataWithJSONObject:object];
+    XCTAssertTrue([TDBinaryJSON isBinaryJSON:data]);
+
+    NSDictionary* decoded = [TDBinaryJSON JSONObjectWithData:data];
+    XCTAssertEqualObjects(decoded, object);
+    XCTAssertEqualObjects(decoded[@"huge"], @(UINT64_MAX));
+    XCTAssertEqual(CFGetTypeID((__bridge CFTypeRef)decoded[@"ok"]), CFBooleanGetTypeID());
+    XCTAssertFalse([decoded[@"tags"] isKindOfClass:[NSMutableArray class]]);
+
+    // Serializes to the same JSON as the original
+    NSData* json = [TDJSON dataWithJSONObject:decoded options:0 error:NULL];
+    XCTAssertEqualObjects([TDJSON JSONObjectWithData:json options:0 error:NULL], object);
+
+    // Keys repeated in nested objects are only stored once
+    NSMutableArray* rows = [NSMutableArray array];
+    for (int i = 0; i < 100; i++) [rows addObject:@{ @"identifier" : @(i), @"description" : @"" }];
+    NSData* rowsJSON = [TDJSON dataWithJSONObject:@{ @"rows" : rows } options:0 error:NULL];
+    XCTAssertLessThan([TDBinaryJSON dataWithJSONObject:@{ @"rows" : rows }].length,
+                      rowsJSON.length / 2);
+}
+
+- (void)testRejectsMalformedData
+{
+    XCTAssertNil([TDBinaryJSON dataWithJSONObject:@{ @"date" : [NSDate date] }]);
+    XCTAssertNil([TDBinaryJSON dataWithJSONObject:@{ @1 : @"non-string key" }]);
+    XCTAssertNil([TDBinaryJSON dataWithJSONObject:@{ @"nan" : @(NAN) }]);
+
+    NSData* json = [@"{\"a\":1}" dataUsingEncoding:NSUTF8StringEncoding];
+    XCTAssertFalse([TDBinaryJSON isBinaryJSON:json]);
+    XCTAssertNil([TDBinaryJSON JSONObjectWithData:json]);
+
+    NSData* data = [TDBinaryJSON dataWithJSONObject:[self sampleObject]];
+    for (NSUInteger length = 0; length < data.length; length++) {
+        NSData* truncated = [data subdataWithRange:NSMakeRange(0, length)];
+        XCTAssertNil([TDBinaryJSON JSONObjectWithData:truncated], @"length %lu",
+                     (unsigned long)length);
+        XCTAssertNil([[TDLazyJSONDictionary alloc] initWithJSON:truncated]);
+    }
+}
+
+- (void)testLazyDictionaryReadsBinaryData
+{
+    NSDictionary* object = [self sampleObject];
+    TDLazyJSONDictionary* lazy =
+        [[TDLazyJSONDictionary alloc] initWithJSON:[TDBinaryJSON dataWithJSONObject:object]];
+
+    XCTAssertNotNil(lazy);
+    XCTAssertEqual(lazy.count, object.count);
+    XCTAssertEqualObjects([NSSet setWithArray:lazy.allKeys], [NSSet setWithArray:object.allKeys]);
+    XCTAssertEqualObjects(lazy[@"tags"], object[@"tags"]);
+    XCTAssertNil(lazy[@"missing"]);
+    XCTAssertEqualObjects(lazy, object);
+    XCTAssertEqualObjects([lazy dictionaryByAddingEntries:@{ @"_id" : @"doc" }][@"_id"], @"doc");
+}
+
+- (void)testDatabaseStoresBinaryBodies
+{
+    CDTEncryptionKeyNilProvider* provider = [CDTEncryptionKeyNilProvider provider];
+    NSString* binaryPath =
+        [NSTemporaryDirectory() stringByAppendingPathComponent:@"TDBinaryJSONTests_binary"];
+    NSString* jsonPath =
+        [NSTemporaryDirectory() stringByAppendingPathComponent:@"TDBinaryJSONTests_json"];
+    [TD_Database deleteClosedDatabaseAtPath:binaryPath error:nil];
+    [TD_Database deleteClosedDatabaseAtPath:jsonPath error:nil];
+
+    TD_Database* binaryDB = [[TD_Database alloc] initWithPath:binaryPath];
+    binaryDB.storesBinaryBodies = YES;
+    XCTAssertTrue([binaryDB openWithEncryptionKeyProvider:provider]);
+    TD_Database* jsonDB = [TD_Database createEmptyDBAtPath:jsonPath
+                                 withEncryptionKeyProvider:provider];
+
+    NSMutableDictionary* properties = [[self sampleObject] mutableCopy];
+    properties[@"_id"] = @"doc";
+    TDStatus status;
+    TD_Revision* rev = [binaryDB putRevision:[TD_Revision revisionWithProperties:properties]
+                              prevRevisionID:nil
+                               allowConflict:NO
+                                      status:&status];
+    XCTAssertEqual(status, kTDStatusCreated);
+    TD_Revision* jsonRev = [jsonDB putRevision:[TD_Revision revisionWithProperties:properties]
+                                prevRevisionID:nil
+                                 allowConflict:NO
+                                        status:&status];
+
+    // Revision IDs are made from the body's JSON however it's stored
+    XCTAssertEqualObjects(rev.revID, jsonRev.revID);
+
+    __block int version;
+    __block NSData* stored;
+    [binaryDB.fmdbQueue inDatabase:^(FMDatabase* db) {
+        version = [db intForQuery:@"PRAGMA user_version"];
+        stored = [db dataForQuery:@"SELECT json FROM revs WHERE revid=?", rev.revID];
+    }];
+    XCTAssertEqual(version, 400);
+    XCTAssertTrue([TDBinaryJSON isBinaryJSON:stored]);
+
+    NSMutableDictionary* expected = [properties mutableCopy];
+    expected[@"_rev"] = rev.revID;
+    TD_Revision* read = [binaryDB getDocumentWithID:@"doc" revisionID:nil];
+    XCTAssertEqualObjects(read.properties, expected);
+    XCTAssertEqualObjects([TDJSON JSONObjectWithData:read.asJSON options:0 error:NULL],
+                          [jsonDB getDocumentWithID:@"doc" revisionID:nil].properties);
+
+    // Bodies stored either way can still be read once binary bodies are turned off
+    [binaryDB close];
+    binaryDB = [[TD_Database alloc] initWithPath:binaryPath];
+    XCTAssertTrue([binaryDB openWithEncryptionKeyProvider:provider]);
+    properties[@"_rev"] = rev.revID;
+    properties[@"age"] = @13;
+    TD_Revision* rev2 = [binaryDB putRevision:[TD_Revision revisionWithProperties:properties]
+                               prevRevisionID:rev.revID
+                                allowConflict:NO
+                                       status:&status];
+    XCTAssertEqual(status, kTDStatusCreated);
+    TD_Revision* oldRead = [binaryDB getDocumentWithID:@"doc" revisionID:rev.revID];
+    TD_Revision* newRead = [binaryDB getDocumentWithID:@"doc" revisionID:nil];
+    XCTAssertEqualObjects(oldRead.properties[@"age"], @12);
+    XCTAssertEqualObjects(newRead.properties[@"age"], @13);
+    XCTAssertEqualObjects(newRead.revID, rev2.revID);
+
+    [binaryDB deleteDatabase:nil];
+    [jsonDB deleteDatabase:nil];
+}
+
+@end
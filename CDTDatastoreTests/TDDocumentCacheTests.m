@@ -0,0 +1,65 @@
+//
+//  TDDocumentCacheTests.m
+//
+//  Copyright © 2018 IBM Corporation. All rights reserved.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//  except in compliance with the License. You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+//  Unless required by applicable law or agreed to in writing, software distributed under the
+//  License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//  either express or implied. See the License for the specific language governing permissions
+//  and limitations under the License.
+
+#import <Foundation/Foundation.h>
+#import "TDDocumentCache.h"
+#import "CloudantTests.h"
+
+@interface TDDocumentCacheTests : CloudantTests
+
+@end
+
+@implementation TDDocumentCacheTests
+
+- (void)testLookupsMatchRevisionAndCountHits
+{
+    TDDocumentCache* cache = [[TDDocumentCache alloc] initWithMaxCost:100];
+    NSDictionary* body = @{ @"a" : @1 };
+    [cache setBody:body forDocID:@"doc" revID:@"1-a" cost:10];
+
+    XCTAssertEqual([cache bodyForDocID:@"doc" revID:@"1-a"], body);
+    XCTAssertNil([cache bodyForDocID:@"doc" revID:@"2-b"]);
+    XCTAssertNil([cache bodyForDocID:@"other" revID:@"1-a"]);
+    XCTAssertEqual(cache.hits, 1u);
+    XCTAssertEqual(cache.misses, 2u);
+
+    // A newer revision replaces the document's entry
+    [cache setBody:@{} forDocID:@"doc" revID:@"2-b" cost:20];
+    XCTAssertNil([cache bodyForDocID:@"doc" revID:@"1-a"]);
+    XCTAssertEqualObjects([cache bodyForDocID:@"doc" revID:@"2-b"], @{});
+
+    [cache removeDocID:@"doc"];
+    XCTAssertNil([cache bodyForDocID:@"doc" revID:@"2-b"]);
+    XCTAssertEqual(cache.hits, 2u);
+    XCTAssertEqual(cache.misses, 4u);
+}
+
+- (void)testDropsBodiesOverMaxCost
+{
+    TDDocumentCache* cache = [[TDDocumentCache alloc] initWithMaxCost:30];
+    [cache setBody:@{} forDocID:@"a" revID:@"1-x" cost:10];
+
+    // A body costing more than the whole cache isn't kept, and replaces the document's entry
+    [cache setBody:@{} forDocID:@"b" revID:@"1-x" cost:31];
+    XCTAssertNil([cache bodyForDocID:@"b" revID:@"1-x"]);
+    [cache setBody:@{} forDocID:@"a" revID:@"2-x" cost:31];
+    XCTAssertNil([cache bodyForDocID:@"a" revID:@"1-x"]);
+    XCTAssertNil([cache bodyForDocID:@"a" revID:@"2-x"]);
+
+    [cache setBody:@{} forDocID:@"c" revID:@"1-x" cost:10];
+    XCTAssertNotNil([cache bodyForDocID:@"c" revID:@"1-x"]);
+    [cache removeAll];
+    XCTAssertNil([cache bodyForDocID:@"c" revID:@"1-x"]);
+}
+
+@end
@@ -0,0 +1,96 @@
+//
+//  TDJSONTests.m
+//  Tests
+//
+//  Copyright © 2018 IBM Corporation. All rights reserved.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+//  except in compliance with the License. You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+//  Unless required by applicable law or agreed to in writing, software distributed under the
+//  License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+//  either express or implied. See the License for the specific language governing permissions
+//  and limitations under the License.
+
+#import <Foundation/Foundation.h>
+#import "CollectionUtils.h"
+#import "TDJSON.h"
+#import "CloudantTests.h"
+
+@interface TDJSONTests : CloudantTests
+
+@end
+
+@implementation TDJSONTests
+
+- (TDLazyJSONDictionary*)lazyDictionaryWithJSONString:(NSString*)json
+{
+    NSData* data = [json dataUsingEncoding:NSUTF8StringEncoding];
+    return [[TDLazyJSONDictionary alloc] initWithJSON:data];
+}
+
+- (void)testLazyDictionaryMatchesParsedJSON
+{
+    NSString* json = @" { \"name\" : \"mi\\\"ke\", \"age\":12, \"pet\":null, \"ok\" : true ,"
+                      "\"tags\":[\"a\", \"}\", {\"b\":[1,2]}], \"esc\\u0061ped\":{\"x\":\"{[\"},"
+                      "\"num\":-1.5e3, \"empty\":{}, \"age\":13 } ";
+    NSDictionary* parsed = [TDJSON JSONObjectWithData:[json dataUsingEncoding:NSUTF8StringEncoding]
+                                              options:0
+                                                error:NULL];
+    TDLazyJSONDictionary* lazy = [self lazyDictionaryWithJSONString:json];
+
+    XCTAssertNotNil(lazy);
+    XCTAssertEqual(lazy.count, parsed.count);
+    XCTAssertEqualObjects([NSSet setWithArray:lazy.allKeys], [NSSet setWithArray:parsed.allKeys]);
+    XCTAssertEqualObjects(lazy[@"name"], @"mi\"ke");
+    XCTAssertEqualObjects(lazy[@"age"], @13);
+    XCTAssertEqualObjects(lazy[@"escaped"], @{ @"x" : @"{[" });
+    XCTAssertNil(lazy[@"missing"]);
+    XCTAssertEqualObjects(lazy, parsed);
+
+    NSMutableDictionary* mutable = [lazy mutableCopy];
+    mutable[@"name"] = @"bob";
+    XCTAssertEqualObjects(mutable[@"tags"], parsed[@"tags"]);
+    XCTAssertEqualObjects(lazy[@"name"], @"mi\"ke");
+}
+
+- (void)testLazyDictionaryRejectsMalformedObjects
+{
+    for (NSString* json in @[ @"", @"[1,2]", @"\"str\"", @"{", @"{\"a\"}", @"{\"a\":}",
+                              @"{\"a\":1,}", @"{\"a\":[1,2}", @"{\"a\":\"1}", @"{\"a\":1} x" ]) {
+        XCTAssertNil([self lazyDictionaryWithJSONString:json], @"%@", json);
+    }
+    XCTAssertEqualObjects([self lazyDictionaryWithJSONString:@"{}"], @{});
+}
+
+- (void)testLazyDictionaryRejectsMalformedValues
+{
+    // Values aren't parsed up front, but they are checked
+    for (NSString* json in @[ @"{\"b\":tru}", @"{\"c\":[1,,2]}", @"{\"a\":01}", @"{\"a\":1.}",
+                              @"{\"a\":-}", @"{\"a\":[1 2]}", @"{\"a\":{\"b\"}}",
+                              @"{\"a\":\"\\x\"}", @"{\"a\":\"\\u12g4\"}", @"{\"a\":nul}" ]) {
+        XCTAssertNil([self lazyDictionaryWithJSONString:json], @"%@", json);
+    }
+    NSString* valid = @"{\"a\":[true,false,null],\"b\":\"\\u00e9\\n\",\"c\":-0.5E+2}";
+    TDLazyJSONDictionary* lazy = [self lazyDictionaryWithJSONString:valid];
+    XCTAssertEqualObjects(lazy, (@{ @"a" : @[ @YES, @NO, [NSNull null] ], @"b" : @"\u00e9\n",
+                                    @"c" : @-50 }));
+}
+
+- (void)testLazyDictionaryAddsAndRemovesEntries
+{
+    TDLazyJSONDictionary* lazy = [self lazyDictionaryWithJSONString:@"{\"a\":1,\"b\":2,\"_c\":3}"];
+
+    TDLazyJSONDictionary* added = [lazy dictionaryByAddingEntries:@{ @"b" : @"B", @"d" : @4 }];
+    XCTAssertEqualObjects(added, (@{ @"a" : @1, @"b" : @"B", @"_c" : @3, @"d" : @4 }));
+
+    TDLazyJSONDictionary* removed = [added dictionaryByRemovingKeys:@[ @"_c", @"d" ]];
+    XCTAssertEqualObjects(removed, (@{ @"a" : @1, @"b" : @"B" }));
+    XCTAssertEqualObjects([removed dictionaryByAddingEntries:@{ @"_c" : @5 }][@"_c"], @5);
+
+    // The originals are unchanged
+    XCTAssertEqualObjects(lazy, (@{ @"a" : @1, @"b" : @2, @"_c" : @3 }));
+    XCTAssertEqual([lazy copy], lazy);
+}
+
+@end
@@ -18,6 +18,7 @@
 
 #import <CDTDatastore/CDTChangedDictionary.h>
 #import <CDTDatastore/CDTChangedArray.h>
+#import <CDTDatastore/TDJSON.h>
 
 @interface CDTChangedDictionaryJSONWrappingTests : XCTestCase
 
@@ -85,4 +86,34 @@
     XCTAssertTrue(self.dictionary.isChanged);
 }
 
+- (void)testLazilyCopiedContents
+{
+    NSData *json = [TDJSON dataWithJSONObject:@{
+        @"dict" : @{@"dict" : @{@"one" : @"two"}},
+        @"array" : @[ @{@"foo" : @YES} ],
+        @"hello" : @"world"
+    }
+                                      options:0
+                                        error:NULL];
+    CDTChangedDictionary *dictionary = [CDTChangedDictionary
+        dictionaryCopyingContents:[[TDLazyJSONDictionary alloc] initWithJSON:json]];
+
+    XCTAssertEqual(dictionary.count, 3);
+    XCTAssertEqualObjects(dictionary[@"hello"], @"world");
+    XCTAssertTrue([dictionary[@"dict"] isKindOfClass:[CDTChangedDictionary class]]);
+    XCTAssertFalse(dictionary.isChanged);
+
+    // Nested containers copied on read still report changes
+    dictionary[@"array"][0][@"foo"] = @NO;
+    XCTAssertTrue(dictionary.isChanged);
+    XCTAssertEqualObjects(dictionary[@"array"], @[ @{@"foo" : @NO} ]);
+
+    // A change copies the rest of the contents first
+    [dictionary removeObjectForKey:@"hello"];
+    XCTAssertEqualObjects(dictionary, (@{
+                              @"dict" : @{@"dict" : @{@"one" : @"two"}},
+                              @"array" : @[ @{@"foo" : @NO} ]
+                          }));
+}
+
 @end